@@ -0,0 +1,538 @@
+/*==========================================================================
+
+  Copyright (c) 2014 Uditha L. Jayarathne, ujayarat@robarts.ca
+
+  Use, modification and redistribution of the software, in source or
+  binary forms, are permitted provided that the following terms and
+  conditions are met:
+
+  1) Redistribution of the source code, in verbatim or modified
+  form, must retain the above copyright notice, this license,
+  the following disclaimer, and any notices that refer to this
+  license and/or the following disclaimer.  
+
+  2) Redistribution in binary form must include the above copyright
+  notice, a copy of this license and the following disclaimer
+  in the documentation or with other materials provided with the
+  distribution.
+
+  3) Modified copies of the source code must be clearly marked as such,
+  and must not be misrepresented as verbatim copies of the source code.
+
+  THE COPYRIGHT HOLDERS AND/OR OTHER PARTIES PROVIDE THE SOFTWARE "AS IS"
+  WITHOUT EXPRESSED OR IMPLIED WARRANTY INCLUDING, BUT NOT LIMITED TO,
+  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  PURPOSE.  IN NO EVENT SHALL ANY COPYRIGHT HOLDER OR OTHER PARTY WHO MAY
+  MODIFY AND/OR REDISTRIBUTE THE SOFTWARE UNDER THE TERMS OF THIS LICENSE
+  BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, LOSS OF DATA OR DATA BECOMING INACCURATE
+  OR LOSS OF PROFIT OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF
+  THE USE OR INABILITY TO USE THE SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGES.
+  =========================================================================*/
+#include <iostream> 
+#include <vector>
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+
+#include "cv_camera_calib.h"
+#include "cv_corner_detector.h"
+#include "cv_checkerboard_renderer.h"
+#include "cv_subpix_refiner.h"
+#include "cv_fixed_remap.h"
+
+// Timings in ms per image and accuracy figures of one benchmark case
+struct BenchResult{
+	cv::Size img_size;
+	int distortion_model;
+	double noise;
+
+	int n_views;
+	int n_found;			// findChessboardCorners
+	int n_found_pyramid;	// CvCornerDetector
+
+	double t_render;
+	double t_decode;
+	double t_detect;
+	double t_subpix;
+	double t_refiner;		// CvSubPixRefiner on the same corners as cornerSubPix
+	double t_pyramid;
+	double t_remap_opencv;	// cv::remap on convertMaps CV_16SC2 maps, as before CvFixedRemap
+	double t_remap_fixed;	// CvFixedRemap on the same views
+	double t_solve_opencv;	// whole solve, not per image
+	double t_solve_native;
+
+	double corner_rms;			// findChessboardCorners + cornerSubPix vs ground truth
+	double corner_rms_refiner;	// findChessboardCorners + CvSubPixRefiner vs ground truth
+	double corner_rms_pyramid;	// CvCornerDetector vs ground truth
+	double remap_diff;			// max gray level difference of the two remaps
+
+	double rms_opencv;			// reprojection errors
+	double rms_native;
+	double focal_err_opencv;	// max |f - f_true|, px
+	double focal_err_native;
+	double pp_err_opencv;		// |c - c_true|, px
+	double pp_err_native;
+	double model_err_opencv;	// max pixel difference of the lens models over the image
+	double model_err_native;
+};
+
+/**
+ * Ground truth camera for an image size and distortion model
+ * @param image size
+ * @param distortion model (4/5/8)
+ * @param reference to the camera matrix
+ * @param reference to the distortion params
+ */
+void ground_truth_camera(cv::Size, int, cv::Mat*, cv::Mat*);
+
+/**
+ * RMS distance of detected corners to the ground truth. The detector may
+ * return the grid in reverse order, which is undone first.
+ * @param detected corners
+ * @param ground truth corners
+ */
+double corner_rms(std::vector<cv::Point2f>, const std::vector<cv::Point2f>&);
+
+/**
+ * Largest pixel difference between two lens models over an image grid
+ * @param true camera matrix
+ * @param true distortion params
+ * @param estimated camera matrix
+ * @param estimated distortion params
+ * @param image size
+ */
+double model_error(const cv::Mat&, const cv::Mat&, const cv::Mat&, const cv::Mat&, cv::Size);
+
+/**
+ * Calibrate with CvCameraCalib and compare against the ground truth
+ * @param calibration parameters
+ * @param detected corners
+ * @param true camera matrix
+ * @param true distortion params
+ * @param use the native solver
+ * @param reference to the solve time in ms
+ * @param reference to the reprojection error
+ * @param reference to the focal length error
+ * @param reference to the principal point error
+ * @param reference to the lens model error
+ */
+void solve_and_compare(CvCameraCalib::CalibParams, 
+					   const std::vector<std::vector<cv::Point2f>>&, 
+					   const cv::Mat&, const cv::Mat&, bool, 
+					   double*, double*, double*, double*, double*);
+
+/**
+ * Write benchmark results to an xml file
+ * @param file name
+ * @param results
+ */
+bool write_report(std::string, const std::vector<BenchResult>&);
+
+int main(int argc, char **argv){
+
+	// Software usage
+	if(argc<2 || argc>3){ 
+		std::cout << "Usage:\t CV_Calib_Bench infile [outfile]\n"
+				  << "\t	infile: benchmark configuration file \n" 
+				  << "\t	outfile: xml file to write the results to" 
+				  << std::endl;
+		return 0;
+	}
+
+	std::string settings_file_name(argv[1]);
+	cv::FileStorage file;	
+	if(!file.open(settings_file_name, cv::FileStorage::READ)){
+		std::cout << "Could not open the configuration file" << std::endl;
+		return 0;
+	}
+
+	// Checkerboard params
+	cv::FileNode n = file["Checkerboard_Specs"];
+	int w_corners((int)n["width_count"]);
+	int h_corners((int)n["height_count"]);
+	float sq_size((float)n["square_size"]);
+
+	n = file["Benchmark_Params"];
+	int n_views = (int)n["image_count"];
+	int supersampling = (int)n["supersampling"];
+	int seed = (int)n["seed"];
+
+	std::vector<cv::Size> resolutions;
+	cv::FileNode seq = n["resolutions"];
+	for(size_t i=0; i+1<seq.size(); i+=2)
+		resolutions.push_back(cv::Size((int)seq[i], (int)seq[i+1]));
+
+	std::vector<int> models;
+	seq = n["distortion_models"];
+	for(size_t i=0; i<seq.size(); i++)
+		models.push_back((int)seq[i]);
+
+	std::vector<double> noise_levels;
+	seq = n["noise_levels"];
+	for(size_t i=0; i<seq.size(); i++)
+		noise_levels.push_back((double)seq[i]);
+
+	std::cout << "Benchmark: " << resolutions.size() << " resolutions, " 
+			  << models.size() << " distortion models, " 
+			  << noise_levels.size() << " noise levels, " 
+			  << n_views << " views each" << std::endl;
+
+	CvCheckerboardRenderer renderer(w_corners, h_corners, sq_size);
+	CvCornerDetector detector(w_corners, h_corners);
+	detector.setDetectionFlags(cv::CALIB_CB_ADAPTIVE_THRESH+
+								cv::CALIB_CB_NORMALIZE_IMAGE);
+	cv::Size board_size(w_corners, h_corners);
+	cv::TermCriteria subpix_criteria(cv::TermCriteria::EPS+cv::TermCriteria::MAX_ITER, 
+									 30, 0.1);
+	CvSubPixRefiner refiner(cvSize(5, 5), subpix_criteria);
+	double tick_ms = 1000.0/cv::getTickFrequency();
+
+	std::vector<BenchResult> results;
+	for(size_t r=0; r<resolutions.size(); r++){
+	for(size_t m=0; m<models.size(); m++){
+	for(size_t s=0; s<noise_levels.size(); s++){
+
+		BenchResult res;
+		res.img_size = resolutions[r];
+		res.distortion_model = models[m];
+		res.noise = noise_levels[s];
+		res.n_views = n_views;
+
+		cv::Mat K_true, D_true;
+		ground_truth_camera(res.img_size, res.distortion_model, &K_true, &D_true);
+		renderer.setCamera(K_true, D_true, res.img_size);
+		renderer.setQuality(supersampling, res.noise);
+
+		// Same poses for every case with the same seed. The noise has its 
+		// own generator, so the noise level does not change the poses.
+		cv::RNG pose_rng(seed), noise_rng(seed + 1);
+
+		// render and encode, only rendering is timed
+		std::vector<std::vector<uchar>> encoded(n_views);
+		std::vector<std::vector<cv::Point2f>> truth(n_views);
+		int64 start = cv::getTickCount();
+		for(int i=0; i<n_views; i++){
+			cv::Mat rvec, tvec, image;
+			if(!renderer.randomPose(&pose_rng, &rvec, &tvec)){
+				std::cerr << "No valid board pose for view " << i << std::endl;
+				continue;
+			}
+			renderer.render(rvec, tvec, &noise_rng, &image, &truth[i]);
+			cv::imencode(".png", image, encoded[i]);
+		}
+		res.t_render = (cv::getTickCount() - start)*tick_ms/n_views;
+
+		// decode
+		std::vector<cv::Mat> images(n_views);
+		start = cv::getTickCount();
+		for(int i=0; i<n_views; i++)
+			if(!encoded[i].empty())
+				images[i] = cv::imdecode(encoded[i], CV_LOAD_IMAGE_GRAYSCALE);
+		res.t_decode = (cv::getTickCount() - start)*tick_ms/n_views;
+
+		// detection, as the tools did before CvCornerDetector
+		std::vector<std::vector<cv::Point2f>> corners(n_views);
+		std::vector<bool> found(n_views, false);
+		start = cv::getTickCount();
+		for(int i=0; i<n_views; i++)
+			if(!images[i].empty())
+				found[i] = cv::findChessboardCorners(images[i], board_size, corners[i], 
+													 cv::CALIB_CB_ADAPTIVE_THRESH+
+													 cv::CALIB_CB_NORMALIZE_IMAGE);
+		res.t_detect = (cv::getTickCount() - start)*tick_ms/n_views;
+
+		// sub-pixel refinement, both implementations from the same start
+		std::vector<std::vector<cv::Point2f>> corners_refiner = corners;
+		start = cv::getTickCount();
+		for(int i=0; i<n_views; i++)
+			if(found[i])
+				refiner.refine(images[i], &corners_refiner[i]);
+		res.t_refiner = (cv::getTickCount() - start)*tick_ms/n_views;
+
+		start = cv::getTickCount();
+		for(int i=0; i<n_views; i++)
+			if(found[i])
+				cv::cornerSubPix(images[i], corners[i], cvSize(5, 5), cvSize(-1, -1), 
+								 subpix_criteria);
+		res.t_subpix = (cv::getTickCount() - start)*tick_ms/n_views;
+
+		// pyramid detector, including its own refinement
+		std::vector<std::vector<cv::Point2f>> corners_pyramid(n_views);
+		std::vector<bool> found_pyramid(n_views, false);
+		start = cv::getTickCount();
+		for(int i=0; i<n_views; i++)
+			if(!images[i].empty())
+				found_pyramid[i] = detector.detectCorners(images[i], &corners_pyramid[i]);
+		res.t_pyramid = (cv::getTickCount() - start)*tick_ms/n_views;
+
+		// undistortion of the views, OpenCV's fixed point remap against 
+		// CvFixedRemap, both built from the same float maps
+		cv::Mat map_x, map_y, map1, map2;
+		cv::initUndistortRectifyMap(K_true, D_true, cv::Mat(), K_true, res.img_size, 
+									CV_32FC1, map_x, map_y);
+		cv::convertMaps(map_x, map_y, map1, map2, CV_16SC2);
+		CvFixedRemap fixed_remap;
+		fixed_remap.create(map_x, map_y);
+
+		std::vector<cv::Mat> frames;
+		for(int i=0; i<n_views; i++)
+			if(!images[i].empty()){
+				frames.push_back(cv::Mat());
+				cv::cvtColor(images[i], frames.back(), CV_GRAY2BGR);
+			}
+
+		std::vector<cv::Mat> remapped_opencv(frames.size()), remapped_fixed(frames.size());
+		start = cv::getTickCount();
+		for(size_t i=0; i<frames.size(); i++)
+			cv::remap(frames[i], remapped_opencv[i], map1, map2, cv::INTER_LINEAR);
+		res.t_remap_opencv = (cv::getTickCount() - start)*tick_ms/n_views;
+
+		start = cv::getTickCount();
+		for(size_t i=0; i<frames.size(); i++)
+			fixed_remap.remap(frames[i], &remapped_fixed[i]);
+		res.t_remap_fixed = (cv::getTickCount() - start)*tick_ms/n_views;
+
+		res.remap_diff = 0;
+		for(size_t i=0; i<frames.size(); i++)
+			res.remap_diff = std::max(res.remap_diff, 
+									  cv::norm(remapped_opencv[i], remapped_fixed[i], 
+											   cv::NORM_INF));
+
+		// corner accuracy
+		std::vector<std::vector<cv::Point2f>> all_corners;
+		double sq_err = 0, sq_err_refiner = 0, sq_err_pyramid = 0;
+		res.n_found = res.n_found_pyramid = 0;
+		for(int i=0; i<n_views; i++){
+			if(found[i]){
+				double e = corner_rms(corners[i], truth[i]);
+				sq_err += e*e;
+				e = corner_rms(corners_refiner[i], truth[i]);
+				sq_err_refiner += e*e;
+				res.n_found++;
+				all_corners.push_back(corners[i]);
+			}
+			if(found_pyramid[i]){
+				double e = corner_rms(corners_pyramid[i], truth[i]);
+				sq_err_pyramid += e*e;
+				res.n_found_pyramid++;
+			}
+		}
+		res.corner_rms = res.n_found ? sqrt(sq_err/res.n_found) : -1;
+		res.corner_rms_refiner = res.n_found ? sqrt(sq_err_refiner/res.n_found) : -1;
+		res.corner_rms_pyramid = res.n_found_pyramid ? 
+									sqrt(sq_err_pyramid/res.n_found_pyramid) : -1;
+
+		// solve with both solvers on the same corners
+		res.rms_opencv = res.rms_native = -1;
+		res.t_solve_opencv = res.t_solve_native = 0;
+		res.focal_err_opencv = res.focal_err_native = -1;
+		res.pp_err_opencv = res.pp_err_native = -1;
+		res.model_err_opencv = res.model_err_native = -1;
+		if(all_corners.size() >= 3){
+			CvCameraCalib::CalibParams params;
+			params.w_corners = w_corners;
+			params.h_corners = h_corners;
+			params.sq_size = sq_size;
+			params.img_width = res.img_size.width;
+			params.img_height = res.img_size.height;
+			params.distortion_model = res.distortion_model;
+
+			solve_and_compare(params, all_corners, K_true, D_true, false, 
+							  &res.t_solve_opencv, &res.rms_opencv, &res.focal_err_opencv,
+							  &res.pp_err_opencv, &res.model_err_opencv);
+			solve_and_compare(params, all_corners, K_true, D_true, true, 
+							  &res.t_solve_native, &res.rms_native, &res.focal_err_native,
+							  &res.pp_err_native, &res.model_err_native);
+		}
+
+		results.push_back(res);
+	}
+	}
+	}
+
+	// summary
+	printf("\n%-10s %5s %5s | %8s %8s %8s %8s %8s %8s %8s %8s | %9s %9s | %5s %6s %6s %6s %5s | %9s %9s %9s\n", 
+			"size", "model", "noise", "render", "decode", "detect", "subpix", "refiner", "pyramid",
+			"remap_cv", "remap_fx", "solve_cv", "solve_lm", "found", "c_rms", "c_ref", "c_pyr", 
+			"rmp_d", "mdl_err_cv", "mdl_err_lm", "f_err_cv");
+	for(size_t i=0; i<results.size(); i++){
+		const BenchResult &res = results[i];
+		char size[16];
+		sprintf(size, "%dx%d", res.img_size.width, res.img_size.height);
+		printf("%-10s %5d %5.1f | %8.2f %8.2f %8.2f %8.2f %8.2f %8.2f %8.2f %8.2f | %9.1f %9.1f | %2d/%-2d %6.3f %6.3f %6.3f %5.0f | %9.3f %9.3f %9.3f\n", 
+				size, res.distortion_model, res.noise, res.t_render, res.t_decode, 
+				res.t_detect, res.t_subpix, res.t_refiner, res.t_pyramid, 
+				res.t_remap_opencv, res.t_remap_fixed, 
+				res.t_solve_opencv, res.t_solve_native, res.n_found, res.n_views, 
+				res.corner_rms, res.corner_rms_refiner, res.corner_rms_pyramid, res.remap_diff, 
+				res.model_err_opencv, res.model_err_native, 
+				res.focal_err_opencv);
+	}
+	printf("Stage times in ms per image, solve times in ms, errors in px, rmp_d in gray levels\n");
+
+	if(argc == 3){
+		if(!write_report(argv[2], results)){
+			std::cout << "Unable to write the report to " << argv[2] << std::endl;
+			return 0;
+		}
+		std::cout << "Results were written to " << argv[2] << std::endl;
+	}
+
+	return 0;
+}
+
+void ground_truth_camera(cv::Size img_size, int model, cv::Mat *K, cv::Mat *D){
+
+	// ~64 degree horizontal field of view, principal point off centre
+	*K = cv::Mat::zeros(3, 3, CV_64F);
+	K->at<double>(0, 0) = 0.8*img_size.width;
+	K->at<double>(1, 1) = 0.8*img_size.width;
+	K->at<double>(0, 2) = 0.51*img_size.width;
+	K->at<double>(1, 2) = 0.49*img_size.height;
+	K->at<double>(2, 2) = 1;
+
+	// moderate barrel distortion: k1 k2 p1 p2 k3 k4 k5 k6
+	const double coeffs[8] = {-0.28, 0.09, 0.0008, -0.0006, -0.012, 0, 0, 0};
+	const double rational[8] = {0.35, -0.05, 0.0008, -0.0006, 0, 0.62, -0.02, 0};
+
+	*D = cv::Mat(model, 1, CV_64F);
+	for(int i=0; i<model; i++)
+		D->at<double>(i, 0) = (model == 8) ? rational[i] : coeffs[i];
+}
+
+double corner_rms(std::vector<cv::Point2f> detected, 
+				  const std::vector<cv::Point2f> &truth){
+
+	if(detected.size() != truth.size() || truth.empty())
+		return -1;
+
+	cv::Point2f d0 = detected[0] - truth[0], d1 = detected[0] - truth.back();
+	if(d1.x*d1.x + d1.y*d1.y < d0.x*d0.x + d0.y*d0.y)
+		std::reverse(detected.begin(), detected.end());
+
+	double sq_err = 0;
+	for(size_t i=0; i<truth.size(); i++){
+		cv::Point2f d = detected[i] - truth[i];
+		sq_err += d.x*d.x + d.y*d.y;
+	}
+
+	return sqrt(sq_err/truth.size());
+}
+
+double model_error(const cv::Mat &K_true, const cv::Mat &D_true, 
+				   const cv::Mat &K, const cv::Mat &D, cv::Size img_size){
+
+	std::vector<cv::Point2f> pixels, normalized;
+	for(int y=0; y<=20; y++)
+		for(int x=0; x<=20; x++)
+			pixels.push_back(cv::Point2f(x*(img_size.width - 1)/20.f, 
+										 y*(img_size.height - 1)/20.f));
+
+	// pixel -> ray with the true model -> pixel with the estimated model
+	cv::undistortPoints(cv::Mat(pixels), normalized, K_true, D_true);
+
+	std::vector<cv::Point3f> rays;
+	for(size_t i=0; i<normalized.size(); i++)
+		rays.push_back(cv::Point3f(normalized[i].x, normalized[i].y, 1));
+
+	std::vector<cv::Point2f> projected;
+	cv::Mat zero = cv::Mat::zeros(3, 1, CV_64F);
+	cv::projectPoints(cv::Mat(rays), zero, zero, K, D, projected);
+
+	double max_err = 0;
+	for(size_t i=0; i<pixels.size(); i++){
+		cv::Point2f d = projected[i] - pixels[i];
+		max_err = std::max(max_err, (double)sqrt(d.x*d.x + d.y*d.y));
+	}
+
+	return max_err;
+}
+
+void solve_and_compare(CvCameraCalib::CalibParams params, 
+					   const std::vector<std::vector<cv::Point2f>> &corners, 
+					   const cv::Mat &K_true, const cv::Mat &D_true, bool native, 
+					   double *t_solve, double *rms, double *focal_err, 
+					   double *pp_err, double *model_err){
+
+	CvCameraCalib calibrator;
+	calibrator.setNativeSolver(native);
+	calibrator.setOutlierRejection(false, 0);
+
+	int64 start = cv::getTickCount();
+	calibrator.calibrateCamera(params, corners);
+	*t_solve = (cv::getTickCount() - start)*1000.0/cv::getTickFrequency();
+
+	std::vector<float> view_errors;
+	calibrator.getViewErrors(&view_errors);
+	double sq_err = 0;
+	for(size_t i=0; i<view_errors.size(); i++)
+		sq_err += view_errors[i]*view_errors[i];
+	*rms = view_errors.empty() ? -1 : sqrt(sq_err/view_errors.size());
+
+	std::vector<std::vector<float>> intrinsics;
+	std::vector<float> distortion;
+	calibrator.getCameraIntrinsics(&intrinsics);
+	calibrator.getCameraDistortionParams(&distortion);
+
+	cv::Mat K(3, 3, CV_64F), D(distortion.size(), 1, CV_64F);
+	for(int i=0; i<3; i++)
+		for(int j=0; j<3; j++)
+			K.at<double>(i, j) = intrinsics[i][j];
+	for(size_t i=0; i<distortion.size(); i++)
+		D.at<double>(i, 0) = distortion[i];
+
+	*focal_err = std::max(fabs(K.at<double>(0, 0) - K_true.at<double>(0, 0)),
+						  fabs(K.at<double>(1, 1) - K_true.at<double>(1, 1)));
+	double dx = K.at<double>(0, 2) - K_true.at<double>(0, 2);
+	double dy = K.at<double>(1, 2) - K_true.at<double>(1, 2);
+	*pp_err = sqrt(dx*dx + dy*dy);
+	*model_err = model_error(K_true, D_true, K, D, 
+							 cv::Size(params.img_width, params.img_height));
+}
+
+bool write_report(std::string filename, const std::vector<BenchResult> &results){
+
+	cv::FileStorage fs(filename, cv::FileStorage::WRITE);
+	if(!fs.isOpened())
+		return false;
+
+	fs << "Results" << "[";
+	for(size_t i=0; i<results.size(); i++){
+		const BenchResult &res = results[i];
+		fs << "{" << "width" << res.img_size.width;
+		fs << "height" << res.img_size.height;
+		fs << "distortion_model" << res.distortion_model;
+		fs << "noise" << res.noise;
+		fs << "views" << res.n_views;
+		fs << "found" << res.n_found;
+		fs << "found_pyramid" << res.n_found_pyramid;
+		fs << "t_render_ms" << res.t_render;
+		fs << "t_decode_ms" << res.t_decode;
+		fs << "t_detect_ms" << res.t_detect;
+		fs << "t_subpix_ms" << res.t_subpix;
+		fs << "t_refiner_ms" << res.t_refiner;
+		fs << "t_pyramid_ms" << res.t_pyramid;
+		fs << "t_remap_opencv_ms" << res.t_remap_opencv;
+		fs << "t_remap_fixed_ms" << res.t_remap_fixed;
+		fs << "t_solve_opencv_ms" << res.t_solve_opencv;
+		fs << "t_solve_native_ms" << res.t_solve_native;
+		fs << "corner_rms" << res.corner_rms;
+		fs << "corner_rms_refiner" << res.corner_rms_refiner;
+		fs << "corner_rms_pyramid" << res.corner_rms_pyramid;
+		fs << "remap_max_diff" << res.remap_diff;
+		fs << "rms_opencv" << res.rms_opencv;
+		fs << "rms_native" << res.rms_native;
+		fs << "focal_err_opencv" << res.focal_err_opencv;
+		fs << "focal_err_native" << res.focal_err_native;
+		fs << "pp_err_opencv" << res.pp_err_opencv;
+		fs << "pp_err_native" << res.pp_err_native;
+		fs << "model_err_opencv" << res.model_err_opencv;
+		fs << "model_err_native" << res.model_err_native << "}";
+	}
+	fs << "]";
+
+	fs.release();
+	return true;
+}
@@ -31,12 +31,22 @@
   POSSIBILITY OF SUCH DAMAGES.
   =========================================================================*/
 
+#include <float.h>
+#include <math.h>
+#include <algorithm>
+
 #include "cv_camera_calib.h"
 
 CvCameraCalib::CvCameraCalib(){
 
 	intrinsics_ = new cv::Mat(3, 3, CV_64F);// intrinsics
 	distortion_param_ = new cv::Mat(4, 1, CV_64F); // distortion params. 
+
+	incremental_calibrated_ = false;
+	native_solver_ = false;
+
+	reject_outliers_ = false;
+	outlier_threshold_k_ = 3.0;
 }
 
 CvCameraCalib::~CvCameraCalib(){
@@ -55,57 +65,62 @@ void CvCameraCalib::calibrateCamera(CalibParams params,
 	int n_images = all_image_points.size();
 
 	// create distortion vector
-	switch(params.distortion_model){
-		case 0:
-			std::cout << "Selecting non-parametric distortion model " << std::endl;
-			break;
-		case 4:
-			std::cout << "Selecting 4 parameter distortion model" << std::endl;
-			distortion_param_->release();
-			distortion_param_ = new cv::Mat(4, 1, CV_64F);
-			break;
-		case 5:
-			std::cout << "Selecting 5 parameter distortion model" << std::endl;
-			distortion_param_->release();
-			distortion_param_ = new cv::Mat(5, 1, CV_64F);
-			break;
-		case 8:
-			std::cout << "Selecting 8 parameter distortion model" << std::endl;
-			distortion_param_->release();
-			distortion_param_ = new cv::Mat(8, 1, CV_64F);
-			break;
-		default:
-			std::cout << "Unknown distortion model" << std::endl;
-			return;
-	}
+	if(!createDistortionModel(params.distortion_model))
+		return;
 
 	// generate object points
 	std::vector<std::vector<cv::Point3f>> all_object_points;
 	std::vector<cv::Point3f> object_points;
+	generateObjectPoints(params, &object_points);
 
-	for(int i=0; i<n_images; i++){
-		object_points.clear();
-		for(int y=0; y<params.h_corners; y++){
-			for(int x=0; x<params.w_corners; x++){
-				cv::Point3f point(x*params.sq_size,
-									y*params.sq_size, 
-									  0);
-				object_points.push_back(point);
-			}
-		}
+	for(int i=0; i<n_images; i++)
 		all_object_points.push_back(object_points);
-	}
+
+	cv::Size img_size(params.img_width, params.img_height);
 
 	std::cout << "Calibrating camera.. " << std::endl;
 	// calibrate camera. Pose per view will be saved in rVec and tVec
-	double error = cv::calibrateCamera(all_object_points, 
-										all_image_points, 
-										cvSize(params.img_width, params.img_height),
-										*intrinsics_, *distortion_param_, 
-										rVec, tVec); 
+	double error = solveViews(all_object_points, all_image_points, img_size, 
+								intrinsics_, distortion_param_, &rVec, &tVec, 
+								&solver_);
+	if(native_solver_){
+		const std::vector<CvLMCalibSolver::IterationStats> &stats = 
+											solver_.getIterationStats();
+		for(size_t i=0; i<stats.size(); i++)
+			std::cout << "\t Iteration " << stats[i].iteration 
+					  << ": RMS " << stats[i].rms 
+					  << ", lambda " << stats[i].lambda
+					  << ", " << stats[i].time_ms << "ms" << std::endl;
+	}
+
+	// per-view and per-corner residuals
+	rejected_views_.clear();
+	computeViewErrors(all_object_points, all_image_points, 
+						*intrinsics_, *distortion_param_, rVec, tVec, 
+						&view_errors_, &corner_residuals_);
+
+	if(reject_outliers_)
+		error = rejectOutlierViews(all_object_points, all_image_points, 
+									img_size, error);
 
 	std::cout << "Calibration done. Reprojection error " << error << std::endl; 
 
+	// per-view report
+	for(int i=0; i<n_images; i++){
+		if(view_errors_[i] < 0){
+			std::cout << "\t View " << i << ": rejected" << std::endl;
+			continue;
+		}
+
+		double max_residual = 0;
+		for(size_t j=0; j<corner_residuals_[i].size(); j++){
+			const cv::Point2f &r = corner_residuals_[i][j];
+			max_residual = std::max(max_residual, (double)sqrt(r.x*r.x + r.y*r.y));
+		}
+		std::cout << "\t View " << i << ": RMS " << view_errors_[i] 
+				  << ", max corner " << max_residual << std::endl;
+	}
+
 #ifdef CV_CAMERA_CALIB_DEBUG
 	std::cerr << "Printing intrinsics_ matrix" << std::endl;
 	std::cerr << *intrinsics_ << std::endl;
@@ -117,6 +132,92 @@ void CvCameraCalib::calibrateCamera(CalibParams params,
 	return ; 						
 }
 
+void CvCameraCalib::beginIncremental(CalibParams params){
+
+	incremental_params_ = params;
+	incremental_image_points_.clear();
+	incremental_object_points_.clear();
+	incremental_calibrated_ = false;
+	rVec.clear();
+	tVec.clear();
+
+	createDistortionModel(params.distortion_model);
+}
+
+double CvCameraCalib::addView(std::vector<cv::Point2f> image_points){
+
+	std::vector<cv::Point3f> object_points;
+	generateObjectPoints(incremental_params_, &object_points);
+
+	incremental_image_points_.push_back(image_points);
+	incremental_object_points_.push_back(object_points);
+
+	if((int)incremental_image_points_.size() < MIN_INCREMENTAL_VIEWS)
+		return -1;
+
+	cv::Size img_size(incremental_params_.img_width, 
+						incremental_params_.img_height);
+
+	// The first solve starts from scratch. Later solves start from the 
+	// current calibration and the poses of the earlier views, which are
+	// already close, so a few iterations are enough to absorb the new view.
+	// This is always the native solver: cv::calibrateCamera re-estimates
+	// every pose on each call, so the cost of an add would grow with the
+	// view count.
+	double error = solveNative(incremental_object_points_, 
+								incremental_image_points_, img_size, 
+								incremental_calibrated_, 
+								incremental_calibrated_ ? 10 : 30, 
+								intrinsics_, distortion_param_, 
+								&rVec, &tVec, &solver_);
+	incremental_calibrated_ = true;
+
+#ifdef CV_CAMERA_CALIB_DEBUG
+	std::cerr << "View " << incremental_image_points_.size() 
+			  << " added. Reprojection error " << error << std::endl;
+#endif
+
+	return error;
+}
+
+int CvCameraCalib::getViewCount(){
+
+	return incremental_image_points_.size();
+}
+
+void CvCameraCalib::setNativeSolver(bool native){
+
+	native_solver_ = native;
+}
+
+const std::vector<CvLMCalibSolver::IterationStats>& CvCameraCalib::getSolverIterationStats(){
+
+	return solver_.getIterationStats();
+}
+
+void CvCameraCalib::setOutlierRejection(bool reject, double threshold_k){
+
+	reject_outliers_ = reject;
+	if(threshold_k > 0)
+		outlier_threshold_k_ = threshold_k;
+}
+
+void CvCameraCalib::getViewErrors(std::vector<float> *errors){
+
+	for(size_t i=0; i<view_errors_.size(); i++)
+		errors->push_back((float)view_errors_[i]);
+}
+
+void CvCameraCalib::getCornerResiduals(std::vector<std::vector<cv::Point2f>> *residuals){
+
+	*residuals = corner_residuals_;
+}
+
+void CvCameraCalib::getRejectedViews(std::vector<int> *views){
+
+	*views = rejected_views_;
+}
+
 void CvCameraCalib::getCameraIntrinsics(std::vector<std::vector<float>> *mat){
 
 	for(int i=0; i<3; i++){
@@ -139,6 +240,10 @@ bool CvCameraCalib::saveCalibrationParams(std::string filename){
 	file << "Intrinsics" << *intrinsics_ ;
 	file << "Distortion_Parameters" << *distortion_param_;
 
+	// per-view RMS, -1 for rejected views
+	if(!view_errors_.empty())
+		file << "Per_View_Errors" << cv::Mat(view_errors_);
+
 	file.release();
 	return true;
 }
@@ -155,7 +260,346 @@ void CvCameraCalib::projectPoints(std::vector<cv::Point3f> *points3d,
 								  std::vector<float> rVec, std::vector<float> tVec, 
 								  std::vector<cv::Point2f> *points2d){
 
-	  //TODO
+	CvPointProjector projector;
+	if(!projector.setCamera(*intrinsics_, *distortion_param_))
+		return;
+
+	CvPointProjector::Points3 object_points;
+	CvPointProjector::Points2 image_points;
+	CvPointProjector::toSoA(*points3d, &object_points);
+
+	projector.project(object_points, cv::Mat(rVec), cv::Mat(tVec), &image_points);
+
+	points2d->resize(image_points.u.size());
+	for(size_t i=0; i<image_points.u.size(); i++)
+		(*points2d)[i] = cv::Point2f(image_points.u[i], image_points.v[i]);
+}
+
+void CvCameraCalib::projectPointsBatch(const CvPointProjector::Points3 &points3d, 
+									   const std::vector<int> &offsets, 
+									   const std::vector<cv::Mat> &rVecs, 
+									   const std::vector<cv::Mat> &tVecs, 
+									   CvPointProjector::Points2 *points2d){
 
+	CvPointProjector projector;
+	if(!projector.setCamera(*intrinsics_, *distortion_param_))
+		return;
+
+	projector.project(points3d, offsets, rVecs, tVecs, points2d);
+}
+
+bool CvCameraCalib::createDistortionModel(int model){
+
+	switch(model){
+		case 0:
+			std::cout << "Selecting non-parametric distortion model " << std::endl;
+			break;
+		case 4:
+			std::cout << "Selecting 4 parameter distortion model" << std::endl;
+			distortion_param_->release();
+			distortion_param_ = new cv::Mat(4, 1, CV_64F);
+			break;
+		case 5:
+			std::cout << "Selecting 5 parameter distortion model" << std::endl;
+			distortion_param_->release();
+			distortion_param_ = new cv::Mat(5, 1, CV_64F);
+			break;
+		case 8:
+			std::cout << "Selecting 8 parameter distortion model" << std::endl;
+			distortion_param_->release();
+			distortion_param_ = new cv::Mat(8, 1, CV_64F);
+			break;
+		default:
+			std::cout << "Unknown distortion model" << std::endl;
+			return false;
+	}
+
+	return true;
+}
+
+void CvCameraCalib::generateObjectPoints(CalibParams params, 
+										 std::vector<cv::Point3f> *object_points){
+
+	object_points->clear();
+	for(int y=0; y<params.h_corners; y++){
+		for(int x=0; x<params.w_corners; x++){
+			cv::Point3f point(x*params.sq_size,
+								y*params.sq_size, 
+								  0);
+			object_points->push_back(point);
+		}
+	}
+}
+
+double CvCameraCalib::solveNative(const std::vector<std::vector<cv::Point3f>> &all_object_points,
+								  const std::vector<std::vector<cv::Point2f>> &all_image_points,
+								  cv::Size img_size, bool warm_start, int max_iter, 
+								  cv::Mat *intrinsics, cv::Mat *distortion_params, 
+								  std::vector<cv::Mat> *rVecs, std::vector<cv::Mat> *tVecs, 
+								  CvLMCalibSolver *solver){
+
+	int n_views = all_image_points.size();
+
+	if(!warm_start){
+		*intrinsics = cv::initCameraMatrix2D(all_object_points, 
+												all_image_points, img_size);
+		distortion_params->setTo(cv::Scalar(0));
+		rVecs->clear();
+		tVecs->clear();
+	}
+
+	// poses of new views from the current camera model
+	for(int v=rVecs->size(); v<n_views; v++){
+		cv::Mat r, t;
+		cv::solvePnP(all_object_points[v], all_image_points[v], 
+						*intrinsics, *distortion_params, r, t);
+		rVecs->push_back(r);
+		tVecs->push_back(t);
+	}
+
+	solver->setTermCriteria(cv::TermCriteria(cv::TermCriteria::COUNT+
+												cv::TermCriteria::EPS, 
+												max_iter, DBL_EPSILON));
+
+	return solver->solve(all_object_points, all_image_points, 
+							intrinsics, distortion_params, rVecs, tVecs);
+}
+
+double CvCameraCalib::solveViews(const std::vector<std::vector<cv::Point3f>> &all_object_points,
+								 const std::vector<std::vector<cv::Point2f>> &all_image_points,
+								 cv::Size img_size, 
+								 cv::Mat *intrinsics, cv::Mat *distortion_params, 
+								 std::vector<cv::Mat> *rVecs, std::vector<cv::Mat> *tVecs, 
+								 CvLMCalibSolver *solver){
+
+	if(native_solver_)
+		return solveNative(all_object_points, all_image_points, img_size, 
+							false, 30, intrinsics, distortion_params, 
+							rVecs, tVecs, solver);
+
+	return cv::calibrateCamera(all_object_points, all_image_points, img_size,
+								*intrinsics, *distortion_params, 
+								*rVecs, *tVecs); 
+}
+
+void CvCameraCalib::computeViewErrors(const std::vector<std::vector<cv::Point3f>> &all_object_points,
+									  const std::vector<std::vector<cv::Point2f>> &all_image_points,
+									  const cv::Mat &intrinsics, const cv::Mat &distortion_params, 
+									  const std::vector<cv::Mat> &rVecs, 
+									  const std::vector<cv::Mat> &tVecs, 
+									  std::vector<double> *view_errors, 
+									  std::vector<std::vector<cv::Point2f>> *residuals){
+
+	int n_views = all_object_points.size();
+
+	// all views in one projection call
+	CvPointProjector::Points3 points3d;
+	CvPointProjector::Points2 points2d;
+	std::vector<int> offsets(1, 0);
+	for(int v=0; v<n_views; v++){
+		const std::vector<cv::Point3f> &obj = all_object_points[v];
+		for(size_t p=0; p<obj.size(); p++){
+			points3d.x.push_back(obj[p].x);
+			points3d.y.push_back(obj[p].y);
+			points3d.z.push_back(obj[p].z);
+		}
+		offsets.push_back(offsets.back() + obj.size());
+	}
+
+	CvPointProjector projector;
+	projector.setCamera(intrinsics, distortion_params);
+	projector.project(points3d, offsets, rVecs, tVecs, &points2d);
+
+	view_errors->resize(n_views);
+	if(residuals)
+		residuals->resize(n_views);
+
+	for(int v=0; v<n_views; v++){
+		const std::vector<cv::Point2f> &img = all_image_points[v];
+		int first = offsets[v], n = offsets[v+1] - offsets[v];
+
+		if(residuals)
+			(*residuals)[v].resize(n);
+
+		double sum = 0;
+		for(int p=0; p<n; p++){
+			float du = img[p].x - points2d.u[first+p];
+			float dv = img[p].y - points2d.v[first+p];
+			sum += du*du + dv*dv;
+			if(residuals)
+				(*residuals)[v][p] = cv::Point2f(du, dv);
+		}
+		(*view_errors)[v] = n > 0 ? sqrt(sum/n) : 0;
+	}
+}
+
+double CvCameraCalib::robustThreshold(const std::vector<double> &view_errors, double k){
+
+	std::vector<double> sorted(view_errors);
+	std::sort(sorted.begin(), sorted.end());
+	double median = sorted[sorted.size()/2];
+
+	std::vector<double> deviations;
+	for(size_t i=0; i<sorted.size(); i++)
+		deviations.push_back(fabs(sorted[i] - median));
+	std::sort(deviations.begin(), deviations.end());
+
+	// MAD scaled to a standard deviation, floored so that a set of nearly
+	// identical views does not flag tiny differences
+	double sigma = std::max(1.4826*deviations[deviations.size()/2], 0.1*median);
+
+	return median + k*sigma;
+}
+
+// Result of calibrating with a subset of the views
+typedef struct SubsetResult{
+	std::vector<int> views;		// indices of the views kept
+	cv::Mat intrinsics;
+	cv::Mat distortion_params;
+	std::vector<cv::Mat> rVecs;
+	std::vector<cv::Mat> tVecs;
+	double error;				// RMS reprojection error
+	std::vector<double> view_errors;
+	bool consistent;			// no kept view above the threshold
+} SubsetResult;
+
+// Loop body run by cv::parallel_for_. Each index is one candidate subset.
+class SubsetCalibrationBody : public cv::ParallelLoopBody{
+
+public:
+	SubsetCalibrationBody(CvCameraCalib *calib, 
+						  const std::vector<std::vector<cv::Point3f>> *object_points, 
+						  const std::vector<std::vector<cv::Point2f>> *image_points, 
+						  cv::Size img_size, double threshold_k, 
+						  std::vector<SubsetResult> *results) :
+		calib_(calib), object_points_(object_points), image_points_(image_points), 
+		img_size_(img_size), threshold_k_(threshold_k), results_(results){}
+
+	void operator()(const cv::Range &range) const{
+
+		for(int i=range.start; i<range.end; i++)
+			calib_->solveSubset(*object_points_, *image_points_, img_size_, 
+								threshold_k_, &(*results_)[i]);
+	}
+
+private:
+	CvCameraCalib *calib_;
+	const std::vector<std::vector<cv::Point3f>> *object_points_;
+	const std::vector<std::vector<cv::Point2f>> *image_points_;
+	cv::Size img_size_;
+	double threshold_k_;
+	std::vector<SubsetResult> *results_;
+};
+
+void CvCameraCalib::solveSubset(const std::vector<std::vector<cv::Point3f>> &all_object_points,
+								const std::vector<std::vector<cv::Point2f>> &all_image_points,
+								cv::Size img_size, double threshold_k, SubsetResult *result){
+
+	std::vector<std::vector<cv::Point3f>> object_points;
+	std::vector<std::vector<cv::Point2f>> image_points;
+	for(size_t i=0; i<result->views.size(); i++){
+		object_points.push_back(all_object_points[result->views[i]]);
+		image_points.push_back(all_image_points[result->views[i]]);
+	}
+
+	// every subset owns its matrices and solver
+	CvLMCalibSolver solver;
+	result->distortion_params = distortion_param_->clone();
+	result->error = solveViews(object_points, image_points, img_size, 
+								&result->intrinsics, &result->distortion_params, 
+								&result->rVecs, &result->tVecs, &solver);
+
+	computeViewErrors(object_points, image_points, 
+						result->intrinsics, result->distortion_params, 
+						result->rVecs, result->tVecs, &result->view_errors, NULL);
+
+	double threshold = robustThreshold(result->view_errors, threshold_k);
+	result->consistent = true;
+	for(size_t i=0; i<result->view_errors.size(); i++)
+		if(result->view_errors[i] > threshold)
+			result->consistent = false;
 }
 
+double CvCameraCalib::rejectOutlierViews(const std::vector<std::vector<cv::Point3f>> &all_object_points,
+										 const std::vector<std::vector<cv::Point2f>> &all_image_points,
+										 cv::Size img_size, double error){
+
+	int n_views = all_image_points.size();
+	double threshold = robustThreshold(view_errors_, outlier_threshold_k_);
+
+	// candidates, worst first
+	std::vector<std::pair<double, int>> candidates;
+	for(int v=0; v<n_views; v++)
+		if(view_errors_[v] > threshold)
+			candidates.push_back(std::make_pair(view_errors_[v], v));
+	std::sort(candidates.rbegin(), candidates.rend());
+
+	int n_candidates = std::min((int)candidates.size(), n_views - MIN_KEPT_VIEWS);
+	if(n_candidates <= 0)
+		return error;
+
+	std::cout << n_candidates << " view(s) above the outlier threshold of " 
+			  << threshold << " px" << std::endl;
+
+	// Subset k drops the k+1 worst views. A blurry view also inflates the 
+	// error of good views, so all subsets are solved and the first 
+	// consistent one, which drops the fewest views, is kept.
+	std::vector<SubsetResult> results(n_candidates);
+	for(int k=0; k<n_candidates; k++){
+		std::vector<bool> dropped(n_views, false);
+		for(int j=0; j<=k; j++)
+			dropped[candidates[j].second] = true;
+		for(int v=0; v<n_views; v++)
+			if(!dropped[v])
+				results[k].views.push_back(v);
+	}
+
+	cv::parallel_for_(cv::Range(0, n_candidates), 
+						SubsetCalibrationBody(this, &all_object_points, &all_image_points, 
+											  img_size, outlier_threshold_k_, &results), 
+						n_candidates);
+
+	int best = n_candidates - 1;
+	for(int k=0; k<n_candidates; k++){
+		if(results[k].consistent){
+			best = k;
+			break;
+		}
+	}
+
+	SubsetResult &result = results[best];
+	if(result.error >= error)
+		return error;
+
+	// keep the subset
+	result.intrinsics.copyTo(*intrinsics_);
+	result.distortion_params.copyTo(*distortion_param_);
+	rVec = result.rVecs;
+	tVec = result.tVecs;
+
+	std::vector<double> view_errors(n_views, -1);
+	for(size_t i=0; i<result.views.size(); i++)
+		view_errors[result.views[i]] = result.view_errors[i];
+	view_errors_ = view_errors;
+
+	// residuals of the kept views under the new calibration
+	std::vector<std::vector<cv::Point3f>> object_points;
+	std::vector<std::vector<cv::Point2f>> image_points, kept_residuals;
+	std::vector<double> kept_errors;
+	for(size_t i=0; i<result.views.size(); i++){
+		object_points.push_back(all_object_points[result.views[i]]);
+		image_points.push_back(all_image_points[result.views[i]]);
+	}
+	computeViewErrors(object_points, image_points, *intrinsics_, *distortion_param_, 
+						rVec, tVec, &kept_errors, &kept_residuals);
+
+	corner_residuals_.assign(n_views, std::vector<cv::Point2f>());
+	for(size_t i=0; i<result.views.size(); i++)
+		corner_residuals_[result.views[i]].swap(kept_residuals[i]);
+
+	for(int j=0; j<=best; j++)
+		rejected_views_.push_back(candidates[j].second);
+	std::sort(rejected_views_.begin(), rejected_views_.end());
+
+	return result.error;
+}
@@ -41,9 +41,14 @@
 #include "cv.h"
 #include "highgui.h"
 
+#include "cv_lm_calib_solver.h"
+#include "cv_point_projector.h"
+
 //enable debuging
 //#define CV_CAMERA_CALIB_DEBUG
 
+struct SubsetResult;
+
 class CvCameraCalib{
 
 public:	
@@ -74,6 +79,69 @@ public:
 	void calibrateCamera(CalibParams, 
 						 std::vector<std::vector<cv::Point2f>>);
 
+	/**
+	 * Start an incremental calibration. Views are added one at a time
+	 * with addView; previously added views are discarded.
+	 * @param calibration parameters in CalibParam Structure
+	 */
+	void beginIncremental(CalibParams);
+
+	/**
+	 * Add a view to the incremental calibration and re-optimize with the
+	 * native solver, using the current intrinsics, distortion and poses
+	 * as the initial guess. The first solve runs once enough views have
+	 * been collected.
+	 * @param image points of the view
+	 * @return reprojection error, -1 while there are too few views
+	 */
+	double addView(std::vector<cv::Point2f>);
+
+	/**
+	 * Number of views in the incremental calibration
+	 */
+	int getViewCount();
+
+	/**
+	 * Select the solver used by calibrateCamera. addView always uses the
+	 * native one.
+	 * @param true for CvLMCalibSolver, false for cv::calibrateCamera
+	 */
+	void setNativeSolver(bool);
+
+	/**
+	 * Per-iteration statistics of the last native solve
+	 */
+	const std::vector<CvLMCalibSolver::IterationStats>& getSolverIterationStats();
+
+	/**
+	 * Enable rejection of outlier views in calibrateCamera. Views whose
+	 * RMS error exceeds median + k * (robust sigma) are dropped and the
+	 * calibration is solved again.
+	 * @param enable
+	 * @param k, <= 0 keeps the current value (default 3)
+	 */
+	void setOutlierRejection(bool, double);
+
+	/**
+	 * Get per-view RMS reprojection errors of the last calibration,
+	 * -1 for rejected views
+	 * @param reference to the error array
+	 */
+	void getViewErrors(std::vector<float>*);
+
+	/**
+	 * Get per-corner residuals (detected - projected) of the last
+	 * calibration, empty for rejected views
+	 * @param reference to the residual arrays
+	 */
+	void getCornerResiduals(std::vector<std::vector<cv::Point2f>>*);
+
+	/**
+	 * Get indices of the views rejected by the last calibration
+	 * @param reference to the index array
+	 */
+	void getRejectedViews(std::vector<int>*);
+
 	/** 
 	 * Get camera intrinsics 
 	 * @param reference to a 3x3 array 
@@ -105,6 +173,21 @@ public:
 						std::vector<float>, 
 						std::vector<cv::Point2f>*);
 
+	/**
+	 * Project the object points of many views in one call with the
+	 * current calibration
+	 * @param object points of all views, concatenated
+	 * @param offset of the first point of every view, plus the total count
+	 * @param per-view 3x1 rotation vectors
+	 * @param per-view 3x1 translation vectors
+	 * @param reference to the projected points
+	 */
+	void projectPointsBatch(const CvPointProjector::Points3&, 
+							const std::vector<int>&, 
+							const std::vector<cv::Mat>&, 
+							const std::vector<cv::Mat>&, 
+							CvPointProjector::Points2*);
+
 	/**
 	 * Undistort image 
 	 * @param src image
@@ -116,8 +199,145 @@ public:
 
 
 private:
+
+	friend class SubsetCalibrationBody;
+
+	//private methods
+
+	/**
+	 * Allocate distortion_param_ for the distortion model
+	 * @param distortion model (0/4/5/8)
+	 * @return false for an unknown model
+	 */
+	bool createDistortionModel(int);
+
+	/**
+	 * Checkerboard corners in board coordinates
+	 * @param calibration parameters in CalibParam Structure
+	 * @param reference to the object point array
+	 */
+	void generateObjectPoints(CalibParams, std::vector<cv::Point3f>*);
+
+	/**
+	 * Calibrate with CvLMCalibSolver. A cold start initializes the camera
+	 * matrix from homographies, zero distortion and per-view solvePnP
+	 * poses; a warm start only initializes poses of views without one.
+	 * @param object points per view
+	 * @param image points per view
+	 * @param image size
+	 * @param warm start from the current calibration
+	 * @param maximum number of iterations
+	 * @param camera matrix, result
+	 * @param distortion params, result
+	 * @param per-view rotation vectors, result
+	 * @param per-view translation vectors, result
+	 * @param solver to use
+	 * @return RMS reprojection error
+	 */
+	double solveNative(const std::vector<std::vector<cv::Point3f>>&,
+					   const std::vector<std::vector<cv::Point2f>>&,
+					   cv::Size, bool, int, cv::Mat*, cv::Mat*, 
+					   std::vector<cv::Mat>*, std::vector<cv::Mat>*, 
+					   CvLMCalibSolver*);
+
+	/**
+	 * Calibrate from scratch with the selected solver
+	 * @param object points per view
+	 * @param image points per view
+	 * @param image size
+	 * @param camera matrix, result
+	 * @param distortion params sized for the model, result
+	 * @param per-view rotation vectors, result
+	 * @param per-view translation vectors, result
+	 * @param solver used by the native path
+	 * @return RMS reprojection error
+	 */
+	double solveViews(const std::vector<std::vector<cv::Point3f>>&,
+					  const std::vector<std::vector<cv::Point2f>>&,
+					  cv::Size, cv::Mat*, cv::Mat*, 
+					  std::vector<cv::Mat>*, std::vector<cv::Mat>*, 
+					  CvLMCalibSolver*);
+
+	/**
+	 * Per-view RMS errors and per-corner residuals of a calibration
+	 * @param object points per view
+	 * @param image points per view
+	 * @param camera matrix
+	 * @param distortion params
+	 * @param per-view rotation vectors
+	 * @param per-view translation vectors
+	 * @param reference to the per-view errors
+	 * @param reference to the residuals, or NULL
+	 */
+	static void computeViewErrors(const std::vector<std::vector<cv::Point3f>>&,
+								  const std::vector<std::vector<cv::Point2f>>&,
+								  const cv::Mat&, const cv::Mat&, 
+								  const std::vector<cv::Mat>&, 
+								  const std::vector<cv::Mat>&, 
+								  std::vector<double>*, 
+								  std::vector<std::vector<cv::Point2f>>*);
+
+	/**
+	 * Outlier threshold: median + k * MAD based sigma
+	 * @param per-view errors
+	 * @param k
+	 */
+	static double robustThreshold(const std::vector<double>&, double);
+
+	/**
+	 * Calibrate a subset of views into a SubsetResult. Used by the
+	 * outlier rejection to solve candidate subsets concurrently.
+	 * @param object points of all views
+	 * @param image points of all views
+	 * @param image size
+	 * @param outlier threshold k
+	 * @param reference to the result, with its view list filled in
+	 */
+	void solveSubset(const std::vector<std::vector<cv::Point3f>>&,
+					 const std::vector<std::vector<cv::Point2f>>&,
+					 cv::Size, double, SubsetResult*);
+
+	/**
+	 * Drop views above the robust threshold and re-solve. Candidate
+	 * subsets are solved in parallel; the largest subset without
+	 * remaining outliers, i.e. the one dropping the fewest views, is kept.
+	 * @param object points per view
+	 * @param image points per view
+	 * @param image size
+	 * @param RMS error of the full solve
+	 * @return RMS error of the kept calibration
+	 */
+	double rejectOutlierViews(const std::vector<std::vector<cv::Point3f>>&,
+							  const std::vector<std::vector<cv::Point2f>>&,
+							  cv::Size, double);
+
 	//private members
 
+	// views required before the first incremental solve
+	static const int MIN_INCREMENTAL_VIEWS = 3;
+
+	// views the outlier rejection must leave for the re-solve
+	static const int MIN_KEPT_VIEWS = 3;
+
+	// incremental calibration state
+	CalibParams incremental_params_;
+	std::vector<std::vector<cv::Point2f>> incremental_image_points_;
+	std::vector<std::vector<cv::Point3f>> incremental_object_points_;
+	bool incremental_calibrated_;
+
+	// native solver
+	bool native_solver_;
+	CvLMCalibSolver solver_;
+
+	// residual report of the last calibration
+	std::vector<double> view_errors_;
+	std::vector<std::vector<cv::Point2f>> corner_residuals_;
+	std::vector<int> rejected_views_;
+
+	// outlier view rejection
+	bool reject_outliers_;
+	double outlier_threshold_k_;
+
 	// 3x3 matrix containing instrinsic params
 	cv::Mat *intrinsics_;
 
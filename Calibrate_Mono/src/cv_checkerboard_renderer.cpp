@@ -0,0 +1,267 @@
+/*==========================================================================
+
+  Copyright (c) 2014 Uditha L. Jayarathne, ujayarat@robarts.ca
+
+  Use, modification and redistribution of the software, in source or
+  binary forms, are permitted provided that the following terms and
+  conditions are met:
+
+  1) Redistribution of the source code, in verbatim or modified
+  form, must retain the above copyright notice, this license,
+  the following disclaimer, and any notices that refer to this
+  license and/or the following disclaimer.  
+
+  2) Redistribution in binary form must include the above copyright
+  notice, a copy of this license and the following disclaimer
+  in the documentation or with other materials provided with the
+  distribution.
+
+  3) Modified copies of the source code must be clearly marked as such,
+  and must not be misrepresented as verbatim copies of the source code.
+
+  THE COPYRIGHT HOLDERS AND/OR OTHER PARTIES PROVIDE THE SOFTWARE "AS IS"
+  WITHOUT EXPRESSED OR IMPLIED WARRANTY INCLUDING, BUT NOT LIMITED TO,
+  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  PURPOSE.  IN NO EVENT SHALL ANY COPYRIGHT HOLDER OR OTHER PARTY WHO MAY
+  MODIFY AND/OR REDISTRIBUTE THE SOFTWARE UNDER THE TERMS OF THIS LICENSE
+  BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, LOSS OF DATA OR DATA BECOMING INACCURATE
+  OR LOSS OF PROFIT OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF
+  THE USE OR INABILITY TO USE THE SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGES.
+  =========================================================================*/
+
+#include <math.h>
+#include <algorithm>
+
+#include "cv_checkerboard_renderer.h"
+#include "cv_distortion_model.h"
+
+// Loop body run by cv::parallel_for_. Each index is one image row.
+template<int N_DIST>
+class RenderRowsBody : public cv::ParallelLoopBody{
+
+public:
+	RenderRowsBody(const double *K, const double *k, const double *H_inv, 
+				   double sq_size, int w_corners, int h_corners, 
+				   int supersampling, cv::Mat *image) :
+		K_(K), k_(k), H_inv_(H_inv), sq_size_(sq_size), 
+		w_corners_(w_corners), h_corners_(h_corners), 
+		supersampling_(supersampling), image_(image){}
+
+	void operator()(const cv::Range &range) const{
+
+		const int s = supersampling_;
+		const double fx = K_[0], fy = K_[4], cx = K_[2], cy = K_[5];
+		const double *h = H_inv_;
+
+		for(int v=range.start; v<range.end; v++){
+			float *row = image_->ptr<float>(v);
+			for(int u=0; u<image_->cols; u++){
+
+				float sum = 0;
+				for(int sv=0; sv<s; sv++){
+					for(int su=0; su<s; su++){
+
+						// sample position, pixel centres on integer coordinates
+						double xd = (u + (su + 0.5)/s - 0.5 - cx)/fx;
+						double yd = (v + (sv + 0.5)/s - 0.5 - cy)/fy;
+
+						double x, y;
+						CvDistortionModel<N_DIST>::undistort(k_, xd, yd, 20, &x, &y);
+
+						// ray onto the board plane
+						double w = h[6]*x + h[7]*y + h[8];
+						float level = BACKGROUND_LEVEL;
+						if(w > 0){
+							double bx = (h[0]*x + h[1]*y + h[2])/(w*sq_size_);
+							double by = (h[3]*x + h[4]*y + h[5])/(w*sq_size_);
+
+							// squares span [-1, n] in corner units, with a 
+							// one square white margin around them
+							if(bx >= -2 && bx <= w_corners_ + 1 && 
+							   by >= -2 && by <= h_corners_ + 1){
+								level = WHITE_LEVEL;
+								if(bx >= -1 && bx < w_corners_ && 
+								   by >= -1 && by < h_corners_ && 
+								   (((int)floor(bx) + (int)floor(by)) & 1) == 0)
+									level = BLACK_LEVEL;
+							}
+						}
+						sum += level;
+					}
+				}
+				row[u] = sum/(s*s);
+			}
+		}
+	}
+
+	static const int BLACK_LEVEL = 30;
+	static const int WHITE_LEVEL = 220;
+	static const int BACKGROUND_LEVEL = 120;
+
+private:
+	const double *K_, *k_, *H_inv_;
+	double sq_size_;
+	int w_corners_, h_corners_;
+	int supersampling_;
+	cv::Mat *image_;
+};
+
+CvCheckerboardRenderer::CvCheckerboardRenderer(int w, int h, float sq_size):
+	board_size_(w, h), sq_size_(sq_size), n_distortion_(0), 
+	supersampling_(4), noise_sigma_(0){
+
+}
+
+CvCheckerboardRenderer::~CvCheckerboardRenderer(){
+
+}
+
+bool CvCheckerboardRenderer::setCamera(const cv::Mat &K, const cv::Mat &D, 
+									   cv::Size img_size){
+
+	int n_dist = D.empty() ? 0 : D.rows*D.cols;
+	if(n_dist != 0 && n_dist != 4 && n_dist != 5 && n_dist != 8){
+		std::cerr << "Unsupported distortion model" << std::endl;
+		return false;
+	}
+
+	K.convertTo(camera_matrix_, CV_64F);
+	distortion_ = cv::Mat::zeros(8, 1, CV_64F);
+	for(int i=0; i<n_dist; i++)
+		distortion_.at<double>(i, 0) = D.at<double>(i);
+	n_distortion_ = n_dist;
+
+	img_size_ = img_size;
+	return true;
+}
+
+void CvCheckerboardRenderer::setQuality(int supersampling, double noise_sigma){
+	supersampling_ = std::max(supersampling, 1);
+	noise_sigma_ = noise_sigma;
+}
+
+void CvCheckerboardRenderer::getObjectPoints(std::vector<cv::Point3f> *object_points){
+
+	object_points->clear();
+	for(int y=0; y<board_size_.height; y++)
+		for(int x=0; x<board_size_.width; x++)
+			object_points->push_back(cv::Point3f(x*sq_size_, y*sq_size_, 0));
+}
+
+bool CvCheckerboardRenderer::randomPose(cv::RNG *rng, cv::Mat *rvec, cv::Mat *tvec){
+
+	const double fx = camera_matrix_.at<double>(0, 0);
+	const double fy = camera_matrix_.at<double>(1, 1);
+	const double cx = camera_matrix_.at<double>(0, 2);
+	const double cy = camera_matrix_.at<double>(1, 2);
+
+	// outline of the white margin, checked against the image border
+	std::vector<cv::Point3f> outline;
+	float x0 = -2*sq_size_, x1 = (board_size_.width + 1)*sq_size_;
+	float y0 = -2*sq_size_, y1 = (board_size_.height + 1)*sq_size_;
+	for(int i=0; i<=10; i++){
+		float a = i/10.f;
+		outline.push_back(cv::Point3f(x0 + a*(x1 - x0), y0, 0));
+		outline.push_back(cv::Point3f(x0 + a*(x1 - x0), y1, 0));
+		outline.push_back(cv::Point3f(x0, y0 + a*(y1 - y0), 0));
+		outline.push_back(cv::Point3f(x1, y0 + a*(y1 - y0), 0));
+	}
+	cv::Point3f centre((board_size_.width - 1)*sq_size_/2, 
+					   (board_size_.height - 1)*sq_size_/2, 0);
+
+	float margin = 0.05f*img_size_.width;
+	for(int trial=0; trial<100; trial++){
+
+		// tilt about x and y up to 35 degrees, roll up to 20 degrees
+		cv::Mat r(3, 1, CV_64F), Rx, Ry, Rz;
+		r.setTo(0); r.at<double>(0, 0) = rng->uniform(-0.61, 0.61); cv::Rodrigues(r, Rx);
+		r.setTo(0); r.at<double>(1, 0) = rng->uniform(-0.61, 0.61); cv::Rodrigues(r, Ry);
+		r.setTo(0); r.at<double>(2, 0) = rng->uniform(-0.35, 0.35); cv::Rodrigues(r, Rz);
+		cv::Mat R = Rz*Ry*Rx;
+
+		// board spans 35-70% of the image width
+		double board_width = x1 - x0;
+		double z = fx*board_width/(rng->uniform(0.35, 0.7)*img_size_.width);
+		double u = rng->uniform(0.3, 0.7)*img_size_.width;
+		double v = rng->uniform(0.3, 0.7)*img_size_.height;
+
+		cv::Mat c = (cv::Mat_<double>(3, 1) << centre.x, centre.y, 0);
+		cv::Mat target = (cv::Mat_<double>(3, 1) << z*(u - cx)/fx, z*(v - cy)/fy, z);
+		cv::Mat t = target - R*c;
+
+		cv::Mat rv;
+		cv::Rodrigues(R, rv);
+
+		std::vector<cv::Point2f> projected;
+		cv::projectPoints(cv::Mat(outline), rv, t, camera_matrix_, distortion_, projected);
+
+		bool inside = true;
+		for(size_t i=0; i<projected.size() && inside; i++)
+			inside = projected[i].x > margin && projected[i].x < img_size_.width - margin &&
+					 projected[i].y > margin && projected[i].y < img_size_.height - margin;
+
+		if(inside){
+			rv.copyTo(*rvec);
+			t.copyTo(*tvec);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void CvCheckerboardRenderer::render(const cv::Mat &rvec, const cv::Mat &tvec, 
+									cv::RNG *rng, cv::Mat *image, 
+									std::vector<cv::Point2f> *corners){
+
+	// board (X, Y, 1) -> normalized camera coordinates is [r1 r2 t]
+	cv::Mat R;
+	cv::Rodrigues(rvec, R);
+	cv::Mat H(3, 3, CV_64F);
+	for(int i=0; i<3; i++){
+		H.at<double>(i, 0) = R.at<double>(i, 0);
+		H.at<double>(i, 1) = R.at<double>(i, 1);
+		H.at<double>(i, 2) = tvec.at<double>(i);
+	}
+	cv::Mat H_inv = H.inv();
+
+	cv::Mat K = camera_matrix_.clone(), k = distortion_.clone();
+	cv::Mat rendered(img_size_, CV_32F);
+	cv::Range rows(0, img_size_.height);
+	switch(n_distortion_){
+		case 0:
+			cv::parallel_for_(rows, RenderRowsBody<0>(K.ptr<double>(), k.ptr<double>(), 
+								H_inv.ptr<double>(), sq_size_, board_size_.width, 
+								board_size_.height, supersampling_, &rendered));
+			break;
+		case 4:
+			cv::parallel_for_(rows, RenderRowsBody<4>(K.ptr<double>(), k.ptr<double>(), 
+								H_inv.ptr<double>(), sq_size_, board_size_.width, 
+								board_size_.height, supersampling_, &rendered));
+			break;
+		case 5:
+			cv::parallel_for_(rows, RenderRowsBody<5>(K.ptr<double>(), k.ptr<double>(), 
+								H_inv.ptr<double>(), sq_size_, board_size_.width, 
+								board_size_.height, supersampling_, &rendered));
+			break;
+		case 8:
+			cv::parallel_for_(rows, RenderRowsBody<8>(K.ptr<double>(), k.ptr<double>(), 
+								H_inv.ptr<double>(), sq_size_, board_size_.width, 
+								board_size_.height, supersampling_, &rendered));
+			break;
+	}
+
+	if(noise_sigma_ > 0){
+		cv::Mat noise(img_size_, CV_32F);
+		rng->fill(noise, cv::RNG::NORMAL, 0, noise_sigma_);
+		rendered += noise;
+	}
+	rendered.convertTo(*image, CV_8U);
+
+	std::vector<cv::Point3f> object_points;
+	getObjectPoints(&object_points);
+	cv::projectPoints(cv::Mat(object_points), rvec, tvec, 
+						camera_matrix_, distortion_, *corners);
+}
@@ -0,0 +1,122 @@
+/*==========================================================================
+
+  Copyright (c) 2014 Uditha L. Jayarathne, ujayarat@robarts.ca
+
+  Use, modification and redistribution of the software, in source or
+  binary forms, are permitted provided that the following terms and
+  conditions are met:
+
+  1) Redistribution of the source code, in verbatim or modified
+  form, must retain the above copyright notice, this license,
+  the following disclaimer, and any notices that refer to this
+  license and/or the following disclaimer.  
+
+  2) Redistribution in binary form must include the above copyright
+  notice, a copy of this license and the following disclaimer
+  in the documentation or with other materials provided with the
+  distribution.
+
+  3) Modified copies of the source code must be clearly marked as such,
+  and must not be misrepresented as verbatim copies of the source code.
+
+  THE COPYRIGHT HOLDERS AND/OR OTHER PARTIES PROVIDE THE SOFTWARE "AS IS"
+  WITHOUT EXPRESSED OR IMPLIED WARRANTY INCLUDING, BUT NOT LIMITED TO,
+  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  PURPOSE.  IN NO EVENT SHALL ANY COPYRIGHT HOLDER OR OTHER PARTY WHO MAY
+  MODIFY AND/OR REDISTRIBUTE THE SOFTWARE UNDER THE TERMS OF THIS LICENSE
+  BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, LOSS OF DATA OR DATA BECOMING INACCURATE
+  OR LOSS OF PROFIT OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF
+  THE USE OR INABILITY TO USE THE SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGES.
+  =========================================================================*/
+
+#ifndef __CV_CHECKERBOARD_RENDERER__H
+#define __CV_CHECKERBOARD_RENDERER__H
+
+#include <iostream>
+#include <vector>
+
+// Opencv Includes 
+#include "cv.h"
+
+/**
+ * Renders synthetic checkerboard images seen by a camera with known
+ * intrinsics, distortion (0/4/5/8 params) and pose. Every pixel is traced
+ * back through the inverse distortion onto the board plane, with s x s
+ * supersampling for anti-aliasing, and gaussian noise is added. The exact
+ * corner positions are returned as ground truth.
+ */
+class CvCheckerboardRenderer{
+
+public:
+
+	/**
+	 * @param corners along width
+	 * @param corners along height
+	 * @param square size
+	 */
+	CvCheckerboardRenderer(int, int, float);
+	~CvCheckerboardRenderer();
+
+	//public methods
+
+	/**
+	 * Set the camera
+	 * @param 3x3 camera matrix
+	 * @param distortion params (empty, 4, 5 or 8 elements)
+	 * @param image size
+	 * @return false for an unsupported distortion model
+	 */
+	bool setCamera(const cv::Mat&, const cv::Mat&, cv::Size);
+
+	/**
+	 * Set the rendering quality
+	 * @param supersampling factor per axis
+	 * @param standard deviation of the additive gaussian noise, in grey levels
+	 */
+	void setQuality(int, double);
+
+	/**
+	 * Draw a random board pose with the whole board inside the image
+	 * @param random number generator
+	 * @param reference to the 3x1 rotation vector
+	 * @param reference to the 3x1 translation vector
+	 * @return false if no valid pose was found
+	 */
+	bool randomPose(cv::RNG*, cv::Mat*, cv::Mat*);
+
+	/**
+	 * Render the board
+	 * @param 3x1 rotation vector
+	 * @param 3x1 translation vector
+	 * @param random number generator for the noise, separate from the poses' one
+	 * @param reference to the 8-bit grayscale image
+	 * @param reference to the ground truth corners
+	 */
+	void render(const cv::Mat&, const cv::Mat&, cv::RNG*, 
+				cv::Mat*, std::vector<cv::Point2f>*);
+
+	/**
+	 * Checkerboard corners in board coordinates
+	 * @param reference to the object point array
+	 */
+	void getObjectPoints(std::vector<cv::Point3f>*);
+
+private:
+	//private members
+
+	cv::Size board_size_;
+	float sq_size_;
+
+	cv::Mat camera_matrix_;
+	cv::Mat distortion_;	// always 8x1, zero padded
+	int n_distortion_;
+	cv::Size img_size_;
+
+	int supersampling_;
+	double noise_sigma_;
+
+};
+
+#endif //__CV_CHECKERBOARD_RENDERER__H
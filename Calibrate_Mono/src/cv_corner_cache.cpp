@@ -0,0 +1,230 @@
+/*==========================================================================
+
+  Copyright (c) 2014 Uditha L. Jayarathne, ujayarat@robarts.ca
+
+  Use, modification and redistribution of the software, in source or
+  binary forms, are permitted provided that the following terms and
+  conditions are met:
+
+  1) Redistribution of the source code, in verbatim or modified
+  form, must retain the above copyright notice, this license,
+  the following disclaimer, and any notices that refer to this
+  license and/or the following disclaimer.  
+
+  2) Redistribution in binary form must include the above copyright
+  notice, a copy of this license and the following disclaimer
+  in the documentation or with other materials provided with the
+  distribution.
+
+  3) Modified copies of the source code must be clearly marked as such,
+  and must not be misrepresented as verbatim copies of the source code.
+
+  THE COPYRIGHT HOLDERS AND/OR OTHER PARTIES PROVIDE THE SOFTWARE "AS IS"
+  WITHOUT EXPRESSED OR IMPLIED WARRANTY INCLUDING, BUT NOT LIMITED TO,
+  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  PURPOSE.  IN NO EVENT SHALL ANY COPYRIGHT HOLDER OR OTHER PARTY WHO MAY
+  MODIFY AND/OR REDISTRIBUTE THE SOFTWARE UNDER THE TERMS OF THIS LICENSE
+  BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, LOSS OF DATA OR DATA BECOMING INACCURATE
+  OR LOSS OF PROFIT OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF
+  THE USE OR INABILITY TO USE THE SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGES.
+  =========================================================================*/
+
+#include <fstream>
+#include <string.h>
+
+#include "cv_corner_cache.h"
+
+// File layout (native byte order):
+//	char[4] magic, int32 version, int32 w_corners, int32 h_corners, 
+//	uint64 config_key, int32 n_entries
+//	per entry: uint64 hash, int32 width, int32 height, int32 n_corners, 
+//			   n_corners x (float x, float y)
+static const char CACHE_MAGIC[4] = {'C', 'V', 'C', 'C'};
+// version 2: corners refined by CvSubPixRefiner instead of cv::cornerSubPix
+// version 3: detector configuration key in the header
+static const int CACHE_VERSION = 3;
+
+CvCornerCache::CvCornerCache(std::string filename, int w_corners, int h_corners):
+	filename_(filename), w_corners_(w_corners), h_corners_(h_corners), 
+	config_key_(0), has_config_key_(false), dirty_(false){
+
+}
+
+CvCornerCache::~CvCornerCache(){
+
+}
+
+bool CvCornerCache::load(){
+
+	entries_.clear();
+	dirty_ = false;
+
+	std::ifstream file(filename_.c_str(), std::ios::in | std::ios::binary);
+	if(!file.is_open())
+		return false;
+
+	char magic[4];
+	int version, w_corners, h_corners, n_entries;
+	uint64 config_key;
+	file.read(magic, 4);
+	file.read((char *)&version, sizeof(int));
+	file.read((char *)&w_corners, sizeof(int));
+	file.read((char *)&h_corners, sizeof(int));
+	file.read((char *)&config_key, sizeof(uint64));
+	file.read((char *)&n_entries, sizeof(int));
+
+	if(!file.good() || memcmp(magic, CACHE_MAGIC, 4) != 0 || 
+		version != CACHE_VERSION){
+		std::cerr << "Ignoring invalid corner cache " << filename_ << std::endl;
+		return false;
+	}
+
+	// Corners of another checkerboard are useless
+	if(w_corners != w_corners_ || h_corners != h_corners_)
+		return false;
+
+	// and so are corners, or misses, of another detector configuration
+	if(has_config_key_ && config_key != config_key_){
+		std::cout << "Corner cache " << filename_ 
+				  << " was made with other detector settings, detecting again" << std::endl;
+		return false;
+	}
+	config_key_ = config_key;
+
+	for(int i=0; i<n_entries; i++){
+		uint64 hash;
+		int n_corners;
+		CacheEntry entry;
+
+		file.read((char *)&hash, sizeof(uint64));
+		file.read((char *)&entry.img_width, sizeof(int));
+		file.read((char *)&entry.img_height, sizeof(int));
+		file.read((char *)&n_corners, sizeof(int));
+		if(!file.good() || n_corners < 0 || n_corners > w_corners*h_corners)
+			break;
+
+		entry.corners.resize(n_corners);
+		if(n_corners > 0)
+			file.read((char *)&entry.corners[0], n_corners*sizeof(cv::Point2f));
+		if(!file.good())
+			break;
+
+		entries_[hash] = entry;
+	}
+
+	file.close();
+	return !entries_.empty();
+}
+
+bool CvCornerCache::save(){
+
+	if(!dirty_)
+		return true;
+
+	std::ofstream file(filename_.c_str(), 
+						std::ios::out | std::ios::binary | std::ios::trunc);
+	if(!file.is_open()){
+		std::cerr << "Unable to open the corner cache " << filename_ << std::endl;
+		return false;
+	}
+
+	int n_entries = entries_.size();
+	file.write(CACHE_MAGIC, 4);
+	file.write((const char *)&CACHE_VERSION, sizeof(int));
+	file.write((const char *)&w_corners_, sizeof(int));
+	file.write((const char *)&h_corners_, sizeof(int));
+	file.write((const char *)&config_key_, sizeof(uint64));
+	file.write((const char *)&n_entries, sizeof(int));
+
+	std::map<uint64, CacheEntry>::const_iterator it;
+	for(it = entries_.begin(); it != entries_.end(); ++it){
+		int n_corners = it->second.corners.size();
+		file.write((const char *)&it->first, sizeof(uint64));
+		file.write((const char *)&it->second.img_width, sizeof(int));
+		file.write((const char *)&it->second.img_height, sizeof(int));
+		file.write((const char *)&n_corners, sizeof(int));
+		if(n_corners > 0)
+			file.write((const char *)&it->second.corners[0], 
+						n_corners*sizeof(cv::Point2f));
+	}
+
+	bool ok = file.good();
+	file.close();
+
+	if(ok)
+		dirty_ = false;
+
+	return ok;
+}
+
+void CvCornerCache::setConfigKey(uint64 key){
+
+	if(!entries_.empty() && key != config_key_){
+		std::cout << "Corner cache " << filename_ 
+				  << " was made with other detector settings, detecting again" << std::endl;
+		entries_.clear();
+		dirty_ = true;
+	}
+
+	config_key_ = key;
+	has_config_key_ = true;
+}
+
+bool CvCornerCache::lookup(uint64 hash, CacheEntry *entry) const{
+
+	std::map<uint64, CacheEntry>::const_iterator it = entries_.find(hash);
+	if(it == entries_.end())
+		return false;
+
+	*entry = it->second;
+	return true;
+}
+
+void CvCornerCache::insert(uint64 hash, const CacheEntry &entry){
+
+	entries_[hash] = entry;
+	dirty_ = true;
+}
+
+int CvCornerCache::size() const{
+
+	return entries_.size();
+}
+
+bool CvCornerCache::readFile(const std::string &filename, std::vector<uchar> *buffer){
+
+	std::ifstream file(filename.c_str(), std::ios::in | std::ios::binary);
+	if(!file.is_open())
+		return false;
+
+	file.seekg(0, std::ios::end);
+	std::streamoff length = file.tellg();
+	file.seekg(0, std::ios::beg);
+
+	buffer->resize((size_t)length);
+	if(length > 0)
+		file.read((char *)&(*buffer)[0], length);
+
+	return file.good();
+}
+
+uint64 CvCornerCache::hashBuffer(const std::vector<uchar> &buffer){
+
+	if(buffer.empty())
+		return HASH_SEED;
+
+	return hashBytes(&buffer[0], buffer.size(), HASH_SEED);
+}
+
+uint64 CvCornerCache::hashBytes(const void *bytes, size_t length, uint64 hash){
+
+	const uchar *p = (const uchar *)bytes;
+	for(size_t i=0; i<length; i++){
+		hash ^= p[i];
+		hash *= 1099511628211ULL;
+	}
+
+	return hash;
+}
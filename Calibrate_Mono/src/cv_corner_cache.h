@@ -0,0 +1,156 @@
+/*==========================================================================
+
+  Copyright (c) 2014 Uditha L. Jayarathne, ujayarat@robarts.ca
+
+  Use, modification and redistribution of the software, in source or
+  binary forms, are permitted provided that the following terms and
+  conditions are met:
+
+  1) Redistribution of the source code, in verbatim or modified
+  form, must retain the above copyright notice, this license,
+  the following disclaimer, and any notices that refer to this
+  license and/or the following disclaimer.  
+
+  2) Redistribution in binary form must include the above copyright
+  notice, a copy of this license and the following disclaimer
+  in the documentation or with other materials provided with the
+  distribution.
+
+  3) Modified copies of the source code must be clearly marked as such,
+  and must not be misrepresented as verbatim copies of the source code.
+
+  THE COPYRIGHT HOLDERS AND/OR OTHER PARTIES PROVIDE THE SOFTWARE "AS IS"
+  WITHOUT EXPRESSED OR IMPLIED WARRANTY INCLUDING, BUT NOT LIMITED TO,
+  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  PURPOSE.  IN NO EVENT SHALL ANY COPYRIGHT HOLDER OR OTHER PARTY WHO MAY
+  MODIFY AND/OR REDISTRIBUTE THE SOFTWARE UNDER THE TERMS OF THIS LICENSE
+  BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, LOSS OF DATA OR DATA BECOMING INACCURATE
+  OR LOSS OF PROFIT OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF
+  THE USE OR INABILITY TO USE THE SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGES.
+  =========================================================================*/
+
+#ifndef __CV_CORNER_CACHE__H
+#define __CV_CORNER_CACHE__H
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <map>
+
+// Opencv Includes 
+#include "cv.h"
+
+class CvCornerCache{
+
+public:
+
+	// Cached detection result of one image
+	typedef struct CacheEntry{
+		int img_width;	// image width
+		int img_height; // image height
+		std::vector<cv::Point2f> corners; // refined corners, empty if not found
+	} CacheEntry;
+
+	/**
+	 * @param cache file name
+	 * @param corners along width
+	 * @param corners along height
+	 */
+	CvCornerCache(std::string, int, int);
+	~CvCornerCache();
+
+	//public methods
+
+	/**
+	 * Load the cache file. A missing file or one written for another
+	 * checkerboard or another detector configuration leaves the cache empty.
+	 * @return true if entries were loaded
+	 */
+	bool load();
+
+	/**
+	 * Set the hash of the detector configuration the entries belong to,
+	 * see CvCornerDetector::getConfigKey. It is stored in the file. Entries
+	 * loaded or added under another key are dropped.
+	 * @param configuration hash
+	 */
+	void setConfigKey(uint64);
+
+	/**
+	 * Write the cache file if entries were added since the last load/save
+	 * @return true on success
+	 */
+	bool save();
+
+	/**
+	 * Look up an image. Safe to call from several threads as long as no
+	 * thread inserts at the same time.
+	 * @param content hash of the image file
+	 * @param reference to the entry
+	 * @return true on a cache hit
+	 */
+	bool lookup(uint64, CacheEntry*) const;
+
+	/**
+	 * Add or replace an image entry
+	 * @param content hash of the image file
+	 * @param entry
+	 */
+	void insert(uint64, const CacheEntry&);
+
+	/**
+	 * Number of cached images
+	 */
+	int size() const;
+
+	/**
+	 * Read a whole file into memory
+	 * @param file name
+	 * @param reference to the byte buffer
+	 * @return true on success
+	 */
+	static bool readFile(const std::string&, std::vector<uchar>*);
+
+	/**
+	 * 64-bit FNV-1a hash of a byte buffer
+	 * @param byte buffer
+	 * @return hash
+	 */
+	static uint64 hashBuffer(const std::vector<uchar>&);
+
+	/**
+	 * Continue a 64-bit FNV-1a hash over raw bytes
+	 * @param pointer to the bytes
+	 * @param number of bytes
+	 * @param hash so far, HASH_SEED to start
+	 * @return hash
+	 */
+	static uint64 hashBytes(const void *, size_t, uint64);
+
+	// FNV-1a offset basis
+	static const uint64 HASH_SEED = 14695981039346656037ULL;
+
+private:
+	//private members
+
+	std::string filename_;
+
+	// checkerboard the cached corners belong to
+	int w_corners_;
+	int h_corners_;
+
+	// detector configuration the entries belong to, adopted from the 
+	// file until one is set
+	uint64 config_key_;
+	bool has_config_key_;
+
+	std::map<uint64, CacheEntry> entries_;
+
+	// entries were added since the last load/save
+	bool dirty_;
+
+};
+
+#endif //__CV_CORNER_CACHE__H
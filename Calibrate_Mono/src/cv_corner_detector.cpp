@@ -0,0 +1,274 @@
+/*==========================================================================
+
+  Copyright (c) 2014 Uditha L. Jayarathne, ujayarat@robarts.ca
+
+  Use, modification and redistribution of the software, in source or
+  binary forms, are permitted provided that the following terms and
+  conditions are met:
+
+  1) Redistribution of the source code, in verbatim or modified
+  form, must retain the above copyright notice, this license,
+  the following disclaimer, and any notices that refer to this
+  license and/or the following disclaimer.  
+
+  2) Redistribution in binary form must include the above copyright
+  notice, a copy of this license and the following disclaimer
+  in the documentation or with other materials provided with the
+  distribution.
+
+  3) Modified copies of the source code must be clearly marked as such,
+  and must not be misrepresented as verbatim copies of the source code.
+
+  THE COPYRIGHT HOLDERS AND/OR OTHER PARTIES PROVIDE THE SOFTWARE "AS IS"
+  WITHOUT EXPRESSED OR IMPLIED WARRANTY INCLUDING, BUT NOT LIMITED TO,
+  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  PURPOSE.  IN NO EVENT SHALL ANY COPYRIGHT HOLDER OR OTHER PARTY WHO MAY
+  MODIFY AND/OR REDISTRIBUTE THE SOFTWARE UNDER THE TERMS OF THIS LICENSE
+  BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, LOSS OF DATA OR DATA BECOMING INACCURATE
+  OR LOSS OF PROFIT OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF
+  THE USE OR INABILITY TO USE THE SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGES.
+  =========================================================================*/
+
+#include "cv_corner_detector.h"
+
+// Loop body run by cv::parallel_for_. Each index is one image file. 
+class CornerDetectionBody : public cv::ParallelLoopBody{
+
+public:
+	CornerDetectionBody(CvCornerDetector *detector, 
+						const CvCornerCache *cache,
+						const std::vector<std::string> *filenames, 
+						std::vector<std::vector<cv::Point2f>> *corners, 
+						std::vector<cv::Size> *sizes,
+						std::vector<uint64> *hashes,
+						std::vector<uchar> *detected) :
+		detector_(detector), cache_(cache), filenames_(filenames), 
+		corners_(corners), sizes_(sizes), hashes_(hashes), detected_(detected){}
+
+	void operator()(const cv::Range &range) const{
+
+		for(int i=range.start; i<range.end; i++){
+
+			// every index owns its slots, no locking needed
+			cv::Mat frame_gry;
+			if(cache_){
+				// hash the encoded bytes and decode from the same buffer
+				std::vector<uchar> buffer;
+				if(!CvCornerCache::readFile((*filenames_)[i], &buffer))
+					continue;
+
+				(*hashes_)[i] = CvCornerCache::hashBuffer(buffer);
+
+				CvCornerCache::CacheEntry entry;
+				if(cache_->lookup((*hashes_)[i], &entry)){
+					(*sizes_)[i] = cv::Size(entry.img_width, entry.img_height);
+					(*corners_)[i] = entry.corners;
+					continue;
+				}
+
+				frame_gry = cv::imdecode(cv::Mat(buffer), CV_LOAD_IMAGE_GRAYSCALE);
+			}
+			else
+				frame_gry = cv::imread((*filenames_)[i], CV_LOAD_IMAGE_GRAYSCALE);
+
+			if(frame_gry.empty())
+				continue;
+
+			(*sizes_)[i] = frame_gry.size();
+			(*detected_)[i] = 1;
+
+			if(!detector_->detectCorners(frame_gry, &(*corners_)[i]))
+				(*corners_)[i].clear();
+		}
+	}
+
+private:
+	CvCornerDetector *detector_;
+	const CvCornerCache *cache_;
+	const std::vector<std::string> *filenames_;
+	std::vector<std::vector<cv::Point2f>> *corners_;
+	std::vector<cv::Size> *sizes_;
+	std::vector<uint64> *hashes_;
+	std::vector<uchar> *detected_;
+};
+
+CvCornerDetector::CvCornerDetector(int w_corners, int h_corners):
+	board_size_(w_corners, h_corners), 
+	detection_flags_(cv::CALIB_CB_ADAPTIVE_THRESH+cv::CALIB_CB_FILTER_QUADS),
+	pyramid_max_width_(640),
+	cache_(NULL),
+	coarse_refiner_(cv::Size(3, 3), 
+					cv::TermCriteria(cv::TermCriteria::EPS+cv::TermCriteria::MAX_ITER, 30, 0.1)),
+	refiner_(cv::Size(5, 5), 
+			 cv::TermCriteria(cv::TermCriteria::EPS+cv::TermCriteria::MAX_ITER, 30, 0.1)){
+
+}
+
+CvCornerDetector::~CvCornerDetector(){
+
+}
+
+bool CvCornerDetector::detectCorners(const cv::Mat &frame_gry, 
+									 std::vector<cv::Point2f> *corners){
+
+	corners->clear();
+
+	// Build the coarse level. 
+	cv::Mat coarse = frame_gry;
+	int n_levels = 0;
+	while(pyramid_max_width_ > 0 && coarse.cols > pyramid_max_width_){
+		cv::Mat down;
+		cv::pyrDown(coarse, down);
+		coarse = down;
+		n_levels++;
+	}
+
+	if(n_levels == 0){
+		if(!cv::findChessboardCorners(frame_gry, board_size_, *corners,
+										detection_flags_))
+			return false;
+	}
+	// Fast check rejects board-free frames before the full quad search
+	else if(cv::findChessboardCorners(coarse, board_size_, *corners,
+									  detection_flags_+cv::CALIB_CB_FAST_CHECK)){
+		// A smaller window keeps neighbouring corners out at this scale
+		coarse_refiner_.refine(coarse, corners);
+
+		// pyrDown centres pixel j of a level on pixel 2j of the level below
+		float scale = (float)(1 << n_levels);
+		for(size_t j=0; j<corners->size(); j++){
+			(*corners)[j].x *= scale;
+			(*corners)[j].y *= scale;
+		}
+	}
+	else{
+		// Small or distant boards can blur away at the coarse level, so
+		// search the full resolution before giving up on the frame
+		corners->clear();
+		if(!cv::findChessboardCorners(frame_gry, board_size_, *corners,
+										detection_flags_+
+										cv::CALIB_CB_FAST_CHECK))
+			return false;
+	}
+
+	// Refine corner sub pix
+	refiner_.refine(frame_gry, corners);
+
+	return true;
+}
+
+bool CvCornerDetector::detectCorners(const std::string &filename, 
+									 const cv::Mat &frame_gry, 
+									 std::vector<cv::Point2f> *corners){
+
+	if(!cache_)
+		return detectCorners(frame_gry, corners);
+
+	std::vector<uchar> buffer;
+	if(!CvCornerCache::readFile(filename, &buffer))
+		return detectCorners(frame_gry, corners);
+
+	uint64 hash = CvCornerCache::hashBuffer(buffer);
+	CvCornerCache::CacheEntry entry;
+	if(cache_->lookup(hash, &entry)){
+		*corners = entry.corners;
+		return !corners->empty();
+	}
+
+	bool found = detectCorners(frame_gry, corners);
+
+	entry.img_width = frame_gry.cols;
+	entry.img_height = frame_gry.rows;
+	entry.corners = *corners;
+	cache_->insert(hash, entry);
+
+	return found;
+}
+
+void CvCornerDetector::setCache(CvCornerCache *cache){
+	cache_ = cache;
+	if(cache_)
+		cache_->setConfigKey(getConfigKey());
+}
+
+void CvCornerDetector::setDetectionFlags(int flags){
+	detection_flags_ = flags;
+	if(cache_)
+		cache_->setConfigKey(getConfigKey());
+}
+
+void CvCornerDetector::setPyramidMaxWidth(int width){
+	pyramid_max_width_ = width;
+	if(cache_)
+		cache_->setConfigKey(getConfigKey());
+}
+
+cv::Size CvCornerDetector::getBoardSize() const{
+	return board_size_;
+}
+
+uint64 CvCornerDetector::getConfigKey() const{
+
+	double settings[5 + 2*4];
+	int k = 0;
+	settings[k++] = DETECTION_REVISION;
+	settings[k++] = board_size_.width;
+	settings[k++] = board_size_.height;
+	settings[k++] = detection_flags_;
+	settings[k++] = pyramid_max_width_;
+
+	const CvSubPixRefiner *refiners[2] = {&coarse_refiner_, &refiner_};
+	for(int r=0; r<2; r++){
+		cv::Size half_win;
+		int max_iter;
+		double eps;
+		refiners[r]->getSettings(&half_win, &max_iter, &eps);
+		settings[k++] = half_win.width;
+		settings[k++] = half_win.height;
+		settings[k++] = max_iter;
+		settings[k++] = eps;
+	}
+
+	return CvCornerCache::hashBytes(settings, sizeof(settings), CvCornerCache::HASH_SEED);
+}
+
+int CvCornerDetector::detectCornersBatch(const std::vector<std::string> &filenames, 
+										 std::vector<std::vector<cv::Point2f>> *all_corners, 
+										 cv::Size *img_size){
+
+	int n_images = filenames.size();
+
+	all_corners->clear();
+	all_corners->resize(n_images);
+	std::vector<cv::Size> sizes(n_images);
+	std::vector<uint64> hashes(n_images, 0);
+	std::vector<uchar> detected(n_images, 0);
+
+	// One stripe per image so that slow images do not stall a whole block.
+	cv::parallel_for_(cv::Range(0, n_images), 
+						CornerDetectionBody(this, cache_, &filenames, all_corners, 
+											&sizes, &hashes, &detected), 
+						n_images);
+
+	int n_found = 0;
+	for(int i=0; i<n_images; i++){
+		// Remember fresh results, board-free images included
+		if(cache_ && detected[i]){
+			CvCornerCache::CacheEntry entry;
+			entry.img_width = sizes[i].width;
+			entry.img_height = sizes[i].height;
+			entry.corners = (*all_corners)[i];
+			cache_->insert(hashes[i], entry);
+		}
+
+		if((*all_corners)[i].empty())
+			continue;
+
+		*img_size = sizes[i];
+		n_found++;
+	}
+
+	return n_found;
+}
@@ -0,0 +1,159 @@
+/*==========================================================================
+
+  Copyright (c) 2014 Uditha L. Jayarathne, ujayarat@robarts.ca
+
+  Use, modification and redistribution of the software, in source or
+  binary forms, are permitted provided that the following terms and
+  conditions are met:
+
+  1) Redistribution of the source code, in verbatim or modified
+  form, must retain the above copyright notice, this license,
+  the following disclaimer, and any notices that refer to this
+  license and/or the following disclaimer.  
+
+  2) Redistribution in binary form must include the above copyright
+  notice, a copy of this license and the following disclaimer
+  in the documentation or with other materials provided with the
+  distribution.
+
+  3) Modified copies of the source code must be clearly marked as such,
+  and must not be misrepresented as verbatim copies of the source code.
+
+  THE COPYRIGHT HOLDERS AND/OR OTHER PARTIES PROVIDE THE SOFTWARE "AS IS"
+  WITHOUT EXPRESSED OR IMPLIED WARRANTY INCLUDING, BUT NOT LIMITED TO,
+  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  PURPOSE.  IN NO EVENT SHALL ANY COPYRIGHT HOLDER OR OTHER PARTY WHO MAY
+  MODIFY AND/OR REDISTRIBUTE THE SOFTWARE UNDER THE TERMS OF THIS LICENSE
+  BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, LOSS OF DATA OR DATA BECOMING INACCURATE
+  OR LOSS OF PROFIT OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF
+  THE USE OR INABILITY TO USE THE SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGES.
+  =========================================================================*/
+
+#ifndef __CV_CORNER_DETECTOR__H
+#define __CV_CORNER_DETECTOR__H
+
+#include <iostream>
+#include <vector>
+#include <string>
+
+// Opencv Includes 
+#include "cv.h"
+#include "highgui.h"
+
+#include "cv_corner_cache.h"
+#include "cv_subpix_refiner.h"
+
+class CvCornerDetector{
+
+public:
+
+	/**
+	 * @param corners along width
+	 * @param corners along height
+	 */
+	CvCornerDetector(int, int);
+	~CvCornerDetector();
+
+	//public methods
+
+	/**
+	 * Detect checkerboard corners and refine them to sub-pixel accuracy.
+	 * Images wider than the pyramid width are searched on a downscaled
+	 * pyramid level first and the coarse corners of a found board are
+	 * refined at full size. A miss there falls back to a fast-checked
+	 * search at full resolution.
+	 * @param 8-bit grayscale image
+	 * @param reference to the corner array
+	 * @return true if the checkerboard was found
+	 */
+	bool detectCorners(const cv::Mat &, std::vector<cv::Point2f>*);
+
+	/**
+	 * Same as above, but results are looked up in and added to the
+	 * corner cache, if one is set, using the content of the image file
+	 * @param image file name
+	 * @param 8-bit grayscale image decoded from that file
+	 * @param reference to the corner array
+	 * @return true if the checkerboard was found
+	 */
+	bool detectCorners(const std::string &, const cv::Mat &, 
+					   std::vector<cv::Point2f>*);
+
+	/**
+	 * Read, detect and refine a list of images using all available cores.
+	 * Images are decoded straight to grayscale. With a corner cache set,
+	 * unchanged images are not decoded at all. Results keep the order of
+	 * the file list; the corner array of an image is left empty if the
+	 * image could not be read or the checkerboard was not found.
+	 * @param image file names
+	 * @param reference to the per image corner arrays
+	 * @param reference to the image size
+	 * @return number of images with a detected checkerboard
+	 */
+	int detectCornersBatch(const std::vector<std::string> &,
+						   std::vector<std::vector<cv::Point2f>>*,
+						   cv::Size*);
+
+	/**
+	 * Use a corner cache for file based detection. The cache is not owned.
+	 * It is keyed to the detector configuration, which the setters below
+	 * keep up to date.
+	 * @param pointer to the cache, NULL to disable
+	 */
+	void setCache(CvCornerCache*);
+
+	/**
+	 * Set flags passed to cv::findChessboardCorners
+	 * @param CALIB_CB_* flags
+	 */
+	void setDetectionFlags(int);
+
+	/**
+	 * Set the widest image searched directly. Larger images are halved
+	 * with cv::pyrDown until they fit. 0 disables the coarse search.
+	 * @param width in pixels
+	 */
+	void setPyramidMaxWidth(int);
+
+	/**
+	 * Get the inner corner count of the checkerboard
+	 * @return board size
+	 */
+	cv::Size getBoardSize() const;
+
+	/**
+	 * Hash of everything that decides the corners found in an image: the
+	 * detection revision, board size, flags, pyramid width and both 
+	 * refiners. Cached results are only valid under the same key.
+	 * @return configuration hash
+	 */
+	uint64 getConfigKey() const;
+
+	// changes whenever detectCorners finds different corners for the 
+	// same settings
+	static const int DETECTION_REVISION = 2;
+
+private:
+	//private members
+
+	// checkerboard size in inner corners
+	cv::Size board_size_;
+
+	// flags passed to cv::findChessboardCorners
+	int detection_flags_;
+
+	// widest pyramid level searched by findChessboardCorners
+	int pyramid_max_width_;
+
+	// optional detection cache
+	CvCornerCache *cache_;
+
+	// sub-pixel refinement on the coarse level and at full resolution
+	CvSubPixRefiner coarse_refiner_;
+	CvSubPixRefiner refiner_;
+
+};
+
+#endif //__CV_CORNER_DETECTOR__H
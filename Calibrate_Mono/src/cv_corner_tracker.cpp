@@ -0,0 +1,176 @@
+/*==========================================================================
+
+  Copyright (c) 2014 Uditha L. Jayarathne, ujayarat@robarts.ca
+
+  Use, modification and redistribution of the software, in source or
+  binary forms, are permitted provided that the following terms and
+  conditions are met:
+
+  1) Redistribution of the source code, in verbatim or modified
+  form, must retain the above copyright notice, this license,
+  the following disclaimer, and any notices that refer to this
+  license and/or the following disclaimer.  
+
+  2) Redistribution in binary form must include the above copyright
+  notice, a copy of this license and the following disclaimer
+  in the documentation or with other materials provided with the
+  distribution.
+
+  3) Modified copies of the source code must be clearly marked as such,
+  and must not be misrepresented as verbatim copies of the source code.
+
+  THE COPYRIGHT HOLDERS AND/OR OTHER PARTIES PROVIDE THE SOFTWARE "AS IS"
+  WITHOUT EXPRESSED OR IMPLIED WARRANTY INCLUDING, BUT NOT LIMITED TO,
+  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  PURPOSE.  IN NO EVENT SHALL ANY COPYRIGHT HOLDER OR OTHER PARTY WHO MAY
+  MODIFY AND/OR REDISTRIBUTE THE SOFTWARE UNDER THE TERMS OF THIS LICENSE
+  BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, LOSS OF DATA OR DATA BECOMING INACCURATE
+  OR LOSS OF PROFIT OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF
+  THE USE OR INABILITY TO USE THE SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGES.
+  =========================================================================*/
+
+#include <math.h>
+
+#include "cv_corner_tracker.h"
+
+CvCornerTracker::CvCornerTracker(CvCornerDetector *detector):
+	detector_(detector), 
+	refiner_(cv::Size(5, 5), 
+			 cv::TermCriteria(cv::TermCriteria::EPS+cv::TermCriteria::MAX_ITER, 30, 0.1)),
+	flow_window_(21, 21), flow_levels_(3), 
+	keyframe_interval_(30), frames_since_keyframe_(0), 
+	last_keyframe_(false), n_keyframes_(0), n_tracked_(0){
+
+	board_size_ = detector->getBoardSize();
+}
+
+CvCornerTracker::~CvCornerTracker(){
+
+}
+
+void CvCornerTracker::setKeyframeInterval(int interval){
+	keyframe_interval_ = interval;
+}
+
+void CvCornerTracker::reset(){
+	prev_pyramid_.clear();
+	prev_corners_.clear();
+	frames_since_keyframe_ = 0;
+}
+
+bool CvCornerTracker::lastWasKeyframe() const{
+	return last_keyframe_;
+}
+
+void CvCornerTracker::getCounts(int *n_keyframes, int *n_tracked) const{
+	*n_keyframes = n_keyframes_;
+	*n_tracked = n_tracked_;
+}
+
+bool CvCornerTracker::track(const cv::Mat &frame_gry, std::vector<cv::Point2f> *corners){
+
+	// the pyramid is built once and reused as the previous frame next time
+	std::vector<cv::Mat> pyramid;
+	cv::buildOpticalFlowPyramid(frame_gry, pyramid, flow_window_, flow_levels_);
+
+	bool keyframe_due = prev_corners_.empty() || 
+						(keyframe_interval_ > 0 && frames_since_keyframe_ >= keyframe_interval_);
+
+	if(!keyframe_due && propagate(pyramid, frame_gry.size(), corners)){
+
+		refiner_.refine(frame_gry, corners);
+		frames_since_keyframe_++;
+		last_keyframe_ = false;
+		n_tracked_++;
+	}
+	else{
+		// keyframe, or tracking was lost
+		if(!detector_->detectCorners(frame_gry, corners)){
+			reset();
+			return false;
+		}
+		frames_since_keyframe_ = 0;
+		last_keyframe_ = true;
+		n_keyframes_++;
+	}
+
+	prev_pyramid_.swap(pyramid);
+	prev_corners_ = *corners;
+	return true;
+}
+
+bool CvCornerTracker::propagate(const std::vector<cv::Mat> &pyramid, cv::Size img_size, 
+								std::vector<cv::Point2f> *corners){
+
+	std::vector<uchar> status;
+	std::vector<float> error;
+	cv::calcOpticalFlowPyrLK(prev_pyramid_, pyramid, prev_corners_, *corners, 
+							 status, error, flow_window_, flow_levels_, 
+							 cv::TermCriteria(cv::TermCriteria::COUNT+cv::TermCriteria::EPS, 
+											  30, 0.01));
+
+	// every corner must survive, inside the image
+	for(size_t i=0; i<status.size(); i++){
+		const cv::Point2f &p = (*corners)[i];
+		if(!status[i] || p.x < 0 || p.y < 0 || 
+		   p.x >= img_size.width || p.y >= img_size.height)
+			return false;
+	}
+
+	return checkTopology(*corners);
+}
+
+bool CvCornerTracker::checkTopology(const std::vector<cv::Point2f> &corners){
+
+	int w = board_size_.width, h = board_size_.height;
+	if((int)corners.size() != w*h)
+		return false;
+
+	// consecutive steps along a row or column may change length and 
+	// direction only as much as perspective allows
+	const float max_ratio = 2.f, min_cos = 0.8f, min_step = 2.f;
+
+	for(int pass=0; pass<2; pass++){
+		// rows on the first pass, columns on the second
+		int n_lines = pass == 0 ? h : w, n_steps = pass == 0 ? w - 1 : h - 1;
+		for(int l=0; l<n_lines; l++){
+			cv::Point2f prev_step;
+			float prev_len = 0;
+			for(int s=0; s<n_steps; s++){
+				int a = pass == 0 ? l*w + s : s*w + l;
+				int b = pass == 0 ? a + 1 : a + w;
+				cv::Point2f step = corners[b] - corners[a];
+				float len = sqrt(step.x*step.x + step.y*step.y);
+				if(len < min_step)
+					return false;
+
+				if(s > 0){
+					float ratio = len/prev_len;
+					float cos_angle = (step.x*prev_step.x + step.y*prev_step.y)/(len*prev_len);
+					if(ratio > max_ratio || ratio < 1/max_ratio || cos_angle < min_cos)
+						return false;
+				}
+				prev_step = step;
+				prev_len = len;
+			}
+		}
+	}
+
+	// all cells keep the orientation of the first one
+	float orientation = 0;
+	for(int y=0; y<h-1; y++){
+		for(int x=0; x<w-1; x++){
+			cv::Point2f u = corners[y*w + x + 1] - corners[y*w + x];
+			cv::Point2f v = corners[(y + 1)*w + x] - corners[y*w + x];
+			float cross = u.x*v.y - u.y*v.x;
+			if(orientation == 0)
+				orientation = cross;
+			else if(cross*orientation <= 0)
+				return false;
+		}
+	}
+
+	return true;
+}
@@ -0,0 +1,139 @@
+/*==========================================================================
+
+  Copyright (c) 2014 Uditha L. Jayarathne, ujayarat@robarts.ca
+
+  Use, modification and redistribution of the software, in source or
+  binary forms, are permitted provided that the following terms and
+  conditions are met:
+
+  1) Redistribution of the source code, in verbatim or modified
+  form, must retain the above copyright notice, this license,
+  the following disclaimer, and any notices that refer to this
+  license and/or the following disclaimer.  
+
+  2) Redistribution in binary form must include the above copyright
+  notice, a copy of this license and the following disclaimer
+  in the documentation or with other materials provided with the
+  distribution.
+
+  3) Modified copies of the source code must be clearly marked as such,
+  and must not be misrepresented as verbatim copies of the source code.
+
+  THE COPYRIGHT HOLDERS AND/OR OTHER PARTIES PROVIDE THE SOFTWARE "AS IS"
+  WITHOUT EXPRESSED OR IMPLIED WARRANTY INCLUDING, BUT NOT LIMITED TO,
+  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  PURPOSE.  IN NO EVENT SHALL ANY COPYRIGHT HOLDER OR OTHER PARTY WHO MAY
+  MODIFY AND/OR REDISTRIBUTE THE SOFTWARE UNDER THE TERMS OF THIS LICENSE
+  BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, LOSS OF DATA OR DATA BECOMING INACCURATE
+  OR LOSS OF PROFIT OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF
+  THE USE OR INABILITY TO USE THE SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGES.
+  =========================================================================*/
+
+#ifndef __CV_CORNER_TRACKER__H
+#define __CV_CORNER_TRACKER__H
+
+#include <iostream>
+#include <vector>
+
+// Opencv Includes 
+#include "cv.h"
+
+#include "cv_corner_detector.h"
+#include "cv_subpix_refiner.h"
+
+/**
+ * Follows a checkerboard through consecutive video frames. The full 
+ * detector runs on keyframes only; in between, the previous corners are
+ * propagated with pyramidal Lucas-Kanade optical flow, the grid topology
+ * is verified and the corners are refined to sub-pixel accuracy. Any
+ * tracking failure falls back to full detection on the same frame.
+ */
+class CvCornerTracker{
+
+public:
+
+	/**
+	 * @param corner detector, not owned
+	 */
+	CvCornerTracker(CvCornerDetector*);
+	~CvCornerTracker();
+
+	//public methods
+
+	/**
+	 * Set the number of frames after which the full detector runs again
+	 * even if tracking succeeds, 0 for never
+	 * @param keyframe interval
+	 */
+	void setKeyframeInterval(int);
+
+	/**
+	 * Find the board in the next frame of the sequence
+	 * @param 8-bit grayscale frame
+	 * @param reference to the corners
+	 * @return true if the board was tracked or detected
+	 */
+	bool track(const cv::Mat&, std::vector<cv::Point2f>*);
+
+	/**
+	 * Forget the previous frame, the next frame is a keyframe
+	 */
+	void reset();
+
+	/**
+	 * Whether the last successful track came from the full detector
+	 */
+	bool lastWasKeyframe() const;
+
+	/**
+	 * Number of frames found by the full detector and by tracking
+	 * @param reference to the keyframe count
+	 * @param reference to the tracked frame count
+	 */
+	void getCounts(int*, int*) const;
+
+private:
+	//private methods
+
+	/**
+	 * Propagate the previous corners into the frame
+	 * @param pyramid of the frame
+	 * @param frame size
+	 * @param reference to the tracked corners
+	 * @return false if any corner was lost or the grid is broken
+	 */
+	bool propagate(const std::vector<cv::Mat>&, cv::Size, std::vector<cv::Point2f>*);
+
+	/**
+	 * Check that the corners still form the board grid: neighbouring
+	 * spacing changes smoothly along rows and columns and no cell folds
+	 * @param corners
+	 * @return true for a plausible grid
+	 */
+	bool checkTopology(const std::vector<cv::Point2f>&);
+
+	//private members
+
+	CvCornerDetector *detector_;
+	CvSubPixRefiner refiner_;
+	cv::Size board_size_;
+
+	// optical flow
+	cv::Size flow_window_;
+	int flow_levels_;
+
+	int keyframe_interval_;
+	int frames_since_keyframe_;
+	bool last_keyframe_;
+	int n_keyframes_;
+	int n_tracked_;
+
+	// previous frame
+	std::vector<cv::Mat> prev_pyramid_;
+	std::vector<cv::Point2f> prev_corners_;
+
+};
+
+#endif //__CV_CORNER_TRACKER__H
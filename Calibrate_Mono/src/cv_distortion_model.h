@@ -0,0 +1,187 @@
+/*==========================================================================
+
+  Copyright (c) 2014 Uditha L. Jayarathne, ujayarat@robarts.ca
+
+  Use, modification and redistribution of the software, in source or
+  binary forms, are permitted provided that the following terms and
+  conditions are met:
+
+  1) Redistribution of the source code, in verbatim or modified
+  form, must retain the above copyright notice, this license,
+  the following disclaimer, and any notices that refer to this
+  license and/or the following disclaimer.  
+
+  2) Redistribution in binary form must include the above copyright
+  notice, a copy of this license and the following disclaimer
+  in the documentation or with other materials provided with the
+  distribution.
+
+  3) Modified copies of the source code must be clearly marked as such,
+  and must not be misrepresented as verbatim copies of the source code.
+
+  THE COPYRIGHT HOLDERS AND/OR OTHER PARTIES PROVIDE THE SOFTWARE "AS IS"
+  WITHOUT EXPRESSED OR IMPLIED WARRANTY INCLUDING, BUT NOT LIMITED TO,
+  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  PURPOSE.  IN NO EVENT SHALL ANY COPYRIGHT HOLDER OR OTHER PARTY WHO MAY
+  MODIFY AND/OR REDISTRIBUTE THE SOFTWARE UNDER THE TERMS OF THIS LICENSE
+  BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, LOSS OF DATA OR DATA BECOMING INACCURATE
+  OR LOSS OF PROFIT OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF
+  THE USE OR INABILITY TO USE THE SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGES.
+  =========================================================================*/
+
+#ifndef __CV_DISTORTION_MODEL__H
+#define __CV_DISTORTION_MODEL__H
+
+/**
+ * Lens distortion with the parameter count fixed at compile time. N is 0
+ * (pinhole), 4 (k1 k2 p1 p2), 5 (+k3) or 8 (+k4 k5 k6, rational), with
+ * the coefficients in OpenCV order. Terms a model does not have are
+ * removed by the compiler, so kernels templated on N inline completely
+ * and have no per-point branches. Select N once per call with a switch
+ * on the runtime parameter count.
+ */
+template<int N>
+struct CvDistortionModel{
+
+	enum{
+		N_PARAMS = N,
+		DISTORTED = (N > 0),
+		HAS_K3 = (N > 4),
+		RATIONAL = (N > 5)
+	};
+
+	/**
+	 * Distort a normalized point
+	 * @param N coefficients
+	 * @param undistorted x
+	 * @param undistorted y
+	 * @param reference to distorted x
+	 * @param reference to distorted y
+	 */
+	template<typename T>
+	static inline void distort(const T *k, T x, T y, T *xd, T *yd){
+
+		if(!DISTORTED){
+			*xd = x; *yd = y;
+			return;
+		}
+
+		T r2 = x*x + y*y;
+		T radial = radialTerm(k, r2);
+		*xd = x*radial + 2*k[2]*x*y + k[3]*(r2 + 2*x*x);
+		*yd = y*radial + k[2]*(r2 + 2*y*y) + 2*k[3]*x*y;
+	}
+
+	/**
+	 * Undistort a normalized point by fixed point iteration
+	 * @param N coefficients
+	 * @param distorted x
+	 * @param distorted y
+	 * @param number of iterations
+	 * @param reference to undistorted x
+	 * @param reference to undistorted y
+	 */
+	template<typename T>
+	static inline void undistort(const T *k, T xd, T yd, int iterations, T *x, T *y){
+
+		T ux = xd, uy = yd;
+		if(DISTORTED){
+			for(int it=0; it<iterations; it++){
+				T r2 = ux*ux + uy*uy;
+				T inv_radial = 1/radialTerm(k, r2);
+				T dx = 2*k[2]*ux*uy + k[3]*(r2 + 2*ux*ux);
+				T dy = k[2]*(r2 + 2*uy*uy) + 2*k[3]*ux*uy;
+				ux = (xd - dx)*inv_radial;
+				uy = (yd - dy)*inv_radial;
+			}
+		}
+		*x = ux; *y = uy;
+	}
+
+	/**
+	 * Distort a normalized point and differentiate
+	 * @param N coefficients
+	 * @param undistorted x
+	 * @param undistorted y
+	 * @param reference to distorted x
+	 * @param reference to distorted y
+	 * @param 2x2 row-major jacobian of (xd, yd) wrt (x, y)
+	 * @param 2xN row-major jacobian of (xd, yd) wrt the coefficients
+	 */
+	static inline void jacobian(const double *k, double x, double y, 
+								double *xd, double *yd, 
+								double *d_point, double *d_params){
+
+		if(!DISTORTED){
+			*xd = x; *yd = y;
+			d_point[0] = 1; d_point[1] = 0;
+			d_point[2] = 0; d_point[3] = 1;
+			return;
+		}
+
+		double r2 = x*x + y*y, r4 = r2*r2, r6 = r4*r2;
+		double xy = x*y;
+
+		// radial term a/b and its derivative wrt r2
+		double a = 1 + k[0]*r2 + k[1]*r4;
+		double da = k[0] + 2*k[1]*r2;
+		if(HAS_K3){
+			a += k[4]*r6;
+			da += 3*k[4]*r4;
+		}
+		double ib = 1, radial = a, dradial = da;
+		if(RATIONAL){
+			double b = 1 + k[5]*r2 + k[6]*r4 + k[7]*r6;
+			double db = k[5] + 2*k[6]*r2 + 3*k[7]*r4;
+			ib = 1/b;
+			radial = a*ib;
+			dradial = (da*b - a*db)*ib*ib;
+		}
+
+		*xd = x*radial + 2*k[2]*xy + k[3]*(r2 + 2*x*x);
+		*yd = y*radial + k[2]*(r2 + 2*y*y) + 2*k[3]*xy;
+
+		d_point[0] = radial + 2*x*x*dradial + 2*k[2]*y + 6*k[3]*x;
+		d_point[1] = 2*xy*dradial + 2*k[2]*x + 2*k[3]*y;
+		d_point[2] = d_point[1];
+		d_point[3] = radial + 2*y*y*dradial + 6*k[2]*y + 2*k[3]*x;
+
+		double *du = d_params, *dv = d_params + N;
+		double xb = x*ib, yb = y*ib;
+		du[0] = xb*r2;			dv[0] = yb*r2;
+		du[1] = xb*r4;			dv[1] = yb*r4;
+		du[2] = 2*xy;			dv[2] = r2 + 2*y*y;
+		du[3] = r2 + 2*x*x;		dv[3] = 2*xy;
+		if(HAS_K3){
+			du[4] = xb*r6;		dv[4] = yb*r6;
+		}
+		if(RATIONAL){
+			double xr = -xb*radial, yr = -yb*radial;
+			du[5] = xr*r2;		dv[5] = yr*r2;
+			du[6] = xr*r4;		dv[6] = yr*r4;
+			du[7] = xr*r6;		dv[7] = yr*r6;
+		}
+	}
+
+	/**
+	 * Radial factor (1 + k1 r^2 + k2 r^4 + k3 r^6)/(1 + k4 r^2 + k5 r^4 + k6 r^6)
+	 * @param N coefficients
+	 * @param r^2
+	 */
+	template<typename T>
+	static inline T radialTerm(const T *k, T r2){
+
+		if(!DISTORTED)
+			return 1;
+
+		T radial = HAS_K3 ? k[1] + r2*k[4] : k[1];
+		radial = 1 + r2*(k[0] + r2*radial);
+		if(RATIONAL)
+			radial /= 1 + r2*(k[5] + r2*(k[6] + r2*k[7]));
+		return radial;
+	}
+};
+
+#endif //__CV_DISTORTION_MODEL__H
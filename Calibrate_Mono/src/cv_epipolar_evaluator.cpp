@@ -0,0 +1,283 @@
+/*==========================================================================
+
+  Copyright (c) 2014 Uditha L. Jayarathne, ujayarat@robarts.ca
+
+  Use, modification and redistribution of the software, in source or
+  binary forms, are permitted provided that the following terms and
+  conditions are met:
+
+  1) Redistribution of the source code, in verbatim or modified
+  form, must retain the above copyright notice, this license,
+  the following disclaimer, and any notices that refer to this
+  license and/or the following disclaimer.  
+
+  2) Redistribution in binary form must include the above copyright
+  notice, a copy of this license and the following disclaimer
+  in the documentation or with other materials provided with the
+  distribution.
+
+  3) Modified copies of the source code must be clearly marked as such,
+  and must not be misrepresented as verbatim copies of the source code.
+
+  THE COPYRIGHT HOLDERS AND/OR OTHER PARTIES PROVIDE THE SOFTWARE "AS IS"
+  WITHOUT EXPRESSED OR IMPLIED WARRANTY INCLUDING, BUT NOT LIMITED TO,
+  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  PURPOSE.  IN NO EVENT SHALL ANY COPYRIGHT HOLDER OR OTHER PARTY WHO MAY
+  MODIFY AND/OR REDISTRIBUTE THE SOFTWARE UNDER THE TERMS OF THIS LICENSE
+  BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, LOSS OF DATA OR DATA BECOMING INACCURATE
+  OR LOSS OF PROFIT OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF
+  THE USE OR INABILITY TO USE THE SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGES.
+  =========================================================================*/
+
+#include <math.h>
+#include <algorithm>
+
+#include "cv_epipolar_evaluator.h"
+
+// Loop body run by cv::parallel_for_. Each index is one stereo pair.
+class EvaluatePairsBody : public cv::ParallelLoopBody{
+
+public:
+	EvaluatePairsBody(const CvEpipolarEvaluator *evaluator, 
+					  const std::vector<std::vector<cv::Point2f>> *left_corners, 
+					  const std::vector<std::vector<cv::Point2f>> *right_corners, 
+					  std::vector<CvEpipolarEvaluator::PairStats> *stats) :
+		evaluator_(evaluator), left_corners_(left_corners), 
+		right_corners_(right_corners), stats_(stats){}
+
+	void operator()(const cv::Range &range) const{
+
+		for(int i=range.start; i<range.end; i++)
+			(*stats_)[i] = evaluator_->evaluatePair((*left_corners_)[i], (*right_corners_)[i]);
+	}
+
+private:
+	const CvEpipolarEvaluator *evaluator_;
+	const std::vector<std::vector<cv::Point2f>> *left_corners_;
+	const std::vector<std::vector<cv::Point2f>> *right_corners_;
+	std::vector<CvEpipolarEvaluator::PairStats> *stats_;
+};
+
+CvEpipolarEvaluator::CvEpipolarEvaluator(){
+
+	for(int i=0; i<4; i++)
+		left_norm_[i] = right_norm_[i] = 0.f;
+	for(int i=0; i<9; i++)
+		f_norm_[i] = 0.f;
+	for(int i=0; i<6; i++)
+		left_h_[i] = right_h_[i] = 0.f;
+}
+
+CvEpipolarEvaluator::~CvEpipolarEvaluator(){
+
+}
+
+bool CvEpipolarEvaluator::setCameras(const cv::Mat &left_intrinsics, 
+									 const cv::Mat &left_distortion_params, 
+									 const cv::Mat &right_intrinsics, 
+									 const cv::Mat &right_distortion_params, 
+									 cv::Size img_size){
+
+	if(!left_undistorter_.setCamera(left_intrinsics, left_distortion_params) ||
+		!right_undistorter_.setCamera(right_intrinsics, right_distortion_params))
+		return false;
+
+	// seeded iterations stay within a few thousandths of a pixel
+	left_undistorter_.buildSeedGrid(img_size, 32);
+	right_undistorter_.buildSeedGrid(img_size, 32);
+
+	left_intrinsics.convertTo(left_intrinsics_, CV_64F);
+	right_intrinsics.convertTo(right_intrinsics_, CV_64F);
+	prepare();
+
+	return true;
+}
+
+void CvEpipolarEvaluator::setStereo(const cv::Mat &fundamental, 
+									const cv::Mat &left_rect, const cv::Mat &left_proj, 
+									const cv::Mat &right_rect, const cv::Mat &right_proj){
+
+	fundamental.convertTo(fundamental_, CV_64F);
+	left_rect.convertTo(left_rect_, CV_64F);
+	left_proj.convertTo(left_proj_, CV_64F);
+	right_rect.convertTo(right_rect_, CV_64F);
+	right_proj.convertTo(right_proj_, CV_64F);
+	prepare();
+}
+
+void CvEpipolarEvaluator::prepare(){
+
+	if(left_intrinsics_.empty() || fundamental_.empty())
+		return;
+
+	// x_pixel = N^-1 x_norm, with one focal length so distances keep scale
+	const cv::Mat *K[2] = {&left_intrinsics_, &right_intrinsics_};
+	float *norm[2] = {left_norm_, right_norm_};
+	cv::Mat N_inv[2];
+	for(int e=0; e<2; e++){
+		double f = K[e]->at<double>(0, 0);
+		double cx = K[e]->at<double>(0, 2), cy = K[e]->at<double>(1, 2);
+		N_inv[e] = (cv::Mat_<double>(3, 3) << f, 0, cx, 0, f, cy, 0, 0, 1);
+
+		norm[e][0] = (float)cx;
+		norm[e][1] = (float)cy;
+		norm[e][2] = (float)(1.0/f);
+		norm[e][3] = (float)f;
+	}
+
+	// F only matters up to scale
+	cv::Mat F = N_inv[1].t()*fundamental_*N_inv[0];
+	double scale = 1.0/cv::norm(F);
+	for(int i=0; i<9; i++)
+		f_norm_[i] = (float)(scale*F.at<double>(i/3, i%3));
+
+	// Undistorted pixels of the own camera to rectified pixels, as 
+	// cv::undistortPoints with R and P does from normalized coordinates
+	cv::Mat H_l = left_proj_.colRange(0, 3)*left_rect_*left_intrinsics_.inv()*N_inv[0];
+	cv::Mat H_r = right_proj_.colRange(0, 3)*right_rect_*right_intrinsics_.inv()*N_inv[1];
+	for(int i=0; i<6; i++){
+		left_h_[i] = (float)H_l.at<double>(1 + i/3, i%3);
+		right_h_[i] = (float)H_r.at<double>(1 + i/3, i%3);
+	}
+}
+
+void CvEpipolarEvaluator::evaluatePoints(const float *ul, const float *vl, 
+										 const float *ur, const float *vr, int n, 
+										 float *epipolar, float *row) const{
+
+	const float *F = f_norm_, *hl = left_h_, *hr = right_h_;
+
+	// each line distance is scaled back to the pixels of its own image
+	const float half_fl = 0.5f*left_norm_[3], half_fr = 0.5f*right_norm_[3];
+	int i = 0;
+
+#if CV_SSE2
+	const __m128 cxl = _mm_set1_ps(left_norm_[0]), cyl = _mm_set1_ps(left_norm_[1]);
+	const __m128 ifl = _mm_set1_ps(left_norm_[2]);
+	const __m128 cxr = _mm_set1_ps(right_norm_[0]), cyr = _mm_set1_ps(right_norm_[1]);
+	const __m128 ifr = _mm_set1_ps(right_norm_[2]);
+	const __m128 hfl = _mm_set1_ps(half_fl), hfr = _mm_set1_ps(half_fr);
+	const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+
+	for(; i <= n-4; i += 4){
+		__m128 xl = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(ul+i), cxl), ifl);
+		__m128 yl = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(vl+i), cyl), ifl);
+		__m128 xr = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(ur+i), cxr), ifr);
+		__m128 yr = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(vr+i), cyr), ifr);
+
+		// epipolar line of the left point in the right image, F x_l
+		__m128 a1 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(F[0]), xl), 
+										  _mm_mul_ps(_mm_set1_ps(F[1]), yl)), _mm_set1_ps(F[2]));
+		__m128 b1 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(F[3]), xl), 
+										  _mm_mul_ps(_mm_set1_ps(F[4]), yl)), _mm_set1_ps(F[5]));
+		__m128 c1 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(F[6]), xl), 
+										  _mm_mul_ps(_mm_set1_ps(F[7]), yl)), _mm_set1_ps(F[8]));
+
+		// epipolar line of the right point in the left image, F^T x_r
+		__m128 a2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(F[0]), xr), 
+										  _mm_mul_ps(_mm_set1_ps(F[3]), yr)), _mm_set1_ps(F[6]));
+		__m128 b2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(F[1]), xr), 
+										  _mm_mul_ps(_mm_set1_ps(F[4]), yr)), _mm_set1_ps(F[7]));
+
+		// x_r^T F x_l
+		__m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(xr, a1), _mm_mul_ps(yr, b1)), c1);
+		r = _mm_and_ps(r, abs_mask);
+
+		__m128 n1 = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(a1, a1), _mm_mul_ps(b1, b1)));
+		__m128 n2 = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(a2, a2), _mm_mul_ps(b2, b2)));
+		__m128 d = _mm_mul_ps(r, _mm_add_ps(_mm_div_ps(hfr, n1), _mm_div_ps(hfl, n2)));
+		_mm_storeu_ps(epipolar+i, d);
+
+		// rectified rows
+		__m128 num_l = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(hl[0]), xl), 
+											 _mm_mul_ps(_mm_set1_ps(hl[1]), yl)), _mm_set1_ps(hl[2]));
+		__m128 den_l = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(hl[3]), xl), 
+											 _mm_mul_ps(_mm_set1_ps(hl[4]), yl)), _mm_set1_ps(hl[5]));
+		__m128 num_r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(hr[0]), xr), 
+											 _mm_mul_ps(_mm_set1_ps(hr[1]), yr)), _mm_set1_ps(hr[2]));
+		__m128 den_r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(hr[3]), xr), 
+											 _mm_mul_ps(_mm_set1_ps(hr[4]), yr)), _mm_set1_ps(hr[5]));
+		_mm_storeu_ps(row+i, _mm_sub_ps(_mm_div_ps(num_l, den_l), _mm_div_ps(num_r, den_r)));
+	}
+#endif
+
+	for(; i<n; i++){
+		float xl = (ul[i] - left_norm_[0])*left_norm_[2];
+		float yl = (vl[i] - left_norm_[1])*left_norm_[2];
+		float xr = (ur[i] - right_norm_[0])*right_norm_[2];
+		float yr = (vr[i] - right_norm_[1])*right_norm_[2];
+
+		float a1 = F[0]*xl + F[1]*yl + F[2];
+		float b1 = F[3]*xl + F[4]*yl + F[5];
+		float c1 = F[6]*xl + F[7]*yl + F[8];
+		float a2 = F[0]*xr + F[3]*yr + F[6];
+		float b2 = F[1]*xr + F[4]*yr + F[7];
+		float r = fabsf(xr*a1 + yr*b1 + c1);
+
+		epipolar[i] = r*(half_fr/sqrtf(a1*a1 + b1*b1) + half_fl/sqrtf(a2*a2 + b2*b2));
+		row[i] = (hl[0]*xl + hl[1]*yl + hl[2])/(hl[3]*xl + hl[4]*yl + hl[5]) - 
+				 (hr[0]*xr + hr[1]*yr + hr[2])/(hr[3]*xr + hr[4]*yr + hr[5]);
+	}
+}
+
+CvEpipolarEvaluator::PairStats CvEpipolarEvaluator::evaluatePair(const std::vector<cv::Point2f> &left_corners, 
+																 const std::vector<cv::Point2f> &right_corners) const{
+
+	PairStats stats;
+	stats.n_points = 0;
+	stats.epipolar_mean = stats.epipolar_rms = stats.epipolar_max = 0.f;
+	stats.row_mean = stats.row_rms = stats.row_max = 0.f;
+
+	int n = left_corners.size();
+	if(n == 0 || right_corners.size() != left_corners.size())
+		return stats;
+
+	// structure of arrays, undistorted in place
+	std::vector<float> buffer(6*n);
+	float *ul = &buffer[0], *vl = ul + n, *ur = vl + n, *vr = ur + n;
+	float *epipolar = vr + n, *row = epipolar + n;
+	for(int i=0; i<n; i++){
+		ul[i] = left_corners[i].x;
+		vl[i] = left_corners[i].y;
+		ur[i] = right_corners[i].x;
+		vr[i] = right_corners[i].y;
+	}
+	left_undistorter_.undistortRange(ul, vl, n, ul, vl);
+	right_undistorter_.undistortRange(ur, vr, n, ur, vr);
+
+	evaluatePoints(ul, vl, ur, vr, n, epipolar, row);
+
+	double sum_e = 0, sq_e = 0, sum_r = 0, sq_r = 0;
+	for(int i=0; i<n; i++){
+		sum_e += epipolar[i];
+		sq_e += epipolar[i]*epipolar[i];
+		sum_r += row[i];
+		sq_r += row[i]*row[i];
+		stats.epipolar_max = std::max(stats.epipolar_max, epipolar[i]);
+		stats.row_max = std::max(stats.row_max, fabsf(row[i]));
+	}
+
+	stats.n_points = n;
+	stats.epipolar_mean = (float)(sum_e/n);
+	stats.epipolar_rms = (float)sqrt(sq_e/n);
+	stats.row_mean = (float)(sum_r/n);
+	stats.row_rms = (float)sqrt(sq_r/n);
+
+	return stats;
+}
+
+void CvEpipolarEvaluator::evaluate(const std::vector<std::vector<cv::Point2f>> &left_corners, 
+								   const std::vector<std::vector<cv::Point2f>> &right_corners, 
+								   std::vector<PairStats> *stats) const{
+
+	int n_pairs = std::min(left_corners.size(), right_corners.size());
+	stats->resize(n_pairs);
+	if(n_pairs == 0)
+		return;
+
+	// a pair is a few dozen corners, so let the scheduler group them
+	cv::parallel_for_(cv::Range(0, n_pairs), 
+						EvaluatePairsBody(this, &left_corners, &right_corners, stats));
+}
@@ -0,0 +1,160 @@
+/*==========================================================================
+
+  Copyright (c) 2014 Uditha L. Jayarathne, ujayarat@robarts.ca
+
+  Use, modification and redistribution of the software, in source or
+  binary forms, are permitted provided that the following terms and
+  conditions are met:
+
+  1) Redistribution of the source code, in verbatim or modified
+  form, must retain the above copyright notice, this license,
+  the following disclaimer, and any notices that refer to this
+  license and/or the following disclaimer.  
+
+  2) Redistribution in binary form must include the above copyright
+  notice, a copy of this license and the following disclaimer
+  in the documentation or with other materials provided with the
+  distribution.
+
+  3) Modified copies of the source code must be clearly marked as such,
+  and must not be misrepresented as verbatim copies of the source code.
+
+  THE COPYRIGHT HOLDERS AND/OR OTHER PARTIES PROVIDE THE SOFTWARE "AS IS"
+  WITHOUT EXPRESSED OR IMPLIED WARRANTY INCLUDING, BUT NOT LIMITED TO,
+  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  PURPOSE.  IN NO EVENT SHALL ANY COPYRIGHT HOLDER OR OTHER PARTY WHO MAY
+  MODIFY AND/OR REDISTRIBUTE THE SOFTWARE UNDER THE TERMS OF THIS LICENSE
+  BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, LOSS OF DATA OR DATA BECOMING INACCURATE
+  OR LOSS OF PROFIT OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF
+  THE USE OR INABILITY TO USE THE SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGES.
+  =========================================================================*/
+
+#ifndef __CV_EPIPOLAR_EVALUATOR__H
+#define __CV_EPIPOLAR_EVALUATOR__H
+
+#include <iostream>
+#include <vector>
+
+// Opencv Includes 
+#include "cv.h"
+
+#include "cv_point_undistorter.h"
+
+/**
+ * Measures how well a stereo calibration explains detected corner pairs.
+ * Corners are undistorted with CvPointUndistorter, then a kernel computes
+ * for several corners per SIMD register the symmetric epipolar distance 
+ * under F and the row disparity left after rectification with R1, P1 and
+ * R2, P2. Both are zero for a perfect calibration and noise-free corners.
+ * Points are moved to coordinates centred on the principal point and 
+ * scaled by the focal length first so single precision is sufficient.
+ */
+class CvEpipolarEvaluator{
+
+public:
+
+	// Errors of one pair, in pixels
+	typedef struct PairStats{
+		int n_points;			// corners evaluated
+		float epipolar_mean;	// symmetric epipolar distance
+		float epipolar_rms;
+		float epipolar_max;
+		float row_mean;			// signed row disparity, left minus right
+		float row_rms;
+		float row_max;			// largest absolute row disparity
+	} PairStats;
+
+	CvEpipolarEvaluator();
+	~CvEpipolarEvaluator();
+
+	//public methods
+
+	/**
+	 * Set the intrinsics of both cameras
+	 * @param left camera matrix
+	 * @param left distortion params, empty or 4, 5 or 8 elements
+	 * @param right camera matrix
+	 * @param right distortion params, empty or 4, 5 or 8 elements
+	 * @param image size
+	 * @return false for an unsupported distortion model
+	 */
+	bool setCameras(const cv::Mat &, const cv::Mat &, const cv::Mat &, const cv::Mat &, 
+					cv::Size);
+
+	/**
+	 * Set the stereo calibration, as written by the stereo calibration 
+	 * tools. May be called before or after setCameras.
+	 * @param fundamental matrix
+	 * @param left rectification transform
+	 * @param left projection matrix
+	 * @param right rectification transform
+	 * @param right projection matrix
+	 */
+	void setStereo(const cv::Mat &, const cv::Mat &, const cv::Mat &, 
+				   const cv::Mat &, const cv::Mat &);
+
+	/**
+	 * Evaluate many pairs in parallel. Pairs whose corner counts differ 
+	 * or are empty get zero points.
+	 * @param distorted left corners of every pair
+	 * @param distorted right corners of every pair
+	 * @param reference to the errors of every pair
+	 */
+	void evaluate(const std::vector<std::vector<cv::Point2f>> &, 
+				  const std::vector<std::vector<cv::Point2f>> &, 
+				  std::vector<PairStats> *) const;
+
+	/**
+	 * Errors of single points on the calling thread
+	 * @param undistorted left u, v
+	 * @param undistorted right u, v
+	 * @param number of points
+	 * @param reference to the symmetric epipolar distances
+	 * @param reference to the row disparities
+	 */
+	void evaluatePoints(const float *, const float *, const float *, const float *, 
+						int, float *, float *) const;
+
+	/**
+	 * Undistort the corners of one pair and summarize their errors
+	 * @param distorted left corners
+	 * @param distorted right corners
+	 * @return errors of the pair
+	 */
+	PairStats evaluatePair(const std::vector<cv::Point2f> &, 
+						   const std::vector<cv::Point2f> &) const;
+
+private:
+	//private methods
+
+	/**
+	 * Fold the normalization into F and the rectifying homographies once 
+	 * both the cameras and the stereo calibration are known
+	 */
+	void prepare();
+
+	//private members
+
+	CvPointUndistorter left_undistorter_;
+	CvPointUndistorter right_undistorter_;
+
+	// camera matrices and stereo calibration as given
+	cv::Mat left_intrinsics_, right_intrinsics_;
+	cv::Mat fundamental_, left_rect_, left_proj_, right_rect_, right_proj_;
+
+	// cx, cy, 1/f, f of each camera
+	float left_norm_[4];
+	float right_norm_[4];
+
+	// F in normalized coordinates, unit Frobenius norm, row-major
+	float f_norm_[9];
+
+	// rows 2 and 3 of the rectifying homographies in normalized coordinates
+	float left_h_[6];
+	float right_h_[6];
+
+};
+
+#endif //__CV_EPIPOLAR_EVALUATOR__H
@@ -0,0 +1,322 @@
+/*==========================================================================
+
+  Copyright (c) 2014 Uditha L. Jayarathne, ujayarat@robarts.ca
+
+  Use, modification and redistribution of the software, in source or
+  binary forms, are permitted provided that the following terms and
+  conditions are met:
+
+  1) Redistribution of the source code, in verbatim or modified
+  form, must retain the above copyright notice, this license,
+  the following disclaimer, and any notices that refer to this
+  license and/or the following disclaimer.  
+
+  2) Redistribution in binary form must include the above copyright
+  notice, a copy of this license and the following disclaimer
+  in the documentation or with other materials provided with the
+  distribution.
+
+  3) Modified copies of the source code must be clearly marked as such,
+  and must not be misrepresented as verbatim copies of the source code.
+
+  THE COPYRIGHT HOLDERS AND/OR OTHER PARTIES PROVIDE THE SOFTWARE "AS IS"
+  WITHOUT EXPRESSED OR IMPLIED WARRANTY INCLUDING, BUT NOT LIMITED TO,
+  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  PURPOSE.  IN NO EVENT SHALL ANY COPYRIGHT HOLDER OR OTHER PARTY WHO MAY
+  MODIFY AND/OR REDISTRIBUTE THE SOFTWARE UNDER THE TERMS OF THIS LICENSE
+  BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, LOSS OF DATA OR DATA BECOMING INACCURATE
+  OR LOSS OF PROFIT OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF
+  THE USE OR INABILITY TO USE THE SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGES.
+  =========================================================================*/
+
+#include <float.h>
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+#include "cv_lm_calib_solver.h"
+
+// Intrinsics are packed as fx, fy, cx, cy followed by the distortion params
+// in OpenCV order k1, k2, p1, p2[, k3[, k4, k5, k6]].
+static const int NI = CvLMCalibSolver::MAX_INTRINSICS;
+static const int NP = CvLMCalibSolver::POSE_PARAMS;
+
+typedef CvLMCalibSolver::SchurBlocks<NI> ViewBlocks;
+
+/**
+ * Project one point and optionally compute the jacobians.
+ * @param packed intrinsics
+ * @param row-major rotation matrix
+ * @param 3x9 jacobian of the rotation matrix wrt the rotation vector
+ * @param translation
+ * @param object point
+ * @param projected point (u, v)
+ * @param 2 x (4+N_DIST) row-major jacobian wrt the intrinsics, or NULL
+ * @param 2 x 6 row-major jacobian wrt rotation vector and translation
+ */
+template<int N_DIST>
+static inline void projectPoint(const double *intr, 
+								const double *R, const double *dRdr, const double *t, 
+								const cv::Point3f &point, double *uv, 
+								double *J_intr, double *J_pose){
+
+	double X = point.x, Y = point.y, Z = point.z;
+	double Xc[3] = { R[0]*X + R[1]*Y + R[2]*Z + t[0],
+					 R[3]*X + R[4]*Y + R[5]*Z + t[1],
+					 R[6]*X + R[7]*Y + R[8]*Z + t[2] };
+
+	double J_point[6];
+	CvLMCalibSolver::projectCamera<N_DIST>(intr, Xc, uv, J_intr, J_point);
+	if(!J_intr)
+		return;
+
+	// through the rotation and translation to the pose
+	const double *du = J_point, *dv = J_point + 3;
+	double *Pu = J_pose, *Pv = J_pose + NP;
+	for(int m=0; m<3; m++){
+		const double *dR = dRdr + 9*m;
+		double dX = dR[0]*X + dR[1]*Y + dR[2]*Z;
+		double dY = dR[3]*X + dR[4]*Y + dR[5]*Z;
+		double dZ = dR[6]*X + dR[7]*Y + dR[8]*Z;
+		Pu[m] = du[0]*dX + du[1]*dY + du[2]*dZ;
+		Pv[m] = dv[0]*dX + dv[1]*dY + dv[2]*dZ;
+		Pu[3+m] = du[m];
+		Pv[3+m] = dv[m];
+	}
+}
+
+// Loop body run by cv::parallel_for_. Each index is one view. Computes the
+// squared error of the view and, if blocks are given, its normal equations.
+template<int N_DIST>
+class ViewBody : public cv::ParallelLoopBody{
+
+public:
+	ViewBody(const std::vector<std::vector<cv::Point3f>> *object_points, 
+			 const std::vector<std::vector<cv::Point2f>> *image_points, 
+			 const double *intr, const double *poses, 
+			 std::vector<double> *costs, std::vector<ViewBlocks> *blocks) :
+		object_points_(object_points), image_points_(image_points), 
+		intr_(intr), poses_(poses), costs_(costs), blocks_(blocks){}
+
+	void operator()(const cv::Range &range) const{
+
+		const int n = 4 + N_DIST;
+		double J_intr[2*NI], J_pose[2*NP], uv[2];
+
+		for(int v=range.start; v<range.end; v++){
+
+			double R[9], dRdr[27];
+			cv::Mat rvec(3, 1, CV_64F, (void *)(poses_ + v*NP));
+			cv::Mat R_mat(3, 3, CV_64F, R), dRdr_mat(3, 9, CV_64F, dRdr);
+			cv::Rodrigues(rvec, R_mat, dRdr_mat);
+			const double *t = poses_ + v*NP + 3;
+
+			const std::vector<cv::Point3f> &obj = (*object_points_)[v];
+			const std::vector<cv::Point2f> &img = (*image_points_)[v];
+
+			ViewBlocks *blk = blocks_ ? &(*blocks_)[v] : NULL;
+			if(blk)
+				memset(blk, 0, sizeof(ViewBlocks));
+
+			double cost = 0;
+			for(size_t p=0; p<obj.size(); p++){
+
+				projectPoint<N_DIST>(intr_, R, dRdr, t, obj[p], uv, 
+									 blk ? J_intr : NULL, J_pose);
+
+				double e[2] = { img[p].x - uv[0], img[p].y - uv[1] };
+				cost += e[0]*e[0] + e[1]*e[1];
+
+				if(!blk)
+					continue;
+
+				// accumulate upper triangles, mirrored below
+				for(int r=0; r<2; r++){
+					const double *Ji = J_intr + r*n, *Jp = J_pose + r*NP;
+					for(int i=0; i<n; i++){
+						for(int j=i; j<n; j++)
+							blk->U[i*n+j] += Ji[i]*Ji[j];
+						for(int j=0; j<NP; j++)
+							blk->W[i*NP+j] += Ji[i]*Jp[j];
+						blk->g_shared[i] += Ji[i]*e[r];
+					}
+					for(int i=0; i<NP; i++){
+						for(int j=i; j<NP; j++)
+							blk->V[i*NP+j] += Jp[i]*Jp[j];
+						blk->g_pose[i] += Jp[i]*e[r];
+					}
+				}
+			}
+
+			if(blk){
+				for(int i=0; i<n; i++)
+					for(int j=0; j<i; j++)
+						blk->U[i*n+j] = blk->U[j*n+i];
+				for(int i=0; i<NP; i++)
+					for(int j=0; j<i; j++)
+						blk->V[i*NP+j] = blk->V[j*NP+i];
+			}
+
+			(*costs_)[v] = cost;
+		}
+	}
+
+private:
+	const std::vector<std::vector<cv::Point3f>> *object_points_;
+	const std::vector<std::vector<cv::Point2f>> *image_points_;
+	const double *intr_;
+	const double *poses_;
+	std::vector<double> *costs_;
+	std::vector<ViewBlocks> *blocks_;
+};
+
+// Error and normal equations of all views, evaluated in parallel with the
+// kernel of the distortion model
+class ViewEvaluator{
+
+public:
+	ViewEvaluator(const std::vector<std::vector<cv::Point3f>> *object_points, 
+				  const std::vector<std::vector<cv::Point2f>> *image_points, int n_dist) :
+		object_points_(object_points), image_points_(image_points), n_dist_(n_dist){}
+
+	void operator()(const double *intr, const double *poses, 
+					std::vector<double> *costs, std::vector<ViewBlocks> *blocks) const{
+
+		cv::Range views(0, object_points_->size());
+		switch(n_dist_){
+			case 0:
+				cv::parallel_for_(views, ViewBody<0>(object_points_, image_points_, 
+													 intr, poses, costs, blocks));
+				break;
+			case 4:
+				cv::parallel_for_(views, ViewBody<4>(object_points_, image_points_, 
+													 intr, poses, costs, blocks));
+				break;
+			case 5:
+				cv::parallel_for_(views, ViewBody<5>(object_points_, image_points_, 
+													 intr, poses, costs, blocks));
+				break;
+			case 8:
+				cv::parallel_for_(views, ViewBody<8>(object_points_, image_points_, 
+													 intr, poses, costs, blocks));
+				break;
+		}
+	}
+
+private:
+	const std::vector<std::vector<cv::Point3f>> *object_points_;
+	const std::vector<std::vector<cv::Point2f>> *image_points_;
+	int n_dist_;
+};
+
+CvLMCalibSolver::CvLMCalibSolver():
+	criteria_(cv::TermCriteria::COUNT+cv::TermCriteria::EPS, 30, DBL_EPSILON){
+
+}
+
+CvLMCalibSolver::~CvLMCalibSolver(){
+
+}
+
+void CvLMCalibSolver::setTermCriteria(cv::TermCriteria criteria){
+	criteria_ = criteria;
+}
+
+double CvLMCalibSolver::solve(const std::vector<std::vector<cv::Point3f>> &object_points,
+							  const std::vector<std::vector<cv::Point2f>> &image_points,
+							  cv::Mat *intrinsics, cv::Mat *distortion_params, 
+							  std::vector<cv::Mat> *rVecs, std::vector<cv::Mat> *tVecs){
+
+	stats_.clear();
+
+	int n_views = object_points.size();
+	int n_dist = distortion_params->rows*distortion_params->cols;
+	int n = 4 + n_dist;
+
+	int n_points = 0;
+	for(int v=0; v<n_views; v++)
+		n_points += object_points[v].size();
+	if(n_points == 0 || (n_dist != 0 && n_dist != 4 && n_dist != 5 && n_dist != 8))
+		return -1;
+
+	// pack parameters
+	double intr[NI];
+	intr[0] = intrinsics->at<double>(0, 0);
+	intr[1] = intrinsics->at<double>(1, 1);
+	intr[2] = intrinsics->at<double>(0, 2);
+	intr[3] = intrinsics->at<double>(1, 2);
+	for(int i=0; i<n_dist; i++)
+		intr[4+i] = distortion_params->at<double>(i);
+
+	std::vector<double> poses(n_views*NP);
+	for(int v=0; v<n_views; v++){
+		for(int i=0; i<3; i++){
+			poses[v*NP+i] = (*rVecs)[v].at<double>(i);
+			poses[v*NP+3+i] = (*tVecs)[v].at<double>(i);
+		}
+	}
+
+	double rms = minimize<NI>(ViewEvaluator(&object_points, &image_points, n_dist), 
+							  n, n_views, n_points, criteria_, intr, &poses, &stats_);
+
+	// unpack parameters
+	intrinsics->setTo(cv::Scalar(0));
+	intrinsics->at<double>(0, 0) = intr[0];
+	intrinsics->at<double>(1, 1) = intr[1];
+	intrinsics->at<double>(0, 2) = intr[2];
+	intrinsics->at<double>(1, 2) = intr[3];
+	intrinsics->at<double>(2, 2) = 1;
+	for(int i=0; i<n_dist; i++)
+		distortion_params->at<double>(i) = intr[4+i];
+
+	for(int v=0; v<n_views; v++){
+		for(int i=0; i<3; i++){
+			(*rVecs)[v].at<double>(i) = poses[v*NP+i];
+			(*tVecs)[v].at<double>(i) = poses[v*NP+3+i];
+		}
+	}
+
+	return rms;
+}
+
+const std::vector<CvLMCalibSolver::IterationStats>& CvLMCalibSolver::getIterationStats(){
+	return stats_;
+}
+
+bool CvLMCalibSolver::choleskySolve(double *A, int n, double *B, int m){
+
+	for(int j=0; j<n; j++){
+		double s = A[j*n+j];
+		for(int k=0; k<j; k++)
+			s -= A[j*n+k]*A[j*n+k];
+		if(s <= 0)
+			return false;
+		double l = sqrt(s);
+		A[j*n+j] = l;
+		for(int i=j+1; i<n; i++){
+			s = A[i*n+j];
+			for(int k=0; k<j; k++)
+				s -= A[i*n+k]*A[j*n+k];
+			A[i*n+j] = s/l;
+		}
+	}
+
+	for(int c=0; c<m; c++){
+		for(int i=0; i<n; i++){
+			double s = B[i*m+c];
+			for(int k=0; k<i; k++)
+				s -= A[i*n+k]*B[k*m+c];
+			B[i*m+c] = s/A[i*n+i];
+		}
+		for(int i=n-1; i>=0; i--){
+			double s = B[i*m+c];
+			for(int k=i+1; k<n; k++)
+				s -= A[k*n+i]*B[k*m+c];
+			B[i*m+c] = s/A[i*n+i];
+		}
+	}
+
+	return true;
+}
@@ -0,0 +1,371 @@
+/*==========================================================================
+
+  Copyright (c) 2014 Uditha L. Jayarathne, ujayarat@robarts.ca
+
+  Use, modification and redistribution of the software, in source or
+  binary forms, are permitted provided that the following terms and
+  conditions are met:
+
+  1) Redistribution of the source code, in verbatim or modified
+  form, must retain the above copyright notice, this license,
+  the following disclaimer, and any notices that refer to this
+  license and/or the following disclaimer.  
+
+  2) Redistribution in binary form must include the above copyright
+  notice, a copy of this license and the following disclaimer
+  in the documentation or with other materials provided with the
+  distribution.
+
+  3) Modified copies of the source code must be clearly marked as such,
+  and must not be misrepresented as verbatim copies of the source code.
+
+  THE COPYRIGHT HOLDERS AND/OR OTHER PARTIES PROVIDE THE SOFTWARE "AS IS"
+  WITHOUT EXPRESSED OR IMPLIED WARRANTY INCLUDING, BUT NOT LIMITED TO,
+  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  PURPOSE.  IN NO EVENT SHALL ANY COPYRIGHT HOLDER OR OTHER PARTY WHO MAY
+  MODIFY AND/OR REDISTRIBUTE THE SOFTWARE UNDER THE TERMS OF THIS LICENSE
+  BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, LOSS OF DATA OR DATA BECOMING INACCURATE
+  OR LOSS OF PROFIT OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF
+  THE USE OR INABILITY TO USE THE SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGES.
+  =========================================================================*/
+
+#ifndef __CV_LM_CALIB_SOLVER__H
+#define __CV_LM_CALIB_SOLVER__H
+
+#include <iostream>
+#include <vector>
+#include <float.h>
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+// Opencv Includes 
+#include "cv.h"
+
+#include "cv_distortion_model.h"
+
+/**
+ * Levenberg-Marquardt refinement of a pinhole camera with OpenCV's 4, 5 or 8
+ * parameter distortion model. Jacobians are analytic. The normal equations
+ * are block sparse: every view has its own 6x6 pose block coupled only to
+ * the shared intrinsics+distortion block, so the pose blocks are eliminated
+ * with a Schur complement and each iteration is linear in the view count.
+ * The projection, the Schur step and the damping loop are public so that
+ * solvers with a larger shared block, e.g. CvLMStereoSolver, reuse them.
+ */
+class CvLMCalibSolver{
+
+public:
+
+	// largest intrinsics+distortion block: fx, fy, cx, cy, k1..k6, p1, p2
+	static const int MAX_INTRINSICS = 12;
+
+	// pose block: rotation vector and translation
+	static const int POSE_PARAMS = 6;
+
+	// Per-iteration report
+	typedef struct IterationStats{
+		int iteration;	// iteration number
+		double rms;		// RMS reprojection error after the iteration
+		double lambda;	// damping used by the accepted (or last) step
+		int n_trials;	// damped solves tried
+		double time_ms; // wall time of the iteration
+	} IterationStats;
+
+	// Normal equation blocks of one view, for a shared block of up to N 
+	// parameters packed first, n x n with the actual size n
+	template<int N>
+	struct SchurBlocks{
+		double U[N*N];							// J_shared^T J_shared
+		double W[N*POSE_PARAMS];				// J_shared^T J_pose
+		double V[POSE_PARAMS*POSE_PARAMS];		// J_pose^T J_pose
+		double g_shared[N];						// J_shared^T e
+		double g_pose[POSE_PARAMS];				// J_pose^T e
+	};
+
+	CvLMCalibSolver();
+	~CvLMCalibSolver();
+
+	//public methods
+
+	/**
+	 * Set termination criteria. COUNT limits the iterations, EPS stops
+	 * when the relative decrease of the squared error falls below epsilon.
+	 * @param criteria
+	 */
+	void setTermCriteria(cv::TermCriteria);
+
+	/**
+	 * Refine intrinsics, distortion and per-view poses, starting from the
+	 * values passed in. All matrices are CV_64F.
+	 * @param object points per view
+	 * @param image points per view
+	 * @param 3x3 camera matrix, initial guess and result
+	 * @param Nx1 distortion params (N = 4, 5 or 8), initial guess and result
+	 * @param per-view 3x1 rotation vectors, initial guess and result
+	 * @param per-view 3x1 translation vectors, initial guess and result
+	 * @return RMS reprojection error
+	 */
+	double solve(const std::vector<std::vector<cv::Point3f>>&,
+				 const std::vector<std::vector<cv::Point2f>>&,
+				 cv::Mat*, cv::Mat*, 
+				 std::vector<cv::Mat>*, std::vector<cv::Mat>*);
+
+	/**
+	 * Statistics of the last solve, one entry per iteration
+	 */
+	const std::vector<IterationStats>& getIterationStats();
+
+	/**
+	 * Solve A X = B in place for a small symmetric positive definite A
+	 * @param row-major n x n matrix, overwritten by its Cholesky factor
+	 * @param n
+	 * @param row-major n x m right hand sides, overwritten by the solution
+	 * @param m
+	 * @return false if A is not positive definite
+	 */
+	static bool choleskySolve(double *, int, double *, int);
+
+	/**
+	 * Project a point in camera coordinates and optionally compute the 
+	 * jacobians.
+	 * @param packed intrinsics: fx, fy, cx, cy and the distortion params in OpenCV order
+	 * @param point in camera coordinates
+	 * @param projected point (u, v)
+	 * @param 2 x (4+N_DIST) row-major jacobian wrt the intrinsics, or NULL
+	 * @param 2 x 3 row-major jacobian wrt the camera coordinates
+	 */
+	template<int N_DIST>
+	static void projectCamera(const double *, const double *, double *, double *, double *);
+
+	/**
+	 * Damped step by Schur complement on the pose blocks.
+	 * @param per-view normal equation blocks
+	 * @param size of the shared block
+	 * @param Marquardt damping
+	 * @param reference to the shared step
+	 * @param reference to the pose steps
+	 * @return false if the damped system is not positive definite
+	 */
+	template<int N>
+	static bool computeStep(const std::vector<SchurBlocks<N>>&, int, double, 
+							double *, std::vector<double>*);
+
+	/**
+	 * Levenberg-Marquardt iterations on a shared block and per-view poses.
+	 * The evaluator is called as evaluate(shared, poses, &costs, &blocks) 
+	 * and fills the per-view squared errors and, unless blocks is NULL, 
+	 * the per-view normal equations.
+	 * @param evaluator
+	 * @param size of the shared block
+	 * @param number of views
+	 * @param number of residual points, for the RMS
+	 * @param termination criteria
+	 * @param packed shared block, initial guess and result
+	 * @param packed poses, initial guess and result
+	 * @param reference to the per-iteration statistics
+	 * @return RMS reprojection error
+	 */
+	template<int N, class Evaluator>
+	static double minimize(const Evaluator&, int, int, int, cv::TermCriteria, 
+						   double *, std::vector<double>*, std::vector<IterationStats>*);
+
+private:
+	//private members
+
+	cv::TermCriteria criteria_;
+
+	std::vector<IterationStats> stats_;
+
+};
+
+template<int N_DIST>
+inline void CvLMCalibSolver::projectCamera(const double *intr, const double *Xc, double *uv, 
+										   double *J_intr, double *J_point){
+
+	typedef CvDistortionModel<N_DIST> Model;
+
+	double iz = 1./Xc[2];
+	double x = Xc[0]*iz, y = Xc[1]*iz;
+	double fx = intr[0], fy = intr[1];
+
+	double xd, yd;
+	if(!J_intr){
+		Model::distort(intr + 4, x, y, &xd, &yd);
+		uv[0] = fx*xd + intr[2];
+		uv[1] = fy*yd + intr[3];
+		return;
+	}
+
+	double d_point[4], d_params[2*N_DIST + 1];
+	Model::jacobian(intr + 4, x, y, &xd, &yd, d_point, d_params);
+	uv[0] = fx*xd + intr[2];
+	uv[1] = fy*yd + intr[3];
+
+	const int n = 4 + N_DIST;
+	double *Ju = J_intr, *Jv = J_intr + n;
+	Ju[0] = xd; Ju[1] = 0; Ju[2] = 1; Ju[3] = 0;
+	Jv[0] = 0; Jv[1] = yd; Jv[2] = 0; Jv[3] = 1;
+	for(int i=0; i<N_DIST; i++){
+		Ju[4+i] = fx*d_params[i];
+		Jv[4+i] = fy*d_params[N_DIST+i];
+	}
+
+	double du_dx = fx*d_point[0], du_dy = fx*d_point[1];
+	double dv_dx = fy*d_point[2], dv_dy = fy*d_point[3];
+
+	// through x = Xc/Zc, y = Yc/Zc to camera coordinates
+	J_point[0] = du_dx*iz; J_point[1] = du_dy*iz; J_point[2] = -(du_dx*x + du_dy*y)*iz;
+	J_point[3] = dv_dx*iz; J_point[4] = dv_dy*iz; J_point[5] = -(dv_dx*x + dv_dy*y)*iz;
+}
+
+template<int N>
+bool CvLMCalibSolver::computeStep(const std::vector<SchurBlocks<N>> &blocks, int n, double lambda, 
+								  double *d_shared, std::vector<double> *d_pose){
+
+	const int NP = POSE_PARAMS;
+	int n_views = blocks.size();
+	int m = n + 1;
+
+	double S[N*N], rhs[N];
+	memset(S, 0, sizeof(S));
+	memset(rhs, 0, sizeof(rhs));
+	for(int v=0; v<n_views; v++){
+		for(int i=0; i<n*n; i++)
+			S[i] += blocks[v].U[i];
+		for(int i=0; i<n; i++)
+			rhs[i] += blocks[v].g_shared[i];
+	}
+	for(int i=0; i<n; i++)
+		S[i*n+i] *= 1 + lambda;
+
+	// V^-1 [W^T | g_pose] per view, kept for the back substitution
+	std::vector<double> Y(n_views*NP*m);
+	for(int v=0; v<n_views; v++){
+		const SchurBlocks<N> &blk = blocks[v];
+		double V[NP*NP];
+		memcpy(V, blk.V, sizeof(V));
+		for(int i=0; i<NP; i++)
+			V[i*NP+i] *= 1 + lambda;
+
+		double *Yv = &Y[v*NP*m];
+		for(int r=0; r<NP; r++){
+			for(int c=0; c<n; c++)
+				Yv[r*m+c] = blk.W[c*NP+r];
+			Yv[r*m+n] = blk.g_pose[r];
+		}
+		if(!choleskySolve(V, NP, Yv, m))
+			return false;
+
+		// S -= W V^-1 W^T, rhs -= W V^-1 g_pose
+		for(int i=0; i<n; i++){
+			for(int j=0; j<m; j++){
+				double s = 0;
+				for(int r=0; r<NP; r++)
+					s += blk.W[i*NP+r]*Yv[r*m+j];
+				if(j < n)
+					S[i*n+j] -= s;
+				else
+					rhs[i] -= s;
+			}
+		}
+	}
+
+	if(!choleskySolve(S, n, rhs, 1))
+		return false;
+	memcpy(d_shared, rhs, n*sizeof(double));
+
+	d_pose->resize(n_views*NP);
+	for(int v=0; v<n_views; v++){
+		const double *Yv = &Y[v*NP*m];
+		for(int r=0; r<NP; r++){
+			double s = Yv[r*m+n];
+			for(int c=0; c<n; c++)
+				s -= Yv[r*m+c]*d_shared[c];
+			(*d_pose)[v*NP+r] = s;
+		}
+	}
+
+	return true;
+}
+
+template<int N, class Evaluator>
+double CvLMCalibSolver::minimize(const Evaluator &evaluate, int n, int n_views, int n_points, 
+								 cv::TermCriteria criteria, double *shared, 
+								 std::vector<double> *poses, std::vector<IterationStats> *stats){
+
+	int max_iter = (criteria.type & cv::TermCriteria::COUNT) ? criteria.maxCount : 30;
+	double eps = (criteria.type & cv::TermCriteria::EPS) ? criteria.epsilon : DBL_EPSILON;
+
+	std::vector<SchurBlocks<N>> blocks(n_views);
+	std::vector<double> costs(n_views);
+	std::vector<double> d_pose, trial_poses(poses->size());
+	double d_shared[N], trial_shared[N];
+
+	double cost = 0;
+	double lambda = 1e-3;
+
+	for(int it=0; it<max_iter; it++){
+
+		int64 start = cv::getTickCount();
+
+		// linearize around the current parameters
+		evaluate(shared, &(*poses)[0], &costs, &blocks);
+		cost = 0;
+		for(int v=0; v<n_views; v++)
+			cost += costs[v];
+
+		// raise the damping until a step reduces the error
+		bool accepted = false;
+		int n_trials = 0;
+		double trial_cost = cost;
+		while(!accepted && n_trials < 10){
+			n_trials++;
+
+			if(computeStep<N>(blocks, n, lambda, d_shared, &d_pose)){
+
+				for(int i=0; i<n; i++)
+					trial_shared[i] = shared[i] + d_shared[i];
+				for(size_t i=0; i<poses->size(); i++)
+					trial_poses[i] = (*poses)[i] + d_pose[i];
+
+				evaluate(trial_shared, &trial_poses[0], &costs, 
+						 (std::vector<SchurBlocks<N>>*)NULL);
+				trial_cost = 0;
+				for(int v=0; v<n_views; v++)
+					trial_cost += costs[v];
+
+				accepted = trial_cost < cost;
+			}
+
+			if(!accepted)
+				lambda *= 10;
+		}
+
+		IterationStats it_stats;
+		it_stats.iteration = it;
+		it_stats.lambda = lambda;
+		it_stats.n_trials = n_trials;
+
+		double prev_cost = cost;
+		if(accepted){
+			memcpy(shared, trial_shared, n*sizeof(double));
+			poses->swap(trial_poses);
+			cost = trial_cost;
+			lambda = std::max(lambda*0.1, 1e-15);
+		}
+
+		it_stats.rms = sqrt(cost/n_points);
+		it_stats.time_ms = (cv::getTickCount() - start)*1000./cv::getTickFrequency();
+		stats->push_back(it_stats);
+
+		if(!accepted || prev_cost - cost <= eps*prev_cost)
+			break;
+	}
+
+	return sqrt(cost/n_points);
+}
+
+#endif //__CV_LM_CALIB_SOLVER__H
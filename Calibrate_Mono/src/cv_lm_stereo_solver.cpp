@@ -0,0 +1,457 @@
+/*==========================================================================
+
+  Copyright (c) 2014 Uditha L. Jayarathne, ujayarat@robarts.ca
+
+  Use, modification and redistribution of the software, in source or
+  binary forms, are permitted provided that the following terms and
+  conditions are met:
+
+  1) Redistribution of the source code, in verbatim or modified
+  form, must retain the above copyright notice, this license,
+  the following disclaimer, and any notices that refer to this
+  license and/or the following disclaimer.  
+
+  2) Redistribution in binary form must include the above copyright
+  notice, a copy of this license and the following disclaimer
+  in the documentation or with other materials provided with the
+  distribution.
+
+  3) Modified copies of the source code must be clearly marked as such,
+  and must not be misrepresented as verbatim copies of the source code.
+
+  THE COPYRIGHT HOLDERS AND/OR OTHER PARTIES PROVIDE THE SOFTWARE "AS IS"
+  WITHOUT EXPRESSED OR IMPLIED WARRANTY INCLUDING, BUT NOT LIMITED TO,
+  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  PURPOSE.  IN NO EVENT SHALL ANY COPYRIGHT HOLDER OR OTHER PARTY WHO MAY
+  MODIFY AND/OR REDISTRIBUTE THE SOFTWARE UNDER THE TERMS OF THIS LICENSE
+  BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, LOSS OF DATA OR DATA BECOMING INACCURATE
+  OR LOSS OF PROFIT OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF
+  THE USE OR INABILITY TO USE THE SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGES.
+  =========================================================================*/
+
+#include <float.h>
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+#include "cv_lm_stereo_solver.h"
+
+// The shared block is packed as the left intrinsics (fx, fy, cx, cy and the
+// distortion params in OpenCV order), the right intrinsics in the same 
+// layout, then the rig rotation vector and translation.
+static const int NS = CvLMStereoSolver::MAX_SHARED;
+static const int NP = CvLMCalibSolver::POSE_PARAMS;
+
+typedef CvLMCalibSolver::SchurBlocks<NS> PairBlocks;
+
+/**
+ * Add the two residual rows of one point to the pair blocks. The shared
+ * jacobian is nonzero only on a contiguous range: the left intrinsics for
+ * the left eye, the right intrinsics and the rig for the right eye.
+ * @param pair blocks
+ * @param size of the shared block
+ * @param first shared parameter of the range
+ * @param length of the range
+ * @param 2 x length row-major shared jacobian
+ * @param 2 x 6 row-major pose jacobian
+ * @param residual
+ */
+static inline void accumulate(PairBlocks *blk, int ns, int first, int length, 
+							  const double *J_shared, const double *J_pose, const double *e){
+
+	for(int r=0; r<2; r++){
+		const double *Js = J_shared + r*length, *Jp = J_pose + r*NP;
+		for(int i=0; i<length; i++){
+			double *U = blk->U + (first + i)*ns + first;
+			double *W = blk->W + (first + i)*NP;
+			for(int j=i; j<length; j++)
+				U[j] += Js[i]*Js[j];
+			for(int j=0; j<NP; j++)
+				W[j] += Js[i]*Jp[j];
+			blk->g_shared[first + i] += Js[i]*e[r];
+		}
+		for(int i=0; i<NP; i++){
+			for(int j=i; j<NP; j++)
+				blk->V[i*NP+j] += Jp[i]*Jp[j];
+			blk->g_pose[i] += Jp[i]*e[r];
+		}
+	}
+}
+
+// Loop body run by cv::parallel_for_. Each index is one pair. Computes the
+// squared error of both eyes and, if blocks are given, the normal equations.
+template<int N_DIST>
+class PairBody : public cv::ParallelLoopBody{
+
+public:
+	PairBody(const std::vector<std::vector<cv::Point3f>> *object_points, 
+			 const std::vector<std::vector<cv::Point2f>> *left_points, 
+			 const std::vector<std::vector<cv::Point2f>> *right_points, 
+			 const double *shared, const double *poses, 
+			 std::vector<double> *costs, std::vector<PairBlocks> *blocks) :
+		object_points_(object_points), left_points_(left_points), right_points_(right_points), 
+		shared_(shared), poses_(poses), costs_(costs), blocks_(blocks){}
+
+	void operator()(const cv::Range &range) const{
+
+		const int n = 4 + N_DIST, ns = 2*n + NP;
+		const double *left_intr = shared_, *right_intr = shared_ + n;
+
+		// rig transform and its derivative
+		double Rs[9], dRsdr[27];
+		cv::Mat rig_rvec(3, 1, CV_64F, (void *)(shared_ + 2*n));
+		cv::Mat Rs_mat(3, 3, CV_64F, Rs), dRsdr_mat(3, 9, CV_64F, dRsdr);
+		cv::Rodrigues(rig_rvec, Rs_mat, dRsdr_mat);
+		const double *ts = shared_ + 2*n + 3;
+
+		double J_intr[2*CvLMCalibSolver::MAX_INTRINSICS], J_point[6];
+		double J_shared[2*(CvLMCalibSolver::MAX_INTRINSICS + NP)], J_pose[2*NP];
+		double uv[2], Xl[3], Xr[3], dXl[9];
+
+		for(int v=range.start; v<range.end; v++){
+
+			double R[9], dRdr[27];
+			cv::Mat rvec(3, 1, CV_64F, (void *)(poses_ + v*NP));
+			cv::Mat R_mat(3, 3, CV_64F, R), dRdr_mat(3, 9, CV_64F, dRdr);
+			cv::Rodrigues(rvec, R_mat, dRdr_mat);
+			const double *t = poses_ + v*NP + 3;
+
+			const std::vector<cv::Point3f> &obj = (*object_points_)[v];
+			const std::vector<cv::Point2f> &left = (*left_points_)[v];
+			const std::vector<cv::Point2f> &right = (*right_points_)[v];
+
+			PairBlocks *blk = blocks_ ? &(*blocks_)[v] : NULL;
+			if(blk)
+				memset(blk, 0, sizeof(PairBlocks));
+
+			double cost = 0;
+			for(int eye=0; eye<2; eye++){
+
+				const std::vector<cv::Point2f> &img = eye ? right : left;
+				for(size_t p=0; p<img.size(); p++){
+
+					double X = obj[p].x, Y = obj[p].y, Z = obj[p].z;
+					Xl[0] = R[0]*X + R[1]*Y + R[2]*Z + t[0];
+					Xl[1] = R[3]*X + R[4]*Y + R[5]*Z + t[1];
+					Xl[2] = R[6]*X + R[7]*Y + R[8]*Z + t[2];
+
+					const double *Xc = Xl;
+					if(eye){
+						for(int i=0; i<3; i++)
+							Xr[i] = Rs[3*i]*Xl[0] + Rs[3*i+1]*Xl[1] + Rs[3*i+2]*Xl[2] + ts[i];
+						Xc = Xr;
+					}
+
+					CvLMCalibSolver::projectCamera<N_DIST>(eye ? right_intr : left_intr, Xc, uv, 
+														   blk ? J_intr : NULL, J_point);
+
+					double e[2] = { img[p].x - uv[0], img[p].y - uv[1] };
+					cost += e[0]*e[0] + e[1]*e[1];
+
+					if(!blk)
+						continue;
+
+					// derivatives of the left camera point wrt the rotation vector
+					for(int m=0; m<3; m++){
+						const double *dR = dRdr + 9*m;
+						dXl[3*m] = dR[0]*X + dR[1]*Y + dR[2]*Z;
+						dXl[3*m+1] = dR[3]*X + dR[4]*Y + dR[5]*Z;
+						dXl[3*m+2] = dR[6]*X + dR[7]*Y + dR[8]*Z;
+					}
+
+					int length = eye ? n + NP : n;
+					for(int r=0; r<2; r++){
+						const double *d = J_point + 3*r;
+
+						// gradient wrt the left camera point, through the rig
+						double g[3] = { d[0], d[1], d[2] };
+						if(eye)
+							for(int i=0; i<3; i++)
+								g[i] = d[0]*Rs[i] + d[1]*Rs[3+i] + d[2]*Rs[6+i];
+
+						double *Jp = J_pose + r*NP, *Js = J_shared + r*length;
+						for(int m=0; m<3; m++){
+							Jp[m] = g[0]*dXl[3*m] + g[1]*dXl[3*m+1] + g[2]*dXl[3*m+2];
+							Jp[3+m] = g[m];
+						}
+
+						memcpy(Js, J_intr + r*n, n*sizeof(double));
+						if(eye){
+							for(int m=0; m<3; m++){
+								const double *dR = dRsdr + 9*m;
+								double dX = dR[0]*Xl[0] + dR[1]*Xl[1] + dR[2]*Xl[2];
+								double dY = dR[3]*Xl[0] + dR[4]*Xl[1] + dR[5]*Xl[2];
+								double dZ = dR[6]*Xl[0] + dR[7]*Xl[1] + dR[8]*Xl[2];
+								Js[n+m] = d[0]*dX + d[1]*dY + d[2]*dZ;
+								Js[n+3+m] = d[m];
+							}
+						}
+					}
+
+					accumulate(blk, ns, eye ? n : 0, length, J_shared, J_pose, e);
+				}
+			}
+
+			if(blk){
+				for(int i=0; i<ns; i++)
+					for(int j=0; j<i; j++)
+						blk->U[i*ns+j] = blk->U[j*ns+i];
+				for(int i=0; i<NP; i++)
+					for(int j=0; j<i; j++)
+						blk->V[i*NP+j] = blk->V[j*NP+i];
+			}
+
+			(*costs_)[v] = cost;
+		}
+	}
+
+private:
+	const std::vector<std::vector<cv::Point3f>> *object_points_;
+	const std::vector<std::vector<cv::Point2f>> *left_points_;
+	const std::vector<std::vector<cv::Point2f>> *right_points_;
+	const double *shared_;
+	const double *poses_;
+	std::vector<double> *costs_;
+	std::vector<PairBlocks> *blocks_;
+};
+
+// Error and normal equations of all pairs, evaluated in parallel with the
+// kernel of the distortion model
+class PairEvaluator{
+
+public:
+	PairEvaluator(const std::vector<std::vector<cv::Point3f>> *object_points, 
+				  const std::vector<std::vector<cv::Point2f>> *left_points, 
+				  const std::vector<std::vector<cv::Point2f>> *right_points, int n_dist) :
+		object_points_(object_points), left_points_(left_points), right_points_(right_points), 
+		n_dist_(n_dist){}
+
+	void operator()(const double *shared, const double *poses, 
+					std::vector<double> *costs, std::vector<PairBlocks> *blocks) const{
+
+		cv::Range pairs(0, object_points_->size());
+		switch(n_dist_){
+			case 0:
+				cv::parallel_for_(pairs, PairBody<0>(object_points_, left_points_, right_points_, 
+													 shared, poses, costs, blocks));
+				break;
+			case 4:
+				cv::parallel_for_(pairs, PairBody<4>(object_points_, left_points_, right_points_, 
+													 shared, poses, costs, blocks));
+				break;
+			case 5:
+				cv::parallel_for_(pairs, PairBody<5>(object_points_, left_points_, right_points_, 
+													 shared, poses, costs, blocks));
+				break;
+			case 8:
+				cv::parallel_for_(pairs, PairBody<8>(object_points_, left_points_, right_points_, 
+													 shared, poses, costs, blocks));
+				break;
+		}
+	}
+
+private:
+	const std::vector<std::vector<cv::Point3f>> *object_points_;
+	const std::vector<std::vector<cv::Point2f>> *left_points_;
+	const std::vector<std::vector<cv::Point2f>> *right_points_;
+	int n_dist_;
+};
+
+// Median of a list of samples
+static double median(std::vector<double> samples){
+
+	size_t k = samples.size()/2;
+	std::nth_element(samples.begin(), samples.begin() + k, samples.end());
+	return samples[k];
+}
+
+CvLMStereoSolver::CvLMStereoSolver():
+	criteria_(cv::TermCriteria::COUNT+cv::TermCriteria::EPS, 30, DBL_EPSILON){
+
+}
+
+CvLMStereoSolver::~CvLMStereoSolver(){
+
+}
+
+void CvLMStereoSolver::setTermCriteria(cv::TermCriteria criteria){
+	criteria_ = criteria;
+}
+
+bool CvLMStereoSolver::initialize(const std::vector<std::vector<cv::Point3f>> &object_points,
+								  const std::vector<std::vector<cv::Point2f>> &left_points,
+								  const std::vector<std::vector<cv::Point2f>> &right_points,
+								  cv::Size img_size, int n_dist, 
+								  cv::Mat *left_intrinsics, cv::Mat *left_distortion, 
+								  cv::Mat *right_intrinsics, cv::Mat *right_distortion, 
+								  cv::Mat *rig_rvec, cv::Mat *rig_tvec, 
+								  std::vector<cv::Mat> *rVecs, std::vector<cv::Mat> *tVecs){
+
+	int n_pairs = object_points.size();
+
+	// camera matrices from the views of each eye
+	std::vector<std::vector<cv::Point3f>> left_obj, right_obj;
+	std::vector<std::vector<cv::Point2f>> left_img, right_img;
+	for(int v=0; v<n_pairs; v++){
+		if(!left_points[v].empty()){
+			left_obj.push_back(object_points[v]);
+			left_img.push_back(left_points[v]);
+		}
+		if(!right_points[v].empty()){
+			right_obj.push_back(object_points[v]);
+			right_img.push_back(right_points[v]);
+		}
+	}
+	if(left_obj.empty() || right_obj.empty())
+		return false;
+
+	cv::initCameraMatrix2D(left_obj, left_img, img_size, 0).convertTo(*left_intrinsics, CV_64F);
+	cv::initCameraMatrix2D(right_obj, right_img, img_size, 0).convertTo(*right_intrinsics, CV_64F);
+	*left_distortion = cv::Mat::zeros(n_dist, 1, CV_64F);
+	*right_distortion = cv::Mat::zeros(n_dist, 1, CV_64F);
+
+	// board poses in each eye, and the rig transform of every stereo pair
+	std::vector<cv::Mat> left_r(n_pairs), left_t(n_pairs), right_r(n_pairs), right_t(n_pairs);
+	std::vector<double> rig[6];
+	for(int v=0; v<n_pairs; v++){
+		bool has_left = !left_points[v].empty(), has_right = !right_points[v].empty();
+		if(has_left)
+			cv::solvePnP(object_points[v], left_points[v], *left_intrinsics, *left_distortion, 
+						 left_r[v], left_t[v]);
+		if(has_right)
+			cv::solvePnP(object_points[v], right_points[v], *right_intrinsics, *right_distortion, 
+						 right_r[v], right_t[v]);
+		if(!has_left || !has_right)
+			continue;
+
+		cv::Mat R_l, R_r, rs;
+		cv::Rodrigues(left_r[v], R_l);
+		cv::Rodrigues(right_r[v], R_r);
+		cv::Mat Rs = R_r*R_l.t();
+		cv::Mat ts = right_t[v] - Rs*left_t[v];
+		cv::Rodrigues(Rs, rs);
+		for(int i=0; i<3; i++){
+			rig[i].push_back(rs.at<double>(i));
+			rig[3+i].push_back(ts.at<double>(i));
+		}
+	}
+	if(rig[0].empty())
+		return false;
+
+	// the per-pair estimates scatter with the detection noise
+	*rig_rvec = cv::Mat(3, 1, CV_64F);
+	*rig_tvec = cv::Mat(3, 1, CV_64F);
+	for(int i=0; i<3; i++){
+		rig_rvec->at<double>(i) = median(rig[i]);
+		rig_tvec->at<double>(i) = median(rig[3+i]);
+	}
+
+	// pairs seen only by the right eye get their left pose through the rig
+	cv::Mat Rs;
+	cv::Rodrigues(*rig_rvec, Rs);
+	rVecs->resize(n_pairs);
+	tVecs->resize(n_pairs);
+	for(int v=0; v<n_pairs; v++){
+		if(!left_points[v].empty()){
+			(*rVecs)[v] = left_r[v];
+			(*tVecs)[v] = left_t[v];
+			continue;
+		}
+
+		cv::Mat R_r, R_l;
+		cv::Rodrigues(right_r[v], R_r);
+		R_l = Rs.t()*R_r;
+		cv::Rodrigues(R_l, (*rVecs)[v]);
+		(*tVecs)[v] = Rs.t()*(right_t[v] - *rig_tvec);
+	}
+
+	return true;
+}
+
+double CvLMStereoSolver::solve(const std::vector<std::vector<cv::Point3f>> &object_points,
+							   const std::vector<std::vector<cv::Point2f>> &left_points,
+							   const std::vector<std::vector<cv::Point2f>> &right_points,
+							   cv::Mat *left_intrinsics, cv::Mat *left_distortion, 
+							   cv::Mat *right_intrinsics, cv::Mat *right_distortion, 
+							   cv::Mat *rig_rvec, cv::Mat *rig_tvec, 
+							   std::vector<cv::Mat> *rVecs, std::vector<cv::Mat> *tVecs){
+
+	stats_.clear();
+
+	int n_pairs = object_points.size();
+	int n_dist = left_distortion->rows*left_distortion->cols;
+	int n = 4 + n_dist, ns = 2*n + NP;
+
+	int n_points = 0;
+	for(int v=0; v<n_pairs; v++){
+		if(left_points[v].empty() && right_points[v].empty())
+			return -1;
+		n_points += left_points[v].size() + right_points[v].size();
+	}
+	if(n_points == 0 || (n_dist != 0 && n_dist != 4 && n_dist != 5 && n_dist != 8) || 
+		right_distortion->rows*right_distortion->cols != n_dist)
+		return -1;
+
+	// pack parameters
+	double shared[NS];
+	cv::Mat *intrinsics[2] = { left_intrinsics, right_intrinsics };
+	cv::Mat *distortion[2] = { left_distortion, right_distortion };
+	for(int eye=0; eye<2; eye++){
+		double *intr = shared + eye*n;
+		intr[0] = intrinsics[eye]->at<double>(0, 0);
+		intr[1] = intrinsics[eye]->at<double>(1, 1);
+		intr[2] = intrinsics[eye]->at<double>(0, 2);
+		intr[3] = intrinsics[eye]->at<double>(1, 2);
+		for(int i=0; i<n_dist; i++)
+			intr[4+i] = distortion[eye]->at<double>(i);
+	}
+	for(int i=0; i<3; i++){
+		shared[2*n+i] = rig_rvec->at<double>(i);
+		shared[2*n+3+i] = rig_tvec->at<double>(i);
+	}
+
+	std::vector<double> poses(n_pairs*NP);
+	for(int v=0; v<n_pairs; v++){
+		for(int i=0; i<3; i++){
+			poses[v*NP+i] = (*rVecs)[v].at<double>(i);
+			poses[v*NP+3+i] = (*tVecs)[v].at<double>(i);
+		}
+	}
+
+	double rms = CvLMCalibSolver::minimize<NS>(PairEvaluator(&object_points, &left_points, 
+															 &right_points, n_dist), 
+											   ns, n_pairs, n_points, criteria_, shared, 
+											   &poses, &stats_);
+
+	// unpack parameters
+	for(int eye=0; eye<2; eye++){
+		const double *intr = shared + eye*n;
+		intrinsics[eye]->setTo(cv::Scalar(0));
+		intrinsics[eye]->at<double>(0, 0) = intr[0];
+		intrinsics[eye]->at<double>(1, 1) = intr[1];
+		intrinsics[eye]->at<double>(0, 2) = intr[2];
+		intrinsics[eye]->at<double>(1, 2) = intr[3];
+		intrinsics[eye]->at<double>(2, 2) = 1;
+		for(int i=0; i<n_dist; i++)
+			distortion[eye]->at<double>(i) = intr[4+i];
+	}
+	for(int i=0; i<3; i++){
+		rig_rvec->at<double>(i) = shared[2*n+i];
+		rig_tvec->at<double>(i) = shared[2*n+3+i];
+	}
+
+	for(int v=0; v<n_pairs; v++){
+		for(int i=0; i<3; i++){
+			(*rVecs)[v].at<double>(i) = poses[v*NP+i];
+			(*tVecs)[v].at<double>(i) = poses[v*NP+3+i];
+		}
+	}
+
+	return rms;
+}
+
+const std::vector<CvLMCalibSolver::IterationStats>& CvLMStereoSolver::getIterationStats(){
+	return stats_;
+}
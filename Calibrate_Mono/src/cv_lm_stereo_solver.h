@@ -0,0 +1,136 @@
+/*==========================================================================
+
+  Copyright (c) 2014 Uditha L. Jayarathne, ujayarat@robarts.ca
+
+  Use, modification and redistribution of the software, in source or
+  binary forms, are permitted provided that the following terms and
+  conditions are met:
+
+  1) Redistribution of the source code, in verbatim or modified
+  form, must retain the above copyright notice, this license,
+  the following disclaimer, and any notices that refer to this
+  license and/or the following disclaimer.  
+
+  2) Redistribution in binary form must include the above copyright
+  notice, a copy of this license and the following disclaimer
+  in the documentation or with other materials provided with the
+  distribution.
+
+  3) Modified copies of the source code must be clearly marked as such,
+  and must not be misrepresented as verbatim copies of the source code.
+
+  THE COPYRIGHT HOLDERS AND/OR OTHER PARTIES PROVIDE THE SOFTWARE "AS IS"
+  WITHOUT EXPRESSED OR IMPLIED WARRANTY INCLUDING, BUT NOT LIMITED TO,
+  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  PURPOSE.  IN NO EVENT SHALL ANY COPYRIGHT HOLDER OR OTHER PARTY WHO MAY
+  MODIFY AND/OR REDISTRIBUTE THE SOFTWARE UNDER THE TERMS OF THIS LICENSE
+  BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, LOSS OF DATA OR DATA BECOMING INACCURATE
+  OR LOSS OF PROFIT OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF
+  THE USE OR INABILITY TO USE THE SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGES.
+  =========================================================================*/
+
+#ifndef __CV_LM_STEREO_SOLVER__H
+#define __CV_LM_STEREO_SOLVER__H
+
+#include <iostream>
+#include <vector>
+
+// Opencv Includes 
+#include "cv.h"
+
+#include "cv_lm_calib_solver.h"
+
+/**
+ * Joint Levenberg-Marquardt calibration of a stereo rig. Both cameras'
+ * intrinsics and distortion and the right-from-left rig transform are 
+ * refined together with one board pose per pair, seen by the left camera
+ * directly and by the right camera through the rig transform. Pairs where
+ * only one eye found the board still constrain that eye. As in 
+ * CvLMCalibSolver the per-pair pose blocks couple only to the shared 
+ * block and are eliminated with a Schur complement, so each iteration is
+ * linear in the pair count. Both eyes use the same distortion model.
+ */
+class CvLMStereoSolver{
+
+public:
+
+	CvLMStereoSolver();
+	~CvLMStereoSolver();
+
+	//public methods
+
+	/**
+	 * Set termination criteria. COUNT limits the iterations, EPS stops
+	 * when the relative decrease of the squared error falls below epsilon.
+	 * @param criteria
+	 */
+	void setTermCriteria(cv::TermCriteria);
+
+	/**
+	 * Initial guess from the corners alone: cv::initCameraMatrix2D per 
+	 * eye without distortion, solvePnP per view and the median rig 
+	 * transform over the pairs seen by both eyes. All outputs are CV_64F.
+	 * @param object points per pair
+	 * @param left image points per pair, empty if the left eye missed the board
+	 * @param right image points per pair, empty if the right eye missed the board
+	 * @param image size
+	 * @param number of distortion params (4, 5 or 8)
+	 * @param reference to the left camera matrix
+	 * @param reference to the left distortion params
+	 * @param reference to the right camera matrix
+	 * @param reference to the right distortion params
+	 * @param reference to the rig rotation vector
+	 * @param reference to the rig translation
+	 * @param reference to the per-pair board rotation vectors
+	 * @param reference to the per-pair board translations
+	 * @return false without a pair seen by both eyes
+	 */
+	static bool initialize(const std::vector<std::vector<cv::Point3f>>&,
+						   const std::vector<std::vector<cv::Point2f>>&,
+						   const std::vector<std::vector<cv::Point2f>>&,
+						   cv::Size, int, 
+						   cv::Mat*, cv::Mat*, cv::Mat*, cv::Mat*, cv::Mat*, cv::Mat*, 
+						   std::vector<cv::Mat>*, std::vector<cv::Mat>*);
+
+	/**
+	 * Refine the rig, starting from the values passed in. All matrices 
+	 * are CV_64F. Every pair must be seen by at least one eye.
+	 * @param object points per pair
+	 * @param left image points per pair, empty if the left eye missed the board
+	 * @param right image points per pair, empty if the right eye missed the board
+	 * @param left camera matrix, initial guess and result
+	 * @param left distortion params (N = 4, 5 or 8), initial guess and result
+	 * @param right camera matrix, initial guess and result
+	 * @param right distortion params, same N, initial guess and result
+	 * @param rotation vector from left to right camera, initial guess and result
+	 * @param translation from left to right camera, initial guess and result
+	 * @param per-pair board rotation vectors in the left camera, initial guess and result
+	 * @param per-pair board translations in the left camera, initial guess and result
+	 * @return RMS reprojection error over both eyes
+	 */
+	double solve(const std::vector<std::vector<cv::Point3f>>&,
+				 const std::vector<std::vector<cv::Point2f>>&,
+				 const std::vector<std::vector<cv::Point2f>>&,
+				 cv::Mat*, cv::Mat*, cv::Mat*, cv::Mat*, cv::Mat*, cv::Mat*, 
+				 std::vector<cv::Mat>*, std::vector<cv::Mat>*);
+
+	/**
+	 * Statistics of the last solve, one entry per iteration
+	 */
+	const std::vector<CvLMCalibSolver::IterationStats>& getIterationStats();
+
+	// shared block: both intrinsics+distortion blocks and the rig transform
+	static const int MAX_SHARED = 2*CvLMCalibSolver::MAX_INTRINSICS + CvLMCalibSolver::POSE_PARAMS;
+
+private:
+	//private members
+
+	cv::TermCriteria criteria_;
+
+	std::vector<CvLMCalibSolver::IterationStats> stats_;
+
+};
+
+#endif //__CV_LM_STEREO_SOLVER__H
@@ -0,0 +1,275 @@
+/*==========================================================================
+
+  Copyright (c) 2014 Uditha L. Jayarathne, ujayarat@robarts.ca
+
+  Use, modification and redistribution of the software, in source or
+  binary forms, are permitted provided that the following terms and
+  conditions are met:
+
+  1) Redistribution of the source code, in verbatim or modified
+  form, must retain the above copyright notice, this license,
+  the following disclaimer, and any notices that refer to this
+  license and/or the following disclaimer.  
+
+  2) Redistribution in binary form must include the above copyright
+  notice, a copy of this license and the following disclaimer
+  in the documentation or with other materials provided with the
+  distribution.
+
+  3) Modified copies of the source code must be clearly marked as such,
+  and must not be misrepresented as verbatim copies of the source code.
+
+  THE COPYRIGHT HOLDERS AND/OR OTHER PARTIES PROVIDE THE SOFTWARE "AS IS"
+  WITHOUT EXPRESSED OR IMPLIED WARRANTY INCLUDING, BUT NOT LIMITED TO,
+  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  PURPOSE.  IN NO EVENT SHALL ANY COPYRIGHT HOLDER OR OTHER PARTY WHO MAY
+  MODIFY AND/OR REDISTRIBUTE THE SOFTWARE UNDER THE TERMS OF THIS LICENSE
+  BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, LOSS OF DATA OR DATA BECOMING INACCURATE
+  OR LOSS OF PROFIT OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF
+  THE USE OR INABILITY TO USE THE SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGES.
+  =========================================================================*/
+
+#include "cv_point_projector.h"
+#include "cv_distortion_model.h"
+
+/**
+ * Projection kernel for one pose. N_DIST is the distortion model (0, 4, 5
+ * or 8) so the unused terms are removed at compile time.
+ */
+template<int N_DIST>
+static void projectKernel(const float *cam, const float *k, 
+						  const float *R, const float *t, 
+						  const float *px, const float *py, const float *pz, 
+						  int n, float *pu, float *pv){
+
+	typedef CvDistortionModel<N_DIST> Model;
+	int i = 0;
+
+#if CV_SSE2
+	const __m128 one = _mm_set1_ps(1.f), two = _mm_set1_ps(2.f);
+	const __m128 r0 = _mm_set1_ps(R[0]), r1 = _mm_set1_ps(R[1]), r2 = _mm_set1_ps(R[2]);
+	const __m128 r3 = _mm_set1_ps(R[3]), r4 = _mm_set1_ps(R[4]), r5 = _mm_set1_ps(R[5]);
+	const __m128 r6 = _mm_set1_ps(R[6]), r7 = _mm_set1_ps(R[7]), r8 = _mm_set1_ps(R[8]);
+	const __m128 t0 = _mm_set1_ps(t[0]), t1 = _mm_set1_ps(t[1]), t2 = _mm_set1_ps(t[2]);
+	const __m128 fx = _mm_set1_ps(cam[0]), fy = _mm_set1_ps(cam[1]);
+	const __m128 cx = _mm_set1_ps(cam[2]), cy = _mm_set1_ps(cam[3]);
+	const __m128 k1 = _mm_set1_ps(Model::DISTORTED ? k[0] : 0.f);
+	const __m128 k2 = _mm_set1_ps(Model::DISTORTED ? k[1] : 0.f);
+	const __m128 p1 = _mm_set1_ps(Model::DISTORTED ? k[2] : 0.f);
+	const __m128 p2 = _mm_set1_ps(Model::DISTORTED ? k[3] : 0.f);
+	const __m128 k3 = _mm_set1_ps(Model::HAS_K3 ? k[4] : 0.f);
+	const __m128 k4 = _mm_set1_ps(Model::RATIONAL ? k[5] : 0.f);
+	const __m128 k5 = _mm_set1_ps(Model::RATIONAL ? k[6] : 0.f);
+	const __m128 k6 = _mm_set1_ps(Model::RATIONAL ? k[7] : 0.f);
+
+	for(; i <= n-4; i += 4){
+		__m128 X = _mm_loadu_ps(px+i), Y = _mm_loadu_ps(py+i), Z = _mm_loadu_ps(pz+i);
+
+		__m128 Xc = _mm_add_ps(_mm_add_ps(_mm_mul_ps(r0, X), _mm_mul_ps(r1, Y)), 
+								_mm_add_ps(_mm_mul_ps(r2, Z), t0));
+		__m128 Yc = _mm_add_ps(_mm_add_ps(_mm_mul_ps(r3, X), _mm_mul_ps(r4, Y)), 
+								_mm_add_ps(_mm_mul_ps(r5, Z), t1));
+		__m128 Zc = _mm_add_ps(_mm_add_ps(_mm_mul_ps(r6, X), _mm_mul_ps(r7, Y)), 
+								_mm_add_ps(_mm_mul_ps(r8, Z), t2));
+
+		__m128 iz = _mm_div_ps(one, Zc);
+		__m128 x = _mm_mul_ps(Xc, iz), y = _mm_mul_ps(Yc, iz);
+		__m128 xd = x, yd = y;
+
+		if(Model::DISTORTED){
+			__m128 xx = _mm_mul_ps(x, x), yy = _mm_mul_ps(y, y), xy = _mm_mul_ps(x, y);
+			__m128 rr = _mm_add_ps(xx, yy);
+
+			// Horner form of 1 + k1 r^2 + k2 r^4 [+ k3 r^6]
+			__m128 radial = Model::HAS_K3 ? _mm_add_ps(k2, _mm_mul_ps(rr, k3)) : k2;
+			radial = _mm_add_ps(one, _mm_mul_ps(rr, _mm_add_ps(k1, _mm_mul_ps(rr, radial))));
+			if(Model::RATIONAL){
+				__m128 den = _mm_add_ps(k5, _mm_mul_ps(rr, k6));
+				den = _mm_add_ps(one, _mm_mul_ps(rr, _mm_add_ps(k4, _mm_mul_ps(rr, den))));
+				radial = _mm_div_ps(radial, den);
+			}
+
+			__m128 xy2 = _mm_mul_ps(two, xy);
+			xd = _mm_add_ps(_mm_mul_ps(x, radial), 
+							_mm_add_ps(_mm_mul_ps(p1, xy2), 
+									   _mm_mul_ps(p2, _mm_add_ps(rr, _mm_mul_ps(two, xx)))));
+			yd = _mm_add_ps(_mm_mul_ps(y, radial), 
+							_mm_add_ps(_mm_mul_ps(p1, _mm_add_ps(rr, _mm_mul_ps(two, yy))), 
+									   _mm_mul_ps(p2, xy2)));
+		}
+
+		_mm_storeu_ps(pu+i, _mm_add_ps(_mm_mul_ps(fx, xd), cx));
+		_mm_storeu_ps(pv+i, _mm_add_ps(_mm_mul_ps(fy, yd), cy));
+	}
+#endif
+
+	// remaining points
+	for(; i<n; i++){
+		float X = px[i], Y = py[i], Z = pz[i];
+		float Xc = R[0]*X + R[1]*Y + R[2]*Z + t[0];
+		float Yc = R[3]*X + R[4]*Y + R[5]*Z + t[1];
+		float Zc = R[6]*X + R[7]*Y + R[8]*Z + t[2];
+
+		float iz = 1.f/Zc;
+		float xd, yd;
+		Model::distort(k, Xc*iz, Yc*iz, &xd, &yd);
+
+		pu[i] = cam[0]*xd + cam[2];
+		pv[i] = cam[1]*yd + cam[3];
+	}
+}
+
+// Loop body run by cv::parallel_for_. Each index is one view. 
+class ProjectViewsBody : public cv::ParallelLoopBody{
+
+public:
+	ProjectViewsBody(const CvPointProjector *projector, 
+					 const CvPointProjector::Points3 *points, 
+					 const std::vector<int> *offsets, 
+					 const std::vector<cv::Mat> *rVecs, 
+					 const std::vector<cv::Mat> *tVecs, 
+					 CvPointProjector::Points2 *projected) :
+		projector_(projector), points_(points), offsets_(offsets), 
+		rVecs_(rVecs), tVecs_(tVecs), projected_(projected){}
+
+	void operator()(const cv::Range &range) const{
+
+		for(int v=range.start; v<range.end; v++){
+			int first = (*offsets_)[v];
+			int n = (*offsets_)[v+1] - first;
+			if(n <= 0)
+				continue;
+
+			projector_->projectRange(&points_->x[first], &points_->y[first], 
+									 &points_->z[first], n, 
+									 (*rVecs_)[v], (*tVecs_)[v], 
+									 &projected_->u[first], &projected_->v[first]);
+		}
+	}
+
+private:
+	const CvPointProjector *projector_;
+	const CvPointProjector::Points3 *points_;
+	const std::vector<int> *offsets_;
+	const std::vector<cv::Mat> *rVecs_;
+	const std::vector<cv::Mat> *tVecs_;
+	CvPointProjector::Points2 *projected_;
+};
+
+CvPointProjector::CvPointProjector(){
+
+	camera_[0] = camera_[1] = 1.f;
+	camera_[2] = camera_[3] = 0.f;
+	for(int i=0; i<8; i++)
+		distortion_[i] = 0.f;
+	n_distortion_ = 0;
+}
+
+CvPointProjector::~CvPointProjector(){
+
+}
+
+bool CvPointProjector::setCamera(const cv::Mat &intrinsics, const cv::Mat &distortion_params){
+
+	int n_dist = distortion_params.empty() ? 0 : 
+					distortion_params.rows*distortion_params.cols;
+	if(n_dist != 0 && n_dist != 4 && n_dist != 5 && n_dist != 8){
+		std::cerr << "Unsupported distortion model" << std::endl;
+		return false;
+	}
+
+	cv::Mat K, D;
+	intrinsics.convertTo(K, CV_64F);
+	camera_[0] = (float)K.at<double>(0, 0);
+	camera_[1] = (float)K.at<double>(1, 1);
+	camera_[2] = (float)K.at<double>(0, 2);
+	camera_[3] = (float)K.at<double>(1, 2);
+
+	for(int i=0; i<8; i++)
+		distortion_[i] = 0.f;
+	if(n_dist > 0){
+		distortion_params.convertTo(D, CV_64F);
+		for(int i=0; i<n_dist; i++)
+			distortion_[i] = (float)D.at<double>(i);
+	}
+	n_distortion_ = n_dist;
+
+	return true;
+}
+
+void CvPointProjector::project(const Points3 &points, const std::vector<int> &offsets, 
+							   const std::vector<cv::Mat> &rVecs, 
+							   const std::vector<cv::Mat> &tVecs, 
+							   Points2 *projected) const{
+
+	int n_views = (int)offsets.size() - 1;
+	int n_points = n_views > 0 ? offsets[n_views] : 0;
+
+	projected->u.resize(n_points);
+	projected->v.resize(n_points);
+	if(n_points == 0)
+		return;
+
+	cv::parallel_for_(cv::Range(0, n_views), 
+						ProjectViewsBody(this, &points, &offsets, &rVecs, &tVecs, 
+										 projected));
+}
+
+void CvPointProjector::project(const Points3 &points, const cv::Mat &rvec, 
+							   const cv::Mat &tvec, Points2 *projected) const{
+
+	int n = points.x.size();
+	projected->u.resize(n);
+	projected->v.resize(n);
+	if(n == 0)
+		return;
+
+	projectRange(&points.x[0], &points.y[0], &points.z[0], n, rvec, tvec, 
+				 &projected->u[0], &projected->v[0]);
+}
+
+void CvPointProjector::projectRange(const float *px, const float *py, const float *pz, 
+									int n, const cv::Mat &rvec, const cv::Mat &tvec, 
+									float *pu, float *pv) const{
+
+	cv::Mat r64, t64, R64;
+	rvec.convertTo(r64, CV_64F);
+	tvec.convertTo(t64, CV_64F);
+	cv::Rodrigues(r64, R64);
+
+	float R[9], t[3];
+	for(int i=0; i<9; i++)
+		R[i] = (float)R64.at<double>(i/3, i%3);
+	for(int i=0; i<3; i++)
+		t[i] = (float)t64.at<double>(i);
+
+	switch(n_distortion_){
+		case 0:
+			projectKernel<0>(camera_, distortion_, R, t, px, py, pz, n, pu, pv);
+			break;
+		case 4:
+			projectKernel<4>(camera_, distortion_, R, t, px, py, pz, n, pu, pv);
+			break;
+		case 5:
+			projectKernel<5>(camera_, distortion_, R, t, px, py, pz, n, pu, pv);
+			break;
+		case 8:
+			projectKernel<8>(camera_, distortion_, R, t, px, py, pz, n, pu, pv);
+			break;
+	}
+}
+
+void CvPointProjector::toSoA(const std::vector<cv::Point3f> &points, Points3 *soa){
+
+	int n = points.size();
+	soa->x.resize(n);
+	soa->y.resize(n);
+	soa->z.resize(n);
+	for(int i=0; i<n; i++){
+		soa->x[i] = points[i].x;
+		soa->y[i] = points[i].y;
+		soa->z[i] = points[i].z;
+	}
+}
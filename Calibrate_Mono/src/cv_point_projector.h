@@ -0,0 +1,132 @@
+/*==========================================================================
+
+  Copyright (c) 2014 Uditha L. Jayarathne, ujayarat@robarts.ca
+
+  Use, modification and redistribution of the software, in source or
+  binary forms, are permitted provided that the following terms and
+  conditions are met:
+
+  1) Redistribution of the source code, in verbatim or modified
+  form, must retain the above copyright notice, this license,
+  the following disclaimer, and any notices that refer to this
+  license and/or the following disclaimer.  
+
+  2) Redistribution in binary form must include the above copyright
+  notice, a copy of this license and the following disclaimer
+  in the documentation or with other materials provided with the
+  distribution.
+
+  3) Modified copies of the source code must be clearly marked as such,
+  and must not be misrepresented as verbatim copies of the source code.
+
+  THE COPYRIGHT HOLDERS AND/OR OTHER PARTIES PROVIDE THE SOFTWARE "AS IS"
+  WITHOUT EXPRESSED OR IMPLIED WARRANTY INCLUDING, BUT NOT LIMITED TO,
+  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  PURPOSE.  IN NO EVENT SHALL ANY COPYRIGHT HOLDER OR OTHER PARTY WHO MAY
+  MODIFY AND/OR REDISTRIBUTE THE SOFTWARE UNDER THE TERMS OF THIS LICENSE
+  BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, LOSS OF DATA OR DATA BECOMING INACCURATE
+  OR LOSS OF PROFIT OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF
+  THE USE OR INABILITY TO USE THE SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGES.
+  =========================================================================*/
+
+#ifndef __CV_POINT_PROJECTOR__H
+#define __CV_POINT_PROJECTOR__H
+
+#include <iostream>
+#include <vector>
+
+// Opencv Includes 
+#include "cv.h"
+
+/**
+ * Batched point projection for OpenCV's pinhole camera with 0 (none), 4, 5
+ * or 8 distortion params. Points are held as structure of arrays so the
+ * kernels project several points per SIMD register; one kernel is compiled
+ * per distortion model and selected once per view.
+ */
+class CvPointProjector{
+
+public:
+
+	// Structure of arrays point buffers
+	typedef struct Points3{
+		std::vector<float> x;
+		std::vector<float> y;
+		std::vector<float> z;
+	} Points3;
+
+	typedef struct Points2{
+		std::vector<float> u;
+		std::vector<float> v;
+	} Points2;
+
+	CvPointProjector();
+	~CvPointProjector();
+
+	//public methods
+
+	/**
+	 * Set the camera model
+	 * @param 3x3 camera matrix
+	 * @param distortion params, empty or 4, 5 or 8 elements
+	 * @return false for an unsupported distortion model
+	 */
+	bool setCamera(const cv::Mat &, const cv::Mat &);
+
+	/**
+	 * Project the object points of many views. Views are processed in
+	 * parallel.
+	 * @param object points of all views, concatenated
+	 * @param offset of the first point of every view, plus the total count
+	 * @param per-view 3x1 rotation vectors
+	 * @param per-view 3x1 translation vectors
+	 * @param reference to the projected points, same layout as the input
+	 */
+	void project(const Points3 &, const std::vector<int> &, 
+				 const std::vector<cv::Mat> &, const std::vector<cv::Mat> &, 
+				 Points2 *) const;
+
+	/**
+	 * Project the object points of one view
+	 * @param object points
+	 * @param 3x1 rotation vector
+	 * @param 3x1 translation vector
+	 * @param reference to the projected points
+	 */
+	void project(const Points3 &, const cv::Mat &, const cv::Mat &, 
+				 Points2 *) const;
+
+	/**
+	 * Project a range of object points with a given pose
+	 * @param object point arrays x, y, z
+	 * @param number of points
+	 * @param 3x1 rotation vector
+	 * @param 3x1 translation vector
+	 * @param output arrays u, v
+	 */
+	void projectRange(const float *, const float *, const float *, int, 
+					  const cv::Mat &, const cv::Mat &, 
+					  float *, float *) const;
+
+	/**
+	 * Copy points into a structure of arrays
+	 * @param points
+	 * @param reference to the point buffer
+	 */
+	static void toSoA(const std::vector<cv::Point3f> &, Points3 *);
+
+private:
+	//private members
+
+	// fx, fy, cx, cy
+	float camera_[4];
+
+	// distortion params in OpenCV order
+	float distortion_[8];
+	int n_distortion_;
+
+};
+
+#endif //__CV_POINT_PROJECTOR__H
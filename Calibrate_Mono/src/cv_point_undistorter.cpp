@@ -0,0 +1,310 @@
+/*==========================================================================
+
+  Copyright (c) 2014 Uditha L. Jayarathne, ujayarat@robarts.ca
+
+  Use, modification and redistribution of the software, in source or
+  binary forms, are permitted provided that the following terms and
+  conditions are met:
+
+  1) Redistribution of the source code, in verbatim or modified
+  form, must retain the above copyright notice, this license,
+  the following disclaimer, and any notices that refer to this
+  license and/or the following disclaimer.  
+
+  2) Redistribution in binary form must include the above copyright
+  notice, a copy of this license and the following disclaimer
+  in the documentation or with other materials provided with the
+  distribution.
+
+  3) Modified copies of the source code must be clearly marked as such,
+  and must not be misrepresented as verbatim copies of the source code.
+
+  THE COPYRIGHT HOLDERS AND/OR OTHER PARTIES PROVIDE THE SOFTWARE "AS IS"
+  WITHOUT EXPRESSED OR IMPLIED WARRANTY INCLUDING, BUT NOT LIMITED TO,
+  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  PURPOSE.  IN NO EVENT SHALL ANY COPYRIGHT HOLDER OR OTHER PARTY WHO MAY
+  MODIFY AND/OR REDISTRIBUTE THE SOFTWARE UNDER THE TERMS OF THIS LICENSE
+  BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, LOSS OF DATA OR DATA BECOMING INACCURATE
+  OR LOSS OF PROFIT OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF
+  THE USE OR INABILITY TO USE THE SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGES.
+  =========================================================================*/
+
+#include <algorithm>
+
+#include "cv_point_undistorter.h"
+#include "cv_distortion_model.h"
+
+/**
+ * Undistortion kernel. N_DIST is the distortion model (0, 4, 5 or 8) so 
+ * the unused terms are removed at compile time. Every point runs the same
+ * number of iterations, so there are no per-point branches.
+ */
+template<int N_DIST>
+static void undistortKernel(const CvPointUndistorter *undistorter, bool seeded, 
+							const float *cam, const float *k, int iterations, 
+							const float *pu, const float *pv, int n, 
+							float *out_u, float *out_v){
+
+	typedef CvDistortionModel<N_DIST> Model;
+	const float ifx = 1.f/cam[0], ify = 1.f/cam[1];
+	int i = 0;
+
+#if CV_SSE2
+	const __m128 one = _mm_set1_ps(1.f), two = _mm_set1_ps(2.f);
+	const __m128 fx = _mm_set1_ps(cam[0]), fy = _mm_set1_ps(cam[1]);
+	const __m128 cx = _mm_set1_ps(cam[2]), cy = _mm_set1_ps(cam[3]);
+	const __m128 ifx4 = _mm_set1_ps(ifx), ify4 = _mm_set1_ps(ify);
+	const __m128 k1 = _mm_set1_ps(Model::DISTORTED ? k[0] : 0.f);
+	const __m128 k2 = _mm_set1_ps(Model::DISTORTED ? k[1] : 0.f);
+	const __m128 p1 = _mm_set1_ps(Model::DISTORTED ? k[2] : 0.f);
+	const __m128 p2 = _mm_set1_ps(Model::DISTORTED ? k[3] : 0.f);
+	const __m128 k3 = _mm_set1_ps(Model::HAS_K3 ? k[4] : 0.f);
+	const __m128 k4 = _mm_set1_ps(Model::RATIONAL ? k[5] : 0.f);
+	const __m128 k5 = _mm_set1_ps(Model::RATIONAL ? k[6] : 0.f);
+	const __m128 k6 = _mm_set1_ps(Model::RATIONAL ? k[7] : 0.f);
+
+	for(; Model::DISTORTED && i <= n-4; i += 4){
+		__m128 xd = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(pu+i), cx), ifx4);
+		__m128 yd = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(pv+i), cy), ify4);
+
+		__m128 x = xd, y = yd;
+		if(seeded){
+			float sx[4], sy[4];
+			for(int j=0; j<4; j++)
+				undistorter->seed(pu[i+j], pv[i+j], &sx[j], &sy[j]);
+			x = _mm_loadu_ps(sx);
+			y = _mm_loadu_ps(sy);
+		}
+
+		// x = (xd - tangential(x))/radial(x), as CvDistortionModel::undistort
+		for(int it=0; it<iterations; it++){
+			__m128 xx = _mm_mul_ps(x, x), yy = _mm_mul_ps(y, y), xy2 = _mm_mul_ps(two, _mm_mul_ps(x, y));
+			__m128 rr = _mm_add_ps(xx, yy);
+
+			__m128 radial = Model::HAS_K3 ? _mm_add_ps(k2, _mm_mul_ps(rr, k3)) : k2;
+			radial = _mm_add_ps(one, _mm_mul_ps(rr, _mm_add_ps(k1, _mm_mul_ps(rr, radial))));
+			__m128 inv_radial = _mm_div_ps(one, radial);
+			if(Model::RATIONAL){
+				__m128 den = _mm_add_ps(k5, _mm_mul_ps(rr, k6));
+				den = _mm_add_ps(one, _mm_mul_ps(rr, _mm_add_ps(k4, _mm_mul_ps(rr, den))));
+				inv_radial = _mm_mul_ps(inv_radial, den);
+			}
+
+			__m128 dx = _mm_add_ps(_mm_mul_ps(p1, xy2), 
+								   _mm_mul_ps(p2, _mm_add_ps(rr, _mm_mul_ps(two, xx))));
+			__m128 dy = _mm_add_ps(_mm_mul_ps(p1, _mm_add_ps(rr, _mm_mul_ps(two, yy))), 
+								   _mm_mul_ps(p2, xy2));
+			x = _mm_mul_ps(_mm_sub_ps(xd, dx), inv_radial);
+			y = _mm_mul_ps(_mm_sub_ps(yd, dy), inv_radial);
+		}
+
+		_mm_storeu_ps(out_u+i, _mm_add_ps(_mm_mul_ps(fx, x), cx));
+		_mm_storeu_ps(out_v+i, _mm_add_ps(_mm_mul_ps(fy, y), cy));
+	}
+#endif
+
+	// remaining points
+	for(; i<n; i++){
+		float xd = (pu[i] - cam[2])*ifx, yd = (pv[i] - cam[3])*ify;
+		float x = xd, y = yd;
+
+		if(Model::DISTORTED){
+			if(seeded)
+				undistorter->seed(pu[i], pv[i], &x, &y);
+
+			// same update as CvDistortionModel::undistort, from the seed
+			for(int it=0; it<iterations; it++){
+				float r2 = x*x + y*y;
+				float inv_radial = 1/Model::radialTerm(k, r2);
+				float dx = 2*k[2]*x*y + k[3]*(r2 + 2*x*x);
+				float dy = k[2]*(r2 + 2*y*y) + 2*k[3]*x*y;
+				x = (xd - dx)*inv_radial;
+				y = (yd - dy)*inv_radial;
+			}
+		}
+
+		out_u[i] = cam[0]*x + cam[2];
+		out_v[i] = cam[1]*y + cam[3];
+	}
+}
+
+// Loop body run by cv::parallel_for_. Each index is one block of points.
+class UndistortBlocksBody : public cv::ParallelLoopBody{
+
+public:
+	UndistortBlocksBody(const CvPointUndistorter *undistorter, 
+						const CvPointProjector::Points2 *points, int block_size,
+						CvPointProjector::Points2 *undistorted) :
+		undistorter_(undistorter), points_(points), block_size_(block_size), 
+		undistorted_(undistorted){}
+
+	void operator()(const cv::Range &range) const{
+
+		int n_points = points_->u.size();
+		for(int b=range.start; b<range.end; b++){
+			int first = b*block_size_;
+			int n = std::min(block_size_, n_points - first);
+
+			undistorter_->undistortRange(&points_->u[first], &points_->v[first], n, 
+										 &undistorted_->u[first], &undistorted_->v[first]);
+		}
+	}
+
+private:
+	const CvPointUndistorter *undistorter_;
+	const CvPointProjector::Points2 *points_;
+	int block_size_;
+	CvPointProjector::Points2 *undistorted_;
+};
+
+CvPointUndistorter::CvPointUndistorter(){
+
+	camera_[0] = camera_[1] = 1.f;
+	camera_[2] = camera_[3] = 0.f;
+	for(int i=0; i<8; i++)
+		distortion_[i] = 0.f;
+	n_distortion_ = 0;
+	iterations_ = 5;
+
+	grid_cols_ = grid_rows_ = 0;
+	grid_step_ = 1.f;
+}
+
+CvPointUndistorter::~CvPointUndistorter(){
+
+}
+
+bool CvPointUndistorter::setCamera(const cv::Mat &intrinsics, const cv::Mat &distortion_params){
+
+	int n_dist = distortion_params.empty() ? 0 : 
+					distortion_params.rows*distortion_params.cols;
+	if(n_dist != 0 && n_dist != 4 && n_dist != 5 && n_dist != 8){
+		std::cerr << "Unsupported distortion model" << std::endl;
+		return false;
+	}
+
+	cv::Mat K, D;
+	intrinsics.convertTo(K, CV_64F);
+	camera_[0] = (float)K.at<double>(0, 0);
+	camera_[1] = (float)K.at<double>(1, 1);
+	camera_[2] = (float)K.at<double>(0, 2);
+	camera_[3] = (float)K.at<double>(1, 2);
+
+	for(int i=0; i<8; i++)
+		distortion_[i] = 0.f;
+	if(n_dist > 0){
+		distortion_params.convertTo(D, CV_64F);
+		for(int i=0; i<n_dist; i++)
+			distortion_[i] = (float)D.at<double>(i);
+	}
+	n_distortion_ = n_dist;
+
+	// a grid of the previous camera would seed far off
+	grid_x_.clear();
+	grid_y_.clear();
+	grid_cols_ = grid_rows_ = 0;
+
+	return true;
+}
+
+void CvPointUndistorter::setIterations(int iterations){
+	iterations_ = std::max(iterations, 0);
+}
+
+void CvPointUndistorter::buildSeedGrid(cv::Size image_size, int step){
+
+	grid_step_ = (float)std::max(step, 1);
+	grid_cols_ = (int)std::ceil((image_size.width - 1)/grid_step_) + 1;
+	grid_rows_ = (int)std::ceil((image_size.height - 1)/grid_step_) + 1;
+	grid_x_.resize(grid_cols_*grid_rows_);
+	grid_y_.resize(grid_cols_*grid_rows_);
+
+	// a few points per cell, so solve them to convergence in double
+	double k[8];
+	for(int i=0; i<8; i++)
+		k[i] = distortion_[i];
+
+	for(int r=0; r<grid_rows_; r++)
+		for(int c=0; c<grid_cols_; c++){
+			double xd = (c*grid_step_ - camera_[2])/camera_[0];
+			double yd = (r*grid_step_ - camera_[3])/camera_[1];
+			double x = xd, y = yd;
+
+			switch(n_distortion_){
+				case 4:
+					CvDistortionModel<4>::undistort(k, xd, yd, 50, &x, &y);
+					break;
+				case 5:
+					CvDistortionModel<5>::undistort(k, xd, yd, 50, &x, &y);
+					break;
+				case 8:
+					CvDistortionModel<8>::undistort(k, xd, yd, 50, &x, &y);
+					break;
+			}
+
+			grid_x_[r*grid_cols_ + c] = (float)x;
+			grid_y_[r*grid_cols_ + c] = (float)y;
+		}
+}
+
+void CvPointUndistorter::seed(float u, float v, float *x, float *y) const{
+
+	// points off the grid take the seed of the nearest border cell
+	float gx = std::min(std::max(u/grid_step_, 0.f), (float)(grid_cols_ - 1));
+	float gy = std::min(std::max(v/grid_step_, 0.f), (float)(grid_rows_ - 1));
+	int c = std::min((int)gx, grid_cols_ - 2), r = std::min((int)gy, grid_rows_ - 2);
+	float ax = gx - c, ay = gy - r;
+
+	int i = r*grid_cols_ + c;
+	const float *gxs = &grid_x_[0], *gys = &grid_y_[0];
+	*x = (1 - ay)*((1 - ax)*gxs[i] + ax*gxs[i + 1]) + 
+		 ay*((1 - ax)*gxs[i + grid_cols_] + ax*gxs[i + grid_cols_ + 1]);
+	*y = (1 - ay)*((1 - ax)*gys[i] + ax*gys[i + 1]) + 
+		 ay*((1 - ax)*gys[i + grid_cols_] + ax*gys[i + grid_cols_ + 1]);
+}
+
+void CvPointUndistorter::undistort(const CvPointProjector::Points2 &points, 
+								   CvPointProjector::Points2 *undistorted) const{
+
+	int n = points.u.size();
+	undistorted->u.resize(n);
+	undistorted->v.resize(n);
+	if(n == 0)
+		return;
+
+	// a few thousand points per frame fit one block, larger sets spread out
+	const int block_size = 4096;
+	int n_blocks = (n + block_size - 1)/block_size;
+	if(n_blocks == 1)
+		undistortRange(&points.u[0], &points.v[0], n, &undistorted->u[0], &undistorted->v[0]);
+	else
+		cv::parallel_for_(cv::Range(0, n_blocks), 
+							UndistortBlocksBody(this, &points, block_size, undistorted));
+}
+
+void CvPointUndistorter::undistortRange(const float *pu, const float *pv, int n, 
+										float *out_u, float *out_v) const{
+
+	bool seeded = grid_cols_ > 1 && grid_rows_ > 1;
+
+	switch(n_distortion_){
+		case 0:
+			undistortKernel<0>(this, seeded, camera_, distortion_, iterations_, 
+							   pu, pv, n, out_u, out_v);
+			break;
+		case 4:
+			undistortKernel<4>(this, seeded, camera_, distortion_, iterations_, 
+							   pu, pv, n, out_u, out_v);
+			break;
+		case 5:
+			undistortKernel<5>(this, seeded, camera_, distortion_, iterations_, 
+							   pu, pv, n, out_u, out_v);
+			break;
+		case 8:
+			undistortKernel<8>(this, seeded, camera_, distortion_, iterations_, 
+							   pu, pv, n, out_u, out_v);
+			break;
+	}
+}
@@ -0,0 +1,133 @@
+/*==========================================================================
+
+  Copyright (c) 2014 Uditha L. Jayarathne, ujayarat@robarts.ca
+
+  Use, modification and redistribution of the software, in source or
+  binary forms, are permitted provided that the following terms and
+  conditions are met:
+
+  1) Redistribution of the source code, in verbatim or modified
+  form, must retain the above copyright notice, this license,
+  the following disclaimer, and any notices that refer to this
+  license and/or the following disclaimer.  
+
+  2) Redistribution in binary form must include the above copyright
+  notice, a copy of this license and the following disclaimer
+  in the documentation or with other materials provided with the
+  distribution.
+
+  3) Modified copies of the source code must be clearly marked as such,
+  and must not be misrepresented as verbatim copies of the source code.
+
+  THE COPYRIGHT HOLDERS AND/OR OTHER PARTIES PROVIDE THE SOFTWARE "AS IS"
+  WITHOUT EXPRESSED OR IMPLIED WARRANTY INCLUDING, BUT NOT LIMITED TO,
+  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  PURPOSE.  IN NO EVENT SHALL ANY COPYRIGHT HOLDER OR OTHER PARTY WHO MAY
+  MODIFY AND/OR REDISTRIBUTE THE SOFTWARE UNDER THE TERMS OF THIS LICENSE
+  BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, LOSS OF DATA OR DATA BECOMING INACCURATE
+  OR LOSS OF PROFIT OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF
+  THE USE OR INABILITY TO USE THE SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGES.
+  =========================================================================*/
+
+#ifndef __CV_POINT_UNDISTORTER__H
+#define __CV_POINT_UNDISTORTER__H
+
+#include <iostream>
+#include <vector>
+
+// Opencv Includes 
+#include "cv.h"
+
+#include "cv_point_projector.h"
+
+/**
+ * Batched undistortion of sparse image points, e.g. tracked features, for 
+ * OpenCV's pinhole camera with 0 (none), 4, 5 or 8 distortion params. 
+ * Distortion is inverted with a fixed number of fixed-point iterations on
+ * several points per SIMD register, so the cost scales with the number of
+ * points and not with the image size. An optional coarse grid holding the
+ * inverse at sparse pixel positions seeds the iterations near the 
+ * solution, so far fewer iterations reach the same accuracy.
+ */
+class CvPointUndistorter{
+
+public:
+
+	CvPointUndistorter();
+	~CvPointUndistorter();
+
+	//public methods
+
+	/**
+	 * Set the camera model. Drops the seed grid.
+	 * @param 3x3 camera matrix
+	 * @param distortion params, empty or 4, 5 or 8 elements
+	 * @return false for an unsupported distortion model
+	 */
+	bool setCamera(const cv::Mat &, const cv::Mat &);
+
+	/**
+	 * Set the number of solver iterations
+	 * @param iterations, default 5 as cv::undistortPoints
+	 */
+	void setIterations(int);
+
+	/**
+	 * Precompute the inverse on a coarse grid over the image. Later 
+	 * calls seed every point from the grid.
+	 * @param image size
+	 * @param grid spacing in pixels
+	 */
+	void buildSeedGrid(cv::Size, int);
+
+	/**
+	 * Undistort points into pixel coordinates of the same camera, as
+	 * cv::undistortPoints with P = camera matrix. Large batches are 
+	 * split across cores.
+	 * @param distorted points
+	 * @param reference to the undistorted points
+	 */
+	void undistort(const CvPointProjector::Points2 &, CvPointProjector::Points2 *) const;
+
+	/**
+	 * Undistort a range of points on the calling thread
+	 * @param distorted point arrays u, v
+	 * @param number of points
+	 * @param output arrays u, v, may be the input arrays
+	 */
+	void undistortRange(const float *, const float *, int, float *, float *) const;
+
+	/**
+	 * Initial guess of the solver, interpolated from the seed grid
+	 * @param distorted u
+	 * @param distorted v
+	 * @param reference to normalized undistorted x
+	 * @param reference to normalized undistorted y
+	 */
+	void seed(float, float, float *, float *) const;
+
+private:
+
+	//private members
+
+	// fx, fy, cx, cy
+	float camera_[4];
+
+	// distortion params in OpenCV order
+	float distortion_[8];
+	int n_distortion_;
+
+	int iterations_;
+
+	// normalized undistorted x, y at every grid node, row-major
+	std::vector<float> grid_x_;
+	std::vector<float> grid_y_;
+	int grid_cols_;
+	int grid_rows_;
+	float grid_step_;
+
+};
+
+#endif //__CV_POINT_UNDISTORTER__H
@@ -0,0 +1,361 @@
+/*==========================================================================
+
+  Copyright (c) 2014 Uditha L. Jayarathne, ujayarat@robarts.ca
+
+  Use, modification and redistribution of the software, in source or
+  binary forms, are permitted provided that the following terms and
+  conditions are met:
+
+  1) Redistribution of the source code, in verbatim or modified
+  form, must retain the above copyright notice, this license,
+  the following disclaimer, and any notices that refer to this
+  license and/or the following disclaimer.  
+
+  2) Redistribution in binary form must include the above copyright
+  notice, a copy of this license and the following disclaimer
+  in the documentation or with other materials provided with the
+  distribution.
+
+  3) Modified copies of the source code must be clearly marked as such,
+  and must not be misrepresented as verbatim copies of the source code.
+
+  THE COPYRIGHT HOLDERS AND/OR OTHER PARTIES PROVIDE THE SOFTWARE "AS IS"
+  WITHOUT EXPRESSED OR IMPLIED WARRANTY INCLUDING, BUT NOT LIMITED TO,
+  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  PURPOSE.  IN NO EVENT SHALL ANY COPYRIGHT HOLDER OR OTHER PARTY WHO MAY
+  MODIFY AND/OR REDISTRIBUTE THE SOFTWARE UNDER THE TERMS OF THIS LICENSE
+  BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, LOSS OF DATA OR DATA BECOMING INACCURATE
+  OR LOSS OF PROFIT OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF
+  THE USE OR INABILITY TO USE THE SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGES.
+  =========================================================================*/
+
+#include <algorithm>
+
+#include "cv_stereo_pair_detector.h"
+
+// Loop body run by cv::parallel_for_. Each index is one stereo pair.
+class PairDetectionBody : public cv::ParallelLoopBody{
+
+public:
+	PairDetectionBody(const CvStereoPairDetector *detector, 
+					  const std::vector<std::string> *left_files, 
+					  const std::vector<std::string> *right_files, 
+					  std::vector<CvStereoPairDetector::EyeImage> *left_eyes, 
+					  std::vector<CvStereoPairDetector::EyeImage> *right_eyes, 
+					  std::vector<int> *outcomes) :
+		detector_(detector), left_files_(left_files), right_files_(right_files), 
+		left_eyes_(left_eyes), right_eyes_(right_eyes), outcomes_(outcomes){}
+
+	void operator()(const cv::Range &range) const{
+
+		// every index owns its slots, no locking needed
+		for(int i=range.start; i<range.end; i++){
+			(*outcomes_)[i] = detector_->processPair((*left_files_)[i], (*right_files_)[i], 
+													 NULL, NULL, 
+													 &(*left_eyes_)[i], &(*right_eyes_)[i]);
+
+			// only the corners are kept once the pair is done
+			std::vector<uchar>().swap((*left_eyes_)[i].buffer);
+			std::vector<uchar>().swap((*right_eyes_)[i].buffer);
+			(*left_eyes_)[i].frame_gry.release();
+			(*right_eyes_)[i].frame_gry.release();
+		}
+	}
+
+private:
+	const CvStereoPairDetector *detector_;
+	const std::vector<std::string> *left_files_;
+	const std::vector<std::string> *right_files_;
+	std::vector<CvStereoPairDetector::EyeImage> *left_eyes_;
+	std::vector<CvStereoPairDetector::EyeImage> *right_eyes_;
+	std::vector<int> *outcomes_;
+};
+
+CvStereoPairDetector::CvStereoPairDetector(CvCornerDetector *detector):
+	detector_(detector), cache_(NULL), probe_eye_(PROBE_SMALLER), 
+	disparity_(0.0f), window_margin_(0.5f){
+
+	resetStats();
+}
+
+CvStereoPairDetector::~CvStereoPairDetector(){
+
+}
+
+void CvStereoPairDetector::setCache(CvCornerCache *cache){
+	cache_ = cache;
+	if(cache_)
+		cache_->setConfigKey(detector_->getConfigKey());
+}
+
+void CvStereoPairDetector::setProbeEye(ProbeEye probe_eye){
+	probe_eye_ = probe_eye;
+}
+
+void CvStereoPairDetector::setDisparity(float disparity){
+	disparity_ = disparity;
+}
+
+void CvStereoPairDetector::setWindowMargin(float margin){
+	window_margin_ = margin;
+}
+
+CvStereoPairDetector::PairStats CvStereoPairDetector::getStats() const{
+	return stats_;
+}
+
+void CvStereoPairDetector::resetStats(){
+	stats_.n_pairs = 0;
+	stats_.n_rejected = 0;
+	stats_.n_window = 0;
+	stats_.n_full = 0;
+	stats_.n_found = 0;
+}
+
+bool CvStereoPairDetector::detectPair(const std::string &left_file, 
+									  const std::string &right_file, 
+									  std::vector<cv::Point2f> *left_corners, 
+									  std::vector<cv::Point2f> *right_corners, 
+									  cv::Size *img_size){
+
+	EyeImage left, right;
+	PairOutcome outcome = processPair(left_file, right_file, NULL, NULL, &left, &right);
+	record(outcome, left, right);
+
+	left_corners->clear();
+	right_corners->clear();
+	if(left.corners.empty() || right.corners.empty())
+		return false;
+
+	*left_corners = left.corners;
+	*right_corners = right.corners;
+	*img_size = left.size;
+	return true;
+}
+
+bool CvStereoPairDetector::detectPair(const std::string &left_file, 
+									  const std::string &right_file, 
+									  const cv::Mat &left_frame, 
+									  const cv::Mat &right_frame, 
+									  std::vector<cv::Point2f> *left_corners, 
+									  std::vector<cv::Point2f> *right_corners, 
+									  cv::Size *img_size){
+
+	EyeImage left, right;
+	PairOutcome outcome = processPair(left_file, right_file, &left_frame, &right_frame, 
+									  &left, &right);
+	record(outcome, left, right);
+
+	left_corners->clear();
+	right_corners->clear();
+	if(left.corners.empty() || right.corners.empty())
+		return false;
+
+	*left_corners = left.corners;
+	*right_corners = right.corners;
+	*img_size = left.size;
+	return true;
+}
+
+int CvStereoPairDetector::detectPairsBatch(const std::vector<std::string> &left_files, 
+										   const std::vector<std::string> &right_files, 
+										   std::vector<std::vector<cv::Point2f>> *all_left_corners, 
+										   std::vector<std::vector<cv::Point2f>> *all_right_corners, 
+										   cv::Size *img_size){
+
+	int n_pairs = std::min(left_files.size(), right_files.size());
+
+	std::vector<EyeImage> left_eyes(n_pairs), right_eyes(n_pairs);
+	std::vector<int> outcomes(n_pairs, OUTCOME_MISSING);
+
+	// One stripe per pair, rejected pairs finish much earlier than others
+	cv::parallel_for_(cv::Range(0, n_pairs), 
+					  PairDetectionBody(this, &left_files, &right_files, 
+										&left_eyes, &right_eyes, &outcomes), 
+					  n_pairs);
+
+	all_left_corners->clear();
+	all_right_corners->clear();
+	all_left_corners->resize(n_pairs);
+	all_right_corners->resize(n_pairs);
+
+	int n_found = 0;
+	for(int i=0; i<n_pairs; i++){
+		// the cache is only written here, after all workers are done
+		record((PairOutcome)outcomes[i], left_eyes[i], right_eyes[i]);
+
+		if(left_eyes[i].corners.empty() || right_eyes[i].corners.empty())
+			continue;
+
+		(*all_left_corners)[i].swap(left_eyes[i].corners);
+		(*all_right_corners)[i].swap(right_eyes[i].corners);
+		*img_size = left_eyes[i].size;
+		n_found++;
+	}
+
+	return n_found;
+}
+
+bool CvStereoPairDetector::readEye(const std::string &filename, const cv::Mat *frame, 
+								   EyeImage *eye) const{
+
+	eye->hash = 0;
+	eye->fresh = true;
+	eye->frame = frame;
+	eye->corners.clear();
+	if(!CvCornerCache::readFile(filename, &eye->buffer))
+		return false;
+
+	if(!cache_)
+		return true;
+
+	eye->hash = CvCornerCache::hashBuffer(eye->buffer);
+
+	CvCornerCache::CacheEntry entry;
+	if(cache_->lookup(eye->hash, &entry)){
+		eye->fresh = false;
+		eye->size = cv::Size(entry.img_width, entry.img_height);
+		eye->corners = entry.corners;
+	}
+
+	return true;
+}
+
+bool CvStereoPairDetector::searchEye(EyeImage *eye, const cv::Rect *window) const{
+
+	// Without the caller's image there is no color image and no cvtColor,
+	// the decoder writes gray directly. Either way the image is decoded 
+	// once, a window miss searches it again in full.
+	if(eye->frame_gry.empty()){
+		if(eye->frame && eye->frame->channels() == 3)
+			cv::cvtColor(*eye->frame, eye->frame_gry, CV_BGR2GRAY);
+		else if(eye->frame)
+			eye->frame_gry = *eye->frame;
+		else
+			eye->frame_gry = cv::imdecode(cv::Mat(eye->buffer), CV_LOAD_IMAGE_GRAYSCALE);
+		if(eye->frame_gry.empty())
+			return false;
+		eye->size = eye->frame_gry.size();
+	}
+
+	cv::Rect roi(0, 0, eye->frame_gry.cols, eye->frame_gry.rows);
+	if(window)
+		roi = roi & *window;
+
+	if(roi.area() == 0 || !detector_->detectCorners(eye->frame_gry(roi), &eye->corners)){
+		eye->corners.clear();
+		return false;
+	}
+
+	// back to full image coordinates
+	for(size_t j=0; j<eye->corners.size(); j++){
+		eye->corners[j].x += roi.x;
+		eye->corners[j].y += roi.y;
+	}
+
+	return true;
+}
+
+cv::Rect CvStereoPairDetector::predictWindow(const std::vector<cv::Point2f> &corners, 
+											 bool probe_is_left, cv::Size img_size) const{
+
+	float x_min = corners[0].x, x_max = corners[0].x;
+	float y_min = corners[0].y, y_max = corners[0].y;
+	for(size_t j=1; j<corners.size(); j++){
+		x_min = std::min(x_min, corners[j].x);
+		x_max = std::max(x_max, corners[j].x);
+		y_min = std::min(y_min, corners[j].y);
+		y_max = std::max(y_max, corners[j].y);
+	}
+
+	// The board moves left from the left to the right image. Rows barely 
+	// change on a horizontal rig, but the margin is kept the same on all 
+	// sides to cover the outer squares and vertical misalignment.
+	float shift = probe_is_left ? -disparity_ : disparity_;
+	float margin = window_margin_*std::max(x_max - x_min, y_max - y_min);
+
+	int x0 = cvFloor(x_min + shift - margin);
+	int y0 = cvFloor(y_min - margin);
+	int x1 = cvCeil(x_max + shift + margin);
+	int y1 = cvCeil(y_max + margin);
+
+	return cv::Rect(x0, y0, x1 - x0, y1 - y0) & cv::Rect(0, 0, img_size.width, img_size.height);
+}
+
+CvStereoPairDetector::PairOutcome CvStereoPairDetector::processPair(const std::string &left_file, 
+																	const std::string &right_file, 
+																	const cv::Mat *left_frame, 
+																	const cv::Mat *right_frame, 
+																	EyeImage *left, 
+																	EyeImage *right) const{
+
+	// Reading the encoded bytes is cheap next to decoding and detection
+	if(!readEye(left_file, left_frame, left) || !readEye(right_file, right_frame, right))
+		return OUTCOME_MISSING;
+
+	bool probe_is_left = true;
+	if(probe_eye_ == PROBE_RIGHT)
+		probe_is_left = false;
+	else if(probe_eye_ == PROBE_SMALLER)
+		probe_is_left = left->buffer.size() <= right->buffer.size();
+
+	// A cached eye is a free probe
+	if(left->fresh != right->fresh)
+		probe_is_left = !left->fresh;
+
+	EyeImage *probe = probe_is_left ? left : right;
+	EyeImage *second = probe_is_left ? right : left;
+
+	// the detector rejects board-free frames on its coarse pyramid level
+	if(probe->fresh)
+		searchEye(probe, NULL);
+
+	if(probe->corners.empty())
+		return OUTCOME_REJECTED;
+
+	if(!second->fresh)
+		return OUTCOME_CACHED;
+
+	// The window needs the size of the second image, which is only known
+	// once decoded; a stereo rig delivers equal sizes on both eyes.
+	cv::Rect window = predictWindow(probe->corners, probe_is_left, probe->size);
+	if(window.area() < probe->size.area() && searchEye(second, &window))
+		return OUTCOME_WINDOW;
+
+	searchEye(second, NULL);
+	return OUTCOME_FULL;
+}
+
+void CvStereoPairDetector::record(PairOutcome outcome, const EyeImage &left, 
+								  const EyeImage &right){
+
+	stats_.n_pairs++;
+	if(outcome == OUTCOME_REJECTED)
+		stats_.n_rejected++;
+	else if(outcome == OUTCOME_WINDOW)
+		stats_.n_window++;
+	else if(outcome == OUTCOME_FULL)
+		stats_.n_full++;
+
+	if(!left.corners.empty() && !right.corners.empty())
+		stats_.n_found++;
+
+	if(!cache_ || outcome == OUTCOME_MISSING)
+		return;
+
+	// Remember fresh results, board-free images included. An eye that was
+	// never searched because the probe failed has no result to remember.
+	const EyeImage *eyes[2] = {&left, &right};
+	for(int e=0; e<2; e++){
+		if(!eyes[e]->fresh || eyes[e]->size.area() == 0)
+			continue;
+
+		CvCornerCache::CacheEntry entry;
+		entry.img_width = eyes[e]->size.width;
+		entry.img_height = eyes[e]->size.height;
+		entry.corners = eyes[e]->corners;
+		cache_->insert(eyes[e]->hash, entry);
+	}
+}
@@ -0,0 +1,259 @@
+/*==========================================================================
+
+  Copyright (c) 2014 Uditha L. Jayarathne, ujayarat@robarts.ca
+
+  Use, modification and redistribution of the software, in source or
+  binary forms, are permitted provided that the following terms and
+  conditions are met:
+
+  1) Redistribution of the source code, in verbatim or modified
+  form, must retain the above copyright notice, this license,
+  the following disclaimer, and any notices that refer to this
+  license and/or the following disclaimer.  
+
+  2) Redistribution in binary form must include the above copyright
+  notice, a copy of this license and the following disclaimer
+  in the documentation or with other materials provided with the
+  distribution.
+
+  3) Modified copies of the source code must be clearly marked as such,
+  and must not be misrepresented as verbatim copies of the source code.
+
+  THE COPYRIGHT HOLDERS AND/OR OTHER PARTIES PROVIDE THE SOFTWARE "AS IS"
+  WITHOUT EXPRESSED OR IMPLIED WARRANTY INCLUDING, BUT NOT LIMITED TO,
+  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  PURPOSE.  IN NO EVENT SHALL ANY COPYRIGHT HOLDER OR OTHER PARTY WHO MAY
+  MODIFY AND/OR REDISTRIBUTE THE SOFTWARE UNDER THE TERMS OF THIS LICENSE
+  BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, LOSS OF DATA OR DATA BECOMING INACCURATE
+  OR LOSS OF PROFIT OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF
+  THE USE OR INABILITY TO USE THE SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGES.
+  =========================================================================*/
+
+#ifndef __CV_STEREO_PAIR_DETECTOR__H
+#define __CV_STEREO_PAIR_DETECTOR__H
+
+#include <iostream>
+#include <vector>
+#include <string>
+
+// Opencv Includes 
+#include "cv.h"
+#include "highgui.h"
+
+#include "cv_corner_cache.h"
+#include "cv_corner_detector.h"
+
+/**
+ * Finds the checkerboard in both images of a stereo pair with early
+ * rejection. Images are decoded straight to grayscale and the cheaper eye
+ * is probed first through the coarse pyramid search of the detector. The 
+ * second eye is decoded and searched only if the probe found the board, 
+ * and then only inside a window predicted from the probe corners shifted
+ * by the approximate disparity of the rig. A miss in the window falls back
+ * to a full search, so a poor disparity guess costs time but never pairs.
+ */
+class CvStereoPairDetector{
+
+public:
+
+	// Which eye is searched first
+	enum ProbeEye{
+		PROBE_LEFT,		// always the left image
+		PROBE_RIGHT,	// always the right image
+		PROBE_SMALLER	// the image with the smaller encoded file
+	};
+
+	// Detection outcome counts
+	typedef struct PairStats{
+		int n_pairs;		// pairs processed
+		int n_rejected;		// pairs rejected by the probe eye
+		int n_window;		// second eye found in the predicted window
+		int n_full;			// second eye needed a full image search
+		int n_found;		// pairs found in both eyes
+	} PairStats;
+
+	/**
+	 * @param corner detector, not owned
+	 */
+	CvStereoPairDetector(CvCornerDetector*);
+	~CvStereoPairDetector();
+
+	//public methods
+
+	/**
+	 * Detect the board in one pair of image files
+	 * @param left image file name
+	 * @param right image file name
+	 * @param reference to the left corners
+	 * @param reference to the right corners
+	 * @param reference to the image size
+	 * @return true if the board was found in both images
+	 */
+	bool detectPair(const std::string &, const std::string &, 
+					std::vector<cv::Point2f>*, std::vector<cv::Point2f>*, 
+					cv::Size*);
+
+	/**
+	 * Detect the board in a pair the caller has already decoded, e.g. for
+	 * display. The files are read for the cache lookup but not decoded 
+	 * again, the search converts the given images to grayscale.
+	 * @param left image file name
+	 * @param right image file name
+	 * @param decoded left image
+	 * @param decoded right image
+	 * @param reference to the left corners
+	 * @param reference to the right corners
+	 * @param reference to the image size
+	 * @return true if the board was found in both images
+	 */
+	bool detectPair(const std::string &, const std::string &, 
+					const cv::Mat &, const cv::Mat &, 
+					std::vector<cv::Point2f>*, std::vector<cv::Point2f>*, 
+					cv::Size*);
+
+	/**
+	 * Detect the board in all pairs on all cores. Corners of pairs that
+	 * were not found in both images are left empty.
+	 * @param left image file names
+	 * @param right image file names
+	 * @param reference to the left corners of every pair
+	 * @param reference to the right corners of every pair
+	 * @param reference to the image size
+	 * @return number of pairs found in both images
+	 */
+	int detectPairsBatch(const std::vector<std::string> &, 
+						 const std::vector<std::string> &, 
+						 std::vector<std::vector<cv::Point2f>>*, 
+						 std::vector<std::vector<cv::Point2f>>*, 
+						 cv::Size*);
+
+	/**
+	 * Use a corner cache. The cache is not owned. It is keyed to the
+	 * configuration of the corner detector, so set the detector up first.
+	 * @param pointer to the cache, NULL to disable
+	 */
+	void setCache(CvCornerCache*);
+
+	/**
+	 * Choose the eye searched first
+	 * @param PROBE_LEFT, PROBE_RIGHT or PROBE_SMALLER
+	 */
+	void setProbeEye(ProbeEye);
+
+	/**
+	 * Set the approximate horizontal shift of the board from the left to
+	 * the right image, focal length times baseline over board distance
+	 * @param disparity in pixels, positive when the board moves left
+	 */
+	void setDisparity(float);
+
+	/**
+	 * Set the margin added around the predicted window on every side
+	 * @param fraction of the larger side of the board bounding box
+	 */
+	void setWindowMargin(float);
+
+	/**
+	 * Counts since construction or the last reset
+	 */
+	PairStats getStats() const;
+
+	/**
+	 * Reset the counts
+	 */
+	void resetStats();
+
+private:
+
+	// Result of one pair
+	enum PairOutcome{
+		OUTCOME_MISSING,	// an image could not be read
+		OUTCOME_REJECTED,	// the probe eye had no board
+		OUTCOME_WINDOW,		// second eye found in the window
+		OUTCOME_FULL,		// second eye searched in the full image
+		OUTCOME_CACHED		// second eye answered by the cache
+	};
+
+	// One image of a pair
+	typedef struct EyeImage{
+		std::vector<uchar> buffer;			// encoded file
+		uint64 hash;						// content hash, if cached
+		bool fresh;							// detected now, not cached
+		cv::Size size;						// decoded size
+		const cv::Mat *frame;				// image decoded by the caller, or NULL
+		cv::Mat frame_gry;					// grayscale image, once decoded
+		std::vector<cv::Point2f> corners;	// refined corners
+	} EyeImage;
+
+	friend class PairDetectionBody;
+
+	//private methods
+
+	/**
+	 * Read an image file and look it up in the cache
+	 * @param file name
+	 * @param image decoded by the caller, or NULL
+	 * @param reference to the image
+	 * @return false if the file could not be read
+	 */
+	bool readEye(const std::string &, const cv::Mat *, EyeImage*) const;
+
+	/**
+	 * Decode an image to grayscale, or convert the caller's image, and 
+	 * search it, inside the window if one is given
+	 * @param reference to the image
+	 * @param search window, NULL for the full image
+	 * @return true if the board was found
+	 */
+	bool searchEye(EyeImage*, const cv::Rect*) const;
+
+	/**
+	 * Predict the window of the board in the second eye
+	 * @param corners of the probe eye
+	 * @param whether the probe eye is the left one
+	 * @param size of the second image
+	 * @return window, clipped to the image
+	 */
+	cv::Rect predictWindow(const std::vector<cv::Point2f>&, bool, cv::Size) const;
+
+	/**
+	 * Run the early rejection on one pair. Safe to call from several
+	 * threads, the cache is only read.
+	 * @param left file name
+	 * @param right file name
+	 * @param left image decoded by the caller, or NULL
+	 * @param right image decoded by the caller, or NULL
+	 * @param reference to the left image
+	 * @param reference to the right image
+	 * @return outcome
+	 */
+	PairOutcome processPair(const std::string &, const std::string &, 
+							const cv::Mat *, const cv::Mat *, 
+							EyeImage*, EyeImage*) const;
+
+	/**
+	 * Count an outcome and add fresh detections to the cache
+	 * @param outcome
+	 * @param left image
+	 * @param right image
+	 */
+	void record(PairOutcome, const EyeImage&, const EyeImage&);
+
+	//private members
+
+	CvCornerDetector *detector_;
+
+	// optional detection cache
+	CvCornerCache *cache_;
+
+	ProbeEye probe_eye_;
+	float disparity_;
+	float window_margin_;
+
+	PairStats stats_;
+
+};
+
+#endif //__CV_STEREO_PAIR_DETECTOR__H
@@ -0,0 +1,273 @@
+/*==========================================================================
+
+  Copyright (c) 2014 Uditha L. Jayarathne, ujayarat@robarts.ca
+
+  Use, modification and redistribution of the software, in source or
+  binary forms, are permitted provided that the following terms and
+  conditions are met:
+
+  1) Redistribution of the source code, in verbatim or modified
+  form, must retain the above copyright notice, this license,
+  the following disclaimer, and any notices that refer to this
+  license and/or the following disclaimer.  
+
+  2) Redistribution in binary form must include the above copyright
+  notice, a copy of this license and the following disclaimer
+  in the documentation or with other materials provided with the
+  distribution.
+
+  3) Modified copies of the source code must be clearly marked as such,
+  and must not be misrepresented as verbatim copies of the source code.
+
+  THE COPYRIGHT HOLDERS AND/OR OTHER PARTIES PROVIDE THE SOFTWARE "AS IS"
+  WITHOUT EXPRESSED OR IMPLIED WARRANTY INCLUDING, BUT NOT LIMITED TO,
+  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  PURPOSE.  IN NO EVENT SHALL ANY COPYRIGHT HOLDER OR OTHER PARTY WHO MAY
+  MODIFY AND/OR REDISTRIBUTE THE SOFTWARE UNDER THE TERMS OF THIS LICENSE
+  BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, LOSS OF DATA OR DATA BECOMING INACCURATE
+  OR LOSS OF PROFIT OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF
+  THE USE OR INABILITY TO USE THE SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGES.
+  =========================================================================*/
+
+#include <float.h>
+#include <math.h>
+#include <algorithm>
+
+#include "cv_subpix_refiner.h"
+
+// Loop body run by cv::parallel_for_. Each index is one frame.
+class RefineFramesBody : public cv::ParallelLoopBody{
+
+public:
+	RefineFramesBody(const CvSubPixRefiner *refiner, 
+					 const std::vector<cv::Mat> *frames, 
+					 std::vector<std::vector<cv::Point2f>> *corners) :
+		refiner_(refiner), frames_(frames), corners_(corners){}
+
+	void operator()(const cv::Range &range) const{
+
+		for(int i=range.start; i<range.end; i++)
+			refiner_->refine((*frames_)[i], &(*corners_)[i]);
+	}
+
+private:
+	const CvSubPixRefiner *refiner_;
+	const std::vector<cv::Mat> *frames_;
+	std::vector<std::vector<cv::Point2f>> *corners_;
+};
+
+CvSubPixRefiner::CvSubPixRefiner(cv::Size half_win, cv::TermCriteria criteria):
+	half_win_(half_win){
+
+	// same limits as cv::cornerSubPix
+	max_iter_ = (criteria.type & cv::TermCriteria::MAX_ITER) ? 
+					std::min(std::max(criteria.maxCount, 1), 100) : 100;
+	double eps = (criteria.type & cv::TermCriteria::EPS) ? 
+					std::max(criteria.epsilon, 0.) : 0;
+	eps_ = eps*eps;
+
+	win_w_ = 2*half_win.width + 1;
+	win_h_ = 2*half_win.height + 1;
+	win_stride_ = (win_w_ + 3) & ~3;
+
+	// one column either side for the central differences, rounded up so 
+	// the patch rows can be filled 4 floats at a time
+	patch_stride_ = win_stride_ + 4;
+
+	mask_.assign(win_stride_*win_h_, 0.f);
+	for(int i=0; i<win_h_; i++){
+		float y = (float)(i - half_win.height)/half_win.height;
+		float vy = exp(-y*y);
+		for(int j=0; j<win_w_; j++){
+			float x = (float)(j - half_win.width)/half_win.width;
+			mask_[i*win_stride_ + j] = vy*exp(-x*x);
+		}
+	}
+}
+
+CvSubPixRefiner::~CvSubPixRefiner(){
+
+}
+
+void CvSubPixRefiner::samplePatch(const cv::Mat &img, cv::Point2f centre, 
+								  float *patch) const{
+
+	int patch_h = win_h_ + 2;
+
+	// top left corner of the (win_w_ + 2) x (win_h_ + 2) patch
+	float fx = centre.x - (win_w_ + 1)*0.5f;
+	float fy = centre.y - (win_h_ + 1)*0.5f;
+	int ix = cvFloor(fx), iy = cvFloor(fy);
+	float ax = fx - ix, ay = fy - iy;
+
+	float w00 = (1 - ax)*(1 - ay), w01 = ax*(1 - ay);
+	float w10 = (1 - ax)*ay, w11 = ax*ay;
+
+	bool inside = ix >= 0 && iy >= 0 && 
+				  ix + patch_stride_ + 4 <= img.cols && 
+				  iy + patch_h < img.rows;
+
+	if(!inside){
+		// replicate the border
+		for(int r=0; r<patch_h; r++){
+			int y0 = std::min(std::max(iy + r, 0), img.rows - 1);
+			int y1 = std::min(std::max(iy + r + 1, 0), img.rows - 1);
+			const uchar *s0 = img.ptr<uchar>(y0), *s1 = img.ptr<uchar>(y1);
+			for(int c=0; c<patch_stride_; c++){
+				int x0 = std::min(std::max(ix + c, 0), img.cols - 1);
+				int x1 = std::min(std::max(ix + c + 1, 0), img.cols - 1);
+				patch[r*patch_stride_ + c] = w00*s0[x0] + w01*s0[x1] + 
+											 w10*s1[x0] + w11*s1[x1];
+			}
+		}
+		return;
+	}
+
+	for(int r=0; r<patch_h; r++){
+		const uchar *s0 = img.ptr<uchar>(iy + r) + ix;
+		const uchar *s1 = img.ptr<uchar>(iy + r + 1) + ix;
+		float *dst = patch + r*patch_stride_;
+		int c = 0;
+
+#if CV_SSE2
+		const __m128i zero = _mm_setzero_si128();
+		const __m128 v00 = _mm_set1_ps(w00), v01 = _mm_set1_ps(w01);
+		const __m128 v10 = _mm_set1_ps(w10), v11 = _mm_set1_ps(w11);
+		for(; c<patch_stride_; c+=4){
+			__m128i a = _mm_loadl_epi64((const __m128i *)(s0 + c));
+			__m128i b = _mm_loadl_epi64((const __m128i *)(s1 + c));
+			a = _mm_unpacklo_epi8(a, zero);
+			b = _mm_unpacklo_epi8(b, zero);
+
+			// pixels c..c+3 and c+1..c+4 of both rows
+			__m128 a0 = _mm_cvtepi32_ps(_mm_unpacklo_epi16(a, zero));
+			__m128 a1 = _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_srli_si128(a, 2), zero));
+			__m128 b0 = _mm_cvtepi32_ps(_mm_unpacklo_epi16(b, zero));
+			__m128 b1 = _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_srli_si128(b, 2), zero));
+
+			__m128 v = _mm_add_ps(_mm_add_ps(_mm_mul_ps(v00, a0), _mm_mul_ps(v01, a1)), 
+								  _mm_add_ps(_mm_mul_ps(v10, b0), _mm_mul_ps(v11, b1)));
+			_mm_storeu_ps(dst + c, v);
+		}
+#endif
+
+		for(; c<patch_stride_; c++)
+			dst[c] = w00*s0[c] + w01*s0[c+1] + w10*s1[c] + w11*s1[c+1];
+	}
+}
+
+void CvSubPixRefiner::getSettings(cv::Size *half_win, int *max_iter, double *eps) const{
+	*half_win = half_win_;
+	*max_iter = max_iter_;
+	*eps = eps_;
+}
+
+void CvSubPixRefiner::refine(const cv::Mat &img, std::vector<cv::Point2f> *corners) const{
+
+	if(corners->empty())
+		return;
+
+	if(img.type() != CV_8UC1){
+		cv::cornerSubPix(img, *corners, half_win_, cvSize(-1, -1), 
+						 cv::TermCriteria(cv::TermCriteria::EPS+cv::TermCriteria::MAX_ITER, 
+										  max_iter_, sqrt(eps_)));
+		return;
+	}
+
+	std::vector<float> patch_buf(patch_stride_*(win_h_ + 2) + 4);
+	float *patch = &patch_buf[0];
+	const float *mask = &mask_[0];
+	const int ps = patch_stride_;
+
+	for(size_t n=0; n<corners->size(); n++){
+
+		cv::Point2f start = (*corners)[n], cI = start;
+
+		for(int iter=0; iter<max_iter_; iter++){
+
+			samplePatch(img, cI, patch);
+
+			double a = 0, b = 0, c = 0, bb1 = 0, bb2 = 0;
+			for(int i=0; i<win_h_; i++){
+				float py = (float)(i - half_win_.height);
+				const float *m = mask + i*win_stride_;
+				// window pixel (i, j) sits at patch (i+1, j+1)
+				const float *row = patch + (i + 1)*ps + 1;
+				int j = 0;
+
+#if CV_SSE2
+				__m128 va = _mm_setzero_ps(), vb = _mm_setzero_ps(), vc = _mm_setzero_ps();
+				__m128 vbb1 = _mm_setzero_ps(), vbb2 = _mm_setzero_ps();
+				__m128 vpx = _mm_setr_ps(-(float)half_win_.width, 1.f - half_win_.width, 
+										 2.f - half_win_.width, 3.f - half_win_.width);
+				const __m128 vpy = _mm_set1_ps(py), four = _mm_set1_ps(4.f);
+				for(; j<win_stride_; j+=4){
+					__m128 vm = _mm_loadu_ps(m + j);
+					__m128 gx = _mm_sub_ps(_mm_loadu_ps(row + j + 1), _mm_loadu_ps(row + j - 1));
+					__m128 gy = _mm_sub_ps(_mm_loadu_ps(row + j + ps), _mm_loadu_ps(row + j - ps));
+
+					__m128 gxx = _mm_mul_ps(_mm_mul_ps(gx, gx), vm);
+					__m128 gxy = _mm_mul_ps(_mm_mul_ps(gx, gy), vm);
+					__m128 gyy = _mm_mul_ps(_mm_mul_ps(gy, gy), vm);
+
+					va = _mm_add_ps(va, gxx);
+					vb = _mm_add_ps(vb, gxy);
+					vc = _mm_add_ps(vc, gyy);
+					vbb1 = _mm_add_ps(vbb1, _mm_add_ps(_mm_mul_ps(gxx, vpx), _mm_mul_ps(gxy, vpy)));
+					vbb2 = _mm_add_ps(vbb2, _mm_add_ps(_mm_mul_ps(gxy, vpx), _mm_mul_ps(gyy, vpy)));
+					vpx = _mm_add_ps(vpx, four);
+				}
+
+				float s[4];
+				_mm_storeu_ps(s, va);	a += s[0] + s[1] + s[2] + s[3];
+				_mm_storeu_ps(s, vb);	b += s[0] + s[1] + s[2] + s[3];
+				_mm_storeu_ps(s, vc);	c += s[0] + s[1] + s[2] + s[3];
+				_mm_storeu_ps(s, vbb1);	bb1 += s[0] + s[1] + s[2] + s[3];
+				_mm_storeu_ps(s, vbb2);	bb2 += s[0] + s[1] + s[2] + s[3];
+#endif
+
+				for(; j<win_w_; j++){
+					float gx = row[j + 1] - row[j - 1];
+					float gy = row[j + ps] - row[j - ps];
+					float px = (float)(j - half_win_.width);
+					float gxx = gx*gx*m[j], gxy = gx*gy*m[j], gyy = gy*gy*m[j];
+					a += gxx; b += gxy; c += gyy;
+					bb1 += gxx*px + gxy*py;
+					bb2 += gxy*px + gyy*py;
+				}
+			}
+
+			double det = a*c - b*b;
+			if(fabs(det) <= DBL_EPSILON*DBL_EPSILON)
+				break;
+
+			double scale = 1/det;
+			cv::Point2f cI2((float)(cI.x + c*scale*bb1 - b*scale*bb2),
+							(float)(cI.y - b*scale*bb1 + a*scale*bb2));
+			double err = (cI2.x - cI.x)*(cI2.x - cI.x) + (cI2.y - cI.y)*(cI2.y - cI.y);
+			cI = cI2;
+
+			if(cI.x < 0 || cI.x >= img.cols || cI.y < 0 || cI.y >= img.rows)
+				break;
+
+			// converged
+			if(err <= eps_)
+				break;
+		}
+
+		// moved out of the window, keep the initial estimate
+		if(fabs(cI.x - start.x) > half_win_.width || fabs(cI.y - start.y) > half_win_.height)
+			cI = start;
+
+		(*corners)[n] = cI;
+	}
+}
+
+void CvSubPixRefiner::refineBatch(const std::vector<cv::Mat> &frames, 
+								  std::vector<std::vector<cv::Point2f>> *corners) const{
+
+	cv::parallel_for_(cv::Range(0, frames.size()), 
+						RefineFramesBody(this, &frames, corners), frames.size());
+}
@@ -0,0 +1,114 @@
+/*==========================================================================
+
+  Copyright (c) 2014 Uditha L. Jayarathne, ujayarat@robarts.ca
+
+  Use, modification and redistribution of the software, in source or
+  binary forms, are permitted provided that the following terms and
+  conditions are met:
+
+  1) Redistribution of the source code, in verbatim or modified
+  form, must retain the above copyright notice, this license,
+  the following disclaimer, and any notices that refer to this
+  license and/or the following disclaimer.  
+
+  2) Redistribution in binary form must include the above copyright
+  notice, a copy of this license and the following disclaimer
+  in the documentation or with other materials provided with the
+  distribution.
+
+  3) Modified copies of the source code must be clearly marked as such,
+  and must not be misrepresented as verbatim copies of the source code.
+
+  THE COPYRIGHT HOLDERS AND/OR OTHER PARTIES PROVIDE THE SOFTWARE "AS IS"
+  WITHOUT EXPRESSED OR IMPLIED WARRANTY INCLUDING, BUT NOT LIMITED TO,
+  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  PURPOSE.  IN NO EVENT SHALL ANY COPYRIGHT HOLDER OR OTHER PARTY WHO MAY
+  MODIFY AND/OR REDISTRIBUTE THE SOFTWARE UNDER THE TERMS OF THIS LICENSE
+  BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, LOSS OF DATA OR DATA BECOMING INACCURATE
+  OR LOSS OF PROFIT OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF
+  THE USE OR INABILITY TO USE THE SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGES.
+  =========================================================================*/
+
+#ifndef __CV_SUBPIX_REFINER__H
+#define __CV_SUBPIX_REFINER__H
+
+#include <iostream>
+#include <vector>
+
+// Opencv Includes 
+#include "cv.h"
+
+/**
+ * Sub-pixel corner refinement for 8-bit grayscale images. It solves the
+ * same gradient orthogonality system as cv::cornerSubPix, with the window
+ * weights computed once per refiner instead of once per call, bilinear
+ * patch sampling and gradient accumulation 4 pixels at a time (SSE2), and
+ * an early exit per corner once its update falls below the epsilon of the
+ * termination criteria. Corners near the image border go through the
+ * scalar path with border replication, like cv::getRectSubPix.
+ */
+class CvSubPixRefiner{
+
+public:
+
+	/**
+	 * @param half size of the search window, as for cv::cornerSubPix
+	 * @param termination criteria
+	 */
+	CvSubPixRefiner(cv::Size, cv::TermCriteria);
+	~CvSubPixRefiner();
+
+	//public methods
+
+	/**
+	 * Refine all corners of a frame
+	 * @param 8-bit grayscale image
+	 * @param reference to the corners, refined in place
+	 */
+	void refine(const cv::Mat&, std::vector<cv::Point2f>*) const;
+
+	/**
+	 * Refine the corners of many frames on all cores
+	 * @param 8-bit grayscale images
+	 * @param reference to the corners per image, refined in place
+	 */
+	void refineBatch(const std::vector<cv::Mat>&, 
+					 std::vector<std::vector<cv::Point2f>>*) const;
+
+	/**
+	 * Settings in effect, after the limits applied to the criteria
+	 * @param reference to the half size of the search window
+	 * @param reference to the iteration limit
+	 * @param reference to the squared update at which a corner has converged
+	 */
+	void getSettings(cv::Size*, int*, double*) const;
+
+private:
+	//private methods
+
+	/**
+	 * Sample the (win + 2) patch around a point with bilinear interpolation
+	 * @param image
+	 * @param patch centre
+	 * @param reference to the patch, patch_stride_ floats per row
+	 */
+	void samplePatch(const cv::Mat&, cv::Point2f, float*) const;
+
+	//private members
+
+	cv::Size half_win_;
+	int max_iter_;
+	double eps_;	// squared update at which a corner has converged
+
+	// window, padded to a multiple of 4 columns
+	int win_w_, win_h_, win_stride_;
+	int patch_stride_;
+
+	// gaussian window weights, zero in the padding
+	std::vector<float> mask_;
+
+};
+
+#endif //__CV_SUBPIX_REFINER__H
@@ -0,0 +1,294 @@
+/*==========================================================================
+
+  Copyright (c) 2014 Uditha L. Jayarathne, ujayarat@robarts.ca
+
+  Use, modification and redistribution of the software, in source or
+  binary forms, are permitted provided that the following terms and
+  conditions are met:
+
+  1) Redistribution of the source code, in verbatim or modified
+  form, must retain the above copyright notice, this license,
+  the following disclaimer, and any notices that refer to this
+  license and/or the following disclaimer.  
+
+  2) Redistribution in binary form must include the above copyright
+  notice, a copy of this license and the following disclaimer
+  in the documentation or with other materials provided with the
+  distribution.
+
+  3) Modified copies of the source code must be clearly marked as such,
+  and must not be misrepresented as verbatim copies of the source code.
+
+  THE COPYRIGHT HOLDERS AND/OR OTHER PARTIES PROVIDE THE SOFTWARE "AS IS"
+  WITHOUT EXPRESSED OR IMPLIED WARRANTY INCLUDING, BUT NOT LIMITED TO,
+  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  PURPOSE.  IN NO EVENT SHALL ANY COPYRIGHT HOLDER OR OTHER PARTY WHO MAY
+  MODIFY AND/OR REDISTRIBUTE THE SOFTWARE UNDER THE TERMS OF THIS LICENSE
+  BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, LOSS OF DATA OR DATA BECOMING INACCURATE
+  OR LOSS OF PROFIT OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF
+  THE USE OR INABILITY TO USE THE SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGES.
+  =========================================================================*/
+
+#include <math.h>
+#include <float.h>
+#include <algorithm>
+#include <thread>
+
+#include "cv_video_view_selector.h"
+
+CvVideoViewSelector::CvVideoViewSelector(CvCornerDetector *detector):
+	detector_(detector), tracker_(NULL), frame_stride_(5), queue_depth_(2), 
+	n_grabbed_(0), free_slots_(NULL){
+
+	// the decoder keeps a core
+	n_workers_ = std::max(cv::getNumberOfCPUs() - 1, 1);
+}
+
+CvVideoViewSelector::~CvVideoViewSelector(){
+	delete tracker_;
+}
+
+void CvVideoViewSelector::setTracking(bool enable, int keyframe_interval){
+
+	delete tracker_;
+	tracker_ = NULL;
+
+	if(enable){
+		tracker_ = new CvCornerTracker(detector_);
+		tracker_->setKeyframeInterval(keyframe_interval);
+	}
+}
+
+int CvVideoViewSelector::getWorkerCount() const{
+	return n_workers_;
+}
+
+void CvVideoViewSelector::setFrameStride(int stride){
+	frame_stride_ = std::max(stride, 1);
+}
+
+int CvVideoViewSelector::selectViews(const std::string &video_file, FrameSide side, 
+									 int n_views, 
+									 std::vector<std::vector<cv::Point2f>> *selected, 
+									 cv::Size *img_size){
+
+	selected->clear();
+
+	cv::VideoCapture capture;
+	if(!capture.open(video_file)){
+		std::cerr << "Failed to open the video file. " << std::endl;
+		return 0;
+	}
+
+	// Tracking follows the board through consecutive frames, so it runs in
+	// order on the calling thread, fed by the decoder through one queue.
+	// Detection runs on the workers, each with its own pair of queues.
+	int n_queues = tracker_ ? 1 : n_workers_;
+
+	// enough slots to fill every queue, so the decoder only waits for the
+	// detectors
+	int n_slots = n_queues*2*queue_depth_ + 2;
+	std::vector<ViewSlot> slots(n_slots);
+
+	free_slots_ = new SlotQueue(n_slots);
+	for(int i=0; i<n_slots; i++)
+		free_slots_->push(&slots[i]);
+	for(int q=0; q<n_queues; q++){
+		work_queues_.push_back(new SlotQueue(queue_depth_));
+		if(!tracker_)
+			done_queues_.push_back(new SlotQueue(queue_depth_));
+	}
+
+	std::thread decoder(&CvVideoViewSelector::decodeLoop, this, &capture, side);
+	std::vector<std::thread> workers;
+	if(!tracker_)
+		for(int w=0; w<n_workers_; w++)
+			workers.push_back(std::thread(&CvVideoViewSelector::detectLoop, this, w));
+
+	// Sampled frame i goes to queue i % n, so taking the results round 
+	// robin keeps the candidates in frame order.
+	std::vector<std::vector<cv::Point2f>> candidates;
+	for(int i=0; ; i++){
+		ViewSlot *slot;
+		if(tracker_){
+			slot = work_queues_[0]->pop();
+			if(slot && !tracker_->track(slot->gray, &slot->corners))
+				slot->corners.clear();
+		}
+		else
+			slot = done_queues_[i % n_queues]->pop();
+		if(!slot)
+			break;
+
+		if(!slot->corners.empty())
+			candidates.push_back(slot->corners);
+
+		if(i%10 == 0)
+			std::cout << ".";
+
+		free_slots_->push(slot);
+	}
+	std::cout << std::endl;
+
+	decoder.join();
+	for(size_t w=0; w<workers.size(); w++)
+		workers[w].join();
+
+	// the remaining end of stream markers
+	for(int q=0; q<n_queues; q++){
+		delete work_queues_[q];
+		if(!tracker_)
+			delete done_queues_[q];
+	}
+	work_queues_.clear();
+	done_queues_.clear();
+	delete free_slots_;
+	free_slots_ = NULL;
+
+	*img_size = frame_size_;
+
+	int n_candidates = candidates.size();
+	std::cout << "Checkerboard found in " << n_candidates << " of " 
+			  << (n_grabbed_ + frame_stride_ - 1)/frame_stride_ 
+			  << " sampled frames" << std::endl;
+	if(tracker_){
+		int n_keyframes, n_tracked;
+		tracker_->getCounts(&n_keyframes, &n_tracked);
+		std::cout << n_keyframes << " full detections, " 
+				  << n_tracked << " tracked frames" << std::endl;
+	}
+	if(n_candidates == 0)
+		return 0;
+
+	// Farthest point sampling: start with the largest board, then keep
+	// adding the view farthest from everything already selected.
+	std::vector<float> descriptors(4*n_candidates);
+	int first = 0;
+	for(int i=0; i<n_candidates; i++){
+		describeView(candidates[i], *img_size, &descriptors[4*i]);
+		if(descriptors[4*i+2] > descriptors[4*first+2])
+			first = i;
+	}
+
+	std::vector<float> min_dist(n_candidates, FLT_MAX);
+	std::vector<bool> taken(n_candidates, false);
+	int next = first;
+	for(int k=0; k<n_views && k<n_candidates; k++){
+		taken[next] = true;
+
+		const float *d = &descriptors[4*next];
+		int farthest = -1;
+		for(int i=0; i<n_candidates; i++){
+			if(taken[i])
+				continue;
+
+			const float *c = &descriptors[4*i];
+			float dist = 0;
+			for(int j=0; j<4; j++)
+				dist += (c[j] - d[j])*(c[j] - d[j]);
+			min_dist[i] = std::min(min_dist[i], dist);
+
+			if(farthest < 0 || min_dist[i] > min_dist[farthest])
+				farthest = i;
+		}
+
+		if(farthest < 0)
+			break;
+		next = farthest;
+	}
+
+	for(int i=0; i<n_candidates; i++)
+		if(taken[i])
+			selected->push_back(candidates[i]);
+
+	return n_candidates;
+}
+
+void CvVideoViewSelector::decodeLoop(cv::VideoCapture *capture, FrameSide side){
+
+	int n_queues = work_queues_.size();
+	int n_sampled = 0;
+	cv::Mat frame;
+
+	n_grabbed_ = 0;
+	while(capture->grab()){
+		// skipped frames are only grabbed, not converted
+		if(n_grabbed_++ % frame_stride_ != 0)
+			continue;
+		if(!capture->retrieve(frame))
+			continue;
+
+		cv::Rect roi(0, 0, frame.cols, frame.rows);
+		if(side != FULL_FRAME){
+			roi.width = frame.cols/2;
+			if(side == RIGHT_HALF)
+				roi.x = roi.width;
+		}
+		frame_size_ = roi.size();
+
+		// waits while all slots are in flight. The frame gets a fresh 
+		// buffer, the tracker may still hold on to the previous one.
+		ViewSlot *slot = free_slots_->pop();
+		slot->gray.release();
+		slot->corners.clear();
+		cv::cvtColor(frame(roi), slot->gray, CV_BGR2GRAY);
+
+		work_queues_[n_sampled++ % n_queues]->push(slot);
+	}
+
+	// end of stream for every consumer
+	for(int q=0; q<n_queues; q++)
+		work_queues_[q]->push(NULL);
+}
+
+void CvVideoViewSelector::detectLoop(int worker){
+
+	SlotQueue *in = work_queues_[worker], *out = done_queues_[worker];
+
+	for(;;){
+		ViewSlot *slot = in->pop();
+		if(slot && !detector_->detectCorners(slot->gray, &slot->corners))
+			slot->corners.clear();
+
+		out->push(slot);
+		if(!slot)
+			break;
+	}
+}
+
+void CvVideoViewSelector::describeView(const std::vector<cv::Point2f> &corners, 
+									   cv::Size img_size, float *descriptor){
+
+	cv::Size board = detector_->getBoardSize();
+	int w = board.width, n = corners.size();
+
+	// outer corners of the board
+	cv::Point2f up_left = corners[0], up_right = corners[w-1];
+	cv::Point2f down_right = corners[n-1], down_left = corners[n-w];
+
+	float cx = 0, cy = 0;
+	for(int i=0; i<n; i++){
+		cx += corners[i].x;
+		cy += corners[i].y;
+	}
+
+	// shoelace area of the outer quad
+	cv::Point2f q[4] = { up_left, up_right, down_right, down_left };
+	float area = 0;
+	for(int i=0; i<4; i++)
+		area += q[i].x*q[(i+1)%4].y - q[(i+1)%4].x*q[i].y;
+	area = fabs(area)/2;
+
+	// deviation of the top-right angle from 90 degrees
+	cv::Point2f a = up_left - up_right, b = down_right - up_right;
+	float angle = acos((a.x*b.x + a.y*b.y)/
+						(sqrt(a.x*a.x + a.y*a.y)*sqrt(b.x*b.x + b.y*b.y) + FLT_EPSILON));
+	float skew = std::min(1.f, 2.f*fabs((float)CV_PI/2 - angle));
+
+	descriptor[0] = cx/n/img_size.width;
+	descriptor[1] = cy/n/img_size.height;
+	descriptor[2] = sqrt(area/img_size.area());
+	descriptor[3] = skew;
+}
@@ -0,0 +1,165 @@
+/*==========================================================================
+
+  Copyright (c) 2014 Uditha L. Jayarathne, ujayarat@robarts.ca
+
+  Use, modification and redistribution of the software, in source or
+  binary forms, are permitted provided that the following terms and
+  conditions are met:
+
+  1) Redistribution of the source code, in verbatim or modified
+  form, must retain the above copyright notice, this license,
+  the following disclaimer, and any notices that refer to this
+  license and/or the following disclaimer.  
+
+  2) Redistribution in binary form must include the above copyright
+  notice, a copy of this license and the following disclaimer
+  in the documentation or with other materials provided with the
+  distribution.
+
+  3) Modified copies of the source code must be clearly marked as such,
+  and must not be misrepresented as verbatim copies of the source code.
+
+  THE COPYRIGHT HOLDERS AND/OR OTHER PARTIES PROVIDE THE SOFTWARE "AS IS"
+  WITHOUT EXPRESSED OR IMPLIED WARRANTY INCLUDING, BUT NOT LIMITED TO,
+  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  PURPOSE.  IN NO EVENT SHALL ANY COPYRIGHT HOLDER OR OTHER PARTY WHO MAY
+  MODIFY AND/OR REDISTRIBUTE THE SOFTWARE UNDER THE TERMS OF THIS LICENSE
+  BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, LOSS OF DATA OR DATA BECOMING INACCURATE
+  OR LOSS OF PROFIT OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF
+  THE USE OR INABILITY TO USE THE SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGES.
+  =========================================================================*/
+
+#ifndef __CV_VIDEO_VIEW_SELECTOR__H
+#define __CV_VIDEO_VIEW_SELECTOR__H
+
+#include <iostream>
+#include <vector>
+#include <string>
+
+// Opencv Includes 
+#include "cv.h"
+#include "highgui.h"
+
+#include "cv_corner_detector.h"
+#include "cv_corner_tracker.h"
+#include "cv_spsc_queue.h"
+
+/**
+ * Picks calibration views straight from a video. The video is decoded once
+ * on its own thread; every n-th frame is converted to grayscale and dealt
+ * round robin to detector threads through bounded lock-free queues, so 
+ * decoding overlaps detection. With tracking, the board is followed from 
+ * frame to frame on the calling thread instead. From all detections a 
+ * pose-diverse subset is chosen by farthest point sampling on a board 
+ * position/size/skew descriptor.
+ */
+class CvVideoViewSelector{
+
+public:
+
+	// Part of the frame holding the camera image
+	enum FrameSide{
+		FULL_FRAME = 0,
+		LEFT_HALF,	// left half of a side-by-side stereo frame
+		RIGHT_HALF	// right half of a side-by-side stereo frame
+	};
+
+	/**
+	 * @param corner detector, not owned
+	 */
+	CvVideoViewSelector(CvCornerDetector*);
+	~CvVideoViewSelector();
+
+	//public methods
+
+	/**
+	 * Set the frame subsampling
+	 * @param detect on every n-th frame
+	 */
+	void setFrameStride(int);
+
+	/**
+	 * Track the board between sampled frames instead of detecting it in
+	 * every one. Frames are then processed in order on one core; the
+	 * full detector runs on keyframes and whenever tracking fails.
+	 * @param enable
+	 * @param keyframe interval in sampled frames, 0 for detection on failure only
+	 */
+	void setTracking(bool, int);
+
+	/**
+	 * Number of detector threads, unused while tracking
+	 */
+	int getWorkerCount() const;
+
+	/**
+	 * Select views from a video
+	 * @param video file name
+	 * @param frame side
+	 * @param number of views to select
+	 * @param reference to the selected corner sets, in frame order
+	 * @param reference to the image size
+	 * @return number of frames with a detected checkerboard
+	 */
+	int selectViews(const std::string&, FrameSide, int,
+					std::vector<std::vector<cv::Point2f>>*, cv::Size*);
+
+private:
+
+	// A sampled frame passed from the decoder to the detectors
+	typedef struct ViewSlot{
+		cv::Mat gray;
+		std::vector<cv::Point2f> corners;
+	} ViewSlot;
+
+	typedef CvSpscQueue<ViewSlot*> SlotQueue;
+
+	//private methods
+
+	/**
+	 * Decoder thread: fill free slots with sampled frames and deal them 
+	 * to the work queues
+	 * @param opened capture
+	 * @param frame side
+	 */
+	void decodeLoop(cv::VideoCapture*, FrameSide);
+
+	/**
+	 * Detector thread: find the board in the slots of one worker
+	 * @param worker index
+	 */
+	void detectLoop(int);
+
+	/**
+	 * Pose descriptor of a detected board: centre x, centre y, size, skew
+	 * @param corners
+	 * @param image size
+	 * @param reference to the 4 element descriptor
+	 */
+	void describeView(const std::vector<cv::Point2f>&, cv::Size, float*);
+
+	//private members
+
+	CvCornerDetector *detector_;
+	CvCornerTracker *tracker_;
+	int frame_stride_;
+
+	// detector threads and frames queued per thread
+	int n_workers_;
+	int queue_depth_;
+
+	// frames grabbed and image size of the current selection, written
+	// by the decoder
+	int n_grabbed_;
+	cv::Size frame_size_;
+
+	// queues of the current selection
+	SlotQueue *free_slots_;
+	std::vector<SlotQueue*> work_queues_;
+	std::vector<SlotQueue*> done_queues_;
+
+};
+
+#endif //__CV_VIDEO_VIEW_SELECTOR__H
@@ -36,6 +36,8 @@
 #include <time.h>
 
 #include "cv_camera_calib.h"
+#include "cv_corner_detector.h"
+#include "cv_video_view_selector.h"
 
 /**
  * Write settings to an xml file
@@ -47,17 +49,26 @@ int main(int argc, char **argv){
 
 	std::cout << "settings writte" << std::endl;
 	// Software usage
-	if(argc<4 || argc>4){ 
-		std::cout << "Usage:\t CV_Calib_V1 infile outfile	\n"
+	std::string mode(argc > 4 ? argv[4] : "");
+	if(argc<4 || argc>6 || (argc == 5 && mode != "-headless") || 
+	   (argc == 6 && mode != "-video")){ 
+		std::cout << "Usage:\t CV_Calib_V1 infile outfile prefix [-headless | -video file]\n"
 				  << "\t	infile: input configuratoin file \n" 
 				  << "\t	outfile: name of the file to write calibration matrices\n"
-				  << "\t	prefix: camera prefix (L/R)" 
+				  << "\t	prefix: camera prefix (L/R)\n" 
+				  << "\t	-headless: detect corners on all cores without display and calibrate\n" 
+				  << "\t	-video: select views from a video file and calibrate without display.\n"
+				  << "\t	        Prefix L/R picks the half of a side-by-side stereo frame" 
 				  << std::endl;
 		return 0;
 	}
 
 	std::string settings_file_name(argv[1]), output_file_name(argv[2]);
 	std::string cam_prefix(argv[3]); // L or R typically
+	bool headless = (mode == "-headless");
+	std::string video_file_name;
+	if(mode == "-video")
+		video_file_name = argv[5];
 	// Read the settings file.
 	cv::FileStorage file;	
 	if(!file.open(settings_file_name, cv::FileStorage::READ)){
@@ -66,9 +77,9 @@ int main(int argc, char **argv){
 	}
 
 	cv::FileNode n = file["Calibration_Images"];
+	std::string folder_name = (std::string)n["folder_name"];
 	// file prefix
-	std::string prefix = (std::string)n["folder_name"] +
-						"/" + (std::string)n["prefix"];
+	std::string prefix = folder_name + "/" + (std::string)n["prefix"];
 	// file extention
 	std::string ext   = (std::string)n["extension"];
 	// number of files
@@ -76,6 +87,17 @@ int main(int argc, char **argv){
 
 	n = file["Calibration_Params"];
 	int distortion_model = (int)n["distortion_model_param"];
+	bool native_solver = ((int)n["native_solver"] != 0);
+	bool reject_outliers = ((int)n["reject_outlier_views"] != 0);
+	double outlier_threshold = (double)n["outlier_threshold"];
+
+	n = file["Calibration_Video"];
+	int frame_stride = (int)n["frame_stride"];
+	int video_view_count = (int)n["view_count"];
+	bool tracking = ((int)n["tracking"] != 0);
+	int keyframe_interval = (int)n["keyframe_interval"];
+	if(video_view_count <= 0)
+		video_view_count = n_images;
 
 	// Checkerboard params
 	n = file["Checkerboard_Specs"];
@@ -85,9 +107,11 @@ int main(int argc, char **argv){
 	
 	//Read image folder and detect corners
 	std::string filename;
-	char img_no[3];
+	char img_no[8];
 
 	CvCameraCalib CameraCalibrator; 
+	CameraCalibrator.setNativeSolver(native_solver);
+	CameraCalibrator.setOutlierRejection(reject_outliers, outlier_threshold);
 	CvCameraCalib::CalibParams params;
 	params.distortion_model = distortion_model;
 	params.h_corners = h_corners;
@@ -102,10 +126,136 @@ int main(int argc, char **argv){
 			  << "\t Height Corner Count: " << params.h_corners
 			  << "\n"
 			  << "\t Square size: " << params.sq_size << "mm"
+			  << "\n"
+			  << "\t Solver: " << (native_solver ? "native LM" : "OpenCV")
 			  << "\n" << std::endl << std::endl;
 
-	cv::Mat corners;
 	std::vector<std::vector<cv::Point2f>> all_corners;
+	CvCornerDetector detector(w_corners, h_corners);
+
+	// Detections of unchanged images are reused from earlier runs
+	CvCornerCache corner_cache(folder_name + "/corners.cache", w_corners, h_corners);
+	if(corner_cache.load())
+		std::cout << "Loaded " << corner_cache.size() 
+				  << " cached detections" << std::endl;
+	detector.setCache(&corner_cache);
+
+	if(!video_file_name.empty()){
+
+		CvVideoViewSelector::FrameSide side = CvVideoViewSelector::FULL_FRAME;
+		if(cam_prefix == "L")
+			side = CvVideoViewSelector::LEFT_HALF;
+		else if(cam_prefix == "R")
+			side = CvVideoViewSelector::RIGHT_HALF;
+
+		CvVideoViewSelector selector(&detector);
+		if(frame_stride > 0)
+			selector.setFrameStride(frame_stride);
+		selector.setTracking(tracking, keyframe_interval);
+
+		std::cout << "Selecting " << video_view_count << " views from "
+				  << video_file_name;
+		if(tracking)
+			std::cout << " tracking on one thread" << std::endl;
+		else
+			std::cout << " using " << selector.getWorkerCount() 
+					  << " detector threads" << std::endl;
+
+		cv::Size img_size;
+		int64 start = cv::getTickCount();
+		selector.selectViews(video_file_name, side, video_view_count, 
+							 &all_corners, &img_size);
+		double elapsed = (cv::getTickCount() - start)/cv::getTickFrequency();
+
+		std::cout << "Selection took " << elapsed << "s" << std::endl;
+		std::cout << "No. of calibration images: " << all_corners.size() << std::endl;
+
+		if(all_corners.empty())
+			return 0;
+
+		params.img_width = img_size.width;
+		params.img_height = img_size.height;
+
+		if(reject_outliers){
+			// Outlier rejection needs all views at once
+			CameraCalibrator.calibrateCamera(params, all_corners);
+		}
+		else{
+			// Views are added in video order, each solve warm starting from
+			// the last, so every add should cost about the same
+			std::cout << "Calibrating camera incrementally.. " << std::endl;
+			CameraCalibrator.beginIncremental(params);
+			for(size_t i=0; i<all_corners.size(); i++){
+				int64 add_start = cv::getTickCount();
+				double error = CameraCalibrator.addView(all_corners[i]);
+				double add_ms = (cv::getTickCount() - add_start)*1000.0/
+								cv::getTickFrequency();
+				if(error >= 0)
+					std::cout << "\t View " << i << " added: RMS " << error
+							  << ", " << add_ms << "ms" << std::endl;
+			}
+		}
+
+		if(!CameraCalibrator.saveCalibrationParams(output_file_name)){
+			std::cout << "Unable to write calibration parameters to "
+					  << output_file_name << std::endl;
+			return 0;
+		}
+
+		std::cout << "Parameters were written to " 
+				  << output_file_name << std::endl;
+		return 0;
+	}
+
+	if(headless){
+
+		std::vector<std::string> filenames;
+		for(int i=0; i<n_images; i++){
+			itoa(i, img_no, 10);
+			filenames.push_back(prefix + img_no + cam_prefix + ".png");
+		}
+
+		std::cout << "Detecting corners in " << n_images << " images from "
+				  << prefix << " using " << cv::getNumThreads() 
+				  << " threads" << std::endl;
+
+		std::vector<std::vector<cv::Point2f>> detected_corners;
+		cv::Size img_size;
+
+		int64 start = cv::getTickCount();
+		detector.detectCornersBatch(filenames, &detected_corners, &img_size);
+		double elapsed = (cv::getTickCount() - start)/cv::getTickFrequency();
+		corner_cache.save();
+
+		for(int i=0; i<n_images; i++){
+			if(detected_corners[i].empty()){
+				std::cerr << "Failed to find the checkerboard in "
+						  << filenames[i] << std::endl;
+				continue;
+			}
+			all_corners.push_back(detected_corners[i]);
+		}
+
+		std::cout << "Detection took " << elapsed << "s" << std::endl;
+		std::cout << "No. of calibration images: " << all_corners.size() << std::endl;
+
+		if(all_corners.empty())
+			return 0;
+
+		params.img_width = img_size.width;
+		params.img_height = img_size.height;
+
+		CameraCalibrator.calibrateCamera(params, all_corners);
+		if(!CameraCalibrator.saveCalibrationParams(output_file_name)){
+			std::cout << "Unable to write calibration parameters to "
+					  << output_file_name << std::endl;
+			return 0;
+		}
+
+		std::cout << "Parameters were written to " 
+				  << output_file_name << std::endl;
+		return 0;
+	}
 
 	char key;
 
@@ -135,17 +285,15 @@ int main(int argc, char **argv){
 		params.img_width = frame.cols;
 		params.img_height = frame.rows;
 
-		if(!cv::findChessboardCorners(frame, cvSize(w_corners, h_corners),
-									corners,
-									cv::CALIB_CB_ADAPTIVE_THRESH+
-									cv::CALIB_CB_FILTER_QUADS)){
+		std::vector<cv::Point2f> corners_per_image;
+		if(!detector.detectCorners(filename, frame_gry, &corners_per_image)){
 
 			std::cerr << "Failed to find the checkerboard" << std::endl;
 		}
 		else{
 			//draw checkerboard corners
 			cv::drawChessboardCorners(frame, cvSize(w_corners, h_corners),
-										corners, true);			
+										cv::Mat(corners_per_image), true);			
 
 			// show image
 			cv::namedWindow( filename, CV_WINDOW_KEEPRATIO);			
@@ -154,19 +302,6 @@ int main(int argc, char **argv){
 			// wait for any key
 			key = cv::waitKey(-1);	
 
-			// Refine corner sub pix
-			cv::cornerSubPix(frame_gry, corners, cvSize(5, 5), 
-								cvSize(-1, -1), 
-								cv::TermCriteria::TermCriteria(cv::TermCriteria::EPS+cv::TermCriteria::MAX_ITER,
-												30, 0.1));
-
-			//copy corner points into a std::vector
-			std::vector<cv::Point2f> corners_per_image;
-			for(int j=0; j<corners.rows; j++){
-				cv::Point2f point(corners.at<float>(j, 0), 
-									corners.at<float>(j, 1));
-				corners_per_image.push_back(point);
-			}
 			all_corners.push_back(corners_per_image);
 
 			cv::destroyWindow( filename );
@@ -175,6 +310,8 @@ int main(int argc, char **argv){
 		frame_gry.release();
 	}
 
+	corner_cache.save();
+
 	std::cout << "No. of calibration images: " << all_corners.size() << std::endl;
 	std::cout << "Proceed with calibration?" << std::endl;
 	char input;
@@ -224,7 +361,16 @@ void write_settings_to_xml(){
 	fs << "image_count" << 7 << "}";
 
 	fs << "Calibration_Params";
-	fs << "{" << "distortion_model_param" << 5 << "}";
+	fs << "{" << "distortion_model_param" << 5;
+	fs << "native_solver" << 0;
+	fs << "reject_outlier_views" << 1;
+	fs << "outlier_threshold" << 3.0 << "}";
+
+	fs << "Calibration_Video";
+	fs << "{" << "frame_stride" << 5;
+	fs << "view_count" << 30;
+	fs << "tracking" << 0;
+	fs << "keyframe_interval" << 30 << "}";
 
 	std::cout << "Settings were written to settings.xml file" << std::endl;
 
@@ -39,22 +39,78 @@
 #include "cv.h"
 #include "highgui.h"
 
+#include "cv_corner_detector.h"
+#include "cv_stereo_pair_detector.h"
+#include "cv_lm_stereo_solver.h"
+
 /**
  * Write settings to an xml file
  * @param void
  */
 void write_settings_to_xml();
 
+/**
+ * Calibrate the rig from corner pairs, rectify, and write R, T, E, F, R1, 
+ * R2, P1, P2 and Q to a file
+ * @param object points of every pair
+ * @param left corners of every pair
+ * @param right corners of every pair
+ * @param left camera matrix
+ * @param left distortion params
+ * @param right camera matrix
+ * @param right distortion params
+ * @param image size
+ * @param output file name
+ * @return true on success
+ */
+bool calibrate_stereo_and_save(const std::vector<std::vector<cv::Point3f>>&, 
+							   const std::vector<std::vector<cv::Point2f>>&, 
+							   const std::vector<std::vector<cv::Point2f>>&, 
+							   cv::Mat&, cv::Mat&, cv::Mat&, cv::Mat&, 
+							   cv::Size, std::string);
+
+/**
+ * Rectify a calibrated rig and write R, T, E, F, R1, R2, P1, P2 and Q to
+ * a file
+ * @param left camera matrix
+ * @param left distortion params
+ * @param right camera matrix
+ * @param right distortion params
+ * @param image size
+ * @param rotation from left to right camera
+ * @param translation from left to right camera
+ * @param output file name
+ * @return true on success
+ */
+bool save_stereo_calibration(const cv::Mat&, const cv::Mat&, const cv::Mat&, const cv::Mat&, 
+							 cv::Size, const cv::Mat&, const cv::Mat&, std::string);
+
+/**
+ * Write the intrinsics and distortions of one camera in the format of the
+ * mono calibration tool
+ * @param camera matrix
+ * @param distortion params
+ * @param filename
+ * @return true on success
+ */
+bool save_camera_calibration(const cv::Mat&, const cv::Mat&, std::string);
+
 int main(int argc, char** argv){
 
 	// Software usage
-	if(argc<3 || argc>3){ 
-		std::cout << "Usage:\t CV_Calib_V1 infile outfile	\n"
+	std::string mode(argc == 4 ? argv[3] : "");
+	if(argc<3 || argc>4 || (argc == 4 && mode != "-headless" && mode != "-joint")){ 
+		std::cout << "Usage:\t CV_Calib_V1 infile outfile [-headless | -joint]	\n"
 				  << "\t	infile: input configuratoin file \n" 
-				  << "\t	outfile: name of the file to write calibration matrices"
+				  << "\t	outfile: name of the file to write calibration matrices \n"
+				  << "\t	-headless: detect all pairs on all cores without display and calibrate \n"
+				  << "\t	-joint: as -headless, but solve both cameras and the rig together \n"
+				  << "\t	        and write the left and right calibration files as well"
 				  << std::endl;
 		return 0;
 	}
+	bool headless = (mode == "-headless");
+	bool joint = (mode == "-joint");
 
 	// Display software usage
 	std::cout << "Stereo Calibration:\n"
@@ -73,9 +129,9 @@ int main(int argc, char** argv){
 	}
 
 	cv::FileNode n = file["Calibration_Images"];
+	std::string folder_name = (std::string)n["folder_name"];
 	// file prefix
-	std::string prefix = (std::string)n["folder_name"] +
-						"/" + (std::string)n["prefix"];
+	std::string prefix = folder_name + "/" + (std::string)n["prefix"];
 	// file extention
 	std::string ext   = (std::string)n["extension"];
 	// number of files
@@ -105,37 +161,56 @@ int main(int argc, char** argv){
 	std::string left_calibration_file_name((std::string)n["left_calib_file"]), 
 				right_calibration_file_name((std::string)n["right_calib_file"]);
 	
-	cv::FileStorage calib_file(left_calibration_file_name,
-								cv::FileStorage::READ);
-	if(!calib_file.isOpened()){
-		std::cerr << "Left calibration parameters not found" << std::endl;
-		return 0;
-	}
+	// the joint solver estimates both cameras from the images
+	if(!joint){
+		cv::FileStorage calib_file(left_calibration_file_name,
+									cv::FileStorage::READ);
+		if(!calib_file.isOpened()){
+			std::cerr << "Left calibration parameters not found" << std::endl;
+			return 0;
+		}
 
-	calib_file["Intrinsics"] >> left_intrinsics;
-	calib_file["Distortion_Parameters"] >> left_distortion_params;
+		calib_file["Intrinsics"] >> left_intrinsics;
+		calib_file["Distortion_Parameters"] >> left_distortion_params;
 
-	calib_file.release();
+		calib_file.release();
 
-	calib_file = cv::FileStorage(right_calibration_file_name, 
-									cv::FileStorage::READ);
+		calib_file = cv::FileStorage(right_calibration_file_name, 
+										cv::FileStorage::READ);
 
 		if(!calib_file.isOpened()){
-		std::cerr << "Right calibration parameters not found" << std::endl;
-		return 0;
-	}
+			std::cerr << "Right calibration parameters not found" << std::endl;
+			return 0;
+		}
 
-	calib_file["Intrinsics"] >> right_intrinsics;
-	calib_file["Distortion_Parameters"] >> right_distortion_params;
-	calib_file.release();
+		calib_file["Intrinsics"] >> right_intrinsics;
+		calib_file["Distortion_Parameters"] >> right_distortion_params;
+		calib_file.release();
+	}
 
-	
 	//Read image folder and detect corners
-	std::string filename;
-	char img_no[3];	
+	std::string left_filename, right_filename;
+	char img_no[8];	
 	
-	cv::Mat left_corners, right_corners;
+	std::vector<cv::Point2f> left_corners, right_corners;
 	std::vector<std::vector<cv::Point2f>> all_left_corners, all_right_corners;
+
+	CvCornerDetector detector(w_corners, h_corners);
+	detector.setDetectionFlags(cv::CALIB_CB_ADAPTIVE_THRESH+
+								cv::CALIB_CB_NORMALIZE_IMAGE);
+
+	// Detections of unchanged images are reused from earlier runs
+	CvCornerCache corner_cache(folder_name + "/corners.cache", w_corners, h_corners);
+	corner_cache.load();
+	detector.setCache(&corner_cache);
+
+	// Pairs are searched in the cheaper eye first and the other eye only
+	// near the board found there, shifted by the approximate disparity
+	CvStereoPairDetector pair_detector(&detector);
+	pair_detector.setCache(&corner_cache);
+	n = file["Pair_Detection"];
+	if(!n.empty())
+		pair_detector.setDisparity((float)n["disparity"]);
 	std::vector<std::vector<cv::Point3f>> all_object_points;
 
 	std::vector<cv::Point3f> object_points;
@@ -147,18 +222,117 @@ int main(int argc, char** argv){
 	}
 	all_object_points.push_back(object_points);
 
-		
+	// Batch mode: every pair is detected in parallel and the rig is
+	// calibrated once from all pairs found in both eyes. The joint mode
+	// also keeps pairs found in one eye, they still constrain that camera,
+	// so it searches every image in full instead of rejecting pairs early.
+	if(headless || joint){
+
+		std::vector<std::string> left_filenames, right_filenames;
+		for(int i=0; i<n_images; i++){
+			itoa(i, img_no, 10);
+			left_filenames.push_back(prefix + img_no + "L.png");
+			right_filenames.push_back(prefix + img_no + "R.png");
+		}
+
+		std::cout << "Detecting corners in " << n_images << " pairs from "
+				  << prefix << " using " << cv::getNumThreads() 
+				  << " threads" << std::endl;
+
+		std::vector<std::vector<cv::Point2f>> detected_left, detected_right;
+		cv::Size img_size;
+
+		int64 start = cv::getTickCount();
+		if(joint){
+			std::vector<std::string> filenames(left_filenames);
+			filenames.insert(filenames.end(), right_filenames.begin(), right_filenames.end());
+
+			std::vector<std::vector<cv::Point2f>> detected_corners;
+			detector.detectCornersBatch(filenames, &detected_corners, &img_size);
+			detected_left.assign(detected_corners.begin(), detected_corners.begin() + n_images);
+			detected_right.assign(detected_corners.begin() + n_images, detected_corners.end());
+		}
+		else
+			pair_detector.detectPairsBatch(left_filenames, right_filenames, 
+										   &detected_left, &detected_right, &img_size);
+		double elapsed = (cv::getTickCount() - start)/cv::getTickFrequency();
+		corner_cache.save();
+
+		all_object_points.clear();
+		for(int i=0; i<n_images; i++){
+			bool left_found = !detected_left[i].empty();
+			bool right_found = !detected_right[i].empty();
+			if(!(left_found && right_found) && !(joint && (left_found || right_found))){
+				std::cerr << "Failed to find the checkerboard at least in one image of pair "
+						  << i << std::endl;
+				continue;
+			}
+			all_left_corners.push_back(detected_left[i]);
+			all_right_corners.push_back(detected_right[i]);
+			all_object_points.push_back(object_points);
+		}
+
+		std::cout << "Detection took " << elapsed << "s" << std::endl;
+		if(!joint){
+			CvStereoPairDetector::PairStats stats = pair_detector.getStats();
+			std::cout << "Pairs rejected by the first eye: " << stats.n_rejected 
+					  << ", second eye found in the predicted window: " << stats.n_window 
+					  << ", in a full search: " << stats.n_full << std::endl;
+		}
+		std::cout << "No. of calibration pairs: " << all_left_corners.size() << std::endl;
+
+		if(all_left_corners.empty())
+			return 0;
+
+		if(joint){
+			cv::Mat rig_rvec, rig_tvec, R;
+			std::vector<cv::Mat> rVecs, tVecs;
+			if(!CvLMStereoSolver::initialize(all_object_points, all_left_corners, all_right_corners, 
+											 img_size, distortion_model, 
+											 &left_intrinsics, &left_distortion_params, 
+											 &right_intrinsics, &right_distortion_params, 
+											 &rig_rvec, &rig_tvec, &rVecs, &tVecs)){
+				std::cerr << "The checkerboard must be found in both images of a pair at least once" 
+						  << std::endl;
+				return 0;
+			}
+
+			CvLMStereoSolver solver;
+			start = cv::getTickCount();
+			double rms = solver.solve(all_object_points, all_left_corners, all_right_corners, 
+									  &left_intrinsics, &left_distortion_params, 
+									  &right_intrinsics, &right_distortion_params, 
+									  &rig_rvec, &rig_tvec, &rVecs, &tVecs);
+			elapsed = (cv::getTickCount() - start)/cv::getTickFrequency();
+			if(rms < 0){
+				std::cerr << "Unsupported distortion model " << distortion_model << std::endl;
+				return 0;
+			}
+
+			std::cout << "Joint rig calibration: RMS " << rms << " after " 
+					  << solver.getIterationStats().size() << " iterations in " 
+					  << elapsed << "s" << std::endl;
+
+			cv::Rodrigues(rig_rvec, R);
+			if(save_camera_calibration(left_intrinsics, left_distortion_params, 
+										left_calibration_file_name) &&
+				save_camera_calibration(right_intrinsics, right_distortion_params, 
+										right_calibration_file_name))
+				std::cout << "Camera parameters were written to " << left_calibration_file_name 
+						  << " and " << right_calibration_file_name << std::endl;
+			save_stereo_calibration(left_intrinsics, left_distortion_params, 
+									right_intrinsics, right_distortion_params, 
+									img_size, R, rig_tvec, output_file_name);
+			return 0;
+		}
+
+		calibrate_stereo_and_save(all_object_points, all_left_corners, all_right_corners, 
+								  left_intrinsics, left_distortion_params, 
+								  right_intrinsics, right_distortion_params, 
+								  img_size, output_file_name);
+		return 0;
+	}
 
-	// Output matrics
-	cv::Mat R(3, 3, CV_32F); // Rotational matrix between cameras
-	cv::Mat T(3, 1, CV_32F); // Translational vector between cameras
-	cv::Mat E(3, 3, CV_32F); // Essential matrix between the cameras
-	cv::Mat F(3, 3, CV_32F); // Fundamental matrix between the cameras
-	cv::Mat R1(3, 3, CV_32F); // 1st rectification transform
-	cv::Mat R2(3, 3, CV_32F); // 2nd rectification transform
-	cv::Mat P1(3, 4, CV_32F); // 1st projection matrix
-	cv::Mat P2(3, 4, CV_32F); // 2nd projection matrix
-	cv::Mat Q(4, 4, CV_32F); // disparity-to-depth mapping matrix
 
 	char key;
 
@@ -167,28 +341,22 @@ int main(int argc, char** argv){
 	for(int i=0; i<n_images; i++){
 
 		itoa(i, img_no, 10);
-		filename = prefix + img_no + "L.png"; 
+		left_filename = prefix + img_no + "L.png"; 
 
 		// reading left frame
-		std::cout << "Reading image: " << filename << std::endl;
-		cv::Mat left_frame = cv::imread(filename, CV_LOAD_IMAGE_COLOR);
+		std::cout << "Reading image: " << left_filename << std::endl;
+		cv::Mat left_frame = cv::imread(left_filename, CV_LOAD_IMAGE_COLOR);
 
 		// reading right frame
-		filename = prefix + img_no + "R.png";
-		std::cout << "Reading image: " << filename << std::endl;
-		cv::Mat right_frame = cv::imread(filename, CV_LOAD_IMAGE_COLOR);
+		right_filename = prefix + img_no + "R.png";
+		std::cout << "Reading image: " << right_filename << std::endl;
+		cv::Mat right_frame = cv::imread(right_filename, CV_LOAD_IMAGE_COLOR);
 
 		if(left_frame.empty() || right_frame.empty()){
 			std::cerr << "Bad image!" << std::endl;
 			continue; // read the next image
 		}
 
-		// convert image to grayscale. 
-		cv::Mat left_frame_gry(left_frame.rows, left_frame.cols, CV_32F);
-		cv::Mat right_frame_gry(right_frame.rows, right_frame.cols, CV_32F);
-		cv::cvtColor(left_frame, left_frame_gry, CV_BGR2GRAY);
-		cv::cvtColor(right_frame, right_frame_gry, CV_BGR2GRAY);
-
 		// Show images
 		cv::namedWindow("Left_Image", CV_WINDOW_KEEPRATIO);
 		cv::namedWindow("Right_Image", CV_WINDOW_KEEPRATIO);
@@ -202,14 +370,15 @@ int main(int argc, char** argv){
 		if(key == 100 ){ // if the key is 'd'
 			// Detect the checkerboards
 			
-			if(!cv::findChessboardCorners(left_frame, cvSize(w_corners, h_corners),
-									left_corners,
-									cv::CALIB_CB_ADAPTIVE_THRESH+
-									cv::CALIB_CB_NORMALIZE_IMAGE) || 
-					!cv::findChessboardCorners(right_frame, cvSize(w_corners, h_corners),
-									right_corners,
-									cv::CALIB_CB_ADAPTIVE_THRESH+
-									cv::CALIB_CB_NORMALIZE_IMAGE)){
+			cv::Size img_size;
+			// the frames shown above are searched, not decoded again
+			bool found = pair_detector.detectPair(left_filename, right_filename, 
+												  left_frame, right_frame, 
+												  &left_corners, &right_corners, 
+												  &img_size);
+			corner_cache.save();
+
+			if(!found){
 
 			std::cerr << "Failed to find the checkerboard at least in one image" << std::endl;
 			continue; 
@@ -218,11 +387,11 @@ int main(int argc, char** argv){
 				// draw checkerboard corners
 				cv::drawChessboardCorners(left_frame, 
 											cvSize(w_corners, h_corners), 
-											left_corners, true);
+											cv::Mat(left_corners), true);
 
 				cv::drawChessboardCorners(right_frame, 
 											cvSize(w_corners, h_corners), 
-											right_corners, true);
+											cv::Mat(right_corners), true);
 
 				// Show image
 				cv::imshow("Left_Image", left_frame);
@@ -231,77 +400,19 @@ int main(int argc, char** argv){
 				key = cv::waitKey(-1);
 
 				if( key == 115){ // if the key is 's' -- SELECT
-					// Find corner subpix
-					cv::cornerSubPix(left_frame_gry, left_corners, 
-										cvSize(5, 5), 
-										cvSize(-1, -1), 
-										cv::TermCriteria::TermCriteria(cv::TermCriteria::EPS+
-													cv::TermCriteria::MAX_ITER,30, 0.1));
-					cv::cornerSubPix(right_frame_gry, right_corners, 
-										cvSize(5, 5), 
-										cvSize(-1, -1), 
-										cv::TermCriteria::TermCriteria(cv::TermCriteria::EPS+
-													cv::TermCriteria::MAX_ITER,30, 0.1));
-
+					// Corners were refined to sub-pixel by the detector
 					std::vector<std::vector<cv::Point2f>> all_left_corners, all_right_corners;
-					std::vector<cv::Point2f> l_temp, r_temp;
+					all_left_corners.push_back(left_corners);
+					all_right_corners.push_back(right_corners);
 					
-					for(int j=0; j<left_corners.rows; j++){
-						cv::Point2f l_point(left_corners.at<float>( j, 0), 
-												left_corners.at<float>(j, 1)), 
-									r_point(right_corners.at<float>(j, 0), 
-												right_corners.at<float>(j, 1));
-						l_temp.push_back(l_point);
-						r_temp.push_back(r_point);
-					}
-					all_left_corners.push_back(l_temp);
-					all_right_corners.push_back(r_temp);
-					
-					//Do the calibration
-					cv::stereoCalibrate(all_object_points, 
-										all_left_corners, all_right_corners, 
-										left_intrinsics, left_distortion_params, 
-										right_intrinsics, right_distortion_params, 
-										cvSize(left_frame.rows, left_frame.cols), 
-										R, T, 
-										E, F, 
-										cv::TermCriteria(CV_TERMCRIT_ITER+CV_TERMCRIT_EPS, 30, 1e-6));
-
-					// Do stereo calibrated rectifications
-					cv::stereoRectify(left_intrinsics, left_distortion_params, 
-										right_intrinsics, right_distortion_params, 
-										cvSize(left_frame.rows, left_frame.cols), 
-										R, T, 
-										R1, R2, 
-										P1, P2, 
-										Q, 
-										0);
-					
-					//Save Results
-					cv::FileStorage outputFile(output_file_name, cv::FileStorage::WRITE);
-					outputFile << "R" << R;
-					outputFile << "T" << T;
-					outputFile << "E" << E;
-					outputFile << "F" << F;
-					outputFile << "R1"<< R1;
-					outputFile << "R2"<< R2;
-					outputFile << "P1"<< P1;
-					outputFile << "P2"<< P2;
-					outputFile << "Q" << Q;
-
-					std::cout << "Stereo Calibration done."
-							  << "Results were written to the output file" << std::endl;
-
-
-					//Release resources
-					outputFile.release();
-
-					R.release();
-					T.release();
-					E.release();
-					F.release();
-					left_corners.release();
-					right_corners.release();
+					calibrate_stereo_and_save(all_object_points, 
+											  all_left_corners, all_right_corners, 
+											  left_intrinsics, left_distortion_params, 
+											  right_intrinsics, right_distortion_params, 
+											  left_frame.size(), output_file_name);
+
+					left_corners.clear();
+					right_corners.clear();
 
 					return 0;
 				}
@@ -340,5 +451,114 @@ void write_settings_to_xml(){
 	fs << "{" << "left_calib_file" << "./left_calibration.xml";
 	fs << "right_calib_file" << "./right_calibration.xml" << "}";
 
+	fs << "Pair_Detection";
+	fs << "{" << "disparity" << 0.0 << "}";
+
 	fs.release();
-}
\ No newline at end of file
+}
+
+bool calibrate_stereo_and_save(const std::vector<std::vector<cv::Point3f>> &all_object_points, 
+							   const std::vector<std::vector<cv::Point2f>> &all_left_corners, 
+							   const std::vector<std::vector<cv::Point2f>> &all_right_corners, 
+							   cv::Mat &left_intrinsics, cv::Mat &left_distortion_params, 
+							   cv::Mat &right_intrinsics, cv::Mat &right_distortion_params, 
+							   cv::Size img_size, std::string output_file_name){
+
+	// Output matrics
+	cv::Mat R(3, 3, CV_32F); // Rotational matrix between cameras
+	cv::Mat T(3, 1, CV_32F); // Translational vector between cameras
+	cv::Mat E(3, 3, CV_32F); // Essential matrix between the cameras
+	cv::Mat F(3, 3, CV_32F); // Fundamental matrix between the cameras
+
+	//Do the calibration
+	double rms = cv::stereoCalibrate(all_object_points, 
+									 all_left_corners, all_right_corners, 
+									 left_intrinsics, left_distortion_params, 
+									 right_intrinsics, right_distortion_params, 
+									 img_size, 
+									 R, T, 
+									 E, F, 
+									 cv::TermCriteria(CV_TERMCRIT_ITER+CV_TERMCRIT_EPS, 30, 1e-6));
+
+	std::cout << "Stereo reprojection error over " << all_left_corners.size() 
+			  << " pairs: " << rms << std::endl;
+
+	return save_stereo_calibration(left_intrinsics, left_distortion_params, 
+								   right_intrinsics, right_distortion_params, 
+								   img_size, R, T, output_file_name);
+}
+
+bool save_stereo_calibration(const cv::Mat &left_intrinsics, const cv::Mat &left_distortion_params, 
+							 const cv::Mat &right_intrinsics, const cv::Mat &right_distortion_params, 
+							 cv::Size img_size, const cv::Mat &R, const cv::Mat &T, 
+							 std::string output_file_name){
+
+	cv::Mat R1(3, 3, CV_32F); // 1st rectification transform
+	cv::Mat R2(3, 3, CV_32F); // 2nd rectification transform
+	cv::Mat P1(3, 4, CV_32F); // 1st projection matrix
+	cv::Mat P2(3, 4, CV_32F); // 2nd projection matrix
+	cv::Mat Q(4, 4, CV_32F); // disparity-to-depth mapping matrix
+
+	// Essential and fundamental matrices of the rig, E = [T]x R
+	cv::Mat R64, T64, K1, K2;
+	R.convertTo(R64, CV_64F);
+	T.convertTo(T64, CV_64F);
+	left_intrinsics.convertTo(K1, CV_64F);
+	right_intrinsics.convertTo(K2, CV_64F);
+	double tx = T64.at<double>(0), ty = T64.at<double>(1), tz = T64.at<double>(2);
+	cv::Mat T_cross = (cv::Mat_<double>(3, 3) << 0, -tz, ty, tz, 0, -tx, -ty, tx, 0);
+	cv::Mat E = T_cross*R64;
+	cv::Mat F = K2.inv().t()*E*K1.inv();
+	F /= F.at<double>(2, 2);
+
+	// Do stereo calibrated rectifications
+	cv::stereoRectify(left_intrinsics, left_distortion_params, 
+						right_intrinsics, right_distortion_params, 
+						img_size, 
+						R, T, 
+						R1, R2, 
+						P1, P2, 
+						Q, 
+						0);
+
+	//Save Results
+	cv::FileStorage outputFile(output_file_name, cv::FileStorage::WRITE);
+	if(!outputFile.isOpened()){
+		std::cerr << "Unable to write calibration parameters to " 
+				  << output_file_name << std::endl;
+		return false;
+	}
+
+	outputFile << "R" << R;
+	outputFile << "T" << T;
+	outputFile << "E" << E;
+	outputFile << "F" << F;
+	outputFile << "R1"<< R1;
+	outputFile << "R2"<< R2;
+	outputFile << "P1"<< P1;
+	outputFile << "P2"<< P2;
+	outputFile << "Q" << Q;
+
+	std::cout << "Stereo Calibration done."
+			  << "Results were written to the output file" << std::endl;
+
+	//Release resources
+	outputFile.release();
+	return true;
+}
+
+bool save_camera_calibration(const cv::Mat &intrinsics, const cv::Mat &distortion_params, 
+							 std::string filename){
+
+	cv::FileStorage file(filename, cv::FileStorage::WRITE);
+	if(!file.isOpened()){
+		std::cerr << "Unable to write calibration parameters to " << filename << std::endl;
+		return false;
+	}
+
+	file << "Intrinsics" << intrinsics;
+	file << "Distortion_Parameters" << distortion_params;
+
+	file.release();
+	return true;
+}
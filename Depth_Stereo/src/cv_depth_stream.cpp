@@ -0,0 +1,99 @@
+/*==========================================================================
+
+  Copyright (c) 2014 Uditha L. Jayarathne, ujayarat@robarts.ca
+
+  Use, modification and redistribution of the software, in source or
+  binary forms, are permitted provided that the following terms and
+  conditions are met:
+
+  1) Redistribution of the source code, in verbatim or modified
+  form, must retain the above copyright notice, this license,
+  the following disclaimer, and any notices that refer to this
+  license and/or the following disclaimer.  
+
+  2) Redistribution in binary form must include the above copyright
+  notice, a copy of this license and the following disclaimer
+  in the documentation or with other materials provided with the
+  distribution.
+
+  3) Modified copies of the source code must be clearly marked as such,
+  and must not be misrepresented as verbatim copies of the source code.
+
+  THE COPYRIGHT HOLDERS AND/OR OTHER PARTIES PROVIDE THE SOFTWARE "AS IS"
+  WITHOUT EXPRESSED OR IMPLIED WARRANTY INCLUDING, BUT NOT LIMITED TO,
+  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  PURPOSE.  IN NO EVENT SHALL ANY COPYRIGHT HOLDER OR OTHER PARTY WHO MAY
+  MODIFY AND/OR REDISTRIBUTE THE SOFTWARE UNDER THE TERMS OF THIS LICENSE
+  BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, LOSS OF DATA OR DATA BECOMING INACCURATE
+  OR LOSS OF PROFIT OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF
+  THE USE OR INABILITY TO USE THE SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGES.
+  =========================================================================*/
+
+#include "cv_depth_stream.h"
+
+// File layout (native byte order):
+//	char[4] magic, int32 version, int32 width, int32 height, 
+//	float depth units per calibration unit, 
+//	per frame: height x width uint16, 0 where the depth is unknown
+static const char DEPTH_MAGIC[4] = {'C', 'V', 'D', 'S'};
+static const int DEPTH_VERSION = 1;
+
+CvDepthStreamWriter::CvDepthStreamWriter():
+	n_frames_(0){
+
+}
+
+CvDepthStreamWriter::~CvDepthStreamWriter(){
+	close();
+}
+
+bool CvDepthStreamWriter::open(std::string filename, cv::Size size, float depth_scale){
+
+	close();
+	file_.open(filename.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+	if(!file_.is_open()){
+		std::cerr << "Unable to open the depth stream " << filename << std::endl;
+		return false;
+	}
+
+	size_ = size;
+	n_frames_ = 0;
+
+	file_.write(DEPTH_MAGIC, 4);
+	file_.write((const char *)&DEPTH_VERSION, sizeof(int));
+	file_.write((const char *)&size_.width, sizeof(int));
+	file_.write((const char *)&size_.height, sizeof(int));
+	file_.write((const char *)&depth_scale, sizeof(float));
+
+	return file_.good();
+}
+
+bool CvDepthStreamWriter::write(const cv::Mat &depth){
+
+	if(!file_.is_open() || depth.type() != CV_16UC1 || 
+		depth.cols != size_.width || depth.rows != size_.height)
+		return false;
+
+	if(depth.isContinuous())
+		file_.write((const char *)depth.data, depth.total()*depth.elemSize());
+	else
+		for(int r=0; r<depth.rows; r++)
+			file_.write((const char *)depth.ptr(r), depth.cols*depth.elemSize());
+
+	if(!file_.good())
+		return false;
+
+	n_frames_++;
+	return true;
+}
+
+void CvDepthStreamWriter::close(){
+	if(file_.is_open())
+		file_.close();
+}
+
+int CvDepthStreamWriter::getFrameCount() const{
+	return n_frames_;
+}
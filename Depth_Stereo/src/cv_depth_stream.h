@@ -0,0 +1,96 @@
+/*==========================================================================
+
+  Copyright (c) 2014 Uditha L. Jayarathne, ujayarat@robarts.ca
+
+  Use, modification and redistribution of the software, in source or
+  binary forms, are permitted provided that the following terms and
+  conditions are met:
+
+  1) Redistribution of the source code, in verbatim or modified
+  form, must retain the above copyright notice, this license,
+  the following disclaimer, and any notices that refer to this
+  license and/or the following disclaimer.  
+
+  2) Redistribution in binary form must include the above copyright
+  notice, a copy of this license and the following disclaimer
+  in the documentation or with other materials provided with the
+  distribution.
+
+  3) Modified copies of the source code must be clearly marked as such,
+  and must not be misrepresented as verbatim copies of the source code.
+
+  THE COPYRIGHT HOLDERS AND/OR OTHER PARTIES PROVIDE THE SOFTWARE "AS IS"
+  WITHOUT EXPRESSED OR IMPLIED WARRANTY INCLUDING, BUT NOT LIMITED TO,
+  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  PURPOSE.  IN NO EVENT SHALL ANY COPYRIGHT HOLDER OR OTHER PARTY WHO MAY
+  MODIFY AND/OR REDISTRIBUTE THE SOFTWARE UNDER THE TERMS OF THIS LICENSE
+  BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, LOSS OF DATA OR DATA BECOMING INACCURATE
+  OR LOSS OF PROFIT OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF
+  THE USE OR INABILITY TO USE THE SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGES.
+  =========================================================================*/
+
+#ifndef __CV_DEPTH_STREAM__H
+#define __CV_DEPTH_STREAM__H
+
+#include <iostream>
+#include <fstream>
+#include <string>
+
+// Opencv Includes 
+#include "cv.h"
+
+#include "cv_frame_pipeline.h"
+
+/**
+ * Writes 16-bit depth maps to one binary file as they arrive: a short 
+ * header with the map size and the depth scale, then the raw maps back
+ * to back. Two bytes per pixel and no encoder keep the writer far ahead
+ * of the matching stage.
+ */
+class CvDepthStreamWriter : public CvFrameSink{
+
+public:
+
+	CvDepthStreamWriter();
+	~CvDepthStreamWriter();
+
+	//public methods
+
+	/**
+	 * Create the file and write the header
+	 * @param file name
+	 * @param depth map size
+	 * @param depth units per calibration unit
+	 * @return false if the file can not be created
+	 */
+	bool open(std::string, cv::Size, float);
+
+	/**
+	 * Append one depth map
+	 * @param CV_16UC1 map of the size given to open
+	 * @return false on a write error or a map of the wrong size or type
+	 */
+	bool write(const cv::Mat &);
+
+	/**
+	 * Close the file
+	 */
+	void close();
+
+	/**
+	 * Number of maps written
+	 */
+	int getFrameCount() const;
+
+private:
+	//private members
+
+	std::ofstream file_;
+	cv::Size size_;
+	int n_frames_;
+
+};
+
+#endif //__CV_DEPTH_STREAM__H
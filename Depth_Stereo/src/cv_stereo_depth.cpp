@@ -0,0 +1,213 @@
+/*==========================================================================
+
+  Copyright (c) 2014 Uditha L. Jayarathne, ujayarat@robarts.ca
+
+  Use, modification and redistribution of the software, in source or
+  binary forms, are permitted provided that the following terms and
+  conditions are met:
+
+  1) Redistribution of the source code, in verbatim or modified
+  form, must retain the above copyright notice, this license,
+  the following disclaimer, and any notices that refer to this
+  license and/or the following disclaimer.  
+
+  2) Redistribution in binary form must include the above copyright
+  notice, a copy of this license and the following disclaimer
+  in the documentation or with other materials provided with the
+  distribution.
+
+  3) Modified copies of the source code must be clearly marked as such,
+  and must not be misrepresented as verbatim copies of the source code.
+
+  THE COPYRIGHT HOLDERS AND/OR OTHER PARTIES PROVIDE THE SOFTWARE "AS IS"
+  WITHOUT EXPRESSED OR IMPLIED WARRANTY INCLUDING, BUT NOT LIMITED TO,
+  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  PURPOSE.  IN NO EVENT SHALL ANY COPYRIGHT HOLDER OR OTHER PARTY WHO MAY
+  MODIFY AND/OR REDISTRIBUTE THE SOFTWARE UNDER THE TERMS OF THIS LICENSE
+  BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, LOSS OF DATA OR DATA BECOMING INACCURATE
+  OR LOSS OF PROFIT OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF
+  THE USE OR INABILITY TO USE THE SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGES.
+  =========================================================================*/
+
+#include <algorithm>
+
+#include "cv_stereo_depth.h"
+
+// Loop body run by cv::parallel_for_. Each index is one row band.
+class DepthBandBody : public cv::ParallelLoopBody{
+
+public:
+	DepthBandBody(const CvStereoDepth *stereo_depth, const cv::Mat *frame, 
+				  int n_bands, cv::Mat *depth) :
+		stereo_depth_(stereo_depth), frame_(frame), n_bands_(n_bands), depth_(depth){}
+
+	void operator()(const cv::Range &range) const{
+
+		// bands own disjoint rows of the depth map
+		for(int b=range.start; b<range.end; b++)
+			stereo_depth_->computeBand(*frame_, b*frame_->rows/n_bands_, 
+									   (b + 1)*frame_->rows/n_bands_, depth_);
+	}
+
+private:
+	const CvStereoDepth *stereo_depth_;
+	const cv::Mat *frame_;
+	int n_bands_;
+	cv::Mat *depth_;
+};
+
+/**
+ * Store a depth in 16-bit units, 0 when it can not be represented
+ * @param depth numerator
+ * @param depth denominator
+ * @param depth units per calibration unit
+ */
+static inline ushort quantize_depth(double z, double w, float scale){
+
+	if(w == 0)
+		return 0;
+
+	double value = z/w*scale + 0.5;
+	return (value >= 1 && value < 65536) ? (ushort)value : 0;
+}
+
+CvStereoDepth::CvStereoDepth(Matcher matcher, int n_disparities, int block_size):
+	matcher_(matcher), n_disparities_(n_disparities), block_size_(block_size), 
+	n_bands_(0), band_overlap_(16), depth_scale_(1.0f){
+
+	for(int i=0; i<16; i++)
+		q_[i] = 0;
+}
+
+CvStereoDepth::~CvStereoDepth(){
+
+}
+
+void CvStereoDepth::setBands(int n_bands, int overlap){
+	n_bands_ = n_bands;
+	band_overlap_ = std::max(overlap, 0);
+}
+
+bool CvStereoDepth::setReprojection(const cv::Mat &Q, float depth_scale){
+
+	if(Q.rows != 4 || Q.cols != 4){
+		std::cerr << "The disparity-to-depth matrix must be 4x4" << std::endl;
+		return false;
+	}
+
+	cv::Mat Q64;
+	Q.convertTo(Q64, CV_64F);
+	for(int i=0; i<16; i++)
+		q_[i] = Q64.at<double>(i/4, i%4);
+	depth_scale_ = depth_scale;
+
+	// Z and W of cv::stereoRectify depend on the disparity only
+	depth_table_.clear();
+	if(q_[8] != 0 || q_[9] != 0 || q_[12] != 0 || q_[13] != 0)
+		return true;
+
+	// index 0 is a disparity of 0, a point at infinity
+	depth_table_.resize(n_disparities_*16, 0);
+	for(int d=1; d<(int)depth_table_.size(); d++){
+		double disparity = d/16.0;
+		depth_table_[d] = quantize_depth(q_[10]*disparity + q_[11], 
+										 q_[14]*disparity + q_[15], depth_scale_);
+	}
+
+	return true;
+}
+
+bool CvStereoDepth::apply(const cv::Mat &frame, cv::Mat *depth) const{
+
+	if(frame.depth() != CV_8U || (frame.channels() != 1 && frame.channels() != 3))
+		return false;
+
+	depth->create(frame.rows, frame.cols/2, CV_16UC1);
+
+	// semi-global paths run over the whole image, a band would cut them
+	if(matcher_ == MATCHER_SGBM){
+		computeBand(frame, 0, frame.rows, depth);
+		return true;
+	}
+
+	// bands much thinner than their overlap would mostly match overlap
+	int n_bands = n_bands_ > 0 ? n_bands_ : cv::getNumberOfCPUs();
+	n_bands = std::max(std::min(n_bands, frame.rows/std::max(2*band_overlap_, 16)), 1);
+
+	cv::parallel_for_(cv::Range(0, n_bands), 
+						DepthBandBody(this, &frame, n_bands, depth), n_bands);
+
+	return true;
+}
+
+void CvStereoDepth::computeBand(const cv::Mat &frame, int y0, int y1, cv::Mat *depth) const{
+
+	int eye_width = frame.cols/2;
+	int first = std::max(y0 - band_overlap_, 0);
+	int last = std::min(y1 + band_overlap_, frame.rows);
+
+	// only the band rows of each eye are converted to gray
+	cv::Mat left = frame(cv::Rect(0, first, eye_width, last - first));
+	cv::Mat right = frame(cv::Rect(eye_width, first, eye_width, last - first));
+	cv::Mat left_gry, right_gry;
+	if(frame.channels() == 3){
+		cv::cvtColor(left, left_gry, CV_BGR2GRAY);
+		cv::cvtColor(right, right_gry, CV_BGR2GRAY);
+	}
+	else{
+		left_gry = left;
+		right_gry = right;
+	}
+
+	// matchers keep per-call buffers, so every band has its own
+	cv::Mat disparity;
+	if(matcher_ == MATCHER_BM){
+		cv::StereoBM bm(cv::StereoBM::BASIC_PRESET, n_disparities_, block_size_);
+		bm(left_gry, right_gry, disparity, CV_16S);
+	}
+	else{
+		// smoothness penalties as suggested for cv::StereoSGBM
+		int area = block_size_*block_size_;
+		cv::StereoSGBM sgbm(0, n_disparities_, block_size_, 8*area, 32*area, 
+							1, 63, 10, 100, 32, false);
+		sgbm(left_gry, right_gry, disparity);
+	}
+
+	cv::Mat depth_rows = depth->rowRange(y0, y1);
+	toDepth(disparity.rowRange(y0 - first, y1 - first), y0, &depth_rows);
+}
+
+void CvStereoDepth::toDepth(const cv::Mat &disparity, int y_offset, cv::Mat *depth) const{
+
+	int n_table = depth_table_.size();
+
+	for(int y=0; y<disparity.rows; y++){
+		const short *d = disparity.ptr<short>(y);
+		ushort *z = depth->ptr<ushort>(y);
+
+		// Invalid matches are negative and wrap past the end of the table
+		if(n_table > 0){
+			for(int x=0; x<disparity.cols; x++){
+				ushort i = (ushort)d[x];
+				z[x] = i < n_table ? depth_table_[i] : 0;
+			}
+			continue;
+		}
+
+		// general Q, Z and W are affine in the pixel and its disparity
+		double row = y + y_offset;
+		for(int x=0; x<disparity.cols; x++){
+			if(d[x] <= 0){
+				z[x] = 0;
+				continue;
+			}
+
+			double disp = d[x]/16.0;
+			z[x] = quantize_depth(q_[8]*x + q_[9]*row + q_[10]*disp + q_[11], 
+								  q_[12]*x + q_[13]*row + q_[14]*disp + q_[15], 
+								  depth_scale_);
+		}
+	}
+}
@@ -0,0 +1,143 @@
+/*==========================================================================
+
+  Copyright (c) 2014 Uditha L. Jayarathne, ujayarat@robarts.ca
+
+  Use, modification and redistribution of the software, in source or
+  binary forms, are permitted provided that the following terms and
+  conditions are met:
+
+  1) Redistribution of the source code, in verbatim or modified
+  form, must retain the above copyright notice, this license,
+  the following disclaimer, and any notices that refer to this
+  license and/or the following disclaimer.  
+
+  2) Redistribution in binary form must include the above copyright
+  notice, a copy of this license and the following disclaimer
+  in the documentation or with other materials provided with the
+  distribution.
+
+  3) Modified copies of the source code must be clearly marked as such,
+  and must not be misrepresented as verbatim copies of the source code.
+
+  THE COPYRIGHT HOLDERS AND/OR OTHER PARTIES PROVIDE THE SOFTWARE "AS IS"
+  WITHOUT EXPRESSED OR IMPLIED WARRANTY INCLUDING, BUT NOT LIMITED TO,
+  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  PURPOSE.  IN NO EVENT SHALL ANY COPYRIGHT HOLDER OR OTHER PARTY WHO MAY
+  MODIFY AND/OR REDISTRIBUTE THE SOFTWARE UNDER THE TERMS OF THIS LICENSE
+  BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, LOSS OF DATA OR DATA BECOMING INACCURATE
+  OR LOSS OF PROFIT OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF
+  THE USE OR INABILITY TO USE THE SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGES.
+  =========================================================================*/
+
+#ifndef __CV_STEREO_DEPTH__H
+#define __CV_STEREO_DEPTH__H
+
+#include <iostream>
+#include <vector>
+
+// Opencv Includes 
+#include "cv.h"
+
+#include "cv_frame_pipeline.h"
+
+/**
+ * Pipeline stage turning rectified side-by-side frames into 16-bit depth
+ * maps of the left eye. Block matching splits the frame into horizontal 
+ * bands matched in parallel, each with a few rows of overlap so block 
+ * windows near a band edge see the same rows as on the whole frame. 
+ * Semi-global matching carries its path costs down from the top row of 
+ * the image, so a band would restart them and leave seams; it always 
+ * matches the whole frame and relies on several frames in flight for
+ * parallelism. Disparities are reprojected with the Q matrix of the stereo
+ * calibration straight into depth: for the usual Q, depth depends on the
+ * disparity alone and is read from a table over all fixed-point 
+ * disparities instead of being computed per pixel.
+ */
+class CvStereoDepth : public CvFrameFilter{
+
+public:
+
+	// Matching algorithm
+	enum Matcher{
+		MATCHER_BM,		// cv::StereoBM block matching
+		MATCHER_SGBM	// cv::StereoSGBM semi-global matching
+	};
+
+	/**
+	 * @param matching algorithm
+	 * @param number of disparities, a multiple of 16
+	 * @param matching block size, odd
+	 */
+	CvStereoDepth(Matcher, int, int);
+	~CvStereoDepth();
+
+	//public methods
+
+	/**
+	 * Set the row bands matched in parallel. Block matching only, 
+	 * semi-global matching ignores the bands.
+	 * @param number of bands, <= 0 for one per core
+	 * @param rows shared with each neighbouring band
+	 */
+	void setBands(int, int);
+
+	/**
+	 * Set the reprojection to depth
+	 * @param 4x4 disparity-to-depth matrix Q
+	 * @param depth units per calibration unit, e.g. 10 stores 0.1 mm
+	 *		  steps for a calibration in mm
+	 * @return false if Q is not 4x4
+	 */
+	bool setReprojection(const cv::Mat &, float);
+
+	/**
+	 * Compute the depth of one frame. Pixels without a valid disparity or
+	 * out of the 16-bit range are 0.
+	 * @param rectified side-by-side frame, 8-bit gray or BGR
+	 * @param reference to the CV_16UC1 depth of the left eye
+	 * @return false for a frame of the wrong type
+	 */
+	bool apply(const cv::Mat &, cv::Mat *) const;
+
+	/**
+	 * Compute the fixed-point disparity of one band and convert it
+	 * @param rectified side-by-side frame
+	 * @param first row of the band
+	 * @param row after the band
+	 * @param reference to the depth of the whole frame, only the band 
+	 *		  rows are written
+	 */
+	void computeBand(const cv::Mat &, int, int, cv::Mat *) const;
+
+private:
+	//private methods
+
+	/**
+	 * Convert fixed-point disparities to depth
+	 * @param CV_16S disparities, 4 fractional bits
+	 * @param row of the first disparity row in the frame
+	 * @param reference to the depth rows
+	 */
+	void toDepth(const cv::Mat &, int, cv::Mat *) const;
+
+	//private members
+
+	Matcher matcher_;
+	int n_disparities_;
+	int block_size_;
+
+	int n_bands_;
+	int band_overlap_;
+
+	// disparity-to-depth matrix, row-major
+	double q_[16];
+	float depth_scale_;
+
+	// depth of every fixed-point disparity, if Q ignores x and y
+	std::vector<ushort> depth_table_;
+
+};
+
+#endif //__CV_STEREO_DEPTH__H
@@ -0,0 +1,170 @@
+/*==========================================================================
+
+  Copyright (c) 2014 Uditha L. Jayarathne, ujayarat@robarts.ca
+
+  Use, modification and redistribution of the software, in source or
+  binary forms, are permitted provided that the following terms and
+  conditions are met:
+
+  1) Redistribution of the source code, in verbatim or modified
+  form, must retain the above copyright notice, this license,
+  the following disclaimer, and any notices that refer to this
+  license and/or the following disclaimer.  
+
+  2) Redistribution in binary form must include the above copyright
+  notice, a copy of this license and the following disclaimer
+  in the documentation or with other materials provided with the
+  distribution.
+
+  3) Modified copies of the source code must be clearly marked as such,
+  and must not be misrepresented as verbatim copies of the source code.
+
+  THE COPYRIGHT HOLDERS AND/OR OTHER PARTIES PROVIDE THE SOFTWARE "AS IS"
+  WITHOUT EXPRESSED OR IMPLIED WARRANTY INCLUDING, BUT NOT LIMITED TO,
+  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  PURPOSE.  IN NO EVENT SHALL ANY COPYRIGHT HOLDER OR OTHER PARTY WHO MAY
+  MODIFY AND/OR REDISTRIBUTE THE SOFTWARE UNDER THE TERMS OF THIS LICENSE
+  BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, LOSS OF DATA OR DATA BECOMING INACCURATE
+  OR LOSS OF PROFIT OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF
+  THE USE OR INABILITY TO USE THE SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGES.
+  =========================================================================*/
+
+#include <iostream> 
+#include <vector>
+#include <stdlib.h>
+#include <stdio.h>
+#include <algorithm>
+
+// Opencv includes
+#include "cv.h"
+#include "highgui.h"
+
+#include "cv_frame_pipeline.h"
+#include "cv_stereo_depth.h"
+#include "cv_depth_stream.h"
+
+int main(int argc, char** argv){
+
+	// Software usage
+	CvStereoDepth::Matcher matcher = CvStereoDepth::MATCHER_BM;
+	int n_disparities = 64, block_size = 0;
+	int n_bands = 0, n_workers = -1, max_frames = 0;
+	float depth_scale = 10.0f;
+	bool args_ok = (argc >= 4);
+	for(int i=4; args_ok && i<argc; i++){
+		std::string arg(argv[i]);
+		if(arg == "-sgbm")
+			matcher = CvStereoDepth::MATCHER_SGBM;
+		else if(arg == "-disparities" && i + 1 < argc)
+			n_disparities = atoi(argv[++i]);
+		else if(arg == "-block" && i + 1 < argc)
+			block_size = atoi(argv[++i]);
+		else if(arg == "-bands" && i + 1 < argc)
+			n_bands = atoi(argv[++i]);
+		else if(arg == "-workers" && i + 1 < argc)
+			n_workers = atoi(argv[++i]);
+		else if(arg == "-frames" && i + 1 < argc)
+			max_frames = atoi(argv[++i]);
+		else if(arg == "-scale" && i + 1 < argc)
+			depth_scale = (float)atof(argv[++i]);
+		else
+			args_ok = false;
+	}
+
+	if(!args_ok){ 
+		std::cout << "Usage:\t CV_Depth_Stereo infile outfile stereo_calib_file [-sgbm] [-disparities n] [-block n] [-bands n] [-workers n] [-frames n] [-scale s]	\n"
+				  << "\t	infile: rectified side-by-side video, e.g. from CV_Undistort_Stereo -rectify \n" 
+				  << "\t	outfile: depth stream file, 16-bit depth of the left eye per frame \n"
+				  << "\t    stereo_calib_file: stereo_calibration.xml holding Q \n"
+				  << "\t    -sgbm: semi-global matching instead of block matching \n"
+				  << "\t    -disparities: disparity search range, a multiple of 16, 64 by default \n"
+				  << "\t    -block: odd matching block size, 15 for BM and 5 for SGBM by default \n"
+				  << "\t    -bands: row bands block matched in parallel per frame, one per core by default \n"
+				  << "\t    -workers: frames matched at the same time, 2 for block matching and \n"
+				  << "\t              one per spare core for semi-global matching by default \n"
+				  << "\t    -frames: stop after n frames \n"
+				  << "\t    -scale: depth units per calibration unit, 10 by default"
+				  << std::endl;
+		return 0;
+	}
+
+	if(block_size <= 0)
+		block_size = (matcher == CvStereoDepth::MATCHER_BM ? 15 : 5);
+
+	// semi-global matching runs on whole frames, so frames are the parallelism
+	if(n_workers < 0)
+		n_workers = (matcher == CvStereoDepth::MATCHER_BM ? 2 : 0);
+
+	if(n_disparities <= 0 || n_disparities%16 != 0 || block_size%2 == 0 || 
+		(matcher == CvStereoDepth::MATCHER_BM && block_size < 5)){
+		std::cerr << "Disparities must be a positive multiple of 16 and the block size odd, "
+				  << "at least 5 for block matching" << std::endl;
+		return 0;
+	}
+
+	std::string in_file_name(argv[1]), out_file_name(argv[2]), stereo_calib_name(argv[3]);
+
+	// Read the disparity-to-depth matrix
+	cv::FileStorage stereo_calib_file(stereo_calib_name, cv::FileStorage::READ);
+	if(!stereo_calib_file.isOpened()){
+		std::cout << "Could not open the stereo calibration file" << std::endl;
+		return 0;
+	}
+
+	cv::Mat Q;
+	stereo_calib_file["Q"] >> Q;
+	stereo_calib_file.release();
+
+	CvStereoDepth stereo_depth(matcher, n_disparities, block_size);
+	if(!stereo_depth.setReprojection(Q, depth_scale))
+		return 0;
+
+	// block matched rows near a band edge need the neighbour rows under their block
+	stereo_depth.setBands(n_bands, std::max(block_size, 16));
+
+	cv::VideoCapture g_capture;
+	if(!g_capture.open(in_file_name.c_str())){
+		std::cerr << "Failed to open the video file. " << std::endl;
+		return 0;
+	}
+
+	// Query capture properties
+	int n_frames	   = (int)g_capture.get(CV_CAP_PROP_FRAME_COUNT);
+	int frame_width    = (int)g_capture.get(CV_CAP_PROP_FRAME_WIDTH );
+	int frame_height   = (int)g_capture.get(CV_CAP_PROP_FRAME_HEIGHT);
+	int frame_rate     = (int)g_capture.get(CV_CAP_PROP_FPS );
+
+	std::cout << " Reading " << in_file_name.c_str() << " at " << frame_rate << "fps" 
+			  << " [" << n_frames << ", " << frame_width << "x" << frame_height
+			  << " frames]" << std::endl;
+
+	if(max_frames <= 0 || (n_frames > 0 && max_frames > n_frames))
+		max_frames = n_frames;
+
+	CvDepthStreamWriter depth_writer;
+	if(!depth_writer.open(out_file_name, cvSize(frame_width/2, frame_height), depth_scale))
+		return 0;
+
+	// decode, match and write run concurrently, depth maps stay in order
+	CvFramePipeline pipeline(n_workers, 2);
+
+	std::cout << "Computing depth with " 
+			  << (matcher == CvStereoDepth::MATCHER_BM ? "block matching" : "semi-global matching")
+			  << " over " << n_disparities << " disparities on " 
+			  << pipeline.getWorkerCount() << " workers ..";
+	int64 t_start = cv::getTickCount();
+	int n_written = pipeline.run(&g_capture, max_frames, stereo_depth, &depth_writer);
+	double seconds = (cv::getTickCount() - t_start)/cv::getTickFrequency();
+	depth_writer.close();
+
+	std::cout << std::endl << n_written << " depth maps written to " << out_file_name << std::endl;
+	if(seconds > 0)
+		std::cout << "Depth throughput: " << n_written/seconds << " maps/s, " 
+				  << n_written*(frame_width/2.0)*frame_height/seconds/1e6 
+				  << " Mpixel/s" << std::endl;
+	pipeline.printStats();
+
+	return 0; 
+}
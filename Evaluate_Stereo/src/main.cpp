@@ -0,0 +1,314 @@
+/*==========================================================================
+
+  Copyright (c) 2014 Uditha L. Jayarathne, ujayarat@robarts.ca
+
+  Use, modification and redistribution of the software, in source or
+  binary forms, are permitted provided that the following terms and
+  conditions are met:
+
+  1) Redistribution of the source code, in verbatim or modified
+  form, must retain the above copyright notice, this license,
+  the following disclaimer, and any notices that refer to this
+  license and/or the following disclaimer.  
+
+  2) Redistribution in binary form must include the above copyright
+  notice, a copy of this license and the following disclaimer
+  in the documentation or with other materials provided with the
+  distribution.
+
+  3) Modified copies of the source code must be clearly marked as such,
+  and must not be misrepresented as verbatim copies of the source code.
+
+  THE COPYRIGHT HOLDERS AND/OR OTHER PARTIES PROVIDE THE SOFTWARE "AS IS"
+  WITHOUT EXPRESSED OR IMPLIED WARRANTY INCLUDING, BUT NOT LIMITED TO,
+  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  PURPOSE.  IN NO EVENT SHALL ANY COPYRIGHT HOLDER OR OTHER PARTY WHO MAY
+  MODIFY AND/OR REDISTRIBUTE THE SOFTWARE UNDER THE TERMS OF THIS LICENSE
+  BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, LOSS OF DATA OR DATA BECOMING INACCURATE
+  OR LOSS OF PROFIT OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF
+  THE USE OR INABILITY TO USE THE SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGES.
+  =========================================================================*/
+
+#include <iostream> 
+#include <vector>
+#include <stdlib.h>
+#include <math.h>
+
+// Opencv includes
+#include "cv.h"
+#include "highgui.h"
+
+#include "cv_corner_detector.h"
+#include "cv_stereo_pair_detector.h"
+#include "cv_epipolar_evaluator.h"
+
+// Errors over all evaluated pairs, in pixels
+struct EvalSummary{
+	int n_pairs;
+	int n_points;
+	double epipolar_rms;
+	double epipolar_max;
+	int worst_epipolar_pair;
+	double row_rms;
+	double row_max;
+	int worst_row_pair;
+	double t_detect;	// s
+	double t_evaluate;	// ms
+};
+
+/**
+ * Combine the pair statistics, weighted by their corner counts
+ * @param pair statistics
+ * @param reference to the summary
+ */
+void summarize(const std::vector<CvEpipolarEvaluator::PairStats>&, EvalSummary*);
+
+/**
+ * Write the summary and the statistics of every pair to an xml or yml file
+ * @param file name
+ * @param summary
+ * @param left image file names
+ * @param pair statistics
+ * @return true on success
+ */
+bool write_report(std::string, const EvalSummary&, const std::vector<std::string>&, 
+				  const std::vector<CvEpipolarEvaluator::PairStats>&);
+
+int main(int argc, char** argv){
+
+	// Software usage
+	if(argc<3 || argc>4){ 
+		std::cout << "Usage:\t CV_Stereo_Eval infile calibfile [outfile]\n"
+				  << "\t	infile: stereo calibration configuration file \n" 
+				  << "\t	calibfile: stereo calibration with F, R1, R2, P1 and P2 \n"
+				  << "\t	outfile: xml or yml file to write the per-pair report to"
+				  << std::endl;
+		return 1;
+	}
+
+	std::string settings_file_name(argv[1]), stereo_file_name(argv[2]);
+
+	// Read the settings file.
+	cv::FileStorage file(settings_file_name, cv::FileStorage::READ);
+	if(!file.isOpened()){
+		std::cerr << "Could not open the configuration file " << settings_file_name << std::endl;
+		return 1;
+	}
+
+	cv::FileNode n = file["Calibration_Images"];
+	std::string folder_name = (std::string)n["folder_name"];
+	// file prefix
+	std::string prefix = folder_name + "/" + (std::string)n["prefix"];
+	// number of files
+	int n_images      = (int)n["image_count"];
+
+	// Checkerboard params
+	n = file["Checkerboard_Specs"];
+	int w_corners((int)n["width_count"]);
+	int h_corners((int)n["height_count"]);
+
+	// Camera params from the mono calibrations
+	cv::Mat left_intrinsics, left_distortion_params;
+	cv::Mat right_intrinsics, right_distortion_params;
+	n = file["Calibration_File_Locations"];
+	std::string left_calibration_file_name((std::string)n["left_calib_file"]), 
+				right_calibration_file_name((std::string)n["right_calib_file"]);
+
+	cv::FileStorage calib_file(left_calibration_file_name, cv::FileStorage::READ);
+	if(!calib_file.isOpened()){
+		std::cerr << "Left calibration parameters not found in " 
+				  << left_calibration_file_name << std::endl;
+		return 1;
+	}
+	calib_file["Intrinsics"] >> left_intrinsics;
+	calib_file["Distortion_Parameters"] >> left_distortion_params;
+	calib_file.release();
+
+	calib_file = cv::FileStorage(right_calibration_file_name, cv::FileStorage::READ);
+	if(!calib_file.isOpened()){
+		std::cerr << "Right calibration parameters not found in " 
+				  << right_calibration_file_name << std::endl;
+		return 1;
+	}
+	calib_file["Intrinsics"] >> right_intrinsics;
+	calib_file["Distortion_Parameters"] >> right_distortion_params;
+	calib_file.release();
+
+	if(left_intrinsics.rows != 3 || left_intrinsics.cols != 3 || 
+		right_intrinsics.rows != 3 || right_intrinsics.cols != 3){
+		std::cerr << "The mono calibrations must contain a 3x3 Intrinsics matrix" << std::endl;
+		return 1;
+	}
+
+	// Stereo calibration under test
+	cv::Mat F, R1, R2, P1, P2;
+	calib_file = cv::FileStorage(stereo_file_name, cv::FileStorage::READ);
+	if(!calib_file.isOpened()){
+		std::cerr << "Stereo calibration not found in " << stereo_file_name << std::endl;
+		return 1;
+	}
+	calib_file["F"] >> F;
+	calib_file["R1"] >> R1;
+	calib_file["R2"] >> R2;
+	calib_file["P1"] >> P1;
+	calib_file["P2"] >> P2;
+	calib_file.release();
+
+	if(F.empty() || R1.empty() || R2.empty() || P1.empty() || P2.empty()){
+		std::cerr << "The stereo calibration must contain F, R1, R2, P1 and P2" << std::endl;
+		return 1;
+	}
+
+	// Detect the corners of every pair, reusing cached detections
+	CvCornerDetector detector(w_corners, h_corners);
+	detector.setDetectionFlags(cv::CALIB_CB_ADAPTIVE_THRESH+
+								cv::CALIB_CB_NORMALIZE_IMAGE);
+
+	CvCornerCache corner_cache(folder_name + "/corners.cache", w_corners, h_corners);
+	corner_cache.load();
+
+	CvStereoPairDetector pair_detector(&detector);
+	pair_detector.setCache(&corner_cache);
+	n = file["Pair_Detection"];
+	if(!n.empty())
+		pair_detector.setDisparity((float)n["disparity"]);
+
+	std::vector<std::string> left_filenames, right_filenames;
+	char img_no[8];
+	for(int i=0; i<n_images; i++){
+		itoa(i, img_no, 10);
+		left_filenames.push_back(prefix + img_no + "L.png");
+		right_filenames.push_back(prefix + img_no + "R.png");
+	}
+
+	std::cout << "Detecting corners in " << n_images << " pairs from "
+			  << prefix << " using " << cv::getNumThreads() 
+			  << " threads" << std::endl;
+
+	EvalSummary summary;
+	std::vector<std::vector<cv::Point2f>> left_corners, right_corners;
+	cv::Size img_size;
+
+	int64 start = cv::getTickCount();
+	int n_found = pair_detector.detectPairsBatch(left_filenames, right_filenames, 
+												 &left_corners, &right_corners, &img_size);
+	summary.t_detect = (cv::getTickCount() - start)/cv::getTickFrequency();
+	corner_cache.save();
+
+	if(n_found == 0){
+		std::cerr << "The checkerboard was not found in both images of any pair" << std::endl;
+		return 1;
+	}
+
+	// Evaluate
+	CvEpipolarEvaluator evaluator;
+	if(!evaluator.setCameras(left_intrinsics, left_distortion_params, 
+							 right_intrinsics, right_distortion_params, img_size)){
+		std::cerr << "The mono calibrations must use 4, 5 or 8 distortion parameters" << std::endl;
+		return 1;
+	}
+	evaluator.setStereo(F, R1, P1, R2, P2);
+
+	std::vector<CvEpipolarEvaluator::PairStats> stats;
+	start = cv::getTickCount();
+	evaluator.evaluate(left_corners, right_corners, &stats);
+	summary.t_evaluate = (cv::getTickCount() - start)*1000.0/cv::getTickFrequency();
+
+	summarize(stats, &summary);
+
+	std::cout << "Detection took " << summary.t_detect << "s, evaluation of " 
+			  << summary.n_pairs << " pairs took " << summary.t_evaluate << "ms" << std::endl;
+	std::cout << "Symmetric epipolar distance: RMS " << summary.epipolar_rms 
+			  << "px, max " << summary.epipolar_max << "px in pair " 
+			  << summary.worst_epipolar_pair << std::endl;
+	std::cout << "Rectified row disparity:     RMS " << summary.row_rms 
+			  << "px, max " << summary.row_max << "px in pair " 
+			  << summary.worst_row_pair << std::endl;
+
+	if(argc == 4){
+		if(!write_report(argv[3], summary, left_filenames, stats)){
+			std::cerr << "Unable to write the report to " << argv[3] << std::endl;
+			return 1;
+		}
+		std::cout << "Results were written to " << argv[3] << std::endl;
+	}
+
+	return 0;
+}
+
+void summarize(const std::vector<CvEpipolarEvaluator::PairStats> &stats, 
+			   EvalSummary *summary){
+
+	double sq_epipolar = 0, sq_row = 0;
+	summary->n_pairs = summary->n_points = 0;
+	summary->epipolar_max = summary->row_max = 0;
+	summary->worst_epipolar_pair = summary->worst_row_pair = -1;
+
+	for(size_t i=0; i<stats.size(); i++){
+		const CvEpipolarEvaluator::PairStats &s = stats[i];
+		if(s.n_points == 0)
+			continue;
+
+		summary->n_pairs++;
+		summary->n_points += s.n_points;
+		sq_epipolar += (double)s.epipolar_rms*s.epipolar_rms*s.n_points;
+		sq_row += (double)s.row_rms*s.row_rms*s.n_points;
+
+		if(s.epipolar_max > summary->epipolar_max){
+			summary->epipolar_max = s.epipolar_max;
+			summary->worst_epipolar_pair = i;
+		}
+		if(s.row_max > summary->row_max){
+			summary->row_max = s.row_max;
+			summary->worst_row_pair = i;
+		}
+	}
+
+	summary->epipolar_rms = summary->n_points ? sqrt(sq_epipolar/summary->n_points) : 0;
+	summary->row_rms = summary->n_points ? sqrt(sq_row/summary->n_points) : 0;
+}
+
+bool write_report(std::string filename, const EvalSummary &summary, 
+				  const std::vector<std::string> &left_filenames, 
+				  const std::vector<CvEpipolarEvaluator::PairStats> &stats){
+
+	cv::FileStorage fs(filename, cv::FileStorage::WRITE);
+	if(!fs.isOpened())
+		return false;
+
+	fs << "Summary";
+	fs << "{" << "pairs" << summary.n_pairs;
+	fs << "points" << summary.n_points;
+	fs << "epipolar_rms" << summary.epipolar_rms;
+	fs << "epipolar_max" << summary.epipolar_max;
+	fs << "worst_epipolar_pair" << summary.worst_epipolar_pair;
+	fs << "row_rms" << summary.row_rms;
+	fs << "row_max" << summary.row_max;
+	fs << "worst_row_pair" << summary.worst_row_pair;
+	fs << "t_detect_s" << summary.t_detect;
+	fs << "t_evaluate_ms" << summary.t_evaluate << "}";
+
+	// pairs not found in both images are left out
+	fs << "Pairs" << "[";
+	for(size_t i=0; i<stats.size(); i++){
+		const CvEpipolarEvaluator::PairStats &s = stats[i];
+		if(s.n_points == 0)
+			continue;
+
+		fs << "{" << "index" << (int)i;
+		fs << "left_image" << left_filenames[i];
+		fs << "points" << s.n_points;
+		fs << "epipolar_mean" << s.epipolar_mean;
+		fs << "epipolar_rms" << s.epipolar_rms;
+		fs << "epipolar_max" << s.epipolar_max;
+		fs << "row_mean" << s.row_mean;
+		fs << "row_rms" << s.row_rms;
+		fs << "row_max" << s.row_max << "}";
+	}
+	fs << "]";
+
+	fs.release();
+	return true;
+}
@@ -39,6 +39,9 @@
 #include "cv.h"
 #include "highgui.h"
 
+#include "cv_corner_detector.h"
+#include "cv_stereo_pair_detector.h"
+
 /**
  * Write settings to an xml file
  * @param void
@@ -73,9 +76,9 @@ int main(int argc, char** argv){
 	}
 
 	cv::FileNode n = file["Calibration_Images"];
+	std::string folder_name = (std::string)n["folder_name"];
 	// file prefix
-	std::string prefix = (std::string)n["folder_name"] +
-						"/" + (std::string)n["prefix"];
+	std::string prefix = folder_name + "/" + (std::string)n["prefix"];
 	// file extention
 	std::string ext   = (std::string)n["extension"];
 	// number of files
@@ -120,11 +123,28 @@ int main(int argc, char** argv){
 
 	
 	//Read image folder and detect corners
-	std::string filename;
-	char img_no[3];	
+	std::string left_filename, right_filename;
+	char img_no[8];	
 	
-	cv::Mat left_corners, right_corners;
+	std::vector<cv::Point2f> left_corners, right_corners;
 	std::vector<std::vector<cv::Point2f>> all_left_corners, all_right_corners;
+
+	CvCornerDetector detector(w_corners, h_corners);
+	detector.setDetectionFlags(cv::CALIB_CB_ADAPTIVE_THRESH+
+								cv::CALIB_CB_NORMALIZE_IMAGE);
+
+	// Detections of unchanged images are reused from earlier runs
+	CvCornerCache corner_cache(folder_name + "/corners.cache", w_corners, h_corners);
+	corner_cache.load();
+	detector.setCache(&corner_cache);
+
+	// Pairs are searched in the cheaper eye first and the other eye only
+	// near the board found there, shifted by the approximate disparity
+	CvStereoPairDetector pair_detector(&detector);
+	pair_detector.setCache(&corner_cache);
+	n = file["Pair_Detection"];
+	if(!n.empty())
+		pair_detector.setDisparity((float)n["disparity"]);
 	std::vector<std::vector<cv::Point3f>> all_object_points;
 
 	std::vector<cv::Point3f> object_points;
@@ -156,28 +176,22 @@ int main(int argc, char** argv){
 	for(int i=0; i<n_images; i++){
 
 		itoa(i, img_no, 10);
-		filename = prefix + img_no + "L.png"; 
+		left_filename = prefix + img_no + "L.png"; 
 
 		// reading left frame
-		std::cout << "Reading image: " << filename << std::endl;
-		cv::Mat left_frame = cv::imread(filename, CV_LOAD_IMAGE_COLOR);
+		std::cout << "Reading image: " << left_filename << std::endl;
+		cv::Mat left_frame = cv::imread(left_filename, CV_LOAD_IMAGE_COLOR);
 
 		// reading right frame
-		filename = prefix + img_no + "R.png";
-		std::cout << "Reading image: " << filename << std::endl;
-		cv::Mat right_frame = cv::imread(filename, CV_LOAD_IMAGE_COLOR);
+		right_filename = prefix + img_no + "R.png";
+		std::cout << "Reading image: " << right_filename << std::endl;
+		cv::Mat right_frame = cv::imread(right_filename, CV_LOAD_IMAGE_COLOR);
 
 		if(left_frame.empty() || right_frame.empty()){
 			std::cerr << "Bad image!" << std::endl;
 			continue; // read the next image
 		}
 
-		// convert image to grayscale. 
-		cv::Mat left_frame_gry(left_frame.rows, left_frame.cols, CV_32F);
-		cv::Mat right_frame_gry(right_frame.rows, right_frame.cols, CV_32F);
-		cv::cvtColor(left_frame, left_frame_gry, CV_BGR2GRAY);
-		cv::cvtColor(right_frame, right_frame_gry, CV_BGR2GRAY);
-
 		// Show images
 		cv::namedWindow("Left_Image", CV_WINDOW_KEEPRATIO);
 		cv::namedWindow("Right_Image", CV_WINDOW_KEEPRATIO);
@@ -191,14 +205,15 @@ int main(int argc, char** argv){
 		if(key == 100 ){ // if the key is 'd'
 			// Detect the checkerboards
 			
-			if(!cv::findChessboardCorners(left_frame, cvSize(w_corners, h_corners),
-									left_corners,
-									cv::CALIB_CB_ADAPTIVE_THRESH+
-									cv::CALIB_CB_NORMALIZE_IMAGE) || 
-					!cv::findChessboardCorners(right_frame, cvSize(w_corners, h_corners),
-									right_corners,
-									cv::CALIB_CB_ADAPTIVE_THRESH+
-									cv::CALIB_CB_NORMALIZE_IMAGE)){
+			cv::Size img_size;
+			// the frames shown above are searched, not decoded again
+			bool found = pair_detector.detectPair(left_filename, right_filename, 
+												  left_frame, right_frame, 
+												  &left_corners, &right_corners, 
+												  &img_size);
+			corner_cache.save();
+
+			if(!found){
 
 			std::cerr << "Failed to find the checkerboard at least in one image" << std::endl;
 			continue; 
@@ -207,11 +222,11 @@ int main(int argc, char** argv){
 				// draw checkerboard corners
 				cv::drawChessboardCorners(left_frame, 
 											cvSize(w_corners, h_corners), 
-											left_corners, true);
+											cv::Mat(left_corners), true);
 
 				cv::drawChessboardCorners(right_frame, 
 											cvSize(w_corners, h_corners), 
-											right_corners, true);
+											cv::Mat(right_corners), true);
 
 				// Show image
 				cv::imshow("Left_Image", left_frame);
@@ -220,31 +235,10 @@ int main(int argc, char** argv){
 				key = cv::waitKey(-1);
 
 				if( key == 115){ // if the key is 's' -- SELECT
-					// Find corner subpix
-					cv::cornerSubPix(left_frame_gry, left_corners, 
-										cvSize(5, 5), 
-										cvSize(-1, -1), 
-										cv::TermCriteria::TermCriteria(cv::TermCriteria::EPS+
-													cv::TermCriteria::MAX_ITER,30, 0.1));
-					cv::cornerSubPix(right_frame_gry, right_corners, 
-										cvSize(5, 5), 
-										cvSize(-1, -1), 
-										cv::TermCriteria::TermCriteria(cv::TermCriteria::EPS+
-													cv::TermCriteria::MAX_ITER,30, 0.1));
-
+					// Corners were refined to sub-pixel by the detector
 					std::vector<std::vector<cv::Point2f>> all_left_corners, all_right_corners;
-					std::vector<cv::Point2f> l_temp, r_temp;
-					
-					for(int j=0; j<left_corners.rows; j++){
-						cv::Point2f l_point(left_corners.at<float>( j, 0), 
-												left_corners.at<float>(j, 1)), 
-									r_point(right_corners.at<float>(j, 0), 
-												right_corners.at<float>(j, 1));
-						l_temp.push_back(l_point);
-						r_temp.push_back(r_point);
-					}
-					all_left_corners.push_back(l_temp);
-					all_right_corners.push_back(r_temp);
+					all_left_corners.push_back(left_corners);
+					all_right_corners.push_back(right_corners);
 					
 					//Do the calibration
 					cv::stereoCalibrate(all_object_points, 
@@ -289,8 +283,8 @@ int main(int argc, char** argv){
 					T.release();
 					E.release();
 					F.release();
-					left_corners.release();
-					right_corners.release();
+					left_corners.clear();
+					right_corners.clear();
 
 					return 0;
 				}
@@ -329,5 +323,8 @@ void write_settings_to_xml(){
 	fs << "{" << "left_calib_file" << "./left_calibration.xml";
 	fs << "right_calib_file" << "./right_calibration.xml" << "}";
 
+	fs << "Pair_Detection";
+	fs << "{" << "disparity" << 0.0 << "}";
+
 	fs.release();
 }
\ No newline at end of file
@@ -0,0 +1,224 @@
+/*==========================================================================
+
+  Copyright (c) 2014 Uditha L. Jayarathne, ujayarat@robarts.ca
+
+  Use, modification and redistribution of the software, in source or
+  binary forms, are permitted provided that the following terms and
+  conditions are met:
+
+  1) Redistribution of the source code, in verbatim or modified
+  form, must retain the above copyright notice, this license,
+  the following disclaimer, and any notices that refer to this
+  license and/or the following disclaimer.  
+
+  2) Redistribution in binary form must include the above copyright
+  notice, a copy of this license and the following disclaimer
+  in the documentation or with other materials provided with the
+  distribution.
+
+  3) Modified copies of the source code must be clearly marked as such,
+  and must not be misrepresented as verbatim copies of the source code.
+
+  THE COPYRIGHT HOLDERS AND/OR OTHER PARTIES PROVIDE THE SOFTWARE "AS IS"
+  WITHOUT EXPRESSED OR IMPLIED WARRANTY INCLUDING, BUT NOT LIMITED TO,
+  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  PURPOSE.  IN NO EVENT SHALL ANY COPYRIGHT HOLDER OR OTHER PARTY WHO MAY
+  MODIFY AND/OR REDISTRIBUTE THE SOFTWARE UNDER THE TERMS OF THIS LICENSE
+  BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, LOSS OF DATA OR DATA BECOMING INACCURATE
+  OR LOSS OF PROFIT OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF
+  THE USE OR INABILITY TO USE THE SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGES.
+  =========================================================================*/
+
+#include <math.h>
+#include <string.h>
+
+#include "cv_fixed_remap.h"
+
+// weights are FRAC_BITS x FRAC_BITS, their sum is 1 << WEIGHT_BITS
+static const int WEIGHT_BITS = 2*CvFixedRemap::FRAC_BITS;
+
+/**
+ * Interpolate one pixel, reading outside the frame as black
+ * @param source frame
+ * @param integer source x
+ * @param integer source y
+ * @param x fraction
+ * @param y fraction
+ * @param output pixel
+ */
+static inline void remapPixelBorder(const cv::Mat &src, int x, int y, int fx, int fy, 
+									uchar *dst){
+
+	const int one = CvFixedRemap::FRAC_ONE;
+	int w[4] = { (one - fx)*(one - fy), fx*(one - fy), (one - fx)*fy, fx*fy };
+	int sum[3] = { 1 << (WEIGHT_BITS - 1), 1 << (WEIGHT_BITS - 1), 1 << (WEIGHT_BITS - 1) };
+
+	for(int k=0; k<4; k++){
+		int px = x + (k & 1), py = y + (k >> 1);
+		if(px < 0 || py < 0 || px >= src.cols || py >= src.rows)
+			continue;
+		const uchar *p = src.ptr<uchar>(py) + 3*px;
+		sum[0] += w[k]*p[0];
+		sum[1] += w[k]*p[1];
+		sum[2] += w[k]*p[2];
+	}
+
+	dst[0] = (uchar)(sum[0] >> WEIGHT_BITS);
+	dst[1] = (uchar)(sum[1] >> WEIGHT_BITS);
+	dst[2] = (uchar)(sum[2] >> WEIGHT_BITS);
+}
+
+// Loop body run by cv::parallel_for_. Each index is one output row.
+class RemapRowsBody : public cv::ParallelLoopBody{
+
+public:
+	RemapRowsBody(const cv::Mat *src, const cv::Mat *coords, const cv::Mat *fracs, 
+				  cv::Mat *dst) :
+		src_(src), coords_(coords), fracs_(fracs), dst_(dst){}
+
+	void operator()(const cv::Range &range) const{
+
+		const cv::Mat &src = *src_;
+		const int one = CvFixedRemap::FRAC_ONE;
+		const int width = dst_->cols;
+		const size_t step = src.step;
+
+		// the 8 byte loads of the fast path need 3 valid pixels per row
+		const bool tiny = src.cols < 3 || src.rows < 2;
+		const unsigned max_x = src.cols - 3, max_y = src.rows - 2;
+
+#if CV_SSE2
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i round = _mm_set1_epi32(1 << (WEIGHT_BITS - 1));
+#endif
+
+		for(int y=range.start; y<range.end; y++){
+			const short *xy = coords_->ptr<short>(y);
+			const uchar *f = fracs_->ptr<uchar>(y);
+			uchar *d = dst_->ptr<uchar>(y);
+
+			for(int x=0; x<width; x++){
+				int sx = xy[2*x], sy = xy[2*x + 1];
+				int fx = f[2*x], fy = f[2*x + 1];
+
+				if(tiny || (unsigned)sx > max_x || (unsigned)sy > max_y){
+					remapPixelBorder(src, sx, sy, fx, fy, d + 3*x);
+					continue;
+				}
+
+				const uchar *p0 = src.ptr<uchar>(sy) + 3*sx;
+				int w00 = (one - fx)*(one - fy), w01 = fx*(one - fy);
+				int w10 = (one - fx)*fy, w11 = fx*fy;
+
+#if CV_SSE2
+				// rows interleaved: [b0 b0' g0 g0' r0 r0' b1 b1'], [g1 g1' r1 r1' ...]
+				__m128i r0 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)p0), zero);
+				__m128i r1 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(p0 + step)), zero);
+				__m128i lo = _mm_unpacklo_epi16(r0, r1), hi = _mm_unpackhi_epi16(r0, r1);
+
+				__m128i m1 = _mm_madd_epi16(lo, _mm_setr_epi16(w00, w10, w00, w10, 
+															   w00, w10, w01, w11));
+				__m128i m2 = _mm_madd_epi16(hi, _mm_setr_epi16(w01, w11, w01, w11, 
+															   0, 0, 0, 0));
+
+				// [B0 G0 R0 B1] + [B1 G1 R1 0]
+				__m128i s = _mm_add_epi32(m1, _mm_or_si128(_mm_srli_si128(m1, 12), 
+														   _mm_slli_si128(m2, 4)));
+				s = _mm_srli_epi32(_mm_add_epi32(s, round), WEIGHT_BITS);
+				s = _mm_packs_epi32(s, s);
+				int bgr = _mm_cvtsi128_si32(_mm_packus_epi16(s, s));
+
+				// the 4th byte is overwritten by the next pixel of the row
+				if(x < width - 1)
+					memcpy(d + 3*x, &bgr, 4);
+				else
+					memcpy(d + 3*x, &bgr, 3);
+#else
+				const uchar *p1 = p0 + step;
+				for(int c=0; c<3; c++)
+					d[3*x + c] = (uchar)((w00*p0[c] + w01*p0[c + 3] + 
+										  w10*p1[c] + w11*p1[c + 3] + 
+										  (1 << (WEIGHT_BITS - 1))) >> WEIGHT_BITS);
+#endif
+			}
+		}
+	}
+
+private:
+	const cv::Mat *src_;
+	const cv::Mat *coords_;
+	const cv::Mat *fracs_;
+	cv::Mat *dst_;
+};
+
+CvFixedRemap::CvFixedRemap(){
+
+}
+
+CvFixedRemap::~CvFixedRemap(){
+
+}
+
+void CvFixedRemap::create(const cv::Mat &map_x, const cv::Mat &map_y){
+
+	coords_.create(map_x.size(), CV_16SC2);
+	fracs_.create(map_x.size(), CV_8UC2);
+
+	for(int y=0; y<map_x.rows; y++){
+		const float *mx = map_x.ptr<float>(y), *my = map_y.ptr<float>(y);
+		short *xy = coords_.ptr<short>(y);
+		uchar *f = fracs_.ptr<uchar>(y);
+
+		for(int x=0; x<map_x.cols; x++){
+			// round to the nearest 1/128, clamped to the int16 range
+			int ix = cvRound(std::min(std::max(mx[x], -16384.f), 16383.f)*FRAC_ONE);
+			int iy = cvRound(std::min(std::max(my[x], -16384.f), 16383.f)*FRAC_ONE);
+			xy[2*x] = (short)(ix >> FRAC_BITS);
+			xy[2*x + 1] = (short)(iy >> FRAC_BITS);
+			f[2*x] = (uchar)(ix & (FRAC_ONE - 1));
+			f[2*x + 1] = (uchar)(iy & (FRAC_ONE - 1));
+		}
+	}
+}
+
+bool CvFixedRemap::setMaps(const cv::Mat &coords, const cv::Mat &fracs){
+
+	if(coords.type() != CV_16SC2 || fracs.type() != CV_8UC2 || 
+		coords.size() != fracs.size())
+		return false;
+
+	coords_ = coords;
+	fracs_ = fracs;
+	return true;
+}
+
+void CvFixedRemap::getMaps(cv::Mat *coords, cv::Mat *fracs) const{
+	*coords = coords_;
+	*fracs = fracs_;
+}
+
+cv::Size CvFixedRemap::size() const{
+	return coords_.size();
+}
+
+bool CvFixedRemap::remap(const cv::Mat &src, cv::Mat *dst) const{
+	return remap(src, dst, true);
+}
+
+bool CvFixedRemap::remap(const cv::Mat &src, cv::Mat *dst, bool parallel) const{
+
+	if(src.type() != CV_8UC3 || coords_.empty()){
+		std::cerr << "CvFixedRemap supports 8-bit BGR frames only" << std::endl;
+		return false;
+	}
+
+	dst->create(coords_.size(), CV_8UC3);
+	RemapRowsBody body(&src, &coords_, &fracs_, dst);
+	if(parallel)
+		cv::parallel_for_(cv::Range(0, dst->rows), body);
+	else
+		body(cv::Range(0, dst->rows));
+	return true;
+}
@@ -0,0 +1,117 @@
+/*==========================================================================
+
+  Copyright (c) 2014 Uditha L. Jayarathne, ujayarat@robarts.ca
+
+  Use, modification and redistribution of the software, in source or
+  binary forms, are permitted provided that the following terms and
+  conditions are met:
+
+  1) Redistribution of the source code, in verbatim or modified
+  form, must retain the above copyright notice, this license,
+  the following disclaimer, and any notices that refer to this
+  license and/or the following disclaimer.  
+
+  2) Redistribution in binary form must include the above copyright
+  notice, a copy of this license and the following disclaimer
+  in the documentation or with other materials provided with the
+  distribution.
+
+  3) Modified copies of the source code must be clearly marked as such,
+  and must not be misrepresented as verbatim copies of the source code.
+
+  THE COPYRIGHT HOLDERS AND/OR OTHER PARTIES PROVIDE THE SOFTWARE "AS IS"
+  WITHOUT EXPRESSED OR IMPLIED WARRANTY INCLUDING, BUT NOT LIMITED TO,
+  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  PURPOSE.  IN NO EVENT SHALL ANY COPYRIGHT HOLDER OR OTHER PARTY WHO MAY
+  MODIFY AND/OR REDISTRIBUTE THE SOFTWARE UNDER THE TERMS OF THIS LICENSE
+  BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, LOSS OF DATA OR DATA BECOMING INACCURATE
+  OR LOSS OF PROFIT OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF
+  THE USE OR INABILITY TO USE THE SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGES.
+  =========================================================================*/
+
+#ifndef __CV_FIXED_REMAP__H
+#define __CV_FIXED_REMAP__H
+
+#include <iostream>
+#include <vector>
+#include <string>
+
+// Opencv Includes 
+#include "cv.h"
+
+/**
+ * Bilinear remap of 8-bit BGR frames with fixed point maps. Every output 
+ * pixel stores the integer source coordinates as two int16 (CV_16SC2) and 
+ * the fractional parts in 1/128 steps as two uint8 (CV_8UC2): 6 bytes per 
+ * pixel against 8 for float maps. The kernel builds the four bilinear 
+ * weights in 14-bit fixed point and interpolates all channels with SSE2
+ * multiply-adds. Source pixels outside the frame read as black.
+ */
+class CvFixedRemap{
+
+public:
+
+	// fractional steps per pixel
+	static const int FRAC_BITS = 7;
+	static const int FRAC_ONE = 1 << FRAC_BITS;
+
+	CvFixedRemap();
+	~CvFixedRemap();
+
+	//public methods
+
+	/**
+	 * Build the fixed point maps from float maps
+	 * @param CV_32FC1 source x per output pixel
+	 * @param CV_32FC1 source y per output pixel
+	 */
+	void create(const cv::Mat&, const cv::Mat&);
+
+	/**
+	 * Use existing fixed point maps, e.g. from a CvRemapCache
+	 * @param CV_16SC2 coordinates
+	 * @param CV_8UC2 fractions of the same size
+	 * @return false if the maps do not have this format
+	 */
+	bool setMaps(const cv::Mat&, const cv::Mat&);
+
+	/**
+	 * Get the fixed point maps
+	 * @param reference to the coordinates
+	 * @param reference to the fractions
+	 */
+	void getMaps(cv::Mat*, cv::Mat*) const;
+
+	/**
+	 * Output size of the maps
+	 */
+	cv::Size size() const;
+
+	/**
+	 * Remap a frame on all cores
+	 * @param CV_8UC3 source frame
+	 * @param reference to the output frame, reallocated only if needed
+	 * @return false for an unsupported frame type or no maps
+	 */
+	bool remap(const cv::Mat&, cv::Mat*) const;
+
+	/**
+	 * Remap a frame
+	 * @param CV_8UC3 source frame
+	 * @param reference to the output frame, reallocated only if needed
+	 * @param false to stay on the calling thread, e.g. inside a pipeline worker
+	 * @return false for an unsupported frame type or no maps
+	 */
+	bool remap(const cv::Mat&, cv::Mat*, bool) const;
+
+private:
+	//private members
+
+	cv::Mat coords_;
+	cv::Mat fracs_;
+
+};
+
+#endif //__CV_FIXED_REMAP__H
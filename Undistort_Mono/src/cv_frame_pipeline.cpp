@@ -0,0 +1,251 @@
+/*==========================================================================
+
+  Copyright (c) 2014 Uditha L. Jayarathne, ujayarat@robarts.ca
+
+  Use, modification and redistribution of the software, in source or
+  binary forms, are permitted provided that the following terms and
+  conditions are met:
+
+  1) Redistribution of the source code, in verbatim or modified
+  form, must retain the above copyright notice, this license,
+  the following disclaimer, and any notices that refer to this
+  license and/or the following disclaimer.  
+
+  2) Redistribution in binary form must include the above copyright
+  notice, a copy of this license and the following disclaimer
+  in the documentation or with other materials provided with the
+  distribution.
+
+  3) Modified copies of the source code must be clearly marked as such,
+  and must not be misrepresented as verbatim copies of the source code.
+
+  THE COPYRIGHT HOLDERS AND/OR OTHER PARTIES PROVIDE THE SOFTWARE "AS IS"
+  WITHOUT EXPRESSED OR IMPLIED WARRANTY INCLUDING, BUT NOT LIMITED TO,
+  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  PURPOSE.  IN NO EVENT SHALL ANY COPYRIGHT HOLDER OR OTHER PARTY WHO MAY
+  MODIFY AND/OR REDISTRIBUTE THE SOFTWARE UNDER THE TERMS OF THIS LICENSE
+  BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, LOSS OF DATA OR DATA BECOMING INACCURATE
+  OR LOSS OF PROFIT OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF
+  THE USE OR INABILITY TO USE THE SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGES.
+  =========================================================================*/
+
+#include <thread>
+#include <algorithm>
+#include <iomanip>
+
+#include "cv_frame_pipeline.h"
+
+// Frame sink encoding into a video file
+class VideoWriterSink : public CvFrameSink{
+
+public:
+	VideoWriterSink(cv::VideoWriter *writer): writer_(writer){}
+
+	bool write(const cv::Mat &frame){
+		*writer_ << frame;
+		return true;
+	}
+
+private:
+	cv::VideoWriter *writer_;
+};
+
+CvFramePipeline::CvFramePipeline(int n_workers, int queue_depth):
+	n_workers_(n_workers), queue_depth_(std::max(queue_depth, 1)), 
+	display_delay_(0), run_ms_(0), free_slots_(NULL){
+
+	// the decoder and the encoder keep a core each
+	if(n_workers_ <= 0)
+		n_workers_ = std::max(cv::getNumberOfCPUs() - 2, 1);
+}
+
+CvFramePipeline::~CvFramePipeline(){
+
+}
+
+void CvFramePipeline::setDisplay(std::string in_window, std::string out_window, int delay){
+	in_window_ = in_window;
+	out_window_ = out_window;
+	display_delay_ = delay;
+}
+
+int CvFramePipeline::getWorkerCount() const{
+	return n_workers_;
+}
+
+// Value below which the given fraction of the samples lie
+static double percentile(std::vector<double> samples, double fraction){
+
+	if(samples.empty())
+		return 0;
+
+	size_t k = std::min((size_t)(fraction*samples.size()), samples.size() - 1);
+	std::nth_element(samples.begin(), samples.begin() + k, samples.end());
+	return samples[k];
+}
+
+void CvFramePipeline::printStats() const{
+
+	int n = (int)latency_ms_.size();
+	std::streamsize precision = std::cout.precision();
+	std::cout << "Processed " << n << " frames in " << std::fixed << std::setprecision(2) 
+			  << run_ms_/1000 << " s: " << (run_ms_ > 0 ? 1000*n/run_ms_ : 0) 
+			  << " frames/s on " << n_workers_ << " workers" << std::endl;
+	std::cout.unsetf(std::ios::floatfield);
+	std::cout.precision(precision);
+
+	printStageTimes(decode_ms_, process_ms_, encode_ms_, latency_ms_);
+}
+
+void CvFramePipeline::printStageTimes(const std::vector<double> &decode_ms, 
+									  const std::vector<double> &process_ms, 
+									  const std::vector<double> &encode_ms, 
+									  const std::vector<double> &latency_ms){
+
+	const char *names[] = { "decode", "process", "encode", "latency" };
+	const std::vector<double> *times[] = { &decode_ms, &process_ms, &encode_ms, &latency_ms };
+
+	std::streamsize precision = std::cout.precision();
+	std::cout << std::fixed << std::setprecision(2);
+	std::cout << std::setw(10) << "stage" << std::setw(12) << "p50 (ms)" 
+			  << std::setw(12) << "p99 (ms)" << std::endl;
+	for(int i=0; i<4; i++)
+		std::cout << std::setw(10) << names[i] 
+				  << std::setw(12) << percentile(*times[i], 0.5) 
+				  << std::setw(12) << percentile(*times[i], 0.99) << std::endl;
+
+	std::cout.unsetf(std::ios::floatfield);
+	std::cout.precision(precision);
+}
+
+void CvFramePipeline::decodeLoop(cv::VideoCapture *capture, int max_frames){
+
+	for(int i=0; max_frames <= 0 || i < max_frames; i++){
+
+		// waits while all buffers are in flight
+		FrameSlot *slot = free_slots_->pop();
+		slot->t_read = cv::getTickCount();
+		if(!capture->read(slot->in)){
+			if(max_frames > 0)
+				std::cout << "Bad frame" << std::endl;
+			// the encoder is the only producer of free slots, the pool
+			// is dropped after the run anyway
+			break;
+		}
+
+		slot->index = i;
+		slot->decode_ms = 1000.0*(cv::getTickCount() - slot->t_read)/cv::getTickFrequency();
+		work_queues_[i % n_workers_]->push(slot);
+	}
+
+	// end of stream for every worker
+	for(int w=0; w<n_workers_; w++)
+		work_queues_[w]->push(NULL);
+}
+
+void CvFramePipeline::workLoop(int worker, const CvFrameFilter *filter){
+
+	SlotQueue *in = work_queues_[worker], *out = done_queues_[worker];
+
+	for(;;){
+		FrameSlot *slot = in->pop();
+		if(slot){
+			int64 t0 = cv::getTickCount();
+			slot->ok = filter->apply(slot->in, &slot->out);
+			slot->process_ms = 1000.0*(cv::getTickCount() - t0)/cv::getTickFrequency();
+		}
+
+		out->push(slot);
+		if(!slot)
+			break;
+	}
+}
+
+int CvFramePipeline::run(cv::VideoCapture *capture, int max_frames, 
+						 const CvFrameFilter &filter, cv::VideoWriter *writer){
+
+	VideoWriterSink sink(writer);
+	return run(capture, max_frames, filter, &sink);
+}
+
+int CvFramePipeline::run(cv::VideoCapture *capture, int max_frames, 
+						 const CvFrameFilter &filter, CvFrameSink *sink){
+
+	// enough buffers to fill every queue, so no stage waits for memory
+	int n_slots = n_workers_*2*queue_depth_ + 2;
+	std::vector<FrameSlot> slots(n_slots);
+
+	free_slots_ = new SlotQueue(n_slots);
+	for(int i=0; i<n_slots; i++)
+		free_slots_->push(&slots[i]);
+	for(int w=0; w<n_workers_; w++){
+		work_queues_.push_back(new SlotQueue(queue_depth_));
+		done_queues_.push_back(new SlotQueue(queue_depth_));
+	}
+
+	decode_ms_.clear();
+	process_ms_.clear();
+	encode_ms_.clear();
+	latency_ms_.clear();
+	int64 t_start = cv::getTickCount();
+	double ms_per_tick = 1000.0/cv::getTickFrequency();
+
+	std::thread decoder(&CvFramePipeline::decodeLoop, this, capture, max_frames);
+	std::vector<std::thread> workers;
+	for(int w=0; w<n_workers_; w++)
+		workers.push_back(std::thread(&CvFramePipeline::workLoop, this, w, &filter));
+
+	// Encode on the calling thread, which also owns the highgui windows.
+	// Frame i comes from worker i % n, so taking the workers' results 
+	// round robin restores the input order.
+	int n_written = 0;
+	for(int i=0; ; i++){
+		FrameSlot *slot = done_queues_[i % n_workers_]->pop();
+		if(!slot)
+			break;
+
+		int64 t0 = cv::getTickCount();
+		if(!slot->ok)
+			std::cerr << "Failed to process frame " << slot->index << std::endl;
+		else if(!sink->write(slot->out))
+			std::cerr << "Failed to write frame " << slot->index << std::endl;
+		else
+			n_written++;
+
+		int64 t1 = cv::getTickCount();
+		decode_ms_.push_back(slot->decode_ms);
+		process_ms_.push_back(slot->process_ms);
+		encode_ms_.push_back((t1 - t0)*ms_per_tick);
+		latency_ms_.push_back((t1 - slot->t_read)*ms_per_tick);
+
+		if(!in_window_.empty()){
+			cv::imshow(in_window_, slot->in);
+			cv::imshow(out_window_, slot->out);
+			cv::waitKey(display_delay_);
+		}
+
+		if(n_written%100 == 0)
+			std::cout << ".";
+
+		free_slots_->push(slot);
+	}
+
+	decoder.join();
+	for(int w=0; w<n_workers_; w++)
+		workers[w].join();
+	run_ms_ = (cv::getTickCount() - t_start)*ms_per_tick;
+
+	// the remaining end of stream markers
+	for(int w=0; w<n_workers_; w++){
+		delete work_queues_[w];
+		delete done_queues_[w];
+	}
+	work_queues_.clear();
+	done_queues_.clear();
+	delete free_slots_;
+	free_slots_ = NULL;
+
+	return n_written;
+}
@@ -0,0 +1,203 @@
+/*==========================================================================
+
+  Copyright (c) 2014 Uditha L. Jayarathne, ujayarat@robarts.ca
+
+  Use, modification and redistribution of the software, in source or
+  binary forms, are permitted provided that the following terms and
+  conditions are met:
+
+  1) Redistribution of the source code, in verbatim or modified
+  form, must retain the above copyright notice, this license,
+  the following disclaimer, and any notices that refer to this
+  license and/or the following disclaimer.  
+
+  2) Redistribution in binary form must include the above copyright
+  notice, a copy of this license and the following disclaimer
+  in the documentation or with other materials provided with the
+  distribution.
+
+  3) Modified copies of the source code must be clearly marked as such,
+  and must not be misrepresented as verbatim copies of the source code.
+
+  THE COPYRIGHT HOLDERS AND/OR OTHER PARTIES PROVIDE THE SOFTWARE "AS IS"
+  WITHOUT EXPRESSED OR IMPLIED WARRANTY INCLUDING, BUT NOT LIMITED TO,
+  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  PURPOSE.  IN NO EVENT SHALL ANY COPYRIGHT HOLDER OR OTHER PARTY WHO MAY
+  MODIFY AND/OR REDISTRIBUTE THE SOFTWARE UNDER THE TERMS OF THIS LICENSE
+  BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, LOSS OF DATA OR DATA BECOMING INACCURATE
+  OR LOSS OF PROFIT OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF
+  THE USE OR INABILITY TO USE THE SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGES.
+  =========================================================================*/
+
+#ifndef __CV_FRAME_PIPELINE__H
+#define __CV_FRAME_PIPELINE__H
+
+#include <iostream>
+#include <vector>
+#include <string>
+
+// Opencv Includes 
+#include "cv.h"
+#include "highgui.h"
+
+#include "cv_spsc_queue.h"
+
+/**
+ * Per-frame processing run by the pipeline workers. apply is called 
+ * concurrently from all workers and must not modify the filter.
+ */
+class CvFrameFilter{
+
+public:
+	virtual ~CvFrameFilter(){}
+
+	/**
+	 * Process one frame
+	 * @param input frame
+	 * @param reference to the output frame, reused between calls
+	 * @return false on failure
+	 */
+	virtual bool apply(const cv::Mat&, cv::Mat*) const = 0;
+};
+
+/**
+ * Destination of the processed frames. write is called on the thread 
+ * that runs the pipeline, in frame order.
+ */
+class CvFrameSink{
+
+public:
+	virtual ~CvFrameSink(){}
+
+	/**
+	 * Store one frame
+	 * @param processed frame
+	 * @return false on failure
+	 */
+	virtual bool write(const cv::Mat&) = 0;
+};
+
+/**
+ * Decode -> process -> encode pipeline. A decoder thread reads frames
+ * into a fixed pool of buffers and deals them round robin to N worker
+ * threads; the calling thread collects the results in the same order and
+ * writes them, so output frames keep their input order. All stages are
+ * connected by bounded lock-free queues, and a stage that runs ahead 
+ * waits for the slower ones. Every run records per-stage frame timings for
+ * printStats.
+ */
+class CvFramePipeline{
+
+public:
+
+	/**
+	 * @param number of worker threads, <= 0 for one per spare core
+	 * @param frames queued per worker
+	 */
+	CvFramePipeline(int, int);
+	~CvFramePipeline();
+
+	//public methods
+
+	/**
+	 * Show input and output frames while writing
+	 * @param input window name
+	 * @param output window name
+	 * @param cv::waitKey delay in ms
+	 */
+	void setDisplay(std::string, std::string, int);
+
+	/**
+	 * Process a video
+	 * @param opened capture
+	 * @param maximum number of frames to read, <= 0 for all
+	 * @param frame filter
+	 * @param opened writer
+	 * @return number of frames written
+	 */
+	int run(cv::VideoCapture*, int, const CvFrameFilter&, cv::VideoWriter*);
+
+	/**
+	 * Same as above, for outputs a video writer can not hold
+	 * @param opened capture
+	 * @param maximum number of frames to read, <= 0 for all
+	 * @param frame filter
+	 * @param opened frame sink
+	 * @return number of frames written
+	 */
+	int run(cv::VideoCapture*, int, const CvFrameFilter&, CvFrameSink*);
+
+	/**
+	 * Number of worker threads
+	 */
+	int getWorkerCount() const;
+
+	/**
+	 * Print the throughput of the last run and the p50/p99 time of each 
+	 * stage and of a frame end to end
+	 */
+	void printStats() const;
+
+	/**
+	 * Print the p50/p99 table of per-frame stage times
+	 * @param decode times in ms
+	 * @param process times in ms
+	 * @param encode times in ms
+	 * @param end to end times in ms
+	 */
+	static void printStageTimes(const std::vector<double>&, const std::vector<double>&, 
+								const std::vector<double>&, const std::vector<double>&);
+
+private:
+
+	// A frame buffer circulating through the pipeline
+	typedef struct FrameSlot{
+		int index;
+		cv::Mat in;
+		cv::Mat out;
+		bool ok;
+		int64 t_read;		// ticks when the decoder started on the frame
+		double decode_ms;
+		double process_ms;
+	} FrameSlot;
+
+	typedef CvSpscQueue<FrameSlot*> SlotQueue;
+
+	//private methods
+
+	/**
+	 * Decoder thread: fill free slots and deal them to the workers
+	 */
+	void decodeLoop(cv::VideoCapture*, int);
+
+	/**
+	 * Worker thread: apply the filter to the slots of one worker
+	 */
+	void workLoop(int, const CvFrameFilter*);
+
+	//private members
+
+	int n_workers_;
+	int queue_depth_;
+
+	std::string in_window_;
+	std::string out_window_;
+	int display_delay_;
+
+	// timings of the last run, in ms
+	double run_ms_;
+	std::vector<double> decode_ms_;
+	std::vector<double> process_ms_;
+	std::vector<double> encode_ms_;
+	std::vector<double> latency_ms_;
+
+	// queues of the current run
+	SlotQueue *free_slots_;
+	std::vector<SlotQueue*> work_queues_;
+	std::vector<SlotQueue*> done_queues_;
+
+};
+
+#endif //__CV_FRAME_PIPELINE__H
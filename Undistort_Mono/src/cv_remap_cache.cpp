@@ -0,0 +1,168 @@
+/*==========================================================================
+
+  Copyright (c) 2014 Uditha L. Jayarathne, ujayarat@robarts.ca
+
+  Use, modification and redistribution of the software, in source or
+  binary forms, are permitted provided that the following terms and
+  conditions are met:
+
+  1) Redistribution of the source code, in verbatim or modified
+  form, must retain the above copyright notice, this license,
+  the following disclaimer, and any notices that refer to this
+  license and/or the following disclaimer.  
+
+  2) Redistribution in binary form must include the above copyright
+  notice, a copy of this license and the following disclaimer
+  in the documentation or with other materials provided with the
+  distribution.
+
+  3) Modified copies of the source code must be clearly marked as such,
+  and must not be misrepresented as verbatim copies of the source code.
+
+  THE COPYRIGHT HOLDERS AND/OR OTHER PARTIES PROVIDE THE SOFTWARE "AS IS"
+  WITHOUT EXPRESSED OR IMPLIED WARRANTY INCLUDING, BUT NOT LIMITED TO,
+  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  PURPOSE.  IN NO EVENT SHALL ANY COPYRIGHT HOLDER OR OTHER PARTY WHO MAY
+  MODIFY AND/OR REDISTRIBUTE THE SOFTWARE UNDER THE TERMS OF THIS LICENSE
+  BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, LOSS OF DATA OR DATA BECOMING INACCURATE
+  OR LOSS OF PROFIT OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF
+  THE USE OR INABILITY TO USE THE SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGES.
+  =========================================================================*/
+
+#include <fstream>
+#include <string.h>
+
+#include "cv_remap_cache.h"
+#include "cv_corner_cache.h"
+
+// File layout (native byte order):
+//	char[4] magic, int32 version, uint64 key, 
+//	per map: int32 rows, int32 cols, int32 type, rows x cols elements
+static const char REMAP_MAGIC[4] = {'C', 'V', 'R', 'M'};
+static const int REMAP_VERSION = 1;
+
+/**
+ * Read one map
+ * @param input stream
+ * @param reference to the map
+ * @return false on a truncated file
+ */
+static bool readMap(std::ifstream &file, cv::Mat *map){
+
+	int rows, cols, type;
+	file.read((char *)&rows, sizeof(int));
+	file.read((char *)&cols, sizeof(int));
+	file.read((char *)&type, sizeof(int));
+	if(!file.good() || rows < 0 || cols < 0)
+		return false;
+
+	map->create(rows, cols, type);
+	for(int r=0; r<rows; r++)
+		file.read((char *)map->ptr(r), cols*map->elemSize());
+
+	return file.good();
+}
+
+/**
+ * Write one map
+ * @param output stream
+ * @param map
+ */
+static void writeMap(std::ofstream &file, const cv::Mat &map){
+
+	int type = map.type();
+	file.write((const char *)&map.rows, sizeof(int));
+	file.write((const char *)&map.cols, sizeof(int));
+	file.write((const char *)&type, sizeof(int));
+	for(int r=0; r<map.rows; r++)
+		file.write((const char *)map.ptr(r), map.cols*map.elemSize());
+}
+
+CvRemapCache::CvRemapCache(std::string filename):
+	filename_(filename){
+
+}
+
+CvRemapCache::~CvRemapCache(){
+
+}
+
+bool CvRemapCache::computeKey(const std::string &calib_file, cv::Size frame_size, 
+							  uint64 *key){
+	return computeKey(std::vector<std::string>(1, calib_file), frame_size, key);
+}
+
+bool CvRemapCache::computeKey(const std::vector<std::string> &calib_files, 
+							  cv::Size frame_size, uint64 *key){
+
+	std::vector<uchar> buffer, file_buffer;
+	for(size_t i=0; i<calib_files.size(); i++){
+		if(!CvCornerCache::readFile(calib_files[i], &file_buffer))
+			return false;
+		buffer.insert(buffer.end(), file_buffer.begin(), file_buffer.end());
+	}
+
+	// FNV-1a over the file contents followed by the frame size
+	const uchar *size_bytes = (const uchar *)&frame_size.width;
+	buffer.insert(buffer.end(), size_bytes, size_bytes + sizeof(int));
+	size_bytes = (const uchar *)&frame_size.height;
+	buffer.insert(buffer.end(), size_bytes, size_bytes + sizeof(int));
+
+	*key = CvCornerCache::hashBuffer(buffer);
+	return true;
+}
+
+bool CvRemapCache::load(uint64 key, cv::Mat *map1, cv::Mat *map2){
+
+	std::ifstream file(filename_.c_str(), std::ios::in | std::ios::binary);
+	if(!file.is_open())
+		return false;
+
+	char magic[4];
+	int version;
+	uint64 file_key;
+	file.read(magic, 4);
+	file.read((char *)&version, sizeof(int));
+	file.read((char *)&file_key, sizeof(uint64));
+
+	if(!file.good() || memcmp(magic, REMAP_MAGIC, 4) != 0 || 
+		version != REMAP_VERSION){
+		std::cerr << "Ignoring invalid remap cache " << filename_ << std::endl;
+		return false;
+	}
+
+	// written for another calibration or frame size
+	if(file_key != key)
+		return false;
+
+	if(!readMap(file, map1) || !readMap(file, map2)){
+		std::cerr << "Ignoring truncated remap cache " << filename_ << std::endl;
+		return false;
+	}
+
+	file.close();
+	return true;
+}
+
+bool CvRemapCache::save(uint64 key, const cv::Mat &map1, const cv::Mat &map2){
+
+	std::ofstream file(filename_.c_str(), 
+						std::ios::out | std::ios::binary | std::ios::trunc);
+	if(!file.is_open()){
+		std::cerr << "Unable to open the remap cache " << filename_ << std::endl;
+		return false;
+	}
+
+	file.write(REMAP_MAGIC, 4);
+	file.write((const char *)&REMAP_VERSION, sizeof(int));
+	file.write((const char *)&key, sizeof(uint64));
+	writeMap(file, map1);
+	writeMap(file, map2);
+
+	bool ok = file.good();
+	file.close();
+
+	return ok;
+}
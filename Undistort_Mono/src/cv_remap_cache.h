@@ -0,0 +1,106 @@
+/*==========================================================================
+
+  Copyright (c) 2014 Uditha L. Jayarathne, ujayarat@robarts.ca
+
+  Use, modification and redistribution of the software, in source or
+  binary forms, are permitted provided that the following terms and
+  conditions are met:
+
+  1) Redistribution of the source code, in verbatim or modified
+  form, must retain the above copyright notice, this license,
+  the following disclaimer, and any notices that refer to this
+  license and/or the following disclaimer.  
+
+  2) Redistribution in binary form must include the above copyright
+  notice, a copy of this license and the following disclaimer
+  in the documentation or with other materials provided with the
+  distribution.
+
+  3) Modified copies of the source code must be clearly marked as such,
+  and must not be misrepresented as verbatim copies of the source code.
+
+  THE COPYRIGHT HOLDERS AND/OR OTHER PARTIES PROVIDE THE SOFTWARE "AS IS"
+  WITHOUT EXPRESSED OR IMPLIED WARRANTY INCLUDING, BUT NOT LIMITED TO,
+  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  PURPOSE.  IN NO EVENT SHALL ANY COPYRIGHT HOLDER OR OTHER PARTY WHO MAY
+  MODIFY AND/OR REDISTRIBUTE THE SOFTWARE UNDER THE TERMS OF THIS LICENSE
+  BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, LOSS OF DATA OR DATA BECOMING INACCURATE
+  OR LOSS OF PROFIT OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF
+  THE USE OR INABILITY TO USE THE SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGES.
+  =========================================================================*/
+
+#ifndef __CV_REMAP_CACHE__H
+#define __CV_REMAP_CACHE__H
+
+#include <iostream>
+#include <vector>
+#include <string>
+
+// Opencv Includes 
+#include "cv.h"
+
+/**
+ * Binary cache of a pair of cv::remap tables. The tables are stored with
+ * a key derived from the content of the calibration file they were built
+ * from and the frame size, so an edited calibration or a different video
+ * resolution never picks up stale tables.
+ */
+class CvRemapCache{
+
+public:
+
+	/**
+	 * @param cache file name
+	 */
+	CvRemapCache(std::string);
+	~CvRemapCache();
+
+	//public methods
+
+	/**
+	 * Key of a calibration file and a frame size
+	 * @param calibration file name
+	 * @param frame size
+	 * @param reference to the key
+	 * @return false if the calibration file can not be read
+	 */
+	static bool computeKey(const std::string&, cv::Size, uint64*);
+
+	/**
+	 * Key of several calibration files and a frame size, for tables built
+	 * from all of them, e.g. both eyes of a stereo rig
+	 * @param calibration file names
+	 * @param frame size
+	 * @param reference to the key
+	 * @return false if a calibration file can not be read
+	 */
+	static bool computeKey(const std::vector<std::string>&, cv::Size, uint64*);
+
+	/**
+	 * Load the tables if the cache file was written for the key
+	 * @param key
+	 * @param reference to the first map
+	 * @param reference to the second map
+	 * @return true if both maps were loaded
+	 */
+	bool load(uint64, cv::Mat*, cv::Mat*);
+
+	/**
+	 * Write the tables
+	 * @param key
+	 * @param first map
+	 * @param second map
+	 * @return true on success
+	 */
+	bool save(uint64, const cv::Mat&, const cv::Mat&);
+
+private:
+	//private members
+
+	std::string filename_;
+
+};
+
+#endif //__CV_REMAP_CACHE__H
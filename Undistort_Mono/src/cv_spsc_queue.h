@@ -0,0 +1,131 @@
+/*==========================================================================
+
+  Copyright (c) 2014 Uditha L. Jayarathne, ujayarat@robarts.ca
+
+  Use, modification and redistribution of the software, in source or
+  binary forms, are permitted provided that the following terms and
+  conditions are met:
+
+  1) Redistribution of the source code, in verbatim or modified
+  form, must retain the above copyright notice, this license,
+  the following disclaimer, and any notices that refer to this
+  license and/or the following disclaimer.  
+
+  2) Redistribution in binary form must include the above copyright
+  notice, a copy of this license and the following disclaimer
+  in the documentation or with other materials provided with the
+  distribution.
+
+  3) Modified copies of the source code must be clearly marked as such,
+  and must not be misrepresented as verbatim copies of the source code.
+
+  THE COPYRIGHT HOLDERS AND/OR OTHER PARTIES PROVIDE THE SOFTWARE "AS IS"
+  WITHOUT EXPRESSED OR IMPLIED WARRANTY INCLUDING, BUT NOT LIMITED TO,
+  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  PURPOSE.  IN NO EVENT SHALL ANY COPYRIGHT HOLDER OR OTHER PARTY WHO MAY
+  MODIFY AND/OR REDISTRIBUTE THE SOFTWARE UNDER THE TERMS OF THIS LICENSE
+  BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, LOSS OF DATA OR DATA BECOMING INACCURATE
+  OR LOSS OF PROFIT OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF
+  THE USE OR INABILITY TO USE THE SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGES.
+  =========================================================================*/
+
+#ifndef __CV_SPSC_QUEUE__H
+#define __CV_SPSC_QUEUE__H
+
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <chrono>
+
+/**
+ * Bounded lock-free queue for exactly one producer and one consumer
+ * thread. push and pop wait while the queue is full or empty, yielding
+ * first and then sleeping briefly, which gives backpressure between 
+ * pipeline stages without locks.
+ */
+template<typename T>
+class CvSpscQueue{
+
+public:
+
+	/**
+	 * @param maximum number of queued items
+	 */
+	CvSpscQueue(int capacity):
+		buffer_(capacity + 1), head_(0), tail_(0){}
+
+	/**
+	 * Append an item if there is room
+	 * @param item
+	 * @return false if the queue is full
+	 */
+	bool tryPush(const T &item){
+
+		size_t tail = tail_.load(std::memory_order_relaxed);
+		size_t next = (tail + 1) % buffer_.size();
+		if(next == head_.load(std::memory_order_acquire))
+			return false;
+
+		buffer_[tail] = item;
+		tail_.store(next, std::memory_order_release);
+		return true;
+	}
+
+	/**
+	 * Take the oldest item if there is one
+	 * @param reference to the item
+	 * @return false if the queue is empty
+	 */
+	bool tryPop(T *item){
+
+		size_t head = head_.load(std::memory_order_relaxed);
+		if(head == tail_.load(std::memory_order_acquire))
+			return false;
+
+		*item = buffer_[head];
+		head_.store((head + 1) % buffer_.size(), std::memory_order_release);
+		return true;
+	}
+
+	/**
+	 * Append an item, waiting while the queue is full
+	 * @param item
+	 */
+	void push(const T &item){
+		for(int spins=0; !tryPush(item); spins++)
+			backoff(spins);
+	}
+
+	/**
+	 * Take the oldest item, waiting while the queue is empty
+	 * @return item
+	 */
+	T pop(){
+		T item;
+		for(int spins=0; !tryPop(&item); spins++)
+			backoff(spins);
+		return item;
+	}
+
+private:
+
+	static void backoff(int spins){
+		if(spins < 64)
+			std::this_thread::yield();
+		else
+			std::this_thread::sleep_for(std::chrono::microseconds(100));
+	}
+
+	std::vector<T> buffer_;
+
+	// consumer and producer indices on separate cache lines
+	char pad0_[64];
+	std::atomic<size_t> head_;
+	char pad1_[64];
+	std::atomic<size_t> tail_;
+
+};
+
+#endif //__CV_SPSC_QUEUE__H
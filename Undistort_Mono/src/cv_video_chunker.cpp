@@ -0,0 +1,397 @@
+/*==========================================================================
+
+  Copyright (c) 2014 Uditha L. Jayarathne, ujayarat@robarts.ca
+
+  Use, modification and redistribution of the software, in source or
+  binary forms, are permitted provided that the following terms and
+  conditions are met:
+
+  1) Redistribution of the source code, in verbatim or modified
+  form, must retain the above copyright notice, this license,
+  the following disclaimer, and any notices that refer to this
+  license and/or the following disclaimer.  
+
+  2) Redistribution in binary form must include the above copyright
+  notice, a copy of this license and the following disclaimer
+  in the documentation or with other materials provided with the
+  distribution.
+
+  3) Modified copies of the source code must be clearly marked as such,
+  and must not be misrepresented as verbatim copies of the source code.
+
+  THE COPYRIGHT HOLDERS AND/OR OTHER PARTIES PROVIDE THE SOFTWARE "AS IS"
+  WITHOUT EXPRESSED OR IMPLIED WARRANTY INCLUDING, BUT NOT LIMITED TO,
+  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  PURPOSE.  IN NO EVENT SHALL ANY COPYRIGHT HOLDER OR OTHER PARTY WHO MAY
+  MODIFY AND/OR REDISTRIBUTE THE SOFTWARE UNDER THE TERMS OF THIS LICENSE
+  BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, LOSS OF DATA OR DATA BECOMING INACCURATE
+  OR LOSS OF PROFIT OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF
+  THE USE OR INABILITY TO USE THE SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGES.
+  =========================================================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <fstream>
+#include <algorithm>
+#include <iomanip>
+
+#include "cv_video_chunker.h"
+
+// 64 bit FNV-1a hash over the pixels of a frame
+static uint64 hashFrame(const cv::Mat &frame){
+
+	uint64 hash = 14695981039346656037ULL;
+	size_t row_bytes = frame.cols*frame.elemSize();
+	for(int r=0; r<frame.rows; r++){
+		const uchar *p = frame.ptr<uchar>(r);
+		for(size_t i=0; i<row_bytes; i++){
+			hash ^= p[i];
+			hash *= 1099511628211ULL;
+		}
+	}
+
+	return hash;
+}
+
+// Single quote a string for the shell and the ffmpeg concat list, 
+// which share the same rule: ' becomes '\''
+static std::string quoteArgument(const std::string &arg){
+
+	std::string quoted = "'";
+	for(size_t c=0; c<arg.size(); c++)
+		if(arg[c] == '\'')
+			quoted += "'\\''";
+		else
+			quoted += arg[c];
+	quoted += "'";
+
+	return quoted;
+}
+
+// Loop body run by cv::parallel_for_. Each index is one chunk.
+class ChunkBody : public cv::ParallelLoopBody{
+
+public:
+	ChunkBody(const std::string *in_file, const std::vector<CvVideoChunker::Chunk> *chunks, 
+			  const CvFrameFilter *filter, int codec, double fps, cv::Size frame_size, 
+			  std::vector<CvVideoChunker::ChunkResult> *results) :
+		in_file_(in_file), chunks_(chunks), filter_(filter), codec_(codec), fps_(fps),
+		frame_size_(frame_size), results_(results){}
+
+	void operator()(const cv::Range &range) const{
+
+		for(int i=range.start; i<range.end; i++)
+			CvVideoChunker::processChunk(*in_file_, (*chunks_)[i], *filter_, codec_, fps_, 
+										 frame_size_, i + 1 < (int)chunks_->size(), 
+										 &(*results_)[i]);
+	}
+
+private:
+	const std::string *in_file_;
+	const std::vector<CvVideoChunker::Chunk> *chunks_;
+	const CvFrameFilter *filter_;
+	int codec_;
+	double fps_;
+	cv::Size frame_size_;
+	std::vector<CvVideoChunker::ChunkResult> *results_;
+};
+
+CvVideoChunker::CvVideoChunker(int n_chunks, int gop_size):
+	n_chunks_(n_chunks), gop_size_(std::max(gop_size, 1)), 
+	run_chunks_(0), run_ms_(0){
+
+	if(n_chunks_ <= 0)
+		n_chunks_ = cv::getNumberOfCPUs();
+}
+
+CvVideoChunker::~CvVideoChunker(){
+
+}
+
+void CvVideoChunker::plan(int n_frames, const std::string &out_file, 
+						  std::vector<Chunk> *chunks) const{
+
+	chunks->clear();
+	if(n_frames <= 0)
+		return;
+
+	// equal chunks, lengthened to whole GOPs
+	int length = (n_frames + n_chunks_ - 1)/n_chunks_;
+	length = ((length + gop_size_ - 1)/gop_size_)*gop_size_;
+
+	for(int first=0; first<n_frames; first+=length){
+		char suffix[32];
+		sprintf(suffix, ".part%03d.avi", (int)chunks->size());
+
+		Chunk chunk;
+		chunk.first = first;
+		chunk.count = std::min(length, n_frames - first);
+		chunk.filename = out_file + suffix;
+		chunks->push_back(chunk);
+	}
+}
+
+void CvVideoChunker::processChunk(const std::string &in_file, const Chunk &chunk, 
+								  const CvFrameFilter &filter, int codec, double fps, 
+								  cv::Size frame_size, bool lookahead, ChunkResult *result){
+
+	result->n_written = -1;
+	result->first_hash = 0;
+	result->next_hash = 0;
+	result->bad_frame = false;
+
+	cv::VideoCapture capture;
+	if(!capture.open(in_file)){
+		std::cerr << "Failed to open " << in_file << std::endl;
+		return;
+	}
+
+	// the position read back after a seek is the requested one, so 
+	// whether the seek landed is checked by run() from the frame hashes
+	if(chunk.first > 0)
+		capture.set(CV_CAP_PROP_POS_FRAMES, chunk.first);
+
+	cv::Mat next_frame;
+	filterChunk(&capture, chunk, filter, codec, fps, frame_size, cv::Mat(), lookahead, 
+				result, &next_frame);
+}
+
+void CvVideoChunker::filterChunk(cv::VideoCapture *capture, const Chunk &chunk, 
+								 const CvFrameFilter &filter, int codec, double fps, 
+								 cv::Size frame_size, const cv::Mat &first_frame, 
+								 bool lookahead, ChunkResult *result, cv::Mat *next_frame){
+
+	result->n_written = -1;
+	result->first_hash = 0;
+	result->next_hash = 0;
+	result->bad_frame = false;
+	result->decode_ms.clear();
+	result->process_ms.clear();
+	result->encode_ms.clear();
+	result->latency_ms.clear();
+	next_frame->release();
+
+	cv::VideoWriter writer(chunk.filename, codec, fps, frame_size, true);
+	if(!writer.isOpened()){
+		std::cerr << "Failed to open " << chunk.filename << std::endl;
+		return;
+	}
+
+	double ms_per_tick = 1000.0/cv::getTickFrequency();
+	cv::Mat frame, filtered;
+	int n_written = 0;
+	for(int i=0; i<chunk.count; i++){
+		int64 t0 = cv::getTickCount();
+		if(i == 0 && !first_frame.empty())
+			frame = first_frame;
+		else if(!capture->read(frame)){
+			// reported by run(), this runs on the chunk workers
+			result->bad_frame = true;
+			break;
+		}
+		if(i == 0)
+			result->first_hash = hashFrame(frame);
+
+		int64 t1 = cv::getTickCount();
+		if(!filter.apply(frame, &filtered))
+			return;
+
+		int64 t2 = cv::getTickCount();
+		writer << filtered;
+		n_written++;
+
+		int64 t3 = cv::getTickCount();
+		result->decode_ms.push_back((t1 - t0)*ms_per_tick);
+		result->process_ms.push_back((t2 - t1)*ms_per_tick);
+		result->encode_ms.push_back((t3 - t2)*ms_per_tick);
+		result->latency_ms.push_back((t3 - t0)*ms_per_tick);
+	}
+
+	// the next chunk must start with this frame
+	if(lookahead && n_written == chunk.count && capture->read(*next_frame))
+		result->next_hash = hashFrame(*next_frame);
+
+	result->n_written = n_written;
+}
+
+bool CvVideoChunker::copySegments(const std::vector<Chunk> &chunks, const std::string &out_file){
+
+	// the concat demuxer resolves names relative to the list file, 
+	// which sits next to the segments
+	std::string list_file = out_file + ".parts.txt";
+	std::ofstream list(list_file.c_str());
+	if(!list.is_open())
+		return false;
+
+	for(size_t i=0; i<chunks.size(); i++){
+		std::string name = chunks[i].filename;
+		size_t slash = name.find_last_of("/\\");
+		if(slash != std::string::npos)
+			name = name.substr(slash + 1);
+
+		list << "file " << quoteArgument(name) << std::endl;
+	}
+	list.close();
+
+	std::string command = "ffmpeg -loglevel error -y -f concat -safe 0 -i " + 
+						  quoteArgument(list_file) + " -c copy " + quoteArgument(out_file);
+	int status = system(command.c_str());
+	remove(list_file.c_str());
+
+	return status == 0;
+}
+
+int CvVideoChunker::reencodeSegments(const std::vector<Chunk> &chunks, const std::string &out_file,
+									 int codec, double fps, cv::Size frame_size){
+
+	cv::VideoWriter writer(out_file, codec, fps, frame_size, true);
+	if(!writer.isOpened()){
+		std::cerr << "Failed to open the video writer." << std::endl;
+		return -1;
+	}
+
+	int n_joined = 0;
+	cv::Mat frame;
+	for(size_t i=0; i<chunks.size(); i++){
+		cv::VideoCapture segment(chunks[i].filename);
+		while(segment.read(frame)){
+			writer << frame;
+			n_joined++;
+		}
+	}
+
+	return n_joined;
+}
+
+void CvVideoChunker::printStats() const{
+
+	int n = (int)latency_ms_.size();
+	std::streamsize precision = std::cout.precision();
+	std::cout << "Processed " << n << " frames in " << std::fixed << std::setprecision(2) 
+			  << run_ms_/1000 << " s: " << (run_ms_ > 0 ? 1000*n/run_ms_ : 0) 
+			  << " frames/s in " << run_chunks_ << " chunks" << std::endl;
+	std::cout.unsetf(std::ios::floatfield);
+	std::cout.precision(precision);
+
+	CvFramePipeline::printStageTimes(decode_ms_, process_ms_, encode_ms_, latency_ms_);
+}
+
+int CvVideoChunker::run(const std::string &in_file, int n_frames, const CvFrameFilter &filter, 
+						const std::string &out_file, int codec, double fps, cv::Size frame_size){
+
+	decode_ms_.clear();
+	process_ms_.clear();
+	encode_ms_.clear();
+	latency_ms_.clear();
+	int64 t_start = cv::getTickCount();
+
+	std::vector<Chunk> chunks;
+	plan(n_frames, out_file, &chunks);
+	if(chunks.empty()){
+		std::cerr << "The video has no frame count to split by" << std::endl;
+		return -1;
+	}
+
+	int n = (int)chunks.size();
+	run_chunks_ = n;
+	std::cout << "Processing " << n << " chunks of " << chunks[0].count 
+			  << " frames .." << std::endl;
+
+	std::vector<ChunkResult> results(n);
+	cv::parallel_for_(cv::Range(0, n), 
+						ChunkBody(&in_file, &chunks, &filter, codec, fps, frame_size, &results));
+
+	for(int i=0; i<n; i++)
+		if(results[i].bad_frame)
+			std::cout << "Bad frame " << chunks[i].first + results[i].n_written 
+					  << " in chunk " << i << std::endl;
+
+	// Check the chunks in order. A chunk is good if it is complete and 
+	// starts with the frame its predecessor decoded past its end. The 
+	// others are read again from one capture that only moves forward, so 
+	// the recovery decodes the video at most once.
+	cv::VideoCapture capture;
+	int position = -1;
+	cv::Mat pending;
+	int pending_frame = -1;
+	int n_redone = 0;
+
+	for(int i=0; i<n; i++){
+		const Chunk &chunk = chunks[i];
+		bool lookahead = i + 1 < n;
+
+		// the last chunk may end early if the frame count was too high
+		bool good = results[i].n_written == chunk.count || 
+					(!lookahead && results[i].n_written > 0);
+		if(i > 0)
+			good = good && results[i].first_hash == results[i - 1].next_hash;
+		if(good)
+			continue;
+
+		if(position < 0){
+			if(!capture.open(in_file)){
+				std::cerr << "Failed to open " << in_file << std::endl;
+				return -1;
+			}
+			position = 0;
+		}
+		while(position < chunk.first){
+			if(!capture.grab()){
+				std::cerr << "Failed to reach frame " << chunk.first << std::endl;
+				return -1;
+			}
+			position++;
+		}
+
+		cv::Mat next_frame;
+		filterChunk(&capture, chunk, filter, codec, fps, frame_size, 
+					pending_frame == chunk.first ? pending : cv::Mat(), lookahead, 
+					&results[i], &next_frame);
+		n_redone++;
+
+		int n_written = results[i].n_written;
+		if(n_written < 0){
+			std::cerr << "Chunk " << i << " failed" << std::endl;
+			return -1;
+		}
+		// a short chunk leaves a gap unless it is the last one
+		if(n_written < chunk.count && lookahead){
+			std::cerr << "Chunk " << i << " ended after " << n_written << " of " 
+					  << chunk.count << " frames" << std::endl;
+			return -1;
+		}
+
+		position = chunk.first + n_written + (next_frame.empty() ? 0 : 1);
+		pending = next_frame;
+		pending_frame = chunk.first + n_written;
+	}
+
+	if(n_redone > 0)
+		std::cout << n_redone << " chunks did not seek exactly and were read again" << std::endl;
+
+	// frames of the kept results, redone chunks count their second pass
+	int n_total = 0;
+	for(int i=0; i<n; i++){
+		n_total += results[i].n_written;
+		decode_ms_.insert(decode_ms_.end(), results[i].decode_ms.begin(), results[i].decode_ms.end());
+		process_ms_.insert(process_ms_.end(), results[i].process_ms.begin(), results[i].process_ms.end());
+		encode_ms_.insert(encode_ms_.end(), results[i].encode_ms.begin(), results[i].encode_ms.end());
+		latency_ms_.insert(latency_ms_.end(), results[i].latency_ms.begin(), results[i].latency_ms.end());
+	}
+	if(n_total < n_frames)
+		std::cout << "The video ended " << n_frames - n_total << " frames early" << std::endl;
+
+	if(!copySegments(chunks, out_file)){
+		std::cout << "ffmpeg could not concatenate the segments, encoding them again" << std::endl;
+		n_total = reencodeSegments(chunks, out_file, codec, fps, frame_size);
+	}
+
+	for(int i=0; i<n; i++)
+		remove(chunks[i].filename.c_str());
+
+	run_ms_ = 1000.0*(cv::getTickCount() - t_start)/cv::getTickFrequency();
+
+	return n_total;
+}
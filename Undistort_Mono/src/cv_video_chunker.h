@@ -0,0 +1,195 @@
+/*==========================================================================
+
+  Copyright (c) 2014 Uditha L. Jayarathne, ujayarat@robarts.ca
+
+  Use, modification and redistribution of the software, in source or
+  binary forms, are permitted provided that the following terms and
+  conditions are met:
+
+  1) Redistribution of the source code, in verbatim or modified
+  form, must retain the above copyright notice, this license,
+  the following disclaimer, and any notices that refer to this
+  license and/or the following disclaimer.  
+
+  2) Redistribution in binary form must include the above copyright
+  notice, a copy of this license and the following disclaimer
+  in the documentation or with other materials provided with the
+  distribution.
+
+  3) Modified copies of the source code must be clearly marked as such,
+  and must not be misrepresented as verbatim copies of the source code.
+
+  THE COPYRIGHT HOLDERS AND/OR OTHER PARTIES PROVIDE THE SOFTWARE "AS IS"
+  WITHOUT EXPRESSED OR IMPLIED WARRANTY INCLUDING, BUT NOT LIMITED TO,
+  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  PURPOSE.  IN NO EVENT SHALL ANY COPYRIGHT HOLDER OR OTHER PARTY WHO MAY
+  MODIFY AND/OR REDISTRIBUTE THE SOFTWARE UNDER THE TERMS OF THIS LICENSE
+  BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, LOSS OF DATA OR DATA BECOMING INACCURATE
+  OR LOSS OF PROFIT OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF
+  THE USE OR INABILITY TO USE THE SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGES.
+  =========================================================================*/
+
+#ifndef __CV_VIDEO_CHUNKER__H
+#define __CV_VIDEO_CHUNKER__H
+
+#include <iostream>
+#include <vector>
+#include <string>
+
+// Opencv Includes 
+#include "cv.h"
+#include "highgui.h"
+
+#include "cv_frame_pipeline.h"
+
+/**
+ * Parallel processing of long videos in chunks. The input is split into
+ * consecutive frame ranges, each range is decoded by its own 
+ * cv::VideoCapture, filtered and encoded to a segment file, with the 
+ * chunks running concurrently. The segments are then concatenated by 
+ * ffmpeg with stream copy, so every frame is encoded once and the join 
+ * costs no more than copying the file. Without ffmpeg the segments are 
+ * decoded and encoded again, serially.
+ *
+ * cv::VideoCapture does not report keyframes, and a seek reports the 
+ * requested position whether it got there or not. Chunk starts are 
+ * aligned to a GOP length given by the user, which only makes the seeks
+ * cheap for fixed GOP recordings. Whether a seek landed is checked from 
+ * the frames: each chunk decodes one frame past its end, and the next 
+ * chunk must start with that same frame. Chunks that do not are read 
+ * again in a single forward pass over the video.
+ */
+class CvVideoChunker{
+
+public:
+
+	// A frame range and the segment file it is written to
+	typedef struct Chunk{
+		int first;
+		int count;
+		std::string filename;
+	} Chunk;
+
+	// What processing a chunk produced
+	typedef struct ChunkResult{
+		int n_written;
+		uint64 first_hash;
+		uint64 next_hash;
+		bool bad_frame;		// a frame failed to decode before the chunk end
+
+		// per-frame stage times in ms
+		std::vector<double> decode_ms;
+		std::vector<double> process_ms;
+		std::vector<double> encode_ms;
+		std::vector<double> latency_ms;
+	} ChunkResult;
+
+	/**
+	 * @param number of chunks, <= 0 for one per core
+	 * @param GOP length chunk starts are aligned to, <= 1 for none
+	 */
+	CvVideoChunker(int, int);
+	~CvVideoChunker();
+
+	//public methods
+
+	/**
+	 * Split a video into chunks
+	 * @param number of frames
+	 * @param output file name, segments are named after it
+	 * @param reference to the chunks
+	 */
+	void plan(int, const std::string&, std::vector<Chunk>*) const;
+
+	/**
+	 * Process a video
+	 * @param input file name
+	 * @param number of frames
+	 * @param frame filter
+	 * @param output file name
+	 * @param output fourcc
+	 * @param output frame rate
+	 * @param output frame size
+	 * @return number of frames written, -1 on failure
+	 */
+	int run(const std::string&, int, const CvFrameFilter&, 
+			const std::string&, int, double, cv::Size);
+
+	/**
+	 * Print the throughput of the last run and the p50/p99 time of each 
+	 * stage over the frames of all chunks, as CvFramePipeline::printStats
+	 */
+	void printStats() const;
+
+	/**
+	 * Seek to a chunk and filter its frames into its segment file
+	 * @param input file name
+	 * @param chunk
+	 * @param frame filter
+	 * @param output fourcc
+	 * @param output frame rate
+	 * @param output frame size
+	 * @param decode the frame after the chunk
+	 * @param reference to the result, n_written is -1 on failure
+	 */
+	static void processChunk(const std::string&, const Chunk&, const CvFrameFilter&, 
+							 int, double, cv::Size, bool, ChunkResult*);
+
+private:
+	//private methods
+
+	/**
+	 * Filter the frames of one chunk from a capture at its start
+	 * @param capture
+	 * @param chunk
+	 * @param frame filter
+	 * @param output fourcc
+	 * @param output frame rate
+	 * @param output frame size
+	 * @param first frame if already decoded, empty otherwise
+	 * @param decode the frame after the chunk
+	 * @param reference to the result
+	 * @param reference to the frame after the chunk
+	 */
+	static void filterChunk(cv::VideoCapture*, const Chunk&, const CvFrameFilter&, 
+							int, double, cv::Size, const cv::Mat&, bool, 
+							ChunkResult*, cv::Mat*);
+
+	/**
+	 * Concatenate the segments with ffmpeg stream copy
+	 * @param chunks
+	 * @param output file name
+	 * @return true if ffmpeg wrote the output
+	 */
+	static bool copySegments(const std::vector<Chunk>&, const std::string&);
+
+	/**
+	 * Join the segments by decoding and encoding them again
+	 * @param chunks
+	 * @param output file name
+	 * @param output fourcc
+	 * @param output frame rate
+	 * @param output frame size
+	 * @return number of frames written, -1 on failure
+	 */
+	static int reencodeSegments(const std::vector<Chunk>&, const std::string&, 
+								int, double, cv::Size);
+
+	//private members
+
+	int n_chunks_;
+	int gop_size_;
+
+	// chunks and timings of the last run, in ms
+	int run_chunks_;
+	double run_ms_;
+	std::vector<double> decode_ms_;
+	std::vector<double> process_ms_;
+	std::vector<double> encode_ms_;
+	std::vector<double> latency_ms_;
+
+};
+
+#endif //__CV_VIDEO_CHUNKER__H
@@ -34,24 +34,85 @@
 #include <vector>
 #include <stdlib.h>
 #include <time.h>
+#include <stdio.h>
 
 // Opencv includes
 #include "cv.h"
 #include "highgui.h"
 
+#include "cv_remap_cache.h"
+#include "cv_fixed_remap.h"
+#include "cv_frame_pipeline.h"
+#include "cv_video_chunker.h"
+
+/**
+ * Pipeline stage undistorting whole frames. Each worker remaps on its 
+ * own thread, the pipeline provides the parallelism.
+ */
+class UndistortFilter : public CvFrameFilter{
+
+public:
+	UndistortFilter(const CvFixedRemap *remap): remap_(remap){}
+
+	bool apply(const cv::Mat &frame, cv::Mat *undistorted) const{
+		return remap_->remap(frame, undistorted, false);
+	}
+
+private:
+	const CvFixedRemap *remap_;
+};
+
+/**
+ * Get the undistortion maps of a calibration for a frame size. Maps are
+ * read from a cache file next to the calibration when it is up to date,
+ * otherwise built and written there.
+ * @param calibration file name
+ * @param camera matrix
+ * @param distortion params
+ * @param frame size
+ * @param reference to the remap engine
+ */
+void load_undistort_maps(std::string, const cv::Mat&, const cv::Mat&, cv::Size, 
+						 CvFixedRemap*);
 
 int main(int argc, char** argv){
 
 	// Software usage
-	if(argc<4 || argc>4){ 
-		std::cout << "Usage:\t CV_Undistort_Mono infile calib_file outfile	\n"
+	int n_workers = 0;
+	bool headless = false;
+	int n_chunks = -1, gop_size = 0;
+	bool args_ok = (argc >= 4);
+	for(int i=4; args_ok && i<argc; i++){
+		std::string arg(argv[i]);
+		if(arg == "-headless")
+			headless = true;
+		else if(arg == "-workers" && i + 1 < argc)
+			n_workers = atoi(argv[++i]);
+		else if(arg == "-chunks" && i + 1 < argc)
+			n_chunks = atoi(argv[++i]);
+		else if(arg == "-gop" && i + 1 < argc)
+			gop_size = atoi(argv[++i]);
+		else
+			args_ok = false;
+	}
+
+	if(!args_ok){ 
+		std::cout << "Usage:\t CV_Undistort_Mono infile calib_file outfile [-workers n] [-headless] [-chunks n [-gop n]]	\n"
 				  << "\t	infile: input video file \n" 
 				  << "\t	outfile: output video filename \n"
-				  << "\t    calib_file: left calibration.xml"
+				  << "\t    calib_file: left calibration.xml \n"
+				  << "\t    -workers: undistortion threads, one per spare core by default \n"
+				  << "\t    -headless: no display, run as fast as possible \n"
+				  << "\t    -chunks: split the video into n chunks undistorted in parallel, 0 for one per core \n"
+				  << "\t    -gop: keyframe interval of the input, chunks start on multiples of it"
 				  << std::endl;
 		return 0;
 	}
 	
+	// chunks finish out of order, there is nothing to play back
+	if(n_chunks >= 0)
+		headless = true;
+
 	std::string in_file_name(argv[1]), out_file_name(argv[2]), calib_name(argv[3]);
 	
 	// Read calibration file.
@@ -79,16 +140,16 @@ int main(int argc, char** argv){
 	std::cout << distortion_params << std::endl;
 
 	//Create a window with a fixed aspect ratio
-	cvNamedWindow(in_file_name.c_str(), CV_WINDOW_KEEPRATIO);
-	cvNamedWindow("Undistorted", CV_WINDOW_KEEPRATIO);
+	if(!headless){
+		cvNamedWindow(in_file_name.c_str(), CV_WINDOW_KEEPRATIO);
+		cvNamedWindow("Undistorted", CV_WINDOW_KEEPRATIO);
+	}
 
 	//CvCapture* g_capture = cvCreateFileCapture(in_file_name.c_str());
 	cv::VideoCapture g_capture;
 	cv::VideoWriter video_writer;
 	int codec = CV_FOURCC('D','I','V','X'); 
 
-	cv::Mat frame; 
-
 	if(!g_capture.open(in_file_name.c_str())){
 		std::cerr << "Failed to open the video file. " << std::endl;
 		return 0;
@@ -104,6 +165,24 @@ int main(int argc, char** argv){
 			  << " [" << n_frames << ", " << frame_width << "x" << frame_height
 			  << " frames]" << std::endl;
 
+	// Undistortion maps are built once, not per frame
+	CvFixedRemap undistort_remap;
+	load_undistort_maps(calib_name, intrinsics, distortion_params, 
+						cvSize(frame_width, frame_height), &undistort_remap);
+
+	// long recordings: independent decoders over chunks of the video
+	if(n_chunks >= 0){
+		CvVideoChunker chunker(n_chunks, gop_size);
+		int n_written = chunker.run(in_file_name, n_frames, UndistortFilter(&undistort_remap), 
+									out_file_name, codec, frame_rate, 
+									cvSize(frame_width, frame_height));
+		if(n_written >= 0){
+			std::cout << n_written << " frames written" << std::endl;
+			chunker.printStats();
+		}
+		return 0;
+	}
+
 	// Open the video writer
 	video_writer = cv::VideoWriter(out_file_name, 
 									codec, 
@@ -116,31 +195,47 @@ int main(int argc, char** argv){
 		return 0;
 	}
 
-	std::cout << "Undistorting video ..";
-	while( n_frames-- > 0 ){
+	// decode, undistort and encode run concurrently, frames stay in order
+	CvFramePipeline pipeline(n_workers, 4);
+	if(!headless)
+		pipeline.setDisplay(in_file_name, "Undistorted", (int)(1000/frame_rate));
 
-		if( !g_capture.read(frame)){
-			std::cout << "Bad frame" << std::endl;
-			break;
-		}
+	std::cout << "Undistorting video on " << pipeline.getWorkerCount() << " workers ..";
+	int n_written = pipeline.run(&g_capture, n_frames, UndistortFilter(&undistort_remap), 
+								 &video_writer);
+	std::cout << std::endl << n_written << " frames written" << std::endl;
+	pipeline.printStats();
 
-		if( n_frames%100 == 0)
-			std::cout << ".";
+	return 0; 
+}
 
-		cv::Mat undistorted_frame(frame_height, frame_width, frame.type());
 
-		//Undistort
-		cv::undistort(frame, undistorted_frame, intrinsics, distortion_params);
 
-		cv::imshow(in_file_name.c_str(), frame);
-		cv::imshow("Undistorted", undistorted_frame);
 
-		video_writer << undistorted_frame;
+void load_undistort_maps(std::string calib_name, const cv::Mat &intrinsics, 
+						 const cv::Mat &distortion_params, cv::Size frame_size, 
+						 CvFixedRemap *remap){
 
-		char c = cvWaitKey((int)(1000/frame_rate));
+	char size_str[32];
+	sprintf(size_str, "_%dx%d.remap", frame_size.width, frame_size.height);
+	CvRemapCache remap_cache(calib_name + size_str);
+
+	uint64 key = 0;
+	cv::Mat coords, fracs;
+	bool have_key = CvRemapCache::computeKey(calib_name, frame_size, &key);
+	if(have_key && remap_cache.load(key, &coords, &fracs) && 
+		remap->setMaps(coords, fracs)){
+		std::cout << "Loaded undistortion maps from " << calib_name + size_str << std::endl;
+		return;
 	}
-	
-	return 0; 
-}
 
+	// float maps as cv::undistort builds them, then packed to fixed point
+	cv::Mat map_x, map_y;
+	cv::initUndistortRectifyMap(intrinsics, distortion_params, cv::Mat(), intrinsics, 
+								frame_size, CV_32FC1, map_x, map_y);
+	remap->create(map_x, map_y);
+	remap->getMaps(&coords, &fracs);
 
+	if(have_key && remap_cache.save(key, coords, fracs))
+		std::cout << "Undistortion maps were written to " << calib_name + size_str << std::endl;
+}
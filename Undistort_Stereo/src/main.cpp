@@ -34,25 +34,116 @@
 #include <vector>
 #include <stdlib.h>
 #include <time.h>
+#include <stdio.h>
 
 // Opencv includes
 #include "cv.h"
 #include "highgui.h"
 
+#include "cv_remap_cache.h"
+#include "cv_fixed_remap.h"
+#include "cv_frame_pipeline.h"
+#include "cv_video_chunker.h"
+
+// Remap parameters of one eye. Plain undistortion has no rectification
+// and projects with the intrinsics.
+typedef struct EyeMapParams{
+	cv::Mat intrinsics;
+	cv::Mat distortion_params;
+	cv::Mat rectification;
+	cv::Mat projection;
+} EyeMapParams;
+
+/**
+ * Pipeline stage undistorting side-by-side frames with one remap over the
+ * whole frame, written straight into the reused output buffer.
+ */
+class StereoUndistortFilter : public CvFrameFilter{
+
+public:
+	StereoUndistortFilter(const CvFixedRemap *remap): remap_(remap){}
+
+	bool apply(const cv::Mat &frame, cv::Mat *undistorted) const{
+		return remap_->remap(frame, undistorted, false);
+	}
+
+private:
+	const CvFixedRemap *remap_;
+};
+
+/**
+ * Join the float maps of both eyes into maps over the whole side-by-side
+ * frame. Right eye coordinates are shifted by the eye width, and samples 
+ * that would cross the seam into the other eye are sent outside the 
+ * frame so they come out black, as with separate per-eye remaps.
+ * @param left eye x map
+ * @param left eye y map
+ * @param right eye x map
+ * @param right eye y map
+ * @param side-by-side frame size
+ * @param reference to the joined x map
+ * @param reference to the joined y map
+ */
+void join_eye_maps(const cv::Mat&, const cv::Mat&, const cv::Mat&, const cv::Mat&, 
+				   cv::Size, cv::Mat*, cv::Mat*);
+
+/**
+ * Get the side-by-side remap tables of both eyes. Tables are read from a 
+ * cache file when it was written for the same calibration files and frame
+ * size, otherwise built and written there.
+ * @param cache file name
+ * @param calibration files the tables depend on
+ * @param left eye parameters
+ * @param right eye parameters
+ * @param side-by-side frame size
+ * @param reference to the remap engine
+ */
+void load_stereo_maps(std::string, const std::vector<std::string>&, const EyeMapParams&, 
+					  const EyeMapParams&, cv::Size, CvFixedRemap*);
 
 int main(int argc, char** argv){
 
 	// Software usage
-	if(argc<5 || argc>5){ 
-		std::cout << "Usage:\t CV_Undistort_Stereo infile outfile	\n"
+	int n_workers = 0;
+	bool headless = false;
+	int n_chunks = -1, gop_size = 0;
+	std::string stereo_calib_name;
+	bool args_ok = (argc >= 5);
+	for(int i=5; args_ok && i<argc; i++){
+		std::string arg(argv[i]);
+		if(arg == "-headless")
+			headless = true;
+		else if(arg == "-workers" && i + 1 < argc)
+			n_workers = atoi(argv[++i]);
+		else if(arg == "-chunks" && i + 1 < argc)
+			n_chunks = atoi(argv[++i]);
+		else if(arg == "-gop" && i + 1 < argc)
+			gop_size = atoi(argv[++i]);
+		else if(arg == "-rectify" && i + 1 < argc)
+			stereo_calib_name = argv[++i];
+		else
+			args_ok = false;
+	}
+
+	if(!args_ok){ 
+		std::cout << "Usage:\t CV_Undistort_Stereo infile outfile left_calib_file right_calib_file [-workers n] [-headless] [-chunks n [-gop n]] [-rectify stereo_calib_file]	\n"
 				  << "\t	infile: input video file \n" 
 				  << "\t    left_calib_file: left calibration.xml \n"
 				  << "\t    right_calib_file: right calibration.xml \n"
-				  << "\t	outfile: output video filename"
+				  << "\t	outfile: output video filename \n"
+				  << "\t    -workers: undistortion threads, one per spare core by default \n"
+				  << "\t    -headless: no display, run as fast as possible \n"
+				  << "\t    -chunks: split the video into n chunks undistorted in parallel, 0 for one per core \n"
+				  << "\t    -gop: keyframe interval of the input, chunks start on multiples of it \n"
+				  << "\t    -rectify: write rectified frames using R1, R2, P1, P2 of stereo_calibration.xml"
 				  << std::endl;
 		return 0;
 	}
 	
+	// chunks finish out of order, there is nothing to play back
+	if(n_chunks >= 0)
+		headless = true;
+
 	std::string in_file_name(argv[1]), out_file_name(argv[2]), left_calib_name(argv[3]), right_calib_name(argv[4]);
 	
 	// Read calibration file.
@@ -84,6 +175,41 @@ int main(int argc, char** argv){
 	left_calib_file.release();
 	right_calib_file.release();
 
+	// Undistortion only by default, the stereo calibration adds rectification
+	EyeMapParams left_eye, right_eye;
+	left_eye.intrinsics = left_intrinsics;
+	left_eye.distortion_params = left_distortion_params;
+	left_eye.projection = left_intrinsics;
+	right_eye.intrinsics = right_intrinsics;
+	right_eye.distortion_params = right_distortion_params;
+	right_eye.projection = right_intrinsics;
+
+	std::vector<std::string> calib_files;
+	calib_files.push_back(left_calib_name);
+	calib_files.push_back(right_calib_name);
+
+	if(!stereo_calib_name.empty()){
+		cv::FileStorage stereo_calib_file(stereo_calib_name, cv::FileStorage::READ);
+		if(!stereo_calib_file.isOpened()){
+			std::cout << "Could not open the stereo calibration file" << std::endl;
+			return 0;
+		}
+
+		stereo_calib_file["R1"] >> left_eye.rectification;
+		stereo_calib_file["P1"] >> left_eye.projection;
+		stereo_calib_file["R2"] >> right_eye.rectification;
+		stereo_calib_file["P2"] >> right_eye.projection;
+		stereo_calib_file.release();
+
+		if(left_eye.rectification.empty() || left_eye.projection.empty() || 
+			right_eye.rectification.empty() || right_eye.projection.empty()){
+			std::cerr << "Rectification parameters not found" << std::endl;
+			return 0;
+		}
+
+		calib_files.push_back(stereo_calib_name);
+	}
+
 	std::cout << "Calibration params:" << std::endl;
 	std::cout << "Left Intrinsics: " << std::endl;
 	std::cout << left_intrinsics << std::endl;
@@ -95,16 +221,16 @@ int main(int argc, char** argv){
 	std::cout << right_distortion_params << std::endl;
 
 	//Create a window with a fixed aspect ratio
-	cvNamedWindow(in_file_name.c_str(), CV_WINDOW_KEEPRATIO);
-	cvNamedWindow("Undistorted", CV_WINDOW_KEEPRATIO);
+	if(!headless){
+		cvNamedWindow(in_file_name.c_str(), CV_WINDOW_KEEPRATIO);
+		cvNamedWindow("Undistorted", CV_WINDOW_KEEPRATIO);
+	}
 
 	//CvCapture* g_capture = cvCreateFileCapture(in_file_name.c_str());
 	cv::VideoCapture g_capture;
 	cv::VideoWriter video_writer;
 	int codec = CV_FOURCC('D','I','V','X'); 
 
-	cv::Mat frame; 
-
 	if(!g_capture.open(in_file_name.c_str())){
 		std::cerr << "Failed to open the video file. " << std::endl;
 		return 0;
@@ -120,6 +246,27 @@ int main(int argc, char** argv){
 			  << " [" << n_frames << ", " << frame_width << "x" << frame_height
 			  << " frames]" << std::endl;
 
+	// Maps of both eyes are built once, not per frame, and joined so a 
+	// single pass undistorts or rectifies the whole side-by-side frame
+	CvFixedRemap stereo_remap;
+	load_stereo_maps((stereo_calib_name.empty() ? left_calib_name + "_stereo" : 
+											   stereo_calib_name + "_rectify"), 
+					 calib_files, left_eye, right_eye, cvSize(frame_width, frame_height), 
+					 &stereo_remap);
+
+	// long recordings: independent decoders over chunks of the video
+	if(n_chunks >= 0){
+		CvVideoChunker chunker(n_chunks, gop_size);
+		int n_written = chunker.run(in_file_name, n_frames, StereoUndistortFilter(&stereo_remap), 
+									out_file_name, codec, frame_rate, 
+									cvSize(frame_width, frame_height));
+		if(n_written >= 0){
+			std::cout << n_written << " frames written" << std::endl;
+			chunker.printStats();
+		}
+		return 0;
+	}
+
 	// Open the video writer
 	video_writer = cv::VideoWriter(out_file_name, 
 									codec, 
@@ -132,47 +279,91 @@ int main(int argc, char** argv){
 		return 0;
 	}
 
-	std::cout << "Undistorting video ..";
-	while( n_frames-- > 0 ){
+	// decode, undistort and encode run concurrently, frames stay in order
+	CvFramePipeline pipeline(n_workers, 4);
+	if(!headless)
+		pipeline.setDisplay(in_file_name, "Undistorted", (int)(1000/frame_rate));
+
+	std::cout << (stereo_calib_name.empty() ? "Undistorting" : "Rectifying") 
+			  << " video on " << pipeline.getWorkerCount() << " workers ..";
+	int n_written = pipeline.run(&g_capture, n_frames, 
+								 StereoUndistortFilter(&stereo_remap), 
+								 &video_writer);
+	std::cout << std::endl << n_written << " frames written" << std::endl;
+	pipeline.printStats();
+
+	return 0; 
+}
 
-		if( !g_capture.read(frame)){
-			std::cout << "Bad frame" << std::endl;
-			break;
-		}
 
-		if( n_frames%100 == 0)
-			std::cout << ".";
 
-		// Split frame into left and right parts
-    	int split_width = frame_width/2;
-		int split_height = frame_height;
 
-		cv::Mat left(split_height, split_width, frame.type());
-		cv::Mat uleft(split_height, split_width, frame.type());
-		cv::Mat right(split_height, split_width, frame.type());
-		cv::Mat uright(split_height, split_width, frame.type());
-		cv::Mat undistorted_frame(frame_height, frame_width, frame.type());
+void join_eye_maps(const cv::Mat &left_x, const cv::Mat &left_y, 
+				   const cv::Mat &right_x, const cv::Mat &right_y, 
+				   cv::Size frame_size, cv::Mat *map_x, cv::Mat *map_y){
 
-		// Split, Undistort and Stich together
-		cv::Rect roi(0, 0, split_width, split_height);
-		left = frame(roi);
-		cv::undistort(left, uleft, left_intrinsics, left_distortion_params);
-		uleft.copyTo(undistorted_frame(roi));
+	int eye_width = left_x.cols;
 
-		roi.x = split_width;
-		right = frame(roi);
-		cv::undistort(right, uright, right_intrinsics, right_distortion_params);
-		uright.copyTo(undistorted_frame(roi));
+	// an odd last column belongs to neither eye and stays black
+	map_x->create(frame_size, CV_32FC1);
+	map_y->create(frame_size, CV_32FC1);
+	map_x->setTo(cv::Scalar(-1));
+	map_y->setTo(cv::Scalar(-1));
 
-		cv::imshow(in_file_name.c_str(), frame);
-		cv::imshow("Undistorted", undistorted_frame);
+	for(int y=0; y<frame_size.height; y++){
 
-		video_writer << undistorted_frame;
+		const float *lx = left_x.ptr<float>(y), *ly = left_y.ptr<float>(y);
+		const float *rx = right_x.ptr<float>(y), *ry = right_y.ptr<float>(y);
+		float *mx = map_x->ptr<float>(y), *my = map_y->ptr<float>(y);
 
-		char c = cvWaitKey((int)(1000/frame_rate));
+		for(int x=0; x<eye_width; x++){
+
+			// left eye samples must stay left of the seam
+			if(lx[x] <= eye_width - 1){
+				mx[x] = lx[x];
+				my[x] = ly[x];
+			}
+
+			// right eye samples must stay right of it
+			if(rx[x] >= 0){
+				mx[eye_width + x] = rx[x] + eye_width;
+				my[eye_width + x] = ry[x];
+			}
+		}
 	}
-	
-	return 0; 
 }
 
+void load_stereo_maps(std::string cache_name, const std::vector<std::string> &calib_files, 
+					  const EyeMapParams &left_eye, const EyeMapParams &right_eye, 
+					  cv::Size frame_size, CvFixedRemap *remap){
+
+	char size_str[32];
+	sprintf(size_str, "_%dx%d.remap", frame_size.width, frame_size.height);
+	CvRemapCache remap_cache(cache_name + size_str);
+
+	uint64 key = 0;
+	cv::Mat coords, fracs;
+	bool have_key = CvRemapCache::computeKey(calib_files, frame_size, &key);
+	if(have_key && remap_cache.load(key, &coords, &fracs) && 
+		remap->setMaps(coords, fracs)){
+		std::cout << "Loaded stereo maps from " << cache_name + size_str << std::endl;
+		return;
+	}
 
+	cv::Size eye_size(frame_size.width/2, frame_size.height);
+	cv::Mat left_map_x, left_map_y, right_map_x, right_map_y, map_x, map_y;
+	cv::initUndistortRectifyMap(left_eye.intrinsics, left_eye.distortion_params, 
+								left_eye.rectification, left_eye.projection, 
+								eye_size, CV_32FC1, left_map_x, left_map_y);
+	cv::initUndistortRectifyMap(right_eye.intrinsics, right_eye.distortion_params, 
+								right_eye.rectification, right_eye.projection, 
+								eye_size, CV_32FC1, right_map_x, right_map_y);
+	join_eye_maps(left_map_x, left_map_y, right_map_x, right_map_y, 
+				  frame_size, &map_x, &map_y);
+
+	remap->create(map_x, map_y);
+	remap->getMaps(&coords, &fracs);
+
+	if(have_key && remap_cache.save(key, coords, fracs))
+		std::cout << "Stereo maps were written to " << cache_name + size_str << std::endl;
+}